@@ -0,0 +1,34 @@
+/*
+g++ -std=c++11 -O3 -march=native -pthread -DNDEBUG -Wall -Wextra -o benchmarkcompute benchmarkcompute.cpp && ./benchmarkcompute [GFLOP per run]
+
+Runs the host part of gpuinfo --bench-compute, i.e. the FMA chains in the
+widest registers available at compile time, on one thread and on all
+hardware threads and compares them to the theoretical peak from the
+maximum clock and two FMA units per core. Without -march=native or
+-mavx2 -mfma the scalar fallback is measured. With hyper-threading the
+peak for all threads is twice what the cores can achieve.
+*/
+
+#include "cudacomputebenchmark.hpp"
+
+#include <cstdio>
+#include <cstdlib>                      // atof
+
+
+int main( int argc, char ** argv )
+{
+    uint64_t const nFlops = (uint64_t)( ( argc > 1 ? atof( argv[1] ) : 16 ) * 1e9 );
+    std::vector< ComputePeak > peaks;
+    for ( auto const nThreads : { 1u, HostThreadPool::defaultThreadCount() } )
+    {
+        HostThreadPool pool( nThreads );
+        BenchmarkSuite suite( "host" );
+        addHostComputeStrategies( suite, pool );
+        std::vector< ComputePeak > const threadPeaks = makeHostComputePeaks( suite.run( { nFlops }, 5 ), nThreads );
+        peaks.insert( peaks.end(), threadPeaks.begin(), threadPeaks.end() );
+        printf( "\n" );
+    }
+    printf( "Clock: %.2f GHz\n", getHostMaxClockHz() / 1e9 );
+    printComputePeaks( peaks );
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkdevicecache benchmarkdevicecache.cpp && ./benchmarkdevicecache
+
+Checks the invalidation of the device snapshot cache with two synthetic
+devices of the emulated runtime and a fake /proc and /sys in a temporary
+directory. After each change of a part of the key, i.e. the driver version,
+the driver version string, the PCI devices and the environment variables,
+the devices have to be queried again, and the next time the updated cache
+has to be used. The same holds for a corrupted or truncated cache and for
+a cache path changed by CUDAINFO_CACHE or XDG_CACHE_HOME. Also measures
+how long a query with and without cache takes. Returns non-zero on failure.
+*/
+
+#include "cudadevicecache.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <ftw.h>                        // nftw
+#include <sys/stat.h>                   // mkdir
+
+
+/* creates all missing parent directories of the path below rRoot */
+void writeFile( std::string const & rRoot, std::string const & rPath, std::string const & rContents )
+{
+    for ( size_t i = rPath.find( '/', 1 ); i != std::string::npos; i = rPath.find( '/', i + 1 ) )
+        mkdir( ( rRoot + rPath.substr( 0, i ) ).c_str(), 0700 );
+    if ( FILE * const file = fopen( ( rRoot + rPath ).c_str(), "wb" ) )
+    {
+        fwrite( rContents.data(), 1, rContents.size(), file );
+        fclose( file );
+    }
+}
+
+void addPciDevice( std::string const & rRoot, char const * const rAddress )
+{
+    std::string const path = std::string( "/sys/bus/pci/devices/" ) + rAddress;
+    writeFile( rRoot, path + "/vendor", "0x10de\n" );
+    writeFile( rRoot, path + "/class" , "0x030200\n" );
+}
+
+int removePath( char const * const rPath, struct stat const *, int, struct FTW * )
+{
+    return remove( rPath );
+}
+
+/**
+ * Gets the snapshots and checks whether the devices were queried, which is
+ * the case if and only if the cache wasn't used.
+ */
+bool checkQuery
+(
+    char        const * const   rName       ,
+    bool                const   rbRequery   ,
+    std::string         const & rCachePath  ,
+    std::string         const & rRootPath
+)
+{
+    unsigned int const nQueries = getHostRuntime().nPropertyQueries;
+    bool bCached = false;
+    std::vector< CudaDeviceSnapshot > const snapshots = getCudaDeviceSnapshots( &bCached, rCachePath, rRootPath );
+    bool const bRequeried = getHostRuntime().nPropertyQueries != nQueries;
+    bool const bCorrect = bRequeried == rbRequery && bCached == ! rbRequery && snapshots.size() == 2 &&
+                          strcmp( snapshots[1].properties.name, "Synthetic 1" ) == 0;
+    printf( "%-40s: %s%s\n", rName, bRequeried ? "queried" : "cached", bCorrect ? "" : "  WRONG" );
+    return bCorrect;
+}
+
+int main( void )
+{
+    HostRuntime & runtime = getHostRuntime();
+    runtime.driverVersion = 12020;
+    for ( int iDevice = 0; iDevice < 2; ++iDevice )
+    {
+        HostRuntimeDevice device = makeHostRuntimeDevice( ( "Synthetic " + std::to_string( iDevice ) ).c_str(), 6, 1, 20 );
+        device.properties.pciBusID = iDevice + 1;
+        runtime.devices.push_back( device );
+    }
+
+    char rootBuffer[] = "/tmp/benchmarkdevicecache-XXXXXX";
+    if ( mkdtemp( rootBuffer ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return EXIT_FAILURE;
+    }
+    std::string const root = rootBuffer;
+    writeFile( root, "/proc/driver/nvidia/version", "NVRM version: NVIDIA UNIX x86_64 Kernel Module  535.104.05\n" );
+    addPciDevice( root, "0000:01:00.0" );
+    addPciDevice( root, "0000:02:00.0" );
+    unsetenv( "CUDA_VISIBLE_DEVICES" );
+    unsetenv( "CUDA_DEVICE_ORDER"    );
+    unsetenv( "CUDAINFO_CACHE"       );
+    unsetenv( "XDG_CACHE_HOME"       );
+
+    std::string const cachePath = root + "/cache/cudainfo/devices.bin";
+    bool bCorrect = true;
+    bCorrect &= checkQuery( "No cache yet", true, cachePath, root );
+    bCorrect &= checkQuery( "Unchanged", false, cachePath, root );
+
+    auto const t0 = std::chrono::high_resolution_clock::now();
+    std::vector< CudaDeviceSnapshot > snapshots;
+    queryCudaDeviceSnapshots( &snapshots );
+    auto const t1 = std::chrono::high_resolution_clock::now();
+    getCudaDeviceSnapshots( NULL, cachePath, root );
+    auto const t2 = std::chrono::high_resolution_clock::now();
+
+    runtime.driverVersion = 12030;
+    bCorrect &= checkQuery( "Driver version changed", true, cachePath, root );
+    bCorrect &= checkQuery( "Unchanged", false, cachePath, root );
+
+    writeFile( root, "/proc/driver/nvidia/version", "NVRM version: NVIDIA UNIX x86_64 Kernel Module  535.129.03\n" );
+    bCorrect &= checkQuery( "Driver version string changed", true, cachePath, root );
+    bCorrect &= checkQuery( "Unchanged", false, cachePath, root );
+
+    addPciDevice( root, "0000:03:00.0" );
+    bCorrect &= checkQuery( "PCI device added", true, cachePath, root );
+    writeFile( root, "/sys/bus/pci/devices/0000:03:00.0/class", "0x010802\n" );
+    bCorrect &= checkQuery( "PCI device not a display controller", true, cachePath, root );
+    bCorrect &= checkQuery( "Unchanged", false, cachePath, root );
+
+    setenv( "CUDA_VISIBLE_DEVICES", "1,0", 1 );
+    bCorrect &= checkQuery( "CUDA_VISIBLE_DEVICES set", true, cachePath, root );
+    bCorrect &= checkQuery( "Unchanged", false, cachePath, root );
+    setenv( "CUDA_VISIBLE_DEVICES", "", 1 );
+    bCorrect &= checkQuery( "CUDA_VISIBLE_DEVICES empty", true, cachePath, root );
+    unsetenv( "CUDA_VISIBLE_DEVICES" );
+    bCorrect &= checkQuery( "CUDA_VISIBLE_DEVICES unset", true, cachePath, root );
+    setenv( "CUDA_DEVICE_ORDER", "PCI_BUS_ID", 1 );
+    bCorrect &= checkQuery( "CUDA_DEVICE_ORDER set", true, cachePath, root );
+    bCorrect &= checkQuery( "Unchanged", false, cachePath, root );
+
+    std::string data = readSmallFile( cachePath );
+    data[ data.size() / 2 ] ^= 1;
+    writeFile( root, "/cache/cudainfo/devices.bin", data );
+    bCorrect &= checkQuery( "Checksum mismatch", true, cachePath, root );
+    bCorrect &= checkQuery( "Unchanged", false, cachePath, root );
+    writeFile( root, "/cache/cudainfo/devices.bin", readSmallFile( cachePath ).substr( 0, 100 ) );
+    bCorrect &= checkQuery( "Truncated", true, cachePath, root );
+    bCorrect &= checkQuery( "Unchanged", false, cachePath, root );
+
+    setenv( "CUDAINFO_CACHE", ( root + "/override/devices.bin" ).c_str(), 1 );
+    bCorrect &= getCudaDeviceCachePath() == root + "/override/devices.bin";
+    bCorrect &= checkQuery( "CUDAINFO_CACHE set", true, getCudaDeviceCachePath(), root );
+    bCorrect &= checkQuery( "Unchanged", false, getCudaDeviceCachePath(), root );
+    unsetenv( "CUDAINFO_CACHE" );
+    setenv( "XDG_CACHE_HOME", ( root + "/xdg" ).c_str(), 1 );
+    bCorrect &= getCudaDeviceCachePath() == root + "/xdg/cudainfo/devices.bin";
+    bCorrect &= checkQuery( "XDG_CACHE_HOME set", true, getCudaDeviceCachePath(), root );
+    bCorrect &= checkQuery( "Unchanged", false, getCudaDeviceCachePath(), root );
+    setenv( "CUDAINFO_CACHE", ( root + "/override/devices.bin" ).c_str(), 1 );
+    bCorrect &= checkQuery( "CUDAINFO_CACHE set again", false, getCudaDeviceCachePath(), root );
+
+    nftw( root.c_str(), removePath, 16, FTW_DEPTH | FTW_PHYS );
+
+    printf( "\nquery: %.3f ms, cached: %.3f ms\n",
+            std::chrono::duration< double, std::milli >( t1 - t0 ).count(),
+            std::chrono::duration< double, std::milli >( t2 - t1 ).count() );
+    printf( "correct: %s\n", bCorrect ? "yes" : "NO" );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,63 @@
+/*
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkdevicequery benchmarkdevicequery.cpp && ./benchmarkdevicequery
+
+Queries 8 synthetic devices of the emulated runtime, each taking a
+different time to answer like GPUs being initialized on first touch,
+with 1 thread, i.e. serially, and with up to one thread per device.
+Checks that all results are in device order and equal to the serial one.
+*/
+
+#include "cudadevicecache.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+
+int main( void )
+{
+    int const nDevices = 8;
+    HostRuntime & runtime = getHostRuntime();
+    for ( int iDevice = 0; iDevice < nDevices; ++iDevice )
+    {
+        char name[32];
+        snprintf( name, sizeof( name ), "Synthetic %i", iDevice );
+        HostRuntimeDevice device = makeHostRuntimeDevice( name, 6, 1, 10 + iDevice );
+        /* 40 to 75 ms, the slowest device not being the last */
+        device.queryLatencyMicroseconds = 40000 + 5000 * ( ( iDevice * 3 ) % nDevices );
+        device.properties.pciBusID = iDevice + 1;
+        runtime.devices.push_back( device );
+    }
+
+    std::vector< CudaDeviceSnapshot > serial;
+    printf( "| threads | time / ms | max. concurrent queries | equal to serial |\n" );
+    printf( "|---------|-----------|-------------------------|-----------------|\n" );
+    unsigned int const threadCounts[] = { 1, 2, 4, 0 };
+    for ( auto const nThreads : threadCounts )
+    {
+        runtime.nMaxRunningPropertyQueries = 0;
+        std::vector< CudaDeviceSnapshot > snapshots;
+        auto const t0 = std::chrono::high_resolution_clock::now();
+        queryCudaDeviceSnapshots( &snapshots, nThreads );
+        auto const t1 = std::chrono::high_resolution_clock::now();
+        if ( nThreads == 1 )
+            serial = snapshots;
+
+        bool bInOrder = snapshots.size() == (size_t) nDevices;
+        for ( size_t i = 0; bInOrder && i < snapshots.size(); ++i )
+            bInOrder = snapshots[i].properties.pciBusID == (int) i + 1;
+        bool const bEqual = bInOrder && memcmp( &snapshots[0], &serial[0],
+                                                nDevices * sizeof( CudaDeviceSnapshot ) ) == 0;
+
+        char threads[16];
+        snprintf( threads, sizeof( threads ), "%u", nThreads );
+        printf( "| %7s | %9.1f | %23u | %-15s |\n", nThreads == 0 ? "all" : threads,
+                std::chrono::duration< double >( t1 - t0 ).count() * 1e3,
+                runtime.nMaxRunningPropertyQueries.load(), bEqual ? "yes" : "NO" );
+        if ( ! bEqual )
+            return EXIT_FAILURE;
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+nvcc -x cu -std=c++11 -O3 -DNDEBUG -o benchmarkdevicescan benchmarkdevicescan.cpp && ./benchmarkdevicescan
+g++ -std=c++11 -O3 -march=native -pthread -DNDEBUG -Wall -Wextra -o benchmarkdevicescan benchmarkdevicescan.cpp && ./benchmarkdevicescan
+
+Compares the device-wide inclusive scan and compaction with a sequential
+loop and the multithreaded host versions and checks that all results are
+equal. The device times don't include transfers. Without nvcc the device
+versions run the host versions in a stream of the emulated runtime.
+Finally an output vector grown on the host since its last push is used,
+whose device buffer the scan has to grow. Returns non-zero on mismatch.
+*/
+
+#include "cudacommon.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+
+template< typename T_Functor >
+double measureBest( int const nRepeats, T_Functor const & functor )
+{
+    double tMin = 0;
+    for ( int iRepeat = 0; iRepeat < nRepeats; ++iRepeat )
+    {
+        auto const t0 = std::chrono::high_resolution_clock::now();
+        functor();
+        auto const t1 = std::chrono::high_resolution_clock::now();
+        double const t = std::chrono::duration< double >( t1 - t0 ).count();
+        if ( iRepeat == 0 || t < tMin )
+            tMin = t;
+    }
+    return tMin;
+}
+
+struct IsOdd
+{
+    __host__ __device__ inline bool operator()( int32_t const x ) const { return ( x & 1 ) != 0; }
+};
+
+int main( void )
+{
+    #ifdef CUDA_HOST_RUNTIME
+        getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Host emulation", 6, 1, 20 ) );
+    #endif
+
+    int const nRepeats = 5;
+    std::vector< size_t > const sizes = { size_t( 1 ) << 20, size_t( 1 ) << 24, size_t( 1 ) << 26 };
+
+    cudaStream_t stream;
+    CUDA_ERROR( cudaStreamCreate( &stream ) );
+
+    printf( "%u host threads, warp functions compiled for %s\n\n", getHostThreadPool().size(), HOST_WARP_SIMD );
+    printf( "| op      | elements | sequential G/s | host G/s | device G/s | equal |\n" );
+    printf( "|---------|----------|----------------|----------|------------|-------|\n" );
+    bool bCorrect = true;
+    for ( auto const n : sizes )
+    {
+        MirroredVector< int32_t > in( n, stream ), out( n, stream );
+        std::vector< int32_t > reference( n ), host( n );
+        for ( size_t i = 0; i < n; ++i )
+            in.host[i] = rand() % 16;
+        in.push();
+
+        double const tScanSequential = measureBest( nRepeats, [&]()
+        {
+            int32_t sum = 0;
+            for ( size_t i = 0; i < n; ++i )
+                reference[i] = sum += in.host[i];
+        } );
+        double const tScanHost = measureBest( nRepeats, [&](){ hostInclusiveScan( in.host, host.data(), n ); } );
+        double const tScanDevice = measureBest( nRepeats, [&]()
+        {
+            deviceInclusiveScan( in, out );
+            CUDA_ERROR( cudaStreamSynchronize( stream ) );
+        } );
+        out.pop();
+        bool const bScanEqual = memcmp( reference.data(), host.data(), n * sizeof( int32_t ) ) == 0 &&
+                                memcmp( reference.data(), out.host, n * sizeof( int32_t ) ) == 0;
+
+        size_t nKeptSequential = 0, nKeptHost = 0, nKeptDevice = 0;
+        double const tCompactSequential = measureBest( nRepeats, [&]()
+        {
+            nKeptSequential = 0;
+            for ( size_t i = 0; i < n; ++i )
+            {
+                if ( IsOdd()( in.host[i] ) )
+                    reference[ nKeptSequential++ ] = in.host[i];
+            }
+        } );
+        double const tCompactHost = measureBest( nRepeats, [&](){ nKeptHost = hostCompactIf( in.host, host.data(), n, IsOdd() ); } );
+        double const tCompactDevice = measureBest( nRepeats, [&](){ nKeptDevice = deviceCompactIf( in, out, IsOdd() ); } );
+        out.pop();
+        bool const bCompactEqual = nKeptSequential == nKeptHost && nKeptSequential == nKeptDevice &&
+            memcmp( reference.data(), host.data(), nKeptSequential * sizeof( int32_t ) ) == 0 &&
+            memcmp( reference.data(), out.host, nKeptSequential * sizeof( int32_t ) ) == 0;
+
+        #define TMP_PRINT_ROW( NAME, T_SEQUENTIAL, T_HOST, T_DEVICE, EQUAL ) \
+            printf( "| %-7s | %8lu | %14.2f | %8.2f | %10.2f | %-5s |\n", NAME, (unsigned long) n, \
+                    n / T_SEQUENTIAL / 1e9, n / T_HOST / 1e9, n / T_DEVICE / 1e9, EQUAL ? "yes" : "NO" );
+        TMP_PRINT_ROW( "scan"   , tScanSequential   , tScanHost   , tScanDevice   , bScanEqual    )
+        TMP_PRINT_ROW( "compact", tCompactSequential, tCompactHost, tCompactDevice, bCompactEqual )
+        #undef TMP_PRINT_ROW
+        bCorrect &= bScanEqual && bCompactEqual;
+    }
+
+    {
+        size_t const n = 100003;
+        MirroredVector< int32_t > in( n, stream ), out( 1, stream );
+        out.push();
+        out.resize( n );
+        std::vector< int32_t > reference( n );
+        int32_t sum = 0;
+        for ( size_t i = 0; i < n; ++i )
+        {
+            in.host[i] = rand() % 16;
+            reference[i] = sum += in.host[i];
+        }
+        in.push();
+        deviceInclusiveScan( in, out );
+        out.pop();
+        bool const bGrownEqual = memcmp( reference.data(), out.host, n * sizeof( int32_t ) ) == 0;
+        printf( "\nScan into a grown vector: %s\n", bGrownEqual ? "equal" : "NOT EQUAL" );
+        bCorrect &= bGrownEqual;
+    }
+
+    CUDA_ERROR( cudaStreamDestroy( stream ) );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,192 @@
+/*
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkdeviceselection benchmarkdeviceselection.cpp && ./benchmarkdeviceselection
+
+Checks the device selection policy with synthetic device profiles: the
+order by peak FLOPS and free memory, the NUMA and display penalties and
+the minimum free memory. Then several child processes select and claim
+one of two equal devices in a temporary claims directory one after
+another, which has to spread them over both, and a claim of an exited
+process has to be ignored and removed. Returns non-zero on failure.
+*/
+
+#include "cudadeviceselection.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>                   // waitpid
+#include <unistd.h>                     // fork, pipe, rmdir
+
+
+CudaDeviceCandidate makeCandidate
+(
+    int          const riDevice   ,
+    char const * const rName      ,
+    int          const rMajor     ,
+    int          const rMinor     ,
+    int          const rnSMs      ,
+    uint64_t     const rnBytesFree
+)
+{
+    CudaDeviceCandidate candidate;
+    candidate.iDevice      = riDevice;
+    candidate.properties   = makeHostRuntimeDevice( rName, rMajor, rMinor, rnSMs ).properties;
+    candidate.properties.pciBusID = riDevice + 1;
+    candidate.nBytesFree   = rnBytesFree;
+    candidate.nProcesses   = 0;
+    candidate.numaDistance = -1;
+    return candidate;
+}
+
+bool checkOrder
+(
+    char                               const * const   rName      ,
+    std::vector< CudaDeviceCandidate > const &         rCandidates,
+    std::vector< int >                 const &         rExpected  ,
+    CudaDeviceSelectionPolicy          const &         rPolicy = CudaDeviceSelectionPolicy()
+)
+{
+    std::vector< CudaDeviceScore > const scores = rankCudaDevices( rCandidates, rPolicy );
+    std::vector< int > order;
+    for ( auto const & score : scores )
+        order.push_back( score.bEligible ? score.iDevice : -1 );
+    bool const bCorrect = order == rExpected;
+    printf( "%-26s:", rName );
+    for ( auto const & score : scores )
+        printf( " %i (%.2f%s)", score.iDevice, score.score, score.bEligible ? "" : ", not eligible" );
+    printf( "%s\n", bCorrect ? "" : "  WRONG" );
+    return bCorrect;
+}
+
+/**
+ * Forks a process which selects and claims a device, reports it and keeps
+ * the claim until the parent closes the write end of rKeepAlive.
+ * @return selected device or -2 on failure
+ */
+int selectInChild
+(
+    std::vector< CudaDeviceCandidate > const & rCandidates,
+    std::string                        const & rClaimsPath,
+    int                                const   rKeepAlive[2],
+    std::vector< pid_t >                     & rChildren
+)
+{
+    int result[2];
+    if ( pipe( result ) != 0 )
+        return -2;
+    pid_t const pid = fork();
+    if ( pid == 0 )
+    {
+        close( result[0] );
+        close( rKeepAlive[1] );
+        CudaDeviceClaim claim;
+        int const iDevice = selectAndClaimCudaDevice( rCandidates, CudaDeviceSelectionPolicy(), claim, rClaimsPath );
+        if ( write( result[1], &iDevice, sizeof( iDevice ) ) != sizeof( iDevice ) )
+            _exit( EXIT_FAILURE );
+        char c;
+        while ( read( rKeepAlive[0], &c, 1 ) > 0 ) {}
+        claim.release();
+        _exit( EXIT_SUCCESS );
+    }
+    close( result[1] );
+    int iDevice = -2;
+    if ( pid < 0 || read( result[0], &iDevice, sizeof( iDevice ) ) != sizeof( iDevice ) )
+        iDevice = -2;
+    close( result[0] );
+    if ( pid > 0 )
+        rChildren.push_back( pid );
+    return iDevice;
+}
+
+int main( void )
+{
+    uint64_t const GiB = uint64_t( 1 ) << 30;
+    bool bCorrect = true;
+
+    bCorrect &= checkOrder( "Peak FLOPS", {
+        makeCandidate( 0, "Pascal 20 SMs", 6, 1, 20, 8 * GiB ),
+        makeCandidate( 1, "Volta 80 SMs" , 7, 0, 80, 8 * GiB ),
+        makeCandidate( 2, "Pascal 40 SMs", 6, 1, 40, 8 * GiB ) }, { 1, 2, 0 } );
+    bCorrect &= checkOrder( "Free memory", {
+        makeCandidate( 0, "Pascal 2 GiB free", 6, 1, 20, 2 * GiB ),
+        makeCandidate( 1, "Pascal 6 GiB free", 6, 1, 20, 6 * GiB ),
+        makeCandidate( 2, "Pascal 4 GiB free", 6, 1, 20, 4 * GiB ) }, { 1, 2, 0 } );
+
+    {
+        std::vector< CudaDeviceCandidate > candidates = {
+            makeCandidate( 0, "remote", 6, 1, 20, 8 * GiB ),
+            makeCandidate( 1, "local" , 6, 1, 20, 8 * GiB ),
+            makeCandidate( 2, "unknown node", 6, 1, 20, 8 * GiB ) };
+        candidates[0].numaDistance = 21;
+        candidates[1].numaDistance = 10;
+        bCorrect &= checkOrder( "NUMA penalty", candidates, { 1, 2, 0 } );
+    }
+    {
+        std::vector< CudaDeviceCandidate > candidates = {
+            makeCandidate( 0, "display", 7, 0, 80, 8 * GiB ),
+            makeCandidate( 1, "compute", 6, 1, 20, 8 * GiB ) };
+        candidates[0].properties.kernelExecTimeoutEnabled = 1;
+        bCorrect &= checkOrder( "Display penalty", candidates, { 1, 0 } );
+    }
+    {
+        std::vector< CudaDeviceCandidate > const candidates = {
+            makeCandidate( 0, "fast, little free", 7, 0, 80, 1 * GiB ),
+            makeCandidate( 1, "slow, much free"  , 6, 1, 20, 4 * GiB ) };
+        CudaDeviceSelectionPolicy policy;
+        policy.nMinBytesFree = 2 * GiB;
+        bCorrect &= checkOrder( "Minimum free memory", candidates, { 1, -1 }, policy );
+        bCorrect &= selectCudaDevice( candidates, policy ) == 1;
+        policy.nMinBytesFree = 8 * GiB;
+        bCorrect &= selectCudaDevice( candidates, policy ) == -1;
+    }
+
+    /* claims by child processes, which keep them until keepAlive is closed */
+    char claimsPath[] = "/tmp/benchmarkdeviceselection-XXXXXX";
+    if ( mkdtemp( claimsPath ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return EXIT_FAILURE;
+    }
+    std::vector< CudaDeviceCandidate > const pair = {
+        makeCandidate( 0, "Pascal A", 6, 1, 20, 8 * GiB ),
+        makeCandidate( 1, "Pascal B", 6, 1, 20, 8 * GiB ) };
+    int keepAlive[2];
+    if ( pipe( keepAlive ) != 0 )
+        return EXIT_FAILURE;
+    std::vector< pid_t > children;
+    std::vector< int > selected;
+    for ( int i = 0; i < 4; ++i )
+        selected.push_back( selectInChild( pair, claimsPath, keepAlive, children ) );
+    CudaPciLocation const locations[2] = { { 0, 1, 0 }, { 0, 2, 0 } };
+    int const nClaims[2] = { countCudaDeviceClaims( claimsPath, locations[0] ),
+                             countCudaDeviceClaims( claimsPath, locations[1] ) };
+    close( keepAlive[1] );
+    for ( auto const pid : children )
+        waitpid( pid, NULL, 0 );
+    close( keepAlive[0] );
+
+    bool const bSpread = selected == std::vector< int >{ 0, 1, 0, 1 } && nClaims[0] == 2 && nClaims[1] == 2;
+    printf( "%-26s: %i %i %i %i, claims %i + %i%s\n", "Claims of 4 processes", selected[0], selected[1],
+            selected[2], selected[3], nClaims[0], nClaims[1], bSpread ? "" : "  WRONG" );
+    bCorrect &= bSpread;
+
+    /* a claim of an exited process */
+    pid_t const exited = fork();
+    if ( exited == 0 )
+        _exit( EXIT_SUCCESS );
+    waitpid( exited, NULL, 0 );
+    std::string const stalePath = std::string( claimsPath ) + "/0000:01:00." + std::to_string( exited );
+    if ( FILE * const file = fopen( stalePath.c_str(), "w" ) )
+        fclose( file );
+    bool const bStaleIgnored = countCudaDeviceClaims( claimsPath, locations[0] ) == 0 &&
+                               access( stalePath.c_str(), F_OK ) != 0;
+    printf( "%-26s: %s\n", "Stale claim removed", bStaleIgnored ? "yes" : "NO" );
+    bCorrect &= bStaleIgnored;
+
+    unlink( ( std::string( claimsPath ) + "/.lock" ).c_str() );
+    rmdir( claimsPath );
+    printf( "correct: %s\n", bCorrect ? "yes" : "NO" );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
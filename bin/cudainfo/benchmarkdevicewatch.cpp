@@ -0,0 +1,111 @@
+/*
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkdevicewatch benchmarkdevicewatch.cpp && ./benchmarkdevicewatch
+
+Watches 8 devices of a stand-in metric provider for 2 s with different
+sampling intervals, writing to a temporary file, and reports the CPU
+time used by the process relative to the wall time. Checks that every
+sample was written exactly once, in order, and that none were dropped.
+The last configuration uses the emulated runtime as provider.
+*/
+
+#include "cudadevicewatch.hpp"
+
+#include <algorithm>                    // fill
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>                        // clock
+#include <string>
+#include <thread>
+#include <vector>
+
+
+int main( void )
+{
+    int const nDevices = 8;
+    for ( int iDevice = 0; iDevice < nDevices; ++iDevice )
+        getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Synthetic", 6, 1, 20 ) );
+
+    /* used memory grows with each sample, so that the order can be checked */
+    std::vector< uint64_t > nProvided( nDevices, 0 );
+    auto const provider = [&]( int const iDevice, CudaDeviceSample * const rSample )
+    {
+        rSample->nBytesTotal        = uint64_t( 8 ) << 30;
+        rSample->nBytesFree         = rSample->nBytesTotal - nProvided[ iDevice ]++;
+        rSample->clockRateKHz       = 1500000;
+        rSample->memoryClockRateKHz = 4000000;
+        rSample->computeMode        = 0;
+        return true;
+    };
+
+    struct Configuration { uint64_t intervalMicroseconds, flushIntervalMicroseconds; bool bRuntime; };
+    Configuration const configurations[] = {
+        { 100000, 1000000, false },
+        {  10000, 1000000, false },
+        {   1000, 1000000, false },
+        {   1000,  100000, false },
+        {   1000, 1000000, true  }
+    };
+    double const duration = 2;
+
+    printf( "| interval / ms | flush / ms | provider | samples | dropped | missed | CPU / %% | all written |\n" );
+    printf( "|---------------|------------|----------|---------|---------|--------|---------|-------------|\n" );
+    for ( auto const & configuration : configurations )
+    {
+        std::fill( nProvided.begin(), nProvided.end(), 0 );
+        FILE * const file = tmpfile();
+        if ( file == NULL )
+            return EXIT_FAILURE;
+
+        CudaDeviceWatcher::MetricProvider const chosen = configuration.bRuntime
+            ? CudaDeviceWatcher::MetricProvider( sampleCudaDeviceMetrics )
+            : CudaDeviceWatcher::MetricProvider( provider );
+        CudaDeviceWatcher watcher( file, nDevices, configuration.intervalMicroseconds,
+                                   configuration.flushIntervalMicroseconds, chosen );
+        std::clock_t const c0 = std::clock();
+        watcher.start();
+        std::this_thread::sleep_for( std::chrono::duration< double >( duration ) );
+        watcher.stop();
+        double const cpu = double( std::clock() - c0 ) / CLOCKS_PER_SEC;
+
+        /* every line must continue the used memory of its device */
+        rewind( file );
+        std::vector< uint64_t > nExpected( nDevices, 0 );
+        uint64_t nLines = 0;
+        bool bCorrect = watcher.good();
+        char line[256];
+        bool bHeader = true;
+        while ( fgets( line, sizeof( line ), file ) != NULL )
+        {
+            if ( bHeader )
+            {
+                bHeader = false;
+                continue;
+            }
+            unsigned long long time, nFree, nUsed;
+            int iDevice;
+            if ( sscanf( line, "%llu,%i,%llu,%llu", &time, &iDevice, &nFree, &nUsed ) != 4 ||
+                 iDevice < 0 || iDevice >= nDevices )
+            {
+                bCorrect = false;
+                break;
+            }
+            if ( ! configuration.bRuntime && nUsed != nExpected[ iDevice ]++ )
+                bCorrect = false;
+            ++nLines;
+        }
+        fclose( file );
+        bCorrect = bCorrect && nLines == watcher.getSampleCount() && watcher.getDroppedSampleCount() == 0;
+
+        printf( "| %13.1f | %10.1f | %-8s | %7llu | %7llu | %6llu | %7.3f | %-11s |\n",
+                configuration.intervalMicroseconds / 1e3, configuration.flushIntervalMicroseconds / 1e3,
+                configuration.bRuntime ? "runtime" : "stand-in",
+                (unsigned long long) watcher.getSampleCount(),
+                (unsigned long long) watcher.getDroppedSampleCount(),
+                (unsigned long long) watcher.getMissedIntervalCount(),
+                100 * cpu / duration, bCorrect ? "yes" : "NO" );
+        if ( ! bCorrect )
+            return EXIT_FAILURE;
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+g++ -std=c++17 -O3 -march=native -DNDEBUG -Wall -Wextra -o benchmarkformat benchmarkformat.cpp && ./benchmarkformat
+g++ -std=c++11 -O3 -march=native -DNDEBUG -Wall -Wextra -o benchmarkformat benchmarkformat.cpp && ./benchmarkformat
+
+Compares formatInteger and formatFloat with snprintf and, when compiled
+as C++17 with a standard library supporting it, std::to_chars. The floats
+are random bit patterns, i.e. mostly have large exponents, and uniformly
+distributed numbers in [0,1) as they are more common for debug output.
+All float outputs are checked to read back as the same float.
+*/
+
+#include "cudaformat.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#if __cplusplus >= 201703L
+#   include <charconv>
+#endif
+#if defined( __cpp_lib_to_chars ) && __cpp_lib_to_chars >= 201611L
+#   define TMP_HAS_TO_CHARS 1
+#else
+#   define TMP_HAS_TO_CHARS 0
+#endif
+
+
+template< typename T_Functor >
+double measureBest( int const nRepeats, T_Functor const & functor )
+{
+    double tMin = 0;
+    for ( int iRepeat = 0; iRepeat < nRepeats; ++iRepeat )
+    {
+        auto const t0 = std::chrono::high_resolution_clock::now();
+        functor();
+        auto const t1 = std::chrono::high_resolution_clock::now();
+        double const t = std::chrono::duration< double >( t1 - t0 ).count();
+        if ( iRepeat == 0 || t < tMin )
+            tMin = t;
+    }
+    return tMin;
+}
+
+/* writes all numbers separated by spaces like snprintFloatArray */
+template< typename T, typename T_Format >
+size_t formatAll( std::vector< T > const & rValues, std::vector< char > & rText, T_Format const & format )
+{
+    size_t nChars = 0;
+    for ( auto const x : rValues )
+    {
+        nChars += format( rText.data() + nChars, x );
+        rText[ nChars++ ] = ' ';
+    }
+    rText[ nChars ] = '\0';
+    return nChars;
+}
+
+bool readsBack( std::vector< float > const & rValues, std::vector< char > const & rText )
+{
+    char const * p = rText.data();
+    for ( auto const x : rValues )
+    {
+        char * end = NULL;
+        float const y = strtof( p, &end );
+        if ( end == p || ( memcmp( &x, &y, sizeof( x ) ) != 0 && ! ( x != x && y != y ) ) )
+            return false;
+        p = end;
+    }
+    return true;
+}
+
+int main( void )
+{
+    size_t const n = 1u << 20;
+    int const nRepeats = 5;
+    std::mt19937 randomGenerator( 17 );
+
+    std::vector< int32_t > integers( n );
+    for ( auto & x : integers )
+        x = (int32_t) randomGenerator() >> ( randomGenerator() % 32 );
+    std::vector< float > randomBits( n ), uniform( n );
+    for ( size_t i = 0; i < n; ++i )
+    {
+        uint32_t const bits = randomGenerator();
+        memcpy( &randomBits[i], &bits, sizeof( bits ) );
+        uniform[i] = std::uniform_real_distribution< float >( 0, 1 )( randomGenerator );
+    }
+    std::vector< char > text( n * 32 );
+
+    printf( "| data        | method              | M numbers/s | chars/number | reads back |\n" );
+    printf( "|-------------|---------------------|-------------|--------------|------------|\n" );
+    #define TMP_PRINT_ROW( DATA, METHOD, SECONDS, NCHARS, CHECK ) \
+        printf( "| %-11s | %-19s | %11.2f | %12.2f | %-10s |\n", DATA, METHOD, n / SECONDS / 1e6, \
+                (double) NCHARS / n, CHECK );
+
+    {
+        size_t nChars = 0;
+        double t = measureBest( nRepeats, [&](){ nChars = formatAll( integers, text,
+            []( char * p, int32_t x ){ return formatInteger( p, x ); } ); } );
+        TMP_PRINT_ROW( "int32", "formatInteger", t, nChars, "-" )
+        t = measureBest( nRepeats, [&](){ nChars = formatAll( integers, text,
+            []( char * p, int32_t x ){ return snprintf( p, 32, "%d", x ); } ); } );
+        TMP_PRINT_ROW( "int32", "snprintf %d", t, nChars, "-" )
+        #if TMP_HAS_TO_CHARS
+            t = measureBest( nRepeats, [&](){ nChars = formatAll( integers, text,
+                []( char * p, int32_t x ){ return int( std::to_chars( p, p + 32, x ).ptr - p ); } ); } );
+            TMP_PRINT_ROW( "int32", "std::to_chars", t, nChars, "-" )
+        #endif
+    }
+
+    for ( int iData = 0; iData < 2; ++iData )
+    {
+        auto const & values = iData == 0 ? uniform : randomBits;
+        char const * const name = iData == 0 ? "float [0,1)" : "float bits";
+        size_t nChars = 0;
+
+        double t = measureBest( nRepeats, [&](){ nChars = formatAll( values, text,
+            []( char * p, float x ){ return formatFloat( p, x ); } ); } );
+        TMP_PRINT_ROW( name, "formatFloat", t, nChars, readsBack( values, text ) ? "yes" : "NO" )
+        t = measureBest( nRepeats, [&](){ nChars = formatAll( values, text,
+            []( char * p, float x ){ return snprintf( p, 32, "%.9g", x ); } ); } );
+        TMP_PRINT_ROW( name, "snprintf %.9g", t, nChars, readsBack( values, text ) ? "yes" : "NO" )
+        /* what is needed to get the shortest output with printf */
+        t = measureBest( nRepeats, [&](){ nChars = formatAll( values, text, []( char * p, float x )
+        {
+            int nWritten = 0;
+            for ( int precision = 1; precision <= 9; ++precision )
+            {
+                nWritten = snprintf( p, 32, "%.*g", precision, x );
+                if ( strtof( p, NULL ) == x )
+                    break;
+            }
+            return nWritten;
+        } ); } );
+        TMP_PRINT_ROW( name, "snprintf shortest", t, nChars, readsBack( values, text ) ? "yes" : "NO" )
+        #if TMP_HAS_TO_CHARS
+            t = measureBest( nRepeats, [&](){ nChars = formatAll( values, text,
+                []( char * p, float x ){ return int( std::to_chars( p, p + 32, x ).ptr - p ); } ); } );
+            TMP_PRINT_ROW( name, "std::to_chars", t, nChars, readsBack( values, text ) ? "yes" : "NO" )
+        #endif
+    }
+
+    #undef TMP_PRINT_ROW
+    #undef TMP_HAS_TO_CHARS
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+g++ -std=c++11 -O3 -march=native -pthread -DNDEBUG -Wall -Wextra -o benchmarkhostbackend benchmarkhostbackend.cpp && ./benchmarkhostbackend
+
+Measures how the host backend scales with the number of worker threads for
+a compute-bound reference kernel, which evaluates a polynomial with Horner's
+scheme for each element inside a grid-stride loop.
+*/
+
+#include "cudacommon.hpp"
+
+#include <chrono>
+#include <vector>
+
+
+__device__ void kernelHorner
+(
+    float    const * const x,
+    float          * const y,
+    uint64_t         const n
+)
+{
+    unsigned long long int i, nThreads;
+    getLinearGlobalIdSize( &i, &nThreads );
+    for ( ; i < n; i += nThreads )
+    {
+        float const xi = x[i];
+        float sum = 0;
+        for ( int k = 0; k < 64; ++k )
+            sum = sum * xi + 0.5f;
+        y[i] = sum;
+    }
+}
+
+int main( void )
+{
+    uint64_t const nElements = 1ull << 24;
+    int      const nRepeats  = 5;
+    std::vector< float > x( nElements ), y( nElements );
+    for ( uint64_t i = 0; i < nElements; ++i )
+        x[i] = (float) i / nElements;
+
+    unsigned int const nMaxThreads = HostThreadPool::defaultThreadCount();
+    printf( "Horner kernel (64 FMA per element) on %lu elements, best of %i runs\n",
+            (unsigned long) nElements, nRepeats );
+    printf( "| threads | time / ms | GFLOPS  | speedup | efficiency |\n" );
+    printf( "|---------|-----------|---------|---------|------------|\n" );
+
+    /* powers of two and the full core count if it isn't one */
+    std::vector< unsigned int > threadCounts;
+    for ( unsigned int nThreads = 1; nThreads < nMaxThreads; nThreads *= 2 )
+        threadCounts.push_back( nThreads );
+    threadCounts.push_back( nMaxThreads );
+
+    double tSingle = 0;
+    for ( auto const nThreads : threadCounts )
+    {
+        HostThreadPool pool( nThreads );
+        int const nThreadsPerBlock = 256;
+        int const nBlocks          = nThreads * 8;
+
+        double tMin = 0;
+        for ( int iRepeat = 0; iRepeat < nRepeats; ++iRepeat )
+        {
+            auto const t0 = std::chrono::high_resolution_clock::now();
+            launchHostKernelOnPool( pool, nBlocks, nThreadsPerBlock,
+                [&](){ kernelHorner( x.data(), y.data(), nElements ); } );
+            auto const t1 = std::chrono::high_resolution_clock::now();
+            double const t = std::chrono::duration< double >( t1 - t0 ).count();
+            if ( iRepeat == 0 || t < tMin )
+                tMin = t;
+        }
+        if ( nThreads == 1 )
+            tSingle = tMin;
+
+        printf( "| %7u | %9.2f | %7.2f | %7.2f | %9.1f%% |\n", nThreads, tMin * 1e3,
+                2.0 * 64 * nElements / tMin / 1e9, tSingle / tMin,
+                100.0 * tSingle / tMin / nThreads );
+    }
+
+    /* keep the compiler from optimizing the kernel away */
+    double checksum = 0;
+    for ( uint64_t i = 0; i < nElements; i += 4096 )
+        checksum += y[i];
+    printf( "checksum: %f\n", checksum );
+
+    return 0;
+}
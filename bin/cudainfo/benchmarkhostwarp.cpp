@@ -0,0 +1,206 @@
+/*
+g++ -std=c++11 -O3 -march=native -DNDEBUG -Wall -Wextra -o benchmarkhostwarp benchmarkhostwarp.cpp && ./benchmarkhostwarp
+g++ -std=c++11 -O3 -mavx2 -mfma -DNDEBUG -Wall -Wextra -o benchmarkhostwarp benchmarkhostwarp.cpp && ./benchmarkhostwarp
+g++ -std=c++11 -O3 -DNDEBUG -Wall -Wextra -o benchmarkhostwarp benchmarkhostwarp.cpp && ./benchmarkhostwarp
+
+Compares the warp-wise host reductions, scans and compaction from
+cudahostwarp.hpp against plain sequential loops over the same data.
+"generic" calls the template versions explicitly, i.e. what is used
+without AVX2, "SIMD" the overloads chosen by the compile flags. Both are
+checked against the sequential results, exactly for int32_t and with a
+relative tolerance for float, whose sums may be added in another order.
+Returns non-zero on a mismatch, so it should be run for every build above.
+*/
+
+#include "cudahostwarp.hpp"
+
+#include <algorithm>                    // max
+#include <chrono>
+#include <cmath>                        // fabs
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+
+/* calls functor nPasses times per repetition, so that it can work on data
+ * fitting into the L2 cache, i.e. the arithmetic and not DRAM is measured */
+template< typename T_Functor >
+double measureBest( int const nRepeats, int const nPasses, T_Functor const & functor )
+{
+    double tMin = 0;
+    for ( int iRepeat = 0; iRepeat < nRepeats; ++iRepeat )
+    {
+        auto const t0 = std::chrono::high_resolution_clock::now();
+        for ( int iPass = 0; iPass < nPasses; ++iPass )
+            functor();
+        auto const t1 = std::chrono::high_resolution_clock::now();
+        double const t = std::chrono::duration< double >( t1 - t0 ).count();
+        if ( iRepeat == 0 || t < tMin )
+            tMin = t;
+    }
+    return tMin;
+}
+
+/* like hostBlockReduceCumSum and hostCompact, but with the generic warp
+ * functions, assuming n is a multiple of the warp size */
+template< typename T >
+void genericBlockReduceCumSum( T * const x, size_t const n )
+{
+    T carry = 0;
+    for ( size_t i = 0; i < n; i += hostWarpSize )
+        carry = hostWarpReduceCumSum< T >( *reinterpret_cast< T (*)[32] >( x + i ), carry );
+}
+
+template< typename T >
+size_t genericCompact( T const * const x, bool const * const keep, size_t const n, T * const out )
+{
+    size_t nKept = 0;
+    for ( size_t i = 0; i < n; i += hostWarpSize )
+    {
+        uint32_t const ballot = hostWarpBallotScalar( *reinterpret_cast< bool const (*)[32] >( keep + i ) );
+        nKept += hostWarpCompact< T >( *reinterpret_cast< T const (*)[32] >( x + i ), ballot, out + nKept );
+    }
+    return nKept;
+}
+
+inline bool isEqual( int32_t const a, int32_t const b ){ return a == b; }
+inline bool isEqual( float const a, float const b ){ return std::fabs( a - b ) <= 1e-5f * std::max( 1.0f, std::fabs( b ) ); }
+
+template< typename T >
+bool isEqual( std::vector< T > const & a, std::vector< T > const & b, size_t const n )
+{
+    for ( size_t i = 0; i < n; ++i )
+        if ( ! isEqual( a[i], b[i] ) )
+            return false;
+    return true;
+}
+
+/* results of one run of the measured loops, compared after the measurements */
+template< typename T >
+struct WarpResults
+{
+    T                   sum  ;
+    std::vector< T >    y    ;
+    std::vector< T >    out  ;
+    size_t              nKept;
+};
+
+template< typename T >
+bool benchmark( char const * const rTypeName, size_t const n, int const nRepeats, int const nPasses )
+{
+    std::vector< T > x( n ), y( n ), out( n );
+    std::vector< char > keepBytes( n );
+    for ( size_t i = 0; i < n; ++i )
+    {
+        x[i] = T( rand() % 16 );
+        keepBytes[i] = rand() % 2;
+    }
+    bool const * const keep = (bool const *) keepBytes.data();
+    volatile T sink = 0;
+
+    double const tSumScalar = measureBest( nRepeats, nPasses, [&]()
+    {
+        T sum = 0;
+        for ( size_t i = 0; i < n; ++i )
+            sum += x[i];
+        sink = sum;
+    } );
+    double const tSumGeneric = measureBest( nRepeats, nPasses, [&]()
+    {
+        T sum = 0;
+        for ( size_t i = 0; i < n; i += hostWarpSize )
+            sum += hostWarpReduceSum< T >( *reinterpret_cast< T const (*)[32] >( &x[i] ) );
+        sink = sum;
+    } );
+    double const tSumSimd = measureBest( nRepeats, nPasses, [&](){ sink = hostBlockReduceSum( x.data(), n ); } );
+
+    double const tScanScalar = measureBest( nRepeats, nPasses, [&]()
+    {
+        y = x;
+        T sum = 0;
+        for ( size_t i = 0; i < n; ++i )
+            y[i] = sum += y[i];
+    } );
+    double const tScanGeneric = measureBest( nRepeats, nPasses, [&]()
+    {
+        y = x;
+        genericBlockReduceCumSum( y.data(), n );
+    } );
+    double const tScanSimd = measureBest( nRepeats, nPasses, [&]()
+    {
+        y = x;
+        hostBlockReduceCumSum( y.data(), n );
+    } );
+
+    double const tCompactScalar = measureBest( nRepeats, nPasses, [&]()
+    {
+        size_t nKept = 0;
+        for ( size_t i = 0; i < n; ++i )
+        {
+            if ( keep[i] )
+                out[ nKept++ ] = x[i];
+        }
+        sink = (T) nKept;
+    } );
+    double const tCompactGeneric = measureBest( nRepeats, nPasses, [&](){ sink = (T) genericCompact( x.data(), keep, n, out.data() ); } );
+    double const tCompactSimd = measureBest( nRepeats, nPasses, [&](){ sink = (T) hostCompact( x.data(), keep, n, out.data() ); } );
+
+    WarpResults< T > scalar, generic, simd;
+    scalar.sum = 0;
+    scalar.y   = x;
+    scalar.out.resize( n );
+    scalar.nKept = 0;
+    for ( size_t i = 0; i < n; ++i )
+    {
+        scalar.sum += x[i];
+        scalar.y[i] = scalar.sum;
+        if ( keep[i] )
+            scalar.out[ scalar.nKept++ ] = x[i];
+    }
+
+    generic.sum = 0;
+    for ( size_t i = 0; i < n; i += hostWarpSize )
+        generic.sum += hostWarpReduceSum< T >( *reinterpret_cast< T const (*)[32] >( &x[i] ) );
+    generic.y = x;
+    genericBlockReduceCumSum( generic.y.data(), n );
+    generic.out.resize( n );
+    generic.nKept = genericCompact( x.data(), keep, n, generic.out.data() );
+
+    simd.sum = hostBlockReduceSum( x.data(), n );
+    simd.y   = x;
+    hostBlockReduceCumSum( simd.y.data(), n );
+    simd.out.resize( n );
+    simd.nKept = hostCompact( x.data(), keep, n, simd.out.data() );
+
+    bool const bSumEqual     = isEqual( generic.sum, scalar.sum ) && isEqual( simd.sum, scalar.sum );
+    bool const bScanEqual    = isEqual( generic.y, scalar.y, n ) && isEqual( simd.y, scalar.y, n );
+    bool const bCompactEqual = generic.nKept == scalar.nKept && simd.nKept == scalar.nKept &&
+                               isEqual( generic.out, scalar.out, scalar.nKept ) &&
+                               isEqual( simd.out, scalar.out, scalar.nKept );
+
+    double const nElements = (double) n * nPasses;
+    #define TMP_PRINT_ROW( NAME, T_SCALAR, T_GENERIC, T_SIMD, B_EQUAL ) \
+        printf( "| %-7s | %-7s | %10.2f | %11.2f | %10.2f | %7.2f | %-5s |\n", rTypeName, NAME, \
+                nElements / T_SCALAR / 1e9, nElements / T_GENERIC / 1e9, nElements / T_SIMD / 1e9, \
+                T_SCALAR / T_SIMD, B_EQUAL ? "yes" : "NO" );
+    TMP_PRINT_ROW( "sum"    , tSumScalar    , tSumGeneric   , tSumSimd    , bSumEqual     )
+    TMP_PRINT_ROW( "scan"   , tScanScalar   , tScanGeneric  , tScanSimd   , bScanEqual    )
+    TMP_PRINT_ROW( "compact", tCompactScalar, tCompactGeneric, tCompactSimd, bCompactEqual )
+    #undef TMP_PRINT_ROW
+    return bSumEqual && bScanEqual && bCompactEqual;
+}
+
+int main( void )
+{
+    size_t const n = size_t( 1 ) << 14;
+    int const nRepeats = 5;
+    int const nPasses  = 1000;
+
+    printf( "Compiled for %s, %lu elements, %d passes\n\n", HOST_WARP_SIMD, (unsigned long) n, nPasses );
+    printf( "| type    | op      | scalar G/s | generic G/s | SIMD G/s   | speedup | equal |\n" );
+    printf( "|---------|---------|------------|-------------|------------|---------|-------|\n" );
+    bool bCorrect = true;
+    bCorrect &= benchmark< int32_t >( "int32_t", n, nRepeats, nPasses );
+    bCorrect &= benchmark< float   >( "float"  , n, nRepeats, nPasses );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
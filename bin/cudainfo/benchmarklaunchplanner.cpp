@@ -0,0 +1,165 @@
+/*
+g++ -std=c++11 -O3 -march=native -pthread -DNDEBUG -Wall -Wextra -o benchmarklaunchplanner benchmarklaunchplanner.cpp && ./benchmarklaunchplanner
+
+Shows the launch configurations chosen for a few synthetic device profiles
+and kernel resource usages and measures how long a memoized plan takes.
+Checks that no plan exceeds maxThreadsPerBlock or has more threads than
+elements, including for a device with a single multiprocessor fitting only
+one block, where all threads needed used to end up in that block. For 2D
+and 3D, checks that blocks are no wider than the elements in each
+dimension, that they aren't smaller than planned unless all dimensions are
+exhausted and that the grid doesn't fall below the blocks needed or
+resident, which used to happen for 1 x 1000 and 1000 x 1000 elements.
+Returns non-zero on failure.
+*/
+
+#include "cudalaunchplanner.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>                      // pair
+#include <vector>
+
+
+bool checkPlan
+(
+    cudaDeviceProp      const & rProps    ,
+    uint64_t            const   rnElements,
+    CudaKernelResources const & rResources
+)
+{
+    CudaLaunchConfig const config = CudaLaunchPlanner( rProps ).plan( rnElements, rResources );
+    uint64_t const nThreads = (uint64_t) config.nBlocks.x * config.nThreads.x;
+    bool const bValid = config.nBlocks.x >= 1 && config.nThreads.x >= 1 &&
+                        config.nThreads.x <= (unsigned int) rProps.maxThreadsPerBlock &&
+                        nThreads <= rnElements;
+    if ( ! bValid )
+    {
+        printf( "Invalid plan %u x %u for %lu elements with at least %i per thread on %s\n",
+                config.nBlocks.x, config.nThreads.x, (unsigned long) rnElements,
+                rResources.nMinElementsPerThread, rProps.name );
+    }
+    return bValid;
+}
+
+/**
+ * Checks the block shape and grid for nx * ny * nz elements and prints the
+ * plan. The block may only be much smaller than the one of the 1D plan if
+ * the elements or maxThreadsDim can't fill it in any dimension.
+ */
+bool checkPlan3D
+(
+    cudaDeviceProp      const & rProps    ,
+    uint64_t            const   rnx       ,
+    uint64_t            const   rny       ,
+    uint64_t            const   rnz       ,
+    CudaKernelResources const & rResources
+)
+{
+    CudaLaunchPlanner const planner( rProps );
+    CudaLaunchConfig const config = planner.plan( rnx, rny, rnz, rResources );
+    uint64_t const nThreadsPlanned = planner.plan( 1ull << 30, rResources ).nThreads.x;
+    uint64_t const nThreads = (uint64_t) config.nThreads.x * config.nThreads.y * config.nThreads.z;
+    uint64_t const nBlocks  = (uint64_t) config.nBlocks.x * config.nBlocks.y * config.nBlocks.z;
+    uint64_t const nThreadsNeeded = ( rnx * rny * rnz + rResources.nMinElementsPerThread - 1 ) / rResources.nMinElementsPerThread;
+    uint64_t const nBlocksNeeded  = ( nThreadsNeeded + nThreads - 1 ) / nThreads;
+    uint64_t const nResident = (uint64_t) config.nBlocksPerMultiprocessor * rProps.multiProcessorCount;
+
+    bool const bFits = config.nThreads.x <= rnx && config.nThreads.y <= rny && config.nThreads.z <= rnz &&
+                       nThreads <= (uint64_t) rProps.maxThreadsPerBlock;
+    /* rounding to whole warps or rows may leave less than half unused */
+    bool const bFilled = 2 * nThreads > nThreadsPlanned ||
+                         ( config.nThreads.x >= std::min( rnx, (uint64_t) rProps.maxThreadsDim[0] ) &&
+                           config.nThreads.y >= std::min( rny, (uint64_t) rProps.maxThreadsDim[1] ) &&
+                           config.nThreads.z >= std::min( rnz, (uint64_t) rProps.maxThreadsDim[2] ) );
+    bool const bEnoughBlocks = nBlocks >= std::min( nBlocksNeeded, nResident ) &&
+                               config.nBlocks.x <= ( rnx + config.nThreads.x - 1 ) / config.nThreads.x &&
+                               config.nBlocks.y <= ( rny + config.nThreads.y - 1 ) / config.nThreads.y &&
+                               config.nBlocks.z <= ( rnz + config.nThreads.z - 1 ) / config.nThreads.z;
+    bool const bValid = bFits && bFilled && bEnoughBlocks;
+    printf( "%5lu x %5lu x %5lu on %-15s: %3u x %3u x %3u blocks of %4u x %3u x %3u threads%s\n",
+            (unsigned long) rnx, (unsigned long) rny, (unsigned long) rnz, rProps.name,
+            config.nBlocks.x, config.nBlocks.y, config.nBlocks.z,
+            config.nThreads.x, config.nThreads.y, config.nThreads.z, bValid ? "" : "  WRONG" );
+    return bValid;
+}
+
+int main( void )
+{
+    std::vector< HostRuntimeDevice > const profiles = {
+        makeHostRuntimeDevice( "Kepler GTX 760"  , 3, 0,  6 ),
+        makeHostRuntimeDevice( "Pascal GTX 1080" , 6, 1, 20 ),
+        makeHostRuntimeDevice( "Turing RTX 2080" , 7, 5, 46 ),
+        makeHostRuntimeDevice( "Ampere RTX 3080" , 8, 6, 68 )
+    };
+    std::vector< CudaKernelResources > const resources = {
+        CudaKernelResources(  32,     0 ),
+        CudaKernelResources(  64,     0 ),
+        CudaKernelResources( 128,     0 ),
+        CudaKernelResources(  32, 16384 )
+    };
+
+    printf( "| device          | regs | shared / B | blocks x threads | blocks/SM |\n" );
+    printf( "|-----------------|------|------------|------------------|-----------|\n" );
+    for ( auto const & profile : profiles )
+    {
+        CudaLaunchPlanner const planner( profile.properties );
+        for ( auto const & resource : resources )
+        {
+            CudaLaunchConfig const config = planner.plan( 1ull << 30, resource );
+            printf( "| %-15s | %4i | %10lu | %7u x %6u | %9i |\n", profile.properties.name,
+                    resource.nRegistersPerThread, (unsigned long) resource.nBytesSharedPerBlock,
+                    config.nBlocks.x, config.nThreads.x, config.nBlocksPerMultiprocessor );
+        }
+    }
+
+    /* the block size is memoized after the first call, so this measures
+     * the O(1) part which would be called before every kernel launch */
+    CudaLaunchPlanner const planner( profiles[1].properties );
+    int      const nRepeats = 1000000;
+    uint64_t       checksum = 0;
+    auto const t0 = std::chrono::high_resolution_clock::now();
+    for ( int i = 0; i < nRepeats; ++i )
+    {
+        CudaLaunchConfig const config = planner.plan( 1000 + (uint64_t) i * 997 );
+        checksum += config.nBlocks.x + config.nThreads.x;
+    }
+    auto const t1 = std::chrono::high_resolution_clock::now();
+    printf( "\nplan: %.1f ns per call (checksum %lu)\n",
+            std::chrono::duration< double, std::nano >( t1 - t0 ).count() / nRepeats,
+            (unsigned long) checksum );
+
+    bool bCorrect = true;
+    /* one multiprocessor fitting one block because of the shared memory */
+    HostRuntimeDevice singleBlock = makeHostRuntimeDevice( "1 SM, 1 block", 6, 1, 1 );
+    singleBlock.properties.sharedMemPerMultiprocessor = 48 * 1024;
+    CudaKernelResources const fullShared( 32, 48 * 1024 );
+    bCorrect &= CudaLaunchPlanner( singleBlock.properties ).plan( 1000000, fullShared ).nBlocksPerMultiprocessor == 1;
+    bCorrect &= checkPlan( singleBlock.properties, 1000000, fullShared );
+    /* 300 elements with one per thread used to give 2 x 256 */
+    bCorrect &= checkPlan( profiles[1].properties, 300, CudaKernelResources( 32, 0, 1 ) );
+    std::vector< std::pair< cudaDeviceProp, size_t > > const sweeps = {
+        { singleBlock.properties, 48 * 1024 }, { profiles[0].properties, 0 }, { profiles[3].properties, 0 } };
+    for ( auto const & sweep : sweeps )
+    for ( auto const nMinElements : { 1, 7, 32 } )
+    for ( uint64_t nElements = 1; nElements <= 100000; nElements = nElements * 5 / 4 + 1 )
+        bCorrect &= checkPlan( sweep.first, nElements, CudaKernelResources( 32, sweep.second, nMinElements ) );
+
+    printf( "\n" );
+    uint64_t const shapes[][3] = {
+        { 1, 1000, 1 }, { 1000, 1000, 1 }, { 1000, 2, 1 }, { 1000, 3, 1 }, { 5, 1000, 1 },
+        { 64, 64, 64 }, { 1, 1, 1000 }, { 3, 5, 7 }, { 1000, 2, 2 }, { 512, 512, 512 } };
+    for ( auto const & profile : { profiles[1].properties, profiles[3].properties } )
+    for ( auto const & shape : shapes )
+        bCorrect &= checkPlan3D( profile, shape[0], shape[1], shape[2], CudaKernelResources( 32 ) );
+    /* 123 blocks of 256 threads are needed, halving the grid gave 64 */
+    CudaLaunchConfig const square = CudaLaunchPlanner( profiles[1].properties ).plan( 1000, 1000, 1 );
+    bCorrect &= square.nBlocks.x * square.nBlocks.y * square.nBlocks.z >= 123;
+    /* used to be 32 x 8 threads with all but one in x idle */
+    CudaLaunchConfig const column = CudaLaunchPlanner( profiles[1].properties ).plan( 1, 1000, 1 );
+    bCorrect &= column.nThreads.x == 1 && column.nThreads.y == 256;
+    printf( "plans valid: %s\n", bCorrect ? "yes" : "NO" );
+
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
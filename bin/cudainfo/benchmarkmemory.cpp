@@ -0,0 +1,32 @@
+/*
+g++ -std=c++11 -O3 -march=native -pthread -DNDEBUG -Wall -Wextra -o benchmarkmemory benchmarkmemory.cpp && ./benchmarkmemory [elements per array]
+
+Runs the host part of gpuinfo --bench-memory, i.e. STREAM copy, scale and
+triad per NUMA node with 1, 2, 4, ... threads pinned to the node and the
+arrays bound to it, on machines without GPU. Then it runs the transfer
+sweep against one device of the emulated runtime, which only shows the
+memcpy bandwidth of the host and checks that the sweep works.
+The default of 2^23 doubles, i.e. 64 MiB per array, exceeds the caches
+of current CPUs. STREAM requires at least 4 times the last level cache.
+*/
+
+#include "cudamemorybenchmark.hpp"
+
+#include <cstdio>
+#include <cstdlib>                      // atoll, EXIT_FAILURE
+
+
+int main( int argc, char ** argv )
+{
+    size_t const nElements = argc > 1 ? (size_t) atoll( argv[1] ) : size_t( 1 ) << 23;
+    printHostStreamBenchmarks( benchmarkHostStream( nElements ) );
+
+    getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Emulated", 6, 1, 20 ) );
+    cudaDeviceProp prop;
+    if ( cudaGetDeviceProperties( &prop, 0 ) != cudaSuccess )
+        return EXIT_FAILURE;
+    printf( "\n" );
+    printCudaTransferBenchmarks( prop, benchmarkCudaTransfers( size_t( 16 ) << 20 ),
+                                 benchmarkCudaDeviceCopy( size_t( 64 ) << 20 ) );
+    return 0;
+}
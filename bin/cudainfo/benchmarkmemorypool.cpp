@@ -0,0 +1,173 @@
+/*
+nvcc -x cu -std=c++11 -O3 -DNDEBUG -o benchmarkmemorypool benchmarkmemorypool.cpp && ./benchmarkmemorypool
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkmemorypool benchmarkmemorypool.cpp && ./benchmarkmemorypool
+
+Checks CachingMemoryPool with malloc and free as backing allocator, which
+counts the live blocks and fails above a budget: hits and misses of the
+size classes, requests too large for caching, that per-stream pools don't
+hand blocks of one stream to another, the accounting of trim, the retry
+after releasing the cache when the backing allocator fails and that
+foreign pointers are rejected. Then measures an allocation and free with
+and without the pool. Returns non-zero on failure.
+*/
+
+#include "cudamemorypool.hpp"
+
+#include <chrono>
+#include <cstdint>                      // uintptr_t
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+
+
+namespace
+{
+    size_t nLiveBlocks = 0;
+    size_t nLiveBytes  = 0;
+    /* allocations exceeding it in total fail like cudaMalloc would */
+    size_t nBudgetBytes = ~size_t( 0 );
+    std::map< void *, size_t > liveSizes;
+
+    void * allocateCounted( size_t const rnBytes )
+    {
+        if ( nLiveBytes + rnBytes > nBudgetBytes )
+            return NULL;
+        void * const pointer = malloc( rnBytes );
+        ++nLiveBlocks;
+        nLiveBytes += rnBytes;
+        liveSizes[ pointer ] = rnBytes;
+        return pointer;
+    }
+
+    void freeCounted( void * const rPointer )
+    {
+        --nLiveBlocks;
+        nLiveBytes -= liveSizes[ rPointer ];
+        liveSizes.erase( rPointer );
+        free( rPointer );
+    }
+}
+
+bool check( char const * const rName, bool const rbCorrect )
+{
+    printf( "%-44s: %s\n", rName, rbCorrect ? "ok" : "WRONG" );
+    return rbCorrect;
+}
+
+int main( void )
+{
+    /* only compared by the pool, never used */
+    cudaStream_t const streamA = reinterpret_cast< cudaStream_t >( uintptr_t( 1 ) );
+    cudaStream_t const streamB = reinterpret_cast< cudaStream_t >( uintptr_t( 2 ) );
+
+    bool bCorrect = true;
+    {
+        CachingMemoryPool pool( allocateCounted, freeCounted, false, 4096 );
+        void * const a = pool.allocate( 1000 );
+        CachingMemoryPoolStats stats = pool.stats();
+        bCorrect &= check( "First request is a miss of the 1 KiB class",
+            a != NULL && stats.nMisses == 1 && stats.nHits == 0 && stats.nBytesRequested == 1000 &&
+            stats.nBytesInUse == 1024 && nLiveBytes == 1024 );
+        pool.deallocate( a );
+        stats = pool.stats();
+        bCorrect &= check( "Freed block is cached",
+            stats.nFrees == 1 && stats.nBytesInUse == 0 && stats.nBytesCached == 1024 && nLiveBlocks == 1 );
+        void * const b = pool.allocate( 600 );
+        stats = pool.stats();
+        bCorrect &= check( "Request of the same class is a hit",
+            b == a && stats.nHits == 1 && stats.nMisses == 1 && stats.nBytesCached == 0 &&
+            stats.nBytesRequested == 600 && nLiveBlocks == 1 );
+        void * const c = pool.allocate( 200 );
+        stats = pool.stats();
+        bCorrect &= check( "Request of another class is a miss",
+            c != NULL && c != b && stats.nMisses == 2 && stats.nBytesInUse == 1024 + 256 &&
+            stats.nPeakBytes == 1024 + 256 );
+        void * const d = pool.allocate( 5000 );
+        pool.deallocate( d );
+        stats = pool.stats();
+        bCorrect &= check( "Too large requests aren't cached",
+            d != NULL && stats.nBytesCached == 0 && nLiveBlocks == 2 && stats.nPeakBytes == 1024 + 256 + 5000 );
+
+        bool bThrown = false;
+        int local = 0;
+        try { pool.deallocate( &local ); }
+        catch ( std::invalid_argument const & ) { bThrown = true; }
+        pool.deallocate( NULL );
+        pool.deallocate( c );
+        bool bTwiceThrown = false;
+        try { pool.deallocate( c ); }
+        catch ( std::invalid_argument const & ) { bTwiceThrown = true; }
+        bCorrect &= check( "Foreign and twice freed pointers rejected",
+            bThrown && bTwiceThrown && pool.stats().nFrees == 3 );
+        pool.deallocate( b );
+    }
+    bCorrect &= check( "Destructor releases the cache", nLiveBlocks == 0 && nLiveBytes == 0 );
+
+    for ( auto const bPerStream : { true, false } )
+    {
+        CachingMemoryPool pool( allocateCounted, freeCounted, bPerStream );
+        void * const a = pool.allocate( 1000, streamA );
+        pool.deallocate( a );
+        void * const b = pool.allocate( 1000, streamB );
+        void * const c = pool.allocate( 1000, streamA );
+        bCorrect &= check( bPerStream ? "Per stream: not reused for another stream"
+                                      : "Shared: reused for another stream",
+            bPerStream ? b != a && c == a && pool.stats().nHits == 1
+                       : b == a && c != a && pool.stats().nHits == 1 );
+        pool.deallocate( b );
+        pool.deallocate( c );
+    }
+
+    {
+        CachingMemoryPool pool( allocateCounted, freeCounted );
+        void * const blocks[3] = { pool.allocate( 256 ), pool.allocate( 1024 ), pool.allocate( 4096 ) };
+        for ( auto const block : blocks )
+            pool.deallocate( block );
+        size_t const nReleased = pool.trim( 2000 );
+        bCorrect &= check( "trim releases the largest blocks first",
+            nReleased == 4096 && pool.stats().nBytesCached == 256 + 1024 && nLiveBytes == 256 + 1024 );
+        bCorrect &= check( "trim( 0 ) releases everything",
+            pool.trim() == 256 + 1024 && pool.stats().nBytesCached == 0 && nLiveBlocks == 0 &&
+            pool.trim() == 0 );
+
+        /* 8 KiB only fit next to the 2 KiB in use without the cached 4 KiB */
+        nBudgetBytes = 8192 + 2048;
+        void * const cached = pool.allocate( 4096 );
+        void * const inUse  = pool.allocate( 2048 );
+        pool.deallocate( cached );
+        void * const retried = pool.allocate( 4097 );
+        CachingMemoryPoolStats stats = pool.stats();
+        bCorrect &= check( "Cache released and retried if out of memory",
+            retried != NULL && stats.nBytesCached == 0 && nLiveBytes == 8192 + 2048 );
+        void * const failed = pool.allocate( 4096 );
+        CachingMemoryPoolStats const failedStats = pool.stats();
+        bCorrect &= check( "NULL if still out of memory",
+            failed == NULL && failedStats.nAllocations == stats.nAllocations + 1 &&
+            failedStats.nMisses == stats.nMisses && failedStats.nBytesInUse == stats.nBytesInUse );
+        nBudgetBytes = ~size_t( 0 );
+        pool.deallocate( inUse );
+        pool.deallocate( retried );
+    }
+    bCorrect &= check( "No blocks leaked", nLiveBlocks == 0 && liveSizes.empty() );
+
+    int const nRepetitions = 1000000;
+    CachingMemoryPool pool( malloc, free );
+    auto const t0 = std::chrono::high_resolution_clock::now();
+    for ( int i = 0; i < nRepetitions; ++i )
+        pool.deallocate( pool.allocate( 256 + i % 4096 ) );
+    auto const t1 = std::chrono::high_resolution_clock::now();
+    for ( int i = 0; i < nRepetitions; ++i )
+    {
+        void * volatile pointer = malloc( 256 + i % 4096 );
+        free( pointer );
+    }
+    auto const t2 = std::chrono::high_resolution_clock::now();
+    printf( "\nallocate + free: pool %.1f ns, malloc %.1f ns, hit rate %.4f\n",
+            std::chrono::duration< double, std::nano >( t1 - t0 ).count() / nRepetitions,
+            std::chrono::duration< double, std::nano >( t2 - t1 ).count() / nRepetitions,
+            pool.stats().hitRate() );
+
+    printf( "correct: %s\n", bCorrect ? "yes" : "NO" );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,171 @@
+/*
+nvcc -x cu -std=c++11 -O3 -DNDEBUG -o benchmarkmirroredvector benchmarkmirroredvector.cpp && ./benchmarkmirroredvector
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkmirroredvector benchmarkmirroredvector.cpp && ./benchmarkmirroredvector
+
+Compares the host memory modes of MirroredVector: bandwidth of synchronous
+push and pop and how long an asynchronous push blocks the host, which is
+the whole transfer for pageable memory. Without nvcc the emulated runtime
+is used, which only shows the cost of staging pageable transfers. Mapped
+and managed memory don't copy at all, but the kernels reading them pay
+for the transfers instead, which this doesn't measure.
+
+Without nvcc it is additionally checked that a managed vector can be
+larger than the emulated device memory, that push and pop prefetch and
+advices are issued, that both are skipped on a Kepler device without
+concurrent managed access, and that a vector grown while another device
+is current stays on its device.
+*/
+
+#include "cudacommon.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+
+template< typename T_Functor >
+double measureBest( int const nRepeats, T_Functor const & functor )
+{
+    double tMin = 0;
+    for ( int iRepeat = 0; iRepeat < nRepeats; ++iRepeat )
+    {
+        auto const t0 = std::chrono::high_resolution_clock::now();
+        functor();
+        auto const t1 = std::chrono::high_resolution_clock::now();
+        double const t = std::chrono::duration< double >( t1 - t0 ).count();
+        if ( iRepeat == 0 || t < tMin )
+            tMin = t;
+    }
+    return tMin;
+}
+
+#ifdef CUDA_HOST_RUNTIME
+
+/**
+ * Oversubscribes device riDevice with a managed vector of 4 times its
+ * memory and checks the prefetches and advices counted by the emulation.
+ * @param[in] rbConcurrentManaged whether the device supports prefetching
+ */
+bool checkManagedVector( int const riDevice, bool const rbConcurrentManaged )
+{
+    HostRuntime & runtime = getHostRuntime();
+    CUDA_ERROR( cudaSetDevice( riDevice ) );
+    size_t nBytesFree = 0, nBytesTotal = 0;
+    CUDA_ERROR( cudaMemGetInfo( &nBytesFree, &nBytesTotal ) );
+
+    size_t const nElements = 4 * nBytesTotal / sizeof( int );
+    unsigned int const nAllocations = runtime.nManagedAllocations;
+    unsigned int const nPrefetches  = runtime.nManagedPrefetches;
+    unsigned int const nAdvices     = runtime.nManagedAdvices;
+    bool bCorrect = true;
+    {
+        MirroredVector< int > vector( nElements, 0, false, MirroredHostManaged );
+        bCorrect &= vector.host == vector.gpu;
+        vector.advise( MirroredAdviseReadMostly );
+        vector.advise( MirroredAdvisePreferDevice );
+        vector.advise( MirroredAdvisePreferHost, false );
+        for ( size_t i = 0; i < nElements; ++i )
+            vector.host[i] = (int) i;
+        vector.push();
+        vector.pop();
+        for ( size_t i = 0; i < nElements; ++i )
+            bCorrect &= vector.host[i] == (int) i;
+
+        size_t nBytesFreeAllocated = 0;
+        CUDA_ERROR( cudaMemGetInfo( &nBytesFreeAllocated, &nBytesTotal ) );
+        bCorrect &= nBytesFreeAllocated == nBytesFree;
+    }
+    bCorrect &= runtime.nManagedAllocations == nAllocations + 1;
+    bCorrect &= runtime.nManagedPrefetches  == nPrefetches  + ( rbConcurrentManaged ? 2 : 0 );
+    bCorrect &= runtime.nManagedAdvices     == nAdvices     + ( rbConcurrentManaged ? 3 : 0 );
+    printf( "Managed vector of %s on %s: %s\n", prettyPrintBytes( nElements * sizeof( int ) ).c_str(),
+            runtime.devices[ riDevice ].properties.name, bCorrect ? "correct" : "WRONG" );
+    CUDA_ERROR( cudaSetDevice( 0 ) );
+    return bCorrect;
+}
+
+#endif
+
+int main( void )
+{
+    #ifdef CUDA_HOST_RUNTIME
+        getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Host emulation", 6, 1, 20 ) );
+    #endif
+
+    int const nRepeats = 5;
+    std::vector< size_t > const sizes = { size_t( 64 ) << 10, size_t( 4 ) << 20, size_t( 64 ) << 20 };
+    std::vector< MirroredHostMemory > const modes = {
+        MirroredHostPageable, MirroredHostPinned, MirroredHostRegistered, MirroredHostMapped,
+        MirroredHostManaged };
+
+    cudaStream_t stream;
+    CUDA_ERROR( cudaStreamCreate( &stream ) );
+
+    printf( "| mode       | size      | push GB/s | pop GB/s | async push blocks / us |\n" );
+    printf( "|------------|-----------|-----------|----------|------------------------|\n" );
+    for ( auto const mode : modes )
+    for ( auto const nBytes : sizes )
+    {
+        MirroredVector< char > vector( nBytes, stream, false, mode );
+        memset( vector.host, 1, nBytes );
+
+        double const tPush = measureBest( nRepeats, [&](){ vector.push(); } );
+        double const tPop  = measureBest( nRepeats, [&](){ vector.pop (); } );
+        double const tAsync = measureBest( nRepeats, [&]()
+        {
+            auto const t0 = std::chrono::high_resolution_clock::now();
+            vector.push( true );
+            auto const t1 = std::chrono::high_resolution_clock::now();
+            CUDA_ERROR( cudaStreamSynchronize( stream ) );
+            return std::chrono::duration< double >( t1 - t0 ).count();
+        } );
+
+        printf( "| %-10s | %9s | %9.2f | %8.2f | %22.1f |\n",
+                getMirroredHostMemoryString( mode ), prettyPrintBytes( nBytes ).c_str(),
+                nBytes / tPush / 1e9, nBytes / tPop / 1e9, tAsync * 1e6 );
+    }
+
+    CachingMemoryPoolStats const stats = getCudaDeviceMemoryPool().stats();
+    printf( "\nDevice memory pool: %.0f%% hit rate, peak %s, %.1f%% lost to rounding\n",
+            stats.hitRate() * 100, prettyPrintBytes( stats.nPeakBytes ).c_str(),
+            stats.fragmentation() * 100 );
+
+    #ifdef CUDA_HOST_RUNTIME
+        printf( "Emulated transfers: %u pinned, %u staged through pageable memory\n",
+                (unsigned) getHostRuntime().nPinnedCopies, (unsigned) getHostRuntime().nPageableCopies );
+    #endif
+
+    CUDA_ERROR( cudaStreamDestroy( stream ) );
+
+    bool bCorrect = true;
+    #ifdef CUDA_HOST_RUNTIME
+        for ( auto device : { makeHostRuntimeDevice( "Pascal 16 MiB", 6, 1, 20 ),
+                              makeHostRuntimeDevice( "Kepler 16 MiB", 3, 5, 15 ) } )
+        {
+            device.properties.totalGlobalMem = size_t( 16 ) << 20;
+            getHostRuntime().devices.push_back( device );
+        }
+        printf( "\n" );
+        bCorrect &= checkManagedVector( 1, true  );
+        bCorrect &= checkManagedVector( 2, false );
+
+        /* growing while another device is current must not move the vector */
+        CUDA_ERROR( cudaSetDevice( 0 ) );
+        MirroredVector< int > grown( 4 );
+        grown.push();
+        uint64_t const nOtherAllocations = getCudaDeviceMemoryPool( 1 ).stats().nAllocations;
+        CUDA_ERROR( cudaSetDevice( 1 ) );
+        for ( int i = 0; i < 1000; ++i )
+            grown.push_back( i );
+        grown.push();
+        int iCurrent = -1;
+        CUDA_ERROR( cudaGetDevice( &iCurrent ) );
+        bool const bStayed = grown.device() == 0 && iCurrent == 1 &&
+                             getCudaDeviceMemoryPool( 1 ).stats().nAllocations == nOtherAllocations;
+        printf( "Vector grown while device 1 is current stays on device 0: %s\n", bStayed ? "yes" : "NO" );
+        bCorrect &= bStayed;
+        CUDA_ERROR( cudaSetDevice( 0 ) );
+    #endif
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
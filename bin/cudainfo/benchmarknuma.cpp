@@ -0,0 +1,147 @@
+/*
+nvcc -x cu -std=c++11 -O3 -DNDEBUG -o benchmarknuma benchmarknuma.cpp && ./benchmarknuma
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarknuma benchmarknuma.cpp && ./benchmarknuma
+
+Checks the sysfs parsing of the NUMA topology against a fake /sys tree in a
+temporary directory with the nodes 0 and 2 online, i.e. not contiguous:
+numa_node of PCI devices, distance, cpulist and the node of a CPU. Then
+prints the topology of this machine and on which node memory allocated for
+each node ended up, which isn't checked, because binding may be forbidden.
+Returns non-zero on failure.
+*/
+
+#include "cudanuma.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>                   // mkdir
+#include <unistd.h>                     // rmdir, unlink
+
+
+/**
+ * Creates files and directories below a root and removes all of them in
+ * reverse order on destruction.
+ */
+class FakeTree
+{
+private:
+    std::string                 mRoot ;
+    std::vector< std::string >  mFiles;
+    std::vector< std::string >  mDirectories;
+
+public:
+    explicit FakeTree( std::string const & rRoot ) : mRoot( rRoot ) {}
+
+    ~FakeTree()
+    {
+        for ( auto it = mFiles.rbegin(); it != mFiles.rend(); ++it )
+            unlink( it->c_str() );
+        for ( auto it = mDirectories.rbegin(); it != mDirectories.rend(); ++it )
+            rmdir( it->c_str() );
+    }
+
+    /* creates all missing parent directories of the relative path */
+    void write( std::string const & rPath, std::string const & rContents )
+    {
+        for ( size_t i = rPath.find( '/', 1 ); i != std::string::npos; i = rPath.find( '/', i + 1 ) )
+        {
+            std::string const directory = mRoot + rPath.substr( 0, i );
+            if ( mkdir( directory.c_str(), 0700 ) == 0 )
+                mDirectories.push_back( directory );
+        }
+        std::string const path = mRoot + rPath;
+        if ( FILE * const file = fopen( path.c_str(), "w" ) )
+        {
+            fputs( rContents.c_str(), file );
+            fclose( file );
+            mFiles.push_back( path );
+        }
+    }
+};
+
+template< typename T >
+bool check( char const * const rName, T const & rValue, T const & rExpected )
+{
+    bool const bCorrect = rValue == rExpected;
+    printf( "%-34s: %s\n", rName, bCorrect ? "ok" : "WRONG" );
+    return bCorrect;
+}
+
+std::string formatList( std::vector< int > const & rNumbers )
+{
+    std::string list;
+    for ( auto const number : rNumbers )
+        list += ( list.empty() ? "" : "," ) + std::to_string( number );
+    return list.empty() ? "-" : list;
+}
+
+int main( void )
+{
+    char root[] = "/tmp/benchmarknuma-XXXXXX";
+    if ( mkdtemp( root ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return EXIT_FAILURE;
+    }
+
+    bool bCorrect = true;
+    {
+        FakeTree tree( root );
+        std::string const nodes = "/sys/devices/system/node";
+        tree.write( nodes + "/online", "0,2\n" );
+        tree.write( nodes + "/node0/cpulist", "0-3\n" );
+        tree.write( nodes + "/node0/distance", "10 21\n" );
+        tree.write( nodes + "/node2/cpulist", "4-5,8\n" );
+        tree.write( nodes + "/node2/distance", "21 10\n" );
+        for ( auto const iCpu : { 0, 1, 2, 3 } )
+            tree.write( nodes + "/node0/cpu" + std::to_string( iCpu ), "" );
+        for ( auto const iCpu : { 4, 5, 8 } )
+            tree.write( nodes + "/node2/cpu" + std::to_string( iCpu ), "" );
+        /* node 1 is offline, but its directory may exist nonetheless */
+        tree.write( nodes + "/node1/cpu6", "" );
+        tree.write( "/sys/bus/pci/devices/0000:3b:00.0/numa_node", "2\n" );
+        tree.write( "/sys/bus/pci/devices/0000:af:00.0/numa_node", "-1\n" );
+
+        bCorrect &= check( "Online nodes", getNumaNodes( root ), std::vector< int >{ 0, 2 } );
+        bCorrect &= check( "CPUs of node 2", getNumaNodeCpus( 2, root ), std::vector< int >{ 4, 5, 8 } );
+        bCorrect &= check( "CPUs of missing node 1", getNumaNodeCpus( 1, root ), std::vector< int >() );
+        bCorrect &= check( "Node of CPU 3", getCpuNumaNode( 3, root ), 0 );
+        bCorrect &= check( "Node of CPU 8 behind a gap", getCpuNumaNode( 8, root ), 2 );
+        bCorrect &= check( "Node of CPU 6 on an offline node", getCpuNumaNode( 6, root ), -1 );
+        bCorrect &= check( "Node of unknown CPU 7", getCpuNumaNode( 7, root ), -1 );
+        bCorrect &= check( "Distance 0 -> 2", getNumaDistance( 0, 2, root ), 21 );
+        bCorrect &= check( "Distance 2 -> 0", getNumaDistance( 2, 0, root ), 21 );
+        bCorrect &= check( "Distance 2 -> 2", getNumaDistance( 2, 2, root ), 10 );
+        bCorrect &= check( "Distance to offline node 1", getNumaDistance( 0, 1, root ), -1 );
+        bCorrect &= check( "Node of PCI device 0000:3b:00.0", getPciDeviceNumaNode( 0, 0x3b, 0, root ), 2 );
+        bCorrect &= check( "Node of PCI device 0000:af:00.0", getPciDeviceNumaNode( 0, 0xaf, 0, root ), -1 );
+        bCorrect &= check( "Node of missing PCI device", getPciDeviceNumaNode( 0, 0x3c, 0, root ), -1 );
+
+        #ifdef CUDA_HOST_RUNTIME
+            HostRuntimeDevice device = makeHostRuntimeDevice( "Pascal 20 SMs", 6, 1, 20 );
+            device.properties.pciBusID = 0x3b;
+            getHostRuntime().devices.push_back( device );
+            bCorrect &= check( "Node of device 0", getCudaDeviceNumaNode( 0, root ), 2 );
+        #endif
+    }
+    bCorrect &= check( "Fake tree removed", rmdir( root ), 0 );
+
+    printf( "\nThis machine: nodes %s, current node %i\n",
+            formatList( getNumaNodes() ).c_str(), getCurrentNumaNode() );
+    size_t const nBytes = size_t( 16 ) << 20;
+    for ( auto const node : getNumaNodes() )
+    {
+        void * const memory = allocateNumaMemory( nBytes, node );
+        printf( "  node %i: CPUs %s, distances", node, formatList( getNumaNodeCpus( node ) ).c_str() );
+        for ( auto const other : getNumaNodes() )
+            printf( " %i", getNumaDistance( node, other ) );
+        printf( ", memory bound to it is on node %i\n", getNumaNodeOfAddress( memory ) );
+        freeNumaMemory( memory, nBytes );
+    }
+
+    printf( "correct: %s\n", bCorrect ? "yes" : "NO" );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,138 @@
+/*
+nvcc -x cu -std=c++11 -O3 -DNDEBUG -o benchmarkoccupancy benchmarkoccupancy.cpp && ./benchmarkoccupancy
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkoccupancy benchmarkoccupancy.cpp && ./benchmarkoccupancy
+
+Checks the theoretical occupancy against the values of NVIDIA's occupancy
+calculator for a V100 (7.0) and an RTX 3090 (8.6): cases limited by each of
+threads, blocks, registers and shared memory, the register allocation
+granularity, the shared memory reserved per block since Ampere and kernels
+of which not even a single block fits. Then checks the block sizes chosen
+by findBestCudaBlockSizes and measures how long that search takes. Returns
+non-zero on failure.
+*/
+
+#include "cudaoccupancy.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>                      // memset
+#include <vector>
+
+
+/* only the properties used by the occupancy calculation */
+cudaDeviceProp makeProps
+(
+    int    const major                      ,
+    int    const minor                      ,
+    int    const maxThreadsPerMultiProcessor,
+    size_t const sharedMemPerMultiprocessor
+)
+{
+    cudaDeviceProp props;
+    memset( &props, 0, sizeof( props ) );
+    props.major                       = major;
+    props.minor                       = minor;
+    props.warpSize                    = 32;
+    props.maxThreadsPerBlock          = 1024;
+    props.maxThreadsPerMultiProcessor = maxThreadsPerMultiProcessor;
+    props.regsPerBlock                = 65536;
+    props.regsPerMultiprocessor       = 65536;
+    props.sharedMemPerBlock           = 48 * 1024;
+    props.sharedMemPerMultiprocessor  = sharedMemPerMultiprocessor;
+    return props;
+}
+
+bool checkOccupancy
+(
+    char                const * const   rName            ,
+    cudaDeviceProp      const &         rProps           ,
+    int                 const           rnThreadsPerBlock,
+    CudaKernelResources const &         rResources       ,
+    int                 const           rnExpectedBlocks ,
+    CudaOccupancyLimiter const          rExpectedLimiter
+)
+{
+    CudaOccupancy const result = calcCudaOccupancy( rProps, rnThreadsPerBlock, rResources );
+    bool const bCorrect = result.nBlocksPerMultiprocessor == rnExpectedBlocks &&
+                          result.limiter == rExpectedLimiter &&
+                          result.nWarpsPerMultiprocessor == rnExpectedBlocks * ( ( rnThreadsPerBlock + 31 ) / 32 );
+    printf( "%-44s: %2i blocks, %3.0f %%, %-10s%s\n", rName, result.nBlocksPerMultiprocessor,
+            result.occupancy() * 100, getCudaOccupancyLimiterString( result.limiter ), bCorrect ? "" : "  WRONG" );
+    return bCorrect;
+}
+
+bool checkBestBlockSizes
+(
+    char                const * const   rName     ,
+    cudaDeviceProp      const &         rProps    ,
+    CudaKernelResources const &         rResources,
+    std::vector< int >  const &         rExpected
+)
+{
+    std::vector< CudaOccupancy > const best = findBestCudaBlockSizes( rProps, rResources, 4 );
+    bool bCorrect = best.size() == rExpected.size();
+    printf( "%-44s:", rName );
+    for ( size_t i = 0; i < best.size(); ++i )
+    {
+        printf( " %i", best[i].nThreadsPerBlock );
+        bCorrect = bCorrect && best[i].nThreadsPerBlock == rExpected[i];
+    }
+    printf( "%s%s\n", best.empty() ? " none" : "", bCorrect ? "" : "  WRONG" );
+    return bCorrect;
+}
+
+int main( void )
+{
+    cudaDeviceProp const volta  = makeProps( 7, 0, 2048,  96 * 1024 );
+    cudaDeviceProp const ampere = makeProps( 8, 6, 1536, 100 * 1024 );
+
+    bool bCorrect = true;
+    bCorrect &= checkOccupancy( "7.0, 256 threads, 32 regs", volta, 256, CudaKernelResources( 32 ),
+                                8, CudaOccupancyLimitedByThreads );
+    bCorrect &= checkOccupancy( "7.0, 32 threads, 32 regs", volta, 32, CudaKernelResources( 32 ),
+                                32, CudaOccupancyLimitedByBlocks );
+    /* 37 * 32 registers per warp are rounded up to 1280 */
+    bCorrect &= checkOccupancy( "7.0, 256 threads, 37 regs", volta, 256, CudaKernelResources( 37 ),
+                                6, CudaOccupancyLimitedByRegisters );
+    bCorrect &= checkOccupancy( "7.0, 256 threads, 32 regs, 20 KiB shared", volta, 256, CudaKernelResources( 32, 20 * 1024 ),
+                                4, CudaOccupancyLimitedBySharedMemory );
+    bCorrect &= checkOccupancy( "8.6, 256 threads, 64 regs", ampere, 256, CudaKernelResources( 64 ),
+                                4, CudaOccupancyLimitedByRegisters );
+    bCorrect &= checkOccupancy( "8.6, 256 threads, 32 regs", ampere, 256, CudaKernelResources( 32 ),
+                                6, CudaOccupancyLimitedByThreads );
+    /* 1 KiB is reserved per block, so that 2 instead of 3 blocks fit */
+    bCorrect &= checkOccupancy( "8.6, 128 threads, 32 regs, 33 KiB shared", ampere, 128, CudaKernelResources( 32, 33 * 1024 ),
+                                2, CudaOccupancyLimitedBySharedMemory );
+    bCorrect &= checkOccupancy( "8.6, 64 threads, 32 regs, 0 shared", ampere, 64, CudaKernelResources( 32 ),
+                                16, CudaOccupancyLimitedByBlocks );
+
+    bCorrect &= checkOccupancy( "7.0, 0 threads", volta, 0, CudaKernelResources( 32 ),
+                                0, CudaOccupancyInfeasible );
+    bCorrect &= checkOccupancy( "7.0, 1056 threads", volta, 1056, CudaKernelResources( 32 ),
+                                0, CudaOccupancyInfeasible );
+    bCorrect &= checkOccupancy( "7.0, 256 threads, 256 regs", volta, 256, CudaKernelResources( 256 ),
+                                0, CudaOccupancyInfeasible );
+    bCorrect &= checkOccupancy( "7.0, 1024 threads, 128 regs", volta, 1024, CudaKernelResources( 128 ),
+                                0, CudaOccupancyInfeasible );
+    bCorrect &= checkOccupancy( "7.0, 256 threads, 48 KiB + 1 B shared", volta, 256, CudaKernelResources( 32, 48 * 1024 + 1 ),
+                                0, CudaOccupancyInfeasible );
+
+    /* all sizes with 100 %, i.e. 64 warps, ordered by distance to 256 */
+    bCorrect &= checkBestBlockSizes( "Best for 7.0, 32 regs", volta, CudaKernelResources( 32 ), { 256, 128, 64, 512 } );
+    /* at most 32 warps because of the registers, but not with 96 threads */
+    bCorrect &= checkBestBlockSizes( "Best for 8.6, 64 regs", ampere, CudaKernelResources( 64 ), { 256, 128, 64, 512 } );
+    bCorrect &= checkBestBlockSizes( "Best for 7.0, 256 regs", volta, CudaKernelResources( 256 ), {} );
+
+    int const nRepetitions = 1000;
+    size_t nFound = 0;
+    auto const t0 = std::chrono::high_resolution_clock::now();
+    for ( int i = 0; i < nRepetitions; ++i )
+        nFound += findBestCudaBlockSizes( ampere, CudaKernelResources( 32 + i % 32 ) ).size();
+    auto const t1 = std::chrono::high_resolution_clock::now();
+    printf( "\nfindBestCudaBlockSizes: %.2f us per call (%zu found)\n",
+            std::chrono::duration< double, std::micro >( t1 - t0 ).count() / nRepetitions, nFound );
+
+    printf( "correct: %s\n", bCorrect ? "yes" : "NO" );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
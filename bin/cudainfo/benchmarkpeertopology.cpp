@@ -0,0 +1,177 @@
+/*
+nvcc -x cu -std=c++11 -O3 -DNDEBUG -o benchmarkpeertopology benchmarkpeertopology.cpp && ./benchmarkpeertopology
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkpeertopology benchmarkpeertopology.cpp && ./benchmarkpeertopology
+
+Checks the routing of copies between devices against synthetic topologies,
+e.g. a ring, where opposite devices have to go over a neighbour, and pairs
+of NVLinked devices behind PCIe switches. Then copies 64 MiB between
+MirroredVectors on the first and every other device of the real topology,
+or without nvcc of 4 emulated devices connected as a ring, and measures the
+bandwidth. For the emulated ring it is checked that no copy was staged
+through host memory, that peer access was only enabled for the links the
+copies were routed over, that a copy inside a device is no peer copy and
+that a copy over a link, for which peer access can't be enabled, falls back
+to a copy through host memory. Returns non-zero on failure.
+*/
+
+#include "cudacommon.hpp"               // MirroredVector, copyCudaPeerRouted
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <utility>                      // pair
+#include <vector>
+
+
+struct ExpectedRoute
+{
+    int                iSource ;
+    int                iTarget ;
+    /* intermediate device, -1 for a direct copy, -2 for through the host */
+    int                iVia    ;
+};
+
+static char const * const ringTopology =
+    "X 0 - 0\n"
+    "0 X 0 -\n"
+    "- 0 X 0\n"
+    "0 - 0 X\n";
+
+/* NVLinked pairs 0-1 and 2-3, and only 1 and 2 behind a common PCIe switch */
+static char const * const pairsTopology =
+    "X 0 - -\n"
+    "0 X 2 -\n"
+    "- 2 X 0\n"
+    "- - 0 X\n";
+
+/* all connected, so that every copy is direct, even 0 -> 3, for which
+ * the detour over 1 has better ranks */
+static char const * const meshTopology =
+    "X 0 1 5\n"
+    "0 X 1 0\n"
+    "1 1 X 1\n"
+    "5 0 1 X\n";
+
+bool checkRoutes
+(
+    char                const * const   rName       ,
+    char                const * const   rDescription,
+    std::vector< ExpectedRoute > const & rExpected
+)
+{
+    CudaPeerTopology const topology = parseCudaPeerTopology( rDescription );
+    printf( "%s:\n", rName );
+    printCudaPeerTopology( topology );
+    bool bCorrect = true;
+    for ( auto const & expected : rExpected )
+    {
+        CudaPeerRoute const route = routeCudaPeerCopy( topology, expected.iSource, expected.iTarget );
+        int const iVia = route.bThroughHost ? -2 : route.devices.size() == 3 ? route.devices[1] : -1;
+        bool const bOk = iVia == expected.iVia && route.devices.front() == expected.iSource &&
+                         route.devices.back() == expected.iTarget;
+        printf( "  %i -> %i: %s%s\n", expected.iSource, expected.iTarget,
+                iVia == -2 ? "host" : iVia == -1 ? "direct" : ( "via " + std::to_string( iVia ) ).c_str(),
+                bOk ? "" : "  WRONG" );
+        bCorrect = bCorrect && bOk;
+    }
+    return bCorrect;
+}
+
+int main( void )
+{
+    bool bCorrect = true;
+    bCorrect &= checkRoutes( "Ring", ringTopology, {
+        { 0, 1, -1 }, { 0, 2, 1 }, { 1, 3, 0 }, { 2, 0, 1 }, { 3, 1, 0 }, { 2, 2, -1 } } );
+    bCorrect &= checkRoutes( "NVLink pairs", pairsTopology, {
+        { 0, 1, -1 }, { 0, 2, 1 }, { 1, 3, 2 }, { 0, 3, -2 }, { 3, 0, -2 } } );
+    bCorrect &= checkRoutes( "Mesh", meshTopology, {
+        { 0, 3, -1 }, { 2, 3, -1 }, { 3, 1, -1 } } );
+
+    for ( auto const description : { "X 0\n0", "X 0\n0 0\n", "X -1\n- X\n", "X a\n- X\n" } )
+    {
+        bool bThrown = false;
+        try { parseCudaPeerTopology( description ); }
+        catch ( std::invalid_argument const & ) { bThrown = true; }
+        bCorrect = bCorrect && bThrown;
+    }
+    printf( "Invalid descriptions rejected: %s\n\n", bCorrect ? "yes" : "NO" );
+
+    #ifdef CUDA_HOST_RUNTIME
+        for ( int i = 0; i < 4; ++i )
+            getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Pascal 20 SMs", 6, 1, 20 ) );
+        setHostRuntimePeerTopology( parseCudaPeerTopology( ringTopology ) );
+    #endif
+    CudaPeerTopology const & topology = getCudaPeerTopology();
+    printf( "Devices:\n" );
+    printCudaPeerTopology( topology );
+
+    size_t const nElements = size_t( 16 ) << 20;
+    std::vector< MirroredVector< float > > vectors;
+    for ( int iDevice = 0; iDevice < topology.nDevices; ++iDevice )
+    {
+        CudaDeviceScope const scope( iDevice );
+        vectors.emplace_back( nElements, cudaStream_t( 0 ), false, MirroredHostPinned );
+    }
+    if ( vectors.empty() )
+        return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    for ( size_t i = 0; i < nElements; ++i )
+        vectors[0].host[i] = (float)( i % 1000 );
+    vectors[0].push();
+
+    for ( int iDevice = 1; iDevice < topology.nDevices; ++iDevice )
+    {
+        CudaPeerRoute const route = routeCudaPeerCopy( topology, 0, iDevice );
+        auto const t0 = std::chrono::high_resolution_clock::now();
+        vectors[ iDevice ].copyFromDevice( vectors[0] );
+        auto const t1 = std::chrono::high_resolution_clock::now();
+        double const seconds = std::chrono::duration< double >( t1 - t0 ).count();
+
+        vectors[ iDevice ].pop();
+        bool bCopied = true;
+        for ( size_t i = 0; i < nElements; ++i )
+            bCopied = bCopied && vectors[ iDevice ].host[i] == (float)( i % 1000 );
+        bCorrect = bCorrect && bCopied;
+        printf( "0 -> %i (%s): %8.3f ms, %6.2f GiB/s%s\n", iDevice,
+                route.bThroughHost ? "host" : route.devices.size() == 3 ? "routed" : "direct",
+                seconds * 1e3, nElements * sizeof( float ) / seconds / ( 1 << 30 ), bCopied ? "" : "  WRONG" );
+    }
+
+    #ifdef CUDA_HOST_RUNTIME
+        HostRuntime & runtime = getHostRuntime();
+        bool const bNoStaging = runtime.nHostStagedPeerCopies == 0;
+        printf( "Copies staged through the host: %u\n", runtime.nHostStagedPeerCopies.load() );
+        bCorrect = bCorrect && bNoStaging;
+
+        /* 0 -> 1 and 0 -> 3 direct, 0 -> 2 over 1 */
+        bool const bLazy = runtime.enabledPeerAccesses ==
+            std::set< std::pair< int, int > >{ { 0, 1 }, { 1, 2 }, { 0, 3 } };
+        printf( "Peer access only enabled for the routed links: %s\n", bLazy ? "yes" : "NO" );
+        bCorrect = bCorrect && bLazy;
+
+        unsigned int const nPeerCopies = runtime.nPeerCopies;
+        MirroredVector< float > local( nElements, cudaStream_t( 0 ), false, MirroredHostPinned );
+        local.copyFromDevice( vectors[0] );
+        local.pop();
+        bool const bLocal = runtime.nPeerCopies == nPeerCopies && local.host[ nElements - 1 ] == vectors[0].host[ nElements - 1 ];
+        printf( "Copy inside device 0 without peer copy: %s\n", bLocal ? "yes" : "NO" );
+        bCorrect = bCorrect && bLocal;
+
+        /* the link 2 -> 3 vanishes after the topology was queried, so that
+         * enabling peer access for it fails */
+        runtime.peerPerformanceRanks.erase( std::make_pair( 2, 3 ) );
+        vectors[2].copyFromDevice( vectors[0] );
+        bool bFallback = true;
+        try { vectors[3].copyFromDevice( vectors[2] ); }
+        catch ( std::exception const & ) { bFallback = false; }
+        vectors[3].pop();
+        bFallback = bFallback && runtime.nHostStagedPeerCopies == 1 &&
+                    vectors[3].host[ nElements - 1 ] == vectors[0].host[ nElements - 1 ];
+        printf( "Copy through the host if peer access fails: %s\n", bFallback ? "yes" : "NO" );
+        bCorrect = bCorrect && bFallback;
+    #endif
+    printf( "correct: %s\n", bCorrect ? "yes" : "NO" );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,102 @@
+/*
+nvcc -x cu -std=c++11 -O3 -DNDEBUG -o benchmarkshardedvector benchmarkshardedvector.cpp && ./benchmarkshardedvector
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkshardedvector benchmarkshardedvector.cpp && ./benchmarkshardedvector
+
+Shards 64 Mi floats over all devices, or without nvcc over 4 emulated
+devices of different size, and measures push, halo exchange, pop and
+gather. A stand-in for a stencil kernel writes twice the index into the
+owned elements of each shard, so that it can be checked that every halo
+holds the values of its owner after the exchange and that the gathered
+array is complete. The last emulated device has an unknown architecture,
+i.e. no peak FLOPS, and therefore gets an empty shard.
+*/
+
+#include "cudashardedvector.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+
+/* float holds integers up to 2^24 exactly, so the index is taken modulo 2^23 */
+inline __host__ __device__ float expectedValue( size_t const i )
+{
+    return (float)( i % ( 1u << 23 ) * 2 );
+}
+
+#ifdef __CUDACC__
+__global__ void kernelWriteOwned( float * const x, size_t const iBegin, size_t const n )
+{
+    for ( size_t i = blockIdx.x * blockDim.x + threadIdx.x; i < n; i += gridDim.x * blockDim.x )
+        x[i] = expectedValue( iBegin + i );
+}
+#endif
+
+template< typename T_Functor >
+double measureSeconds( T_Functor const & functor )
+{
+    auto const t0 = std::chrono::high_resolution_clock::now();
+    functor();
+    auto const t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration< double >( t1 - t0 ).count();
+}
+
+int main( void )
+{
+    #ifdef CUDA_HOST_RUNTIME
+        getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Pascal 20 SMs", 6, 1, 20 ) );
+        getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Pascal 40 SMs", 6, 1, 40 ) );
+        getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Volta 80 SMs" , 7, 0, 80 ) );
+        getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Unknown"      , 1, 0, 80 ) );
+    #endif
+
+    size_t const nElements = size_t( 64 ) << 20;
+    size_t const nHalo     = 1024;
+    ShardedMirroredVector< float > x( nElements, {}, nHalo, 256 );
+    for ( size_t iShard = 0; iShard < x.shardCount(); ++iShard )
+    {
+        auto const & shard = x.shard( iShard );
+        printf( "Shard %zu on device %i: [%zu, %zu) with halos %zu + %zu\n", iShard, shard.iDevice,
+                shard.iBegin, shard.iEnd, shard.nHaloLeft, shard.nHaloRight );
+    }
+
+    for ( size_t i = 0; i < nElements; ++i )
+        x[i] = (float) i;
+    double const tPush = measureSeconds( [&](){ x.push(); } );
+
+    for ( size_t iShard = 0; iShard < x.shardCount(); ++iShard )
+    {
+        auto const & shard = x.shard( iShard );
+        #ifdef __CUDACC__
+            CUDA_ERROR( cudaSetDevice( shard.iDevice ) );
+            kernelWriteOwned<<< 256, 256, 0, shard.stream >>>( shard.gpuOwned(), shard.iBegin, shard.size() );
+        #else
+            for ( size_t i = 0; i < shard.size(); ++i )
+                shard.gpuOwned()[i] = expectedValue( shard.iBegin + i );
+        #endif
+    }
+    double const tExchange = measureSeconds( [&](){ x.exchangeHalos(); } );
+    double const tPop      = measureSeconds( [&](){ x.pop(); } );
+
+    bool bCorrect = true;
+    for ( size_t iShard = 0; iShard < x.shardCount(); ++iShard )
+    {
+        auto const & shard = x.shard( iShard );
+        for ( size_t i = 0; i < shard.data.size(); ++i )
+            bCorrect = bCorrect && shard.data.host[i] == expectedValue( shard.iFirst() + i );
+    }
+
+    std::vector< float > gathered( nElements );
+    double const tGather = measureSeconds( [&](){ x.gather( gathered.data() ); } );
+    for ( size_t i = 0; i < nElements; ++i )
+        bCorrect = bCorrect && gathered[i] == expectedValue( i );
+
+    double const nGiB = nElements * sizeof( float ) / double( 1 << 30 );
+    printf( "push     : %8.3f ms, %6.2f GiB/s\n", tPush   * 1e3, nGiB / tPush );
+    printf( "exchange : %8.3f ms\n"             , tExchange * 1e3 );
+    printf( "pop      : %8.3f ms, %6.2f GiB/s\n", tPop    * 1e3, nGiB / tPop );
+    printf( "gather   : %8.3f ms, %6.2f GiB/s\n", tGather * 1e3, nGiB / tGather );
+    printf( "correct  : %s\n", bCorrect ? "yes" : "NO" );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,176 @@
+/*
+nvcc -x cu -std=c++11 -O3 -DNDEBUG -o benchmarkstreampipeline benchmarkstreampipeline.cpp && ./benchmarkstreampipeline
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkstreampipeline benchmarkstreampipeline.cpp && ./benchmarkstreampipeline
+
+Compares push, kernel, pop on the whole vector with the chunked
+multi-stream pipeline for a memory-bound kernel. Without nvcc the emulated
+runtime is used, where each stream is a thread, so that the speedup shows
+how well the schedule overlaps, not real PCIe numbers. With fewer cores
+than streams the emulated pipeline can't overlap and is slower.
+
+After the measurements, both variants are run once more on known values
+and every element is checked to be 2 x + 1, also for a size which isn't a
+multiple of the chunk size, with odd explicit chunk sizes, so that
+scheduling bugs show up on the emulation, and for a vector grown since its
+last push. Returns non-zero on mismatch.
+*/
+
+#include "cudacommon.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+
+#ifdef __CUDACC__
+    __global__ void kernelScale( float * const x, size_t const n )
+    {
+        for ( size_t i = blockIdx.x * blockDim.x + threadIdx.x; i < n; i += gridDim.x * blockDim.x )
+            x[i] = 2.0f * x[i] + 1.0f;
+    }
+
+    void launchScale( float * const x, size_t const n, cudaStream_t const stream )
+    {
+        kernelScale<<< 256, 256, 0, stream >>>( x, n );
+    }
+#else
+    struct ScaleChunk
+    {
+        float * x;
+        size_t  n;
+    };
+
+    void scaleChunk( void * const rpChunk )
+    {
+        ScaleChunk const chunk = *(ScaleChunk*) rpChunk;
+        delete (ScaleChunk*) rpChunk;
+        for ( size_t i = 0; i < chunk.n; ++i )
+            chunk.x[i] = 2.0f * chunk.x[i] + 1.0f;
+    }
+
+    void launchScale( float * const x, size_t const n, cudaStream_t const stream )
+    {
+        CUDA_ERROR( cudaLaunchHostFunc( stream, scaleChunk, new ScaleChunk{ x, n } ) );
+    }
+#endif
+
+template< typename T_Functor >
+double measureBest( int const nRepeats, T_Functor const & functor )
+{
+    double tMin = 0;
+    for ( int iRepeat = 0; iRepeat < nRepeats; ++iRepeat )
+    {
+        auto const t0 = std::chrono::high_resolution_clock::now();
+        functor();
+        auto const t1 = std::chrono::high_resolution_clock::now();
+        double const t = std::chrono::duration< double >( t1 - t0 ).count();
+        if ( iRepeat == 0 || t < tMin )
+            tMin = t;
+    }
+    return tMin;
+}
+
+inline float initialValue( size_t const i )
+{
+    return (float)( i % 1000 );
+}
+
+void initialize( MirroredVector< float > & rVector )
+{
+    for ( size_t i = 0; i < rVector.nElements; ++i )
+        rVector.host[i] = initialValue( i );
+}
+
+/* @return number of elements which aren't 2 x + 1 of their initial value */
+size_t countWrong( MirroredVector< float > const & rVector )
+{
+    size_t nWrong = 0;
+    for ( size_t i = 0; i < rVector.nElements; ++i )
+        nWrong += rVector.host[i] != 2.0f * initialValue( i ) + 1.0f;
+    return nWrong;
+}
+
+int main( void )
+{
+    #ifdef CUDA_HOST_RUNTIME
+        getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Host emulation", 6, 1, 20 ) );
+    #endif
+
+    int iDevice = 0;
+    cudaDeviceProp props;
+    CUDA_ERROR( cudaGetDevice( &iDevice ) );
+    CUDA_ERROR( cudaGetDeviceProperties( &props, iDevice ) );
+
+    int const nRepeats = 5;
+    /* the second one isn't a multiple of any chunk size */
+    std::vector< size_t > const sizes = { size_t( 4 ) << 20, ( size_t( 10 ) << 20 ) + 333 * sizeof( float ),
+                                          size_t( 64 ) << 20, size_t( 256 ) << 20 };
+    auto const scale = []( float * const x, size_t const n, size_t, cudaStream_t const stream )
+    {
+        launchScale( x, n, stream );
+    };
+    bool bCorrect = true;
+
+    CudaStreamPipeline pipeline( props );
+    printf( "%s: %d copy engines, %d streams\n\n", props.name, props.asyncEngineCount, pipeline.nStreams() );
+    printf( "| size               | chunk/MiB | sequential / ms | pipelined / ms | speedup |\n" );
+    printf( "|--------------------|-----------|-----------------|----------------|---------|\n" );
+    for ( auto const nBytes : sizes )
+    {
+        MirroredVector< float > vector( nBytes / sizeof( float ), 0, false, MirroredHostPinned );
+        memset( vector.host, 0, nBytes );
+
+        double const tSequential = measureBest( nRepeats, [&]()
+        {
+            vector.push();
+            launchScale( vector.gpu, vector.nElements, 0 );
+            vector.pop();
+        } );
+        double const tPipelined = measureBest( nRepeats, [&](){ pipeline.run( vector, scale ); } );
+
+        initialize( vector );
+        vector.push();
+        launchScale( vector.gpu, vector.nElements, 0 );
+        vector.pop();
+        size_t const nWrongSequential = countWrong( vector );
+
+        initialize( vector );
+        pipeline.run( vector, scale );
+        size_t const nWrongPipelined = countWrong( vector );
+        bCorrect &= nWrongSequential == 0 && nWrongPipelined == 0;
+
+        printf( "| %18s | %9.2f | %15.2f | %14.2f | %7.2f |\n",
+                prettyPrintBytes( nBytes ).c_str(),
+                planCudaPipeline( props, nBytes ).nChunkBytes / 1048576.0,
+                tSequential * 1e3, tPipelined * 1e3, tSequential / tPipelined );
+        if ( nWrongSequential > 0 || nWrongPipelined > 0 )
+            printf( "  WRONG: %zu sequential and %zu pipelined elements\n", nWrongSequential, nWrongPipelined );
+    }
+
+    /* chunk sizes not dividing the size and not aligned to 256 B */
+    MirroredVector< float > vector( 1000003, 0, false, MirroredHostPinned );
+    for ( auto const nChunkElements : { size_t( 1 ) << 16, size_t( 99991 ), size_t( 1000002 ), size_t( 2000000 ) } )
+    {
+        initialize( vector );
+        pipeline.run( vector.host, vector.gpu, vector.nElements, nChunkElements, scale );
+        size_t const nWrong = countWrong( vector );
+        if ( nWrong > 0 )
+            printf( "WRONG: %zu elements with chunks of %zu elements\n", nWrong, nChunkElements );
+        bCorrect &= nWrong == 0;
+    }
+
+    /* grown on the host after the last push, so that run has to grow the device buffer */
+    MirroredVector< float > grown( 4, 0, false, MirroredHostPinned );
+    grown.push();
+    grown.resize( 1000003 );
+    initialize( grown );
+    pipeline.run( grown, scale );
+    size_t const nWrongGrown = countWrong( grown );
+    if ( nWrongGrown > 0 )
+        printf( "WRONG: %zu elements after growing the vector\n", nWrongGrown );
+    bCorrect &= nWrongGrown == 0;
+
+    printf( "\ncorrect: %s\n", bCorrect ? "yes" : "NO" );
+    return bCorrect ? EXIT_SUCCESS : EXIT_FAILURE;
+}
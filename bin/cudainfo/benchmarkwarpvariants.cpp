@@ -0,0 +1,285 @@
+/*
+nvcc -x cu -std=c++11 -O3 -DNDEBUG -o benchmarkwarpvariants benchmarkwarpvariants.cpp && ./benchmarkwarpvariants
+g++ -std=c++11 -O3 -pthread -DNDEBUG -Wall -Wextra -o benchmarkwarpvariants benchmarkwarpvariants.cpp && ./benchmarkwarpvariants
+
+Usage: benchmarkwarpvariants [<results.tsv> [<header>]]
+
+Measures every formulation of warpReduceSum, warpReduceCumSum and the
+packed byte additions from cudawarpvariants.hpp for several sizes. The
+emulated versions are always measured with the architecture "host". With
+nvcc, the device versions are also measured with the architecture of the
+current device, e.g. "sm_61". The results are appended to results.tsv,
+which defaults to warpvariants.tsv. The header, which defaults to
+gpuinfovariants.hpp, is rewritten from all results collected so far.
+gpuinfo.cu then picks the fastest formulations when compiled with:
+  -DGPUINFO_VARIANTS_HEADER='"cudainfo/gpuinfovariants.hpp"'
+*/
+
+#include "cudacommon.hpp"
+#include "cudabenchmarkharness.hpp"
+#include "cudawarpvariants.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>                      // memcpy
+#include <map>
+#include <string>
+#include <vector>
+
+
+/* all strategies of a group have to produce the same output */
+struct VariantBuffers
+{
+    std::vector< int32_t  > x;
+    std::vector< uint32_t > a, b;
+    /* group -> strategy -> output of the last run */
+    std::map< std::string, std::map< std::string, std::vector< int32_t > > > outputs;
+};
+
+template< typename T_Functor >
+double measureSeconds( T_Functor const & functor )
+{
+    auto const t0 = std::chrono::high_resolution_clock::now();
+    functor();
+    auto const t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration< double >( t1 - t0 ).count();
+}
+
+void addEmulatedStrategies( BenchmarkSuite & suite, VariantBuffers & buffers )
+{
+    #define TMP_ADD_REDUCE( STRATEGY, FUNCTION )                                        \
+    suite.add( "WARP_REDUCE_SUM", STRATEGY, [&buffers]( uint64_t const n )              \
+    {                                                                                   \
+        std::vector< int32_t > & out = buffers.outputs[ "WARP_REDUCE_SUM" ][ STRATEGY ]; \
+        out.resize( n / 32 );                                                           \
+        return measureSeconds( [&]()                                                    \
+        {                                                                               \
+            for ( uint64_t i = 0; i < n; i += 32 )                                      \
+            {                                                                           \
+                int32_t lanes[32];                                                      \
+                memcpy( lanes, &buffers.x[i], sizeof( lanes ) );                        \
+                out[ i / 32 ] = FUNCTION( lanes );                                      \
+            }                                                                           \
+        } );                                                                            \
+    } );
+    TMP_ADD_REDUCE( "UNROLLED", emulatedWarpReduceSumUnrolled )
+    TMP_ADD_REDUCE( "LOOP"    , emulatedWarpReduceSumLoop     )
+    #undef TMP_ADD_REDUCE
+
+    #define TMP_ADD_SCAN( STRATEGY, FUNCTION )                                          \
+    suite.add( "WARP_REDUCE_CUMSUM", STRATEGY, [&buffers]( uint64_t const n )           \
+    {                                                                                   \
+        std::vector< int32_t > & out = buffers.outputs[ "WARP_REDUCE_CUMSUM" ][ STRATEGY ]; \
+        out.resize( n );                                                                \
+        return measureSeconds( [&]()                                                    \
+        {                                                                               \
+            for ( uint64_t i = 0; i < n; i += 32 )                                      \
+            {                                                                           \
+                int32_t (&lanes)[32] = *reinterpret_cast< int32_t (*)[32] >( &out[i] ); \
+                memcpy( lanes, &buffers.x[i], sizeof( lanes ) );                        \
+                FUNCTION( lanes );                                                      \
+            }                                                                           \
+        } );                                                                            \
+    } );
+    TMP_ADD_SCAN( "SHFL_WIDTH" , emulatedWarpReduceCumSumShflWidth  )
+    TMP_ADD_SCAN( "LOOP"       , emulatedWarpReduceCumSumLoop       )
+    TMP_ADD_SCAN( "MASKED_LANE", emulatedWarpReduceCumSumMaskedLane )
+    #undef TMP_ADD_SCAN
+
+    #define TMP_ADD_VADD( STRATEGY, FUNCTION )                                          \
+    suite.add( "VECTOR_ADD", STRATEGY, [&buffers]( uint64_t const n )                   \
+    {                                                                                   \
+        std::vector< int32_t > & out = buffers.outputs[ "VECTOR_ADD" ][ STRATEGY ];      \
+        out.resize( n );                                                                \
+        return measureSeconds( [&]()                                                    \
+        {                                                                               \
+            for ( uint64_t i = 0; i < n; ++i )                                          \
+                out[i] = (int32_t) FUNCTION( buffers.a[i], buffers.b[i] );              \
+        } );                                                                            \
+    } );
+    TMP_ADD_VADD( "SCALAR"    , emulatedVectorAddScalar    )
+    TMP_ADD_VADD( "SIMD_VIDEO", emulatedVectorAddSimdVideo )
+    #undef TMP_ADD_VADD
+}
+
+#ifdef __CUDACC__
+
+int const nBenchmarkThreads = 256;
+
+template< int T_Variant >
+__global__ void kernelWarpReduceSum( int32_t const * const x, int32_t * const out, uint64_t const n )
+{
+    /* n and the stride are multiples of 32, i.e. whole warps take part.
+     * All lanes are stored, because they also have to agree. */
+    for ( uint64_t i = blockIdx.x * blockDim.x + threadIdx.x; i < n; i += gridDim.x * blockDim.x )
+    {
+        out[i] = T_Variant == GPUINFO_WARP_REDUCE_SUM_LOOP ?
+                 warpReduceSumLoop( x[i] ) : warpReduceSumUnrolled( x[i] );
+    }
+}
+
+template< int T_Variant >
+__global__ void kernelWarpReduceCumSum( int32_t const * const x, int32_t * const out, uint64_t const n )
+{
+    for ( uint64_t i = blockIdx.x * blockDim.x + threadIdx.x; i < n; i += gridDim.x * blockDim.x )
+    {
+        out[i] = T_Variant == GPUINFO_WARP_REDUCE_CUMSUM_LOOP        ? warpReduceCumSumLoop      ( x[i] ) :
+                 T_Variant == GPUINFO_WARP_REDUCE_CUMSUM_MASKED_LANE ? warpReduceCumSumMaskedLane( x[i] ) :
+                                                                       warpReduceCumSumShflWidth ( x[i] );
+    }
+}
+
+template< int T_Variant >
+__global__ void kernelVectorAdd( uint32_t const * const a, uint32_t const * const b, int32_t * const out, uint64_t const n )
+{
+    for ( uint64_t i = blockIdx.x * blockDim.x + threadIdx.x; i < n; i += gridDim.x * blockDim.x )
+    {
+        out[i] = T_Variant == GPUINFO_VECTOR_ADD_SIMD_VIDEO ?
+                 vectorAddSimdVideo( a[i], b[i] ) : vectorAddScalar( a[i], b[i] );
+    }
+}
+
+/* measures the kernel launched by rLaunch with events and downloads out */
+template< typename T_Launch >
+double measureKernel( MirroredVector< int32_t > & out, T_Launch const & rLaunch )
+{
+    cudaEvent_t start, stop;
+    CUDA_ERROR( cudaEventCreate( &start ) );
+    CUDA_ERROR( cudaEventCreate( &stop ) );
+    CUDA_ERROR( cudaEventRecord( start ) );
+    rLaunch();
+    CUDA_ERROR( cudaEventRecord( stop ) );
+    CUDA_ERROR( cudaEventSynchronize( stop ) );
+    float milliseconds = 0;
+    CUDA_ERROR( cudaEventElapsedTime( &milliseconds, start, stop ) );
+    CUDA_ERROR( cudaEventDestroy( start ) );
+    CUDA_ERROR( cudaEventDestroy( stop ) );
+    out.pop();
+    return milliseconds / 1e3;
+}
+
+void addDeviceStrategies
+(
+    BenchmarkSuite                            & suite   ,
+    VariantBuffers                            & buffers ,
+    std::map< std::string, MirroredVector< int32_t > > & outputs,
+    MirroredVector< int32_t  >                & x       ,
+    MirroredVector< uint32_t >                & a       ,
+    MirroredVector< uint32_t >                & b
+)
+{
+    int nBlocks = 0;
+    CUDA_ERROR( cudaDeviceGetAttribute( &nBlocks, cudaDevAttrMultiProcessorCount, 0 ) );
+    nBlocks *= 8;
+
+    #define TMP_ADD( GROUP, STRATEGY, KERNEL, ... )                                     \
+    suite.add( GROUP, STRATEGY, [&, nBlocks]( uint64_t const n )                        \
+    {                                                                                   \
+        MirroredVector< int32_t > & out = outputs[ GROUP "_" STRATEGY ];                \
+        out.resize( n );                                                                \
+        double const t = measureKernel( out, [&](){                                     \
+            KERNEL<<< nBlocks, nBenchmarkThreads >>>( __VA_ARGS__, out.gpu, n ); } );   \
+        buffers.outputs[ GROUP ][ STRATEGY ].assign( out.host, out.host + n );         \
+        return t;                                                                       \
+    } );
+    TMP_ADD( "WARP_REDUCE_SUM"   , "UNROLLED"   , kernelWarpReduceSum   < GPUINFO_WARP_REDUCE_SUM_UNROLLED       >, x.gpu )
+    TMP_ADD( "WARP_REDUCE_SUM"   , "LOOP"       , kernelWarpReduceSum   < GPUINFO_WARP_REDUCE_SUM_LOOP           >, x.gpu )
+    TMP_ADD( "WARP_REDUCE_CUMSUM", "SHFL_WIDTH" , kernelWarpReduceCumSum< GPUINFO_WARP_REDUCE_CUMSUM_SHFL_WIDTH  >, x.gpu )
+    TMP_ADD( "WARP_REDUCE_CUMSUM", "LOOP"       , kernelWarpReduceCumSum< GPUINFO_WARP_REDUCE_CUMSUM_LOOP        >, x.gpu )
+    TMP_ADD( "WARP_REDUCE_CUMSUM", "MASKED_LANE", kernelWarpReduceCumSum< GPUINFO_WARP_REDUCE_CUMSUM_MASKED_LANE >, x.gpu )
+    TMP_ADD( "VECTOR_ADD"        , "SCALAR"     , kernelVectorAdd       < GPUINFO_VECTOR_ADD_SCALAR              >, a.gpu, b.gpu )
+    TMP_ADD( "VECTOR_ADD"        , "SIMD_VIDEO" , kernelVectorAdd       < GPUINFO_VECTOR_ADD_SIMD_VIDEO          >, a.gpu, b.gpu )
+    #undef TMP_ADD
+}
+
+#endif
+
+/* @return number of groups whose strategies disagree */
+int checkOutputs( VariantBuffers const & buffers )
+{
+    int nDiffering = 0;
+    for ( auto const & group : buffers.outputs )
+    {
+        auto const & reference = group.second.begin()->second;
+        for ( auto const & output : group.second )
+        {
+            if ( output.second != reference )
+            {
+                printf( "Output of %s %s differs!\n", group.first.c_str(), output.first.c_str() );
+                ++nDiffering;
+                break;
+            }
+        }
+    }
+    return nDiffering;
+}
+
+int main( int argc, char ** argv )
+{
+    std::string const resultsPath = argc > 1 ? argv[1] : "warpvariants.tsv";
+    std::string const headerPath  = argc > 2 ? argv[2] : "gpuinfovariants.hpp";
+    int const nRepeats = 10;
+
+    uint64_t const nMaxElements = uint64_t( 1 ) << 24;
+    VariantBuffers buffers;
+    buffers.x.resize( nMaxElements );
+    buffers.a.resize( nMaxElements );
+    buffers.b.resize( nMaxElements );
+    for ( uint64_t i = 0; i < nMaxElements; ++i )
+    {
+        buffers.x[i] = rand() % 1000;
+        buffers.a[i] = (uint32_t) rand() * 2654435761u;
+        buffers.b[i] = (uint32_t) rand() * 2246822519u;
+    }
+
+    std::vector< BenchmarkResult > results;
+    {
+        BenchmarkSuite suite( "host" );
+        addEmulatedStrategies( suite, buffers );
+        auto const hostResults = suite.run( { uint64_t( 1 ) << 12, uint64_t( 1 ) << 16, uint64_t( 1 ) << 20 }, nRepeats );
+        results.insert( results.end(), hostResults.begin(), hostResults.end() );
+        printf( "\n" );
+    }
+    int nDiffering = checkOutputs( buffers );
+
+    #ifdef __CUDACC__
+    {
+        cudaDeviceProp props;
+        CUDA_ERROR( cudaGetDeviceProperties( &props, 0 ) );
+        std::stringstream architecture;
+        architecture << "sm_" << props.major << props.minor;
+
+        MirroredVector< int32_t  > x( nMaxElements );
+        MirroredVector< uint32_t > a( nMaxElements ), b( nMaxElements );
+        memcpy( x.host, buffers.x.data(), nMaxElements * sizeof( int32_t  ) );
+        memcpy( a.host, buffers.a.data(), nMaxElements * sizeof( uint32_t ) );
+        memcpy( b.host, buffers.b.data(), nMaxElements * sizeof( uint32_t ) );
+        x.push(); a.push(); b.push();
+
+        buffers.outputs.clear();
+        std::map< std::string, MirroredVector< int32_t > > outputs;
+        BenchmarkSuite suite( architecture.str() );
+        addDeviceStrategies( suite, buffers, outputs, x, a, b );
+        auto const deviceResults = suite.run( { uint64_t( 1 ) << 16, uint64_t( 1 ) << 20, nMaxElements }, nRepeats );
+        results.insert( results.end(), deviceResults.begin(), deviceResults.end() );
+        printf( "\n" );
+        nDiffering += checkOutputs( buffers );
+    }
+    #endif
+
+    if ( nDiffering > 0 )
+    {
+        printf( "Not saving the results, because some strategies are wrong.\n" );
+        return 1;
+    }
+    appendBenchmarkResults( resultsPath, results );
+    auto const allResults = loadBenchmarkResults( resultsPath );
+    writeBenchmarkSelectionHeader( headerPath, allResults, "GPUINFO_" );
+    auto const selection = selectFastestStrategies( allResults );
+    for ( auto const & selected : selection )
+        printf( "%-8s %-20s -> %s\n", selected.first.first.c_str(), selected.first.second.c_str(), selected.second.c_str() );
+    printf( "Appended %lu results to %s, wrote %s\n", (unsigned long) results.size(),
+            resultsPath.c_str(), headerPath.c_str() );
+    return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * Writer collecting output in a fixed buffer and handing it to the FILE
+ * only when the buffer is full or on flush, so that e.g. a report of
+ * hundreds of lines results in one write instead of one per printf.
+ * Numbers are formatted with cudaformat.hpp, i.e. nothing is allocated:
+ *
+ *   BufferedWriter out( stdout );
+ *   out.write( "\"clockRate\":" ).writeFloat( 1.62f ).put( '\n' );
+ *   if ( ! out.flush() )
+ *       ...
+ *
+ * JSON strings and CSV fields can be written escaped. The writer can be
+ * reused for another file with setFile.
+ */
+
+#pragma once
+
+#include <cstdint>                      // uint64_t
+#include <cstdio>                       // FILE, fwrite, fflush
+#include <cstring>                      // memcpy, strlen
+
+#include "cudaformat.hpp"               // formatInteger, formatFloat, formatBytes
+
+
+class BufferedWriter
+{
+public:
+    static size_t const nBufferBytes = 64 * 1024;
+
+    inline explicit BufferedWriter( FILE * const rFile = stdout )
+     : mFile( rFile ), mnBuffered( 0 ), mbFailed( false )
+    {}
+
+    inline ~BufferedWriter(){ flush(); }
+
+    BufferedWriter( BufferedWriter const & ) = delete;
+    BufferedWriter & operator=( BufferedWriter const & ) = delete;
+
+    /**
+     * @return false if any write to the file failed since the writer was
+     *         created or the last call to setFile
+     */
+    inline bool flush( void )
+    {
+        if ( mnBuffered > 0 && mFile != NULL )
+        {
+            if ( fwrite( mBuffer, 1, mnBuffered, mFile ) != mnBuffered )
+                mbFailed = true;
+        }
+        mnBuffered = 0;
+        if ( mFile != NULL && fflush( mFile ) != 0 )
+            mbFailed = true;
+        return ! mbFailed;
+    }
+
+    inline void setFile( FILE * const rFile )
+    {
+        flush();
+        mFile    = rFile;
+        mbFailed = false;
+    }
+
+    inline bool good( void ) const { return ! mbFailed; }
+
+    inline BufferedWriter & write( char const * const rData, size_t const rnBytes )
+    {
+        if ( mnBuffered + rnBytes > nBufferBytes )
+        {
+            flush();
+            /* don't copy data which wouldn't fit anyway */
+            if ( rnBytes > nBufferBytes )
+            {
+                if ( mFile != NULL && fwrite( rData, 1, rnBytes, mFile ) != rnBytes )
+                    mbFailed = true;
+                return *this;
+            }
+        }
+        memcpy( mBuffer + mnBuffered, rData, rnBytes );
+        mnBuffered += rnBytes;
+        return *this;
+    }
+
+    inline BufferedWriter & write( char const * const rString )
+    {
+        return write( rString, strlen( rString ) );
+    }
+
+    inline BufferedWriter & put( char const c )
+    {
+        if ( mnBuffered >= nBufferBytes )
+            flush();
+        mBuffer[ mnBuffered++ ] = c;
+        return *this;
+    }
+
+    /* writes c rnTimes, e.g. for padding */
+    inline BufferedWriter & fill( char const c, int rnTimes )
+    {
+        for ( ; rnTimes > 0; --rnTimes )
+            put( c );
+        return *this;
+    }
+
+    template< typename T >
+    inline BufferedWriter & writeInteger( T const rValue, unsigned int const rBase = 10u )
+    {
+        char * const p = reserve( nMaxFormattedIntegerChars );
+        mnBuffered += formatInteger( p, rValue, rBase );
+        return *this;
+    }
+
+    /* shortest representation reading back as the same float */
+    inline BufferedWriter & writeFloat( float const rValue )
+    {
+        char * const p = reserve( nMaxFormattedFloatChars );
+        mnBuffered += formatFloat( p, rValue );
+        return *this;
+    }
+
+    /* e.g. "125 kiB 427 B" */
+    inline BufferedWriter & writeBytes( uint64_t const rnBytes, bool const rLogical = true )
+    {
+        char * const p = reserve( nMaxFormattedBytesChars );
+        mnBuffered += formatBytes( p, rnBytes, rLogical );
+        return *this;
+    }
+
+    /* string in double quotes with ", \ and control characters escaped */
+    inline BufferedWriter & writeJsonString( char const * rString )
+    {
+        put( '"' );
+        for ( ; *rString != '\0'; ++rString )
+        {
+            unsigned char const c = *rString;
+            if ( c == '"' || c == '\\' )
+                put( '\\' ).put( c );
+            else if ( c == '\n' )
+                write( "\\n", 2 );
+            else if ( c < 0x20 )
+            {
+                char const * const hex = "0123456789abcdef";
+                write( "\\u00", 4 ).put( hex[ c >> 4 ] ).put( hex[ c & 0xF ] );
+            }
+            else
+                put( c );
+        }
+        return put( '"' );
+    }
+
+    /* field quoted only if it contains a separator, quote or line break */
+    inline BufferedWriter & writeCsvField( char const * const rString )
+    {
+        if ( strpbrk( rString, ",\"\r\n" ) == NULL )
+            return write( rString );
+        put( '"' );
+        for ( char const * p = rString; *p != '\0'; ++p )
+        {
+            if ( *p == '"' )
+                put( '"' );
+            put( *p );
+        }
+        return put( '"' );
+    }
+
+private:
+    /* @return pointer to at least rnBytes free bytes in the buffer */
+    inline char * reserve( size_t const rnBytes )
+    {
+        if ( mnBuffered + rnBytes > nBufferBytes )
+            flush();
+        return mBuffer + mnBuffered;
+    }
+
+    FILE * mFile     ;
+    size_t mnBuffered;
+    bool   mbFailed  ;
+    char   mBuffer[ nBufferBytes ];
+};
@@ -0,0 +1,175 @@
+/**
+ * Per compute capability hardware characteristics as one table, which can be
+ * evaluated at compile time in host code, device code and template
+ * arguments, e.g.:
+ *
+ *   static_assert( getCudaArchitecture( 6, 1 ).nCoresPerMultiprocessor == 128, "" );
+ *
+ *   template< int T_CudaArch = CUDA_ARCH_CURRENT >
+ *   __global__ void kernelSum( float const * x, float * y, int n )
+ *   {
+ *       #pragma unroll
+ *       for ( int k = 0; k < CudaKernelTuning< T_CudaArch >::nUnroll; ++k )
+ *       ...
+ *   }
+ *
+ * @see http://docs.nvidia.com/cuda/cuda-c-programming-guide/index.html#compute-capabilities
+ * @see http://docs.nvidia.com/cuda/cuda-c-programming-guide/index.html#arithmetic-instructions
+ */
+
+#pragma once
+
+/* make this header work even when not using CUDA */
+#if ! defined( __CUDACC__ ) && ! defined( __host__ ) && ! defined( __device__ )
+#   define __host__
+#   define __device__
+#endif
+
+
+struct CudaArchitecture
+{
+    int          major                       ;
+    int          minor                       ;
+    char const * codeName                    ;
+    /* 32 bit add, multiply, FMA units */
+    int          nCoresPerMultiprocessor     ;
+    int          nDoublePrecisionUnitsPerMultiprocessor;
+    int          nSpecialFunctionUnitsPerMultiprocessor;
+    int          nWarpSchedulersPerMultiprocessor;
+    int          nMaxConcurrentKernels       ;
+    int          nMaxBlocksPerMultiprocessor ;
+};
+
+/**
+ * Note that for 2.0 the two warp schedulers can only issue 16 instructions
+ * per cycle each. Meaning the 32 CUDA cores can't be used in parallel with
+ * the 4 special function units. For 2.1 up this is a different matter.
+ * 3.5 and 3.7 have 64 double precision units only on Tesla and Titan cards,
+ * GeForce cards with the same compute capability have 8.
+ */
+#define CUDA_ARCHITECTURE_TABLE( X ) \
+/*     major minor code name  cores  DP SFU sched. kernels blocks */ \
+    X( 2 , 0 , "Fermi"     ,  32 , 16 ,  4 , 2 ,  16 ,  8 ) \
+    X( 2 , 1 , "Fermi"     ,  48 ,  4 ,  8 , 2 ,  16 ,  8 ) \
+    X( 3 , 0 , "Kepler"    , 192 ,  8 , 32 , 4 ,  16 , 16 ) \
+    X( 3 , 2 , "Kepler"    , 192 ,  8 , 32 , 4 ,   4 , 16 ) \
+    X( 3 , 5 , "Kepler"    , 192 , 64 , 32 , 4 ,  32 , 16 ) \
+    X( 3 , 7 , "Kepler"    , 192 , 64 , 32 , 4 ,  32 , 16 ) \
+    X( 5 , 0 , "Maxwell"   , 128 ,  4 , 32 , 4 ,  32 , 32 ) \
+    X( 5 , 2 , "Maxwell"   , 128 ,  4 , 32 , 4 ,  32 , 32 ) \
+    X( 5 , 3 , "Maxwell"   , 128 ,  4 , 32 , 4 ,  16 , 32 ) \
+    X( 6 , 0 , "Pascal"    ,  64 , 32 , 16 , 2 , 128 , 32 ) \
+    X( 6 , 1 , "Pascal"    , 128 ,  4 , 32 , 4 ,  32 , 32 ) \
+    X( 6 , 2 , "Pascal"    , 128 ,  4 , 32 , 4 ,  16 , 32 ) \
+    X( 7 , 0 , "Volta"     ,  64 , 32 , 16 , 4 , 128 , 32 ) \
+    X( 7 , 2 , "Volta"     ,  64 ,  2 , 16 , 4 ,  16 , 32 ) \
+    X( 7 , 5 , "Turing"    ,  64 ,  2 , 16 , 4 , 128 , 16 ) \
+    X( 8 , 0 , "Ampere"    ,  64 , 32 , 16 , 4 , 128 , 32 ) \
+    X( 8 , 6 , "Ampere"    , 128 ,  2 , 16 , 4 , 128 , 16 ) \
+    X( 8 , 7 , "Ampere"    , 128 ,  2 , 16 , 4 , 128 , 16 ) \
+    X( 8 , 9 , "Ada"       , 128 ,  2 , 16 , 4 , 128 , 24 ) \
+    X( 9 , 0 , "Hopper"    , 128 , 64 , 16 , 4 , 128 , 32 ) \
+    X( 10, 0 , "Blackwell" , 128 , 64 , 16 , 4 , 128 , 32 ) \
+    X( 12, 0 , "Blackwell" , 128 ,  2 , 16 , 4 , 128 , 32 )
+
+#define TMP_ARCHITECTURE_ENTRY( MAJOR, MINOR, NAME, CORES, DP, SFU, SCHEDULERS, KERNELS, BLOCKS ) \
+    { MAJOR, MINOR, NAME, CORES, DP, SFU, SCHEDULERS, KERNELS, BLOCKS },
+
+/* for iterating over all known architectures in host code */
+constexpr CudaArchitecture cudaArchitectures[] = {
+    CUDA_ARCHITECTURE_TABLE( TMP_ARCHITECTURE_ENTRY )
+};
+
+#undef TMP_ARCHITECTURE_ENTRY
+
+constexpr unsigned int nCudaArchitectures = sizeof( cudaArchitectures ) / sizeof( cudaArchitectures[0] );
+
+/* a chain of conditional operators instead of a lookup in cudaArchitectures,
+ * because C++11 constexpr functions can only consist of one return and
+ * device code can't read host arrays */
+#define TMP_ARCHITECTURE_MATCH( MAJOR, MINOR, NAME, CORES, DP, SFU, SCHEDULERS, KERNELS, BLOCKS ) \
+    majorVersion == MAJOR && minorVersion == MINOR ? \
+    CudaArchitecture{ MAJOR, MINOR, NAME, CORES, DP, SFU, SCHEDULERS, KERNELS, BLOCKS } :
+
+/**
+ * @return the table entry or one with code name "Unknown" and all counts
+ *         set to 0 for compute capabilities not in the table
+ */
+__host__ __device__ constexpr CudaArchitecture getCudaArchitecture
+(
+    int const majorVersion,
+    int const minorVersion
+)
+{
+    return CUDA_ARCHITECTURE_TABLE( TMP_ARCHITECTURE_MATCH )
+           CudaArchitecture{ majorVersion, minorVersion, "Unknown", 0, 0, 0, 0, 0, 0 };
+}
+
+#undef TMP_ARCHITECTURE_MATCH
+
+/**
+ * The one formula for theoretical peaks used by all reports and benchmarks,
+ * e.g. getCudaPeakFmaFlops( prop.multiProcessorCount, prop.clockRate,
+ * getCudaArchitecture( prop.major, prop.minor ).nCoresPerMultiprocessor )
+ * for single precision. An FMA counts as two operations.
+ * @param[in] rClockRateKHz cudaDeviceProp::clockRate, which is in kHz
+ * @return operations per second, 0 for unknown architectures
+ */
+__host__ __device__ constexpr double getCudaPeakFmaFlops
+(
+    int const rnMultiprocessors        ,
+    int const rClockRateKHz            ,
+    int const rnUnitsPerMultiprocessor
+)
+{
+    return (double) rnMultiprocessors * rClockRateKHz * 1e3 * rnUnitsPerMultiprocessor * 2 /* FMA */;
+}
+
+/* __CUDA_ARCH__ for the current device compilation pass, 0 for the host pass */
+#ifdef __CUDA_ARCH__
+#   define CUDA_ARCH_CURRENT __CUDA_ARCH__
+#else
+#   define CUDA_ARCH_CURRENT 0
+#endif
+
+/**
+ * Table entry for a __CUDA_ARCH__ value like 610 as compile-time constants,
+ * so that they can be used as template arguments and array sizes.
+ */
+template< int T_CudaArch >
+struct CudaArchitectureTraits
+{
+    static constexpr int major = T_CudaArch / 100;
+    static constexpr int minor = T_CudaArch % 100 / 10;
+    static constexpr int nCoresPerMultiprocessor                = getCudaArchitecture( major, minor ).nCoresPerMultiprocessor;
+    static constexpr int nDoublePrecisionUnitsPerMultiprocessor = getCudaArchitecture( major, minor ).nDoublePrecisionUnitsPerMultiprocessor;
+    static constexpr int nSpecialFunctionUnitsPerMultiprocessor = getCudaArchitecture( major, minor ).nSpecialFunctionUnitsPerMultiprocessor;
+    static constexpr int nWarpSchedulersPerMultiprocessor       = getCudaArchitecture( major, minor ).nWarpSchedulersPerMultiprocessor;
+    static constexpr int nMaxBlocksPerMultiprocessor            = getCudaArchitecture( major, minor ).nMaxBlocksPerMultiprocessor;
+};
+
+/**
+ * Tuning parameters for kernels, chosen at compile time per architecture.
+ * The defaults are derived from the table, e.g. Kepler has more cores per
+ * warp scheduler than one warp wide, so it needs instruction level
+ * parallelism, i.e. more unrolling, to use all of them. Kernels which know
+ * better can specialize it for single architectures:
+ *
+ *   template<> struct CudaKernelTuning< 350 > : CudaKernelTuning< 0 >
+ *   { static constexpr int nUnroll = 16; };
+ */
+template< int T_CudaArch >
+struct CudaKernelTuning
+{
+private:
+    typedef CudaArchitectureTraits< T_CudaArch > Traits;
+    static constexpr int nCoresPerScheduler = Traits::nWarpSchedulersPerMultiprocessor > 0 ?
+        Traits::nCoresPerMultiprocessor / Traits::nWarpSchedulersPerMultiprocessor : 32;
+
+public:
+    /* independent operations in flight per thread */
+    static constexpr int nUnroll          = 4 * ( ( nCoresPerScheduler + 31 ) / 32 );
+    /* square shared memory tiles, e.g. for transposes, one warp wide */
+    static constexpr int nTileSize        = 32;
+    static constexpr int nThreadsPerBlock = 256;
+};
@@ -0,0 +1,307 @@
+/**
+ * Small harness for comparing alternative implementations, i.e. strategies,
+ * of the same operation over a sweep of problem sizes:
+ *
+ *   BenchmarkSuite suite( "sm_61" );
+ *   suite.add( "WARP_REDUCE_SUM", "LOOP", []( uint64_t n ){ ...; return seconds; } );
+ *   auto const results = suite.run( { 1 << 16, 1 << 20 }, 10 );
+ *   appendBenchmarkResults( "results.tsv", results );
+ *   writeBenchmarkSelectionHeader( "variants.hpp", loadBenchmarkResults( "results.tsv" ), "GPUINFO_" );
+ *
+ * Every measurement is repeated and reported as mean throughput with a
+ * 95% confidence interval from Student's t-distribution, so that it can be
+ * seen whether two strategies actually differ. The results are appended to
+ * a tab separated file, so that measurements of several machines and
+ * architectures can be collected. From those a header is written which
+ * defines <prefix><group> to <prefix><group>_<strategy> of the fastest
+ * strategy per architecture, i.e. the strategy is selected at build time.
+ */
+
+#pragma once
+
+#include <algorithm>                    // max
+#include <cmath>                        // sqrt, log, exp
+#include <cstdint>                      // uint64_t
+#include <cstdio>                       // FILE, fopen, fprintf, printf
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>                      // pair
+#include <vector>
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+struct BenchmarkStatistics
+{
+    double mean    ;
+    double stddev  ;
+    /* half width of the 95% confidence interval of the mean */
+    double ci95    ;
+    size_t nSamples;
+};
+
+/* two-sided 95% quantile of Student's t-distribution */
+inline double getStudentT95( size_t const rnDegreesOfFreedom )
+{
+    static double const quantiles[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+         2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+         2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    size_t const nQuantiles = sizeof( quantiles ) / sizeof( quantiles[0] );
+    if ( rnDegreesOfFreedom == 0 )
+        return 0;
+    return rnDegreesOfFreedom <= nQuantiles ? quantiles[ rnDegreesOfFreedom - 1 ] : 1.960;
+}
+
+inline BenchmarkStatistics computeBenchmarkStatistics( std::vector< double > const & rSamples )
+{
+    BenchmarkStatistics statistics = { 0, 0, 0, rSamples.size() };
+    if ( rSamples.empty() )
+        return statistics;
+    for ( auto const x : rSamples )
+        statistics.mean += x;
+    statistics.mean /= rSamples.size();
+    if ( rSamples.size() < 2 )
+        return statistics;
+    for ( auto const x : rSamples )
+        statistics.stddev += ( x - statistics.mean ) * ( x - statistics.mean );
+    statistics.stddev = std::sqrt( statistics.stddev / ( rSamples.size() - 1 ) );
+    statistics.ci95 = getStudentT95( rSamples.size() - 1 ) * statistics.stddev / std::sqrt( (double) rSamples.size() );
+    return statistics;
+}
+
+struct BenchmarkResult
+{
+    std::string architecture;
+    std::string group       ;
+    std::string strategy    ;
+    uint64_t    nElements   ;
+    /* elements per second */
+    double      throughput  ;
+    double      ci95        ;
+};
+
+class BenchmarkSuite
+{
+public:
+    /* must return the seconds needed for processing rnElements elements */
+    typedef std::function< double( uint64_t ) > Measurement;
+
+    /**
+     * @param[in] rArchitecture key the results are stored and selected
+     *            with, e.g. "sm_61" or "host", @see writeBenchmarkSelectionHeader
+     */
+    inline explicit BenchmarkSuite( std::string const & rArchitecture )
+     : mArchitecture( rArchitecture )
+    {}
+
+    inline void add
+    (
+        std::string const & rGroup      ,
+        std::string const & rStrategy   ,
+        Measurement const & rMeasurement
+    )
+    {
+        Strategy const strategy = { rGroup, rStrategy, rMeasurement };
+        mStrategies.push_back( strategy );
+    }
+
+    /**
+     * Measures each strategy for each size rnRepeats times after one
+     * discarded warm-up run and prints a table row per measurement.
+     */
+    inline std::vector< BenchmarkResult > run
+    (
+        std::vector< uint64_t > const & rSizes   ,
+        int                     const   rnRepeats,
+        FILE                  * const   rLog = stdout
+    ) const
+    {
+        if ( rLog != NULL )
+        {
+            fprintf( rLog, "| arch     | group                      | strategy     | elements   | G/s      | +-95%%    |\n" );
+            fprintf( rLog, "|----------|----------------------------|--------------|------------|----------|----------|\n" );
+        }
+
+        std::vector< BenchmarkResult > results;
+        for ( auto const & strategy : mStrategies )
+        for ( auto const n : rSizes )
+        {
+            strategy.measurement( n );
+            std::vector< double > throughputs;
+            for ( int iRepeat = 0; iRepeat < rnRepeats; ++iRepeat )
+                throughputs.push_back( n / strategy.measurement( n ) );
+            BenchmarkStatistics const statistics = computeBenchmarkStatistics( throughputs );
+
+            BenchmarkResult const result = { mArchitecture, strategy.group, strategy.name,
+                                             n, statistics.mean, statistics.ci95 };
+            results.push_back( result );
+            if ( rLog != NULL )
+            {
+                fprintf( rLog, "| %-8s | %-26s | %-12s | %10lu | %8.3f | %8.3f |\n",
+                         mArchitecture.c_str(), strategy.group.c_str(), strategy.name.c_str(),
+                         (unsigned long) n, result.throughput / 1e9, result.ci95 / 1e9 );
+            }
+        }
+        return results;
+    }
+
+private:
+    struct Strategy
+    {
+        std::string group      ;
+        std::string name       ;
+        Measurement measurement;
+    };
+
+    std::string             mArchitecture;
+    std::vector< Strategy > mStrategies  ;
+};
+
+
+/**
+ * Appends one line per result: architecture, group, strategy, elements,
+ * throughput and confidence interval separated by tabs.
+ */
+inline void appendBenchmarkResults
+(
+    std::string                    const & rPath   ,
+    std::vector< BenchmarkResult > const & rResults
+)
+{
+    FILE * const file = fopen( rPath.c_str(), "a" );
+    if ( file == NULL )
+    {
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::appendBenchmarkResults] "
+            << "Could not open '" << rPath << "' for appending.";
+        throw std::runtime_error( msg.str() );
+    }
+    for ( auto const & result : rResults )
+    {
+        fprintf( file, "%s\t%s\t%s\t%lu\t%.6e\t%.6e\n", result.architecture.c_str(),
+                 result.group.c_str(), result.strategy.c_str(), (unsigned long) result.nElements,
+                 result.throughput, result.ci95 );
+    }
+    fclose( file );
+}
+
+/**
+ * @return all results in the file in order, an empty list if the file
+ *         doesn't exist. Malformed lines are skipped.
+ */
+inline std::vector< BenchmarkResult > loadBenchmarkResults( std::string const & rPath )
+{
+    std::vector< BenchmarkResult > results;
+    std::ifstream file( rPath.c_str() );
+    std::string line;
+    while ( std::getline( file, line ) )
+    {
+        std::istringstream fields( line );
+        BenchmarkResult result;
+        if ( std::getline( fields, result.architecture, '\t' ) &&
+             std::getline( fields, result.group       , '\t' ) &&
+             std::getline( fields, result.strategy    , '\t' ) &&
+             fields >> result.nElements >> result.throughput >> result.ci95 )
+        {
+            results.push_back( result );
+        }
+    }
+    return results;
+}
+
+/**
+ * Later results replace earlier ones for the same architecture, group,
+ * strategy and size. Strategies are compared by the geometric mean of
+ * their throughputs over all sizes, so that each size counts the same.
+ *
+ * @return ( architecture, group ) -> fastest strategy
+ */
+inline std::map< std::pair< std::string, std::string >, std::string >
+selectFastestStrategies( std::vector< BenchmarkResult > const & rResults )
+{
+    typedef std::pair< std::string, std::string > Key;
+    std::map< Key, std::map< std::string, std::map< uint64_t, double > > > throughputs;
+    for ( auto const & result : rResults )
+        throughputs[ Key( result.architecture, result.group ) ][ result.strategy ][ result.nElements ] = result.throughput;
+
+    std::map< Key, std::string > selection;
+    for ( auto const & group : throughputs )
+    {
+        double bestScore = 0;
+        for ( auto const & strategy : group.second )
+        {
+            double logSum = 0;
+            for ( auto const & size : strategy.second )
+                logSum += std::log( std::max( size.second, 1e-300 ) );
+            double const score = std::exp( logSum / strategy.second.size() );
+            if ( selection.count( group.first ) == 0 || score > bestScore )
+            {
+                selection[ group.first ] = strategy.first;
+                bestScore = score;
+            }
+        }
+    }
+    return selection;
+}
+
+/**
+ * Writes a header defining rPrefix + group to rPrefix + group + "_" +
+ * strategy for the fastest strategy of each group. Architectures named
+ * like "sm_61" are selected with __CUDA_ARCH__, "host" is used when not
+ * compiling device code, all others are only listed as a comment.
+ * Macros given on the command line take precedence.
+ */
+inline void writeBenchmarkSelectionHeader
+(
+    std::string                    const & rPath   ,
+    std::vector< BenchmarkResult > const & rResults,
+    std::string                    const & rPrefix
+)
+{
+    std::stringstream header;
+    header << "/* written by writeBenchmarkSelectionHeader from " << rResults.size()
+           << " measurements, do not edit */\n\n#pragma once\n";
+
+    auto const selection = selectFastestStrategies( rResults );
+    std::string architecture;
+    for ( auto const & selected : selection )
+    {
+        if ( selected.first.first != architecture )
+        {
+            if ( ! architecture.empty() )
+                header << "#endif\n";
+            architecture = selected.first.first;
+            /* sm_61 -> 610, sm_100 -> 1000 */
+            int version = 0;
+            if ( sscanf( architecture.c_str(), "sm_%d", &version ) == 1 )
+                header << "\n#if defined( __CUDA_ARCH__ ) && __CUDA_ARCH__ == " << version * 10 << "\n";
+            else if ( architecture == "host" )
+                header << "\n#if ! defined( __CUDA_ARCH__ )\n";
+            else
+                header << "\n#if 0 /* unknown architecture '" << architecture << "' */\n";
+        }
+        std::string const macro = rPrefix + selected.first.second;
+        header << "#   ifndef " << macro << "\n"
+               << "#       define " << macro << " " << macro << "_" << selected.second << "\n"
+               << "#   endif\n";
+    }
+    if ( ! architecture.empty() )
+        header << "#endif\n";
+
+    std::ofstream file( rPath.c_str() );
+    file << header.str();
+    if ( ! file )
+    {
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::writeBenchmarkSelectionHeader] "
+            << "Could not write '" << rPath << "'.";
+        throw std::runtime_error( msg.str() );
+    }
+}
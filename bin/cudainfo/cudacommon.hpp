@@ -7,17 +7,34 @@
 #   pragma once
 #endif
 
+#include <algorithm>                    // min, max
 #include <cassert>
+#include <cmath>                        // isnan, isinf
 #include <cstdio>
 #include <cstdlib>                      // NULL, malloc, free, memset
+#include <cstring>                      // memcpy
 #include <cstdlib>                      // EXIT_FAILURE, exit
 #include <iostream>
 #include <stdexcept>
 #include <stdint.h>                     // uint64_t
 #include <sstream>
+#include <type_traits>                  // enable_if, is_arithmetic
+#include <utility>                      // forward, move
 #ifdef __CUDACC__
 #   include <cuda_runtime_api.h>
 #endif
+#include "cudaarchitectures.hpp"        // getCudaArchitecture
+#include "cudahostbackend.hpp"          // HostThreadPool, launchHostKernel
+#include "cudadevicecache.hpp"          // getCudaDeviceSnapshots
+#include "cudalaunchplanner.hpp"        // getCudaLaunchPlanner
+#include "dirtychunkset.hpp"            // DirtyChunkSet
+#include "cudamemorypool.hpp"           // getCudaDeviceMemoryPool
+#include "cudastreampipeline.hpp"       // CudaStreamPipeline
+#include "cudadevicescan.hpp"           // deviceExclusiveScan, deviceCompactIf
+#include "cudaformat.hpp"               // formatInteger, formatFloat
+#include "cudadevicereport.hpp"         // makeCudaDeviceReport, writeCudaDeviceReports
+#include "cudanuma.hpp"                 // allocateNumaMemory, getCudaDeviceNumaNode
+#include "cudapeertopology.hpp"         // copyCudaPeerRouted
 
 
 #define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
@@ -25,7 +42,7 @@
 /* https://stackoverflow.com/questions/8796369/cuda-and-nvcc-using-the-preprocessor-to-choose-between-float-or-double
 It seems you might be conflating two things - how to differentiate between the host and device compilation trajectories when nvcc is processing CUDA code, and how to differentiate between CUDA and non-CUDA code. There is a subtle difference between the two. __CUDA_ARCH__ answers the first question, and __CUDACC__ answers the second.
 */
-#if defined( __CUDACC__ )
+#if defined( __CUDACC__ ) || defined( CUDA_HOST_RUNTIME )
 
 inline void checkCudaError
 (
@@ -61,7 +78,8 @@ inline T ceilDiv( T a, S b )
     assert( b != 0 );
     assert( a == a );
     assert( b == b );
-    return (a+b-1)/b;
+    /* not (a+b-1)/b, which overflows for a close to its maximum */
+    return a/b + ( a%b != 0 );
 }
 
 #include <sstream>
@@ -71,10 +89,9 @@ inline T ceilDiv( T a, S b )
 /**
  * Given the number of bytes, this function prints out an exact human
  * readable format, e.g. 128427:
- *   logical: 125 MiB 427 B
- *   SI     : 128 MB 427 B
- * Wasn't intented, but in both representations the amount of bytes are
- * identical for this number. (This works if xMiB * 1024 ends on 000)
+ *   logical: 125 kiB 427 B
+ *   SI     : 128 kB 427 B
+ * @see formatBytes
  */
 inline std::string prettyPrintBytes
 (
@@ -82,27 +99,8 @@ inline std::string prettyPrintBytes
     bool   const logical = true
 )
 {
-    char const suffixes[] = { ' ', 'k', 'M', 'G', 'T', 'P', 'E', 'Z', 'Y' };
-    std::stringstream out;
-    std::vector< size_t > parts;
-    for ( unsigned i = 0u; i < sizeof( suffixes ); ++i )
-    {
-        parts.push_back( bytes % size_t( 1024 ) );
-        bytes /= size_t( 1024 );
-        if ( bytes == 0 )
-            break;
-    }
-    assert( parts.size() > 0 );
-    for ( int i = (int) parts.size()-1; i >= 0; --i )
-    {
-        if ( i != (int) parts.size()-1 && parts.at(i) == 0 )
-            continue;
-        out << parts[i] << " " << suffixes[i] << ( logical ? "i" : "" )
-            << "B" << ( i > 0 ? " " : "" );
-    }
-    std::string result = out.str();
-    result.erase( result.size()-1, 1 );
-    return result;
+    char buffer[ nMaxFormattedBytesChars ];
+    return std::string( buffer, formatBytes( buffer, bytes, logical ) );
 }
 
 #if defined( __CUDACC__ )
@@ -125,51 +123,54 @@ inline std::string prettyPrintBytes
  */
 inline void calcKernelConfig( int iDevice, uint64_t n, int * nBlocks, int * nThreads )
 {
-    int const nMaxThreads  = 256;
-    int const nMinElements = 32; /* The assumption: one kernel with nMinElements work won't be much slower than nMinElements kernels with each 1 work element. Of course this is workload / kernel dependent, so the fixed value may not be the best idea */
-
-    /* set current device and get device infos */
-    int nDevices;
-    CUDA_ERROR( cudaGetDeviceCount( &nDevices ) );
-    assert( iDevice < nDevices );
+    /* callers rely on iDevice being current for the following launch */
     CUDA_ERROR( cudaSetDevice( iDevice ) );
+    /* The planner is created once per device from the cached properties and
+     * memoizes the block size, so this is O(1) and doesn't need to query the
+     * device. The former nMinElements = 32 and at most 256 threads per block
+     * are the defaults of CudaKernelResources and of the block size
+     * tie-break respectively. */
+    CudaLaunchConfig const config = getCudaLaunchPlanner( iDevice ).plan( n );
+    *nBlocks  = config.nBlocks.x;
+    *nThreads = config.nThreads.x;
 
-    // for GTX 760 this is 12288 threads per device and 384 real cores
-    cudaDeviceProp deviceProperties;
-    CUDA_ERROR( cudaGetDeviceProperties( &deviceProperties, iDevice) );
+    assert( *nBlocks > 0 );
+    assert( *nThreads > 0 );
+    /* the derivation above only works if linid < n for all threads */
+    assert( (uint64_t) *nBlocks * *nThreads <= n );
+}
 
-    int const nMaxThreadsGpu = deviceProperties.maxThreadsPerMultiProcessor
-                             * deviceProperties.multiProcessorCount;
-    if ( n < (uint64_t) nMaxThreadsGpu * nMinElements )
-    {
-        uint64_t const nThreadsNeeded = ceilDiv( n, nMinElements );
-        *nBlocks  = ceilDiv( nThreadsNeeded, nMaxThreads );
-        *nThreads = nMaxThreads;
-        if ( *nBlocks == 1 )
-        {
-            assert( nThreadsNeeded <= nMaxThreads );
-            *nThreads = nThreadsNeeded;
-        }
-    }
-    else
+#else
+
+/**
+ * Host counterpart of calcKernelConfig for kernels launched with
+ * launchHostKernel. iDevice is ignored. Instead of filling all
+ * multiprocessors, enough blocks for several per worker thread are chosen,
+ * so that the work-stealing can balance uneven blocks.
+ */
+inline void calcKernelConfig( int, uint64_t n, int * nBlocks, int * nThreads )
+{
+    int const nMaxThreads      = 256;
+    int const nMinElements     = 32;
+    int const nBlocksPerWorker = 8;
+
+    uint64_t const nMaxBlocks = getHostThreadPool().size() * nBlocksPerWorker;
+    uint64_t const nThreadsNeeded = ceilDiv( n, nMinElements );
+    /* clamped before narrowing, because the block count may not fit an int */
+    uint64_t const nBlocksNeeded = ceilDiv( nThreadsNeeded, nMaxThreads );
+    *nThreads = nMaxThreads;
+    *nBlocks  = (int) std::min( nBlocksNeeded, nMaxBlocks );
+    if ( nBlocksNeeded <= 1 )
     {
-        *nBlocks  = nMaxThreadsGpu / nMaxThreads;
-        *nThreads = nMaxThreads;
+        *nBlocks  = 1;
+        *nThreads = nThreadsNeeded > 0 ? (int) nThreadsNeeded : 1;
     }
     assert( *nBlocks > 0 );
     assert( *nThreads > 0 );
-    uint64_t nIterations = 0;
-    for ( uint64_t linid = 0; linid < (uint64_t) *nBlocks * *nThreads; ++linid )
-    {
-        /* note that this only works if linid < n */
-        assert( linid < n );
-        nIterations += (n-linid-1) / ( *nBlocks * *nThreads ) + 1;
-        //printf( "[thread %i] %i elements\n", linid, (n-linid) / ( *nBlocks * *nThreads ) );
-    }
-    //printf( "Total %i elements out of %i wanted\n", nIterations, n );
-    assert( nIterations == n );
 }
 
+#endif
+
 
 inline __device__ long long unsigned int getLinearThreadId( void )
 {
@@ -240,8 +241,6 @@ inline __device__ long long unsigned int getGridSize( void )
     return gridDim.x * gridDim.y * gridDim.z;
 }
 
-#endif
-
 
 #include <cassert>
 #include <cstdio>               // printf, fflush
@@ -259,45 +258,25 @@ inline __device__ long long unsigned int getGridSize( void )
  * @see http://docs.nvidia.com/cuda/cuda-c-programming-guide/index.html#compute-capabilities
  *      from CUDA Toolkit v9.0.176
  **/
-inline int getCudaCoresPerMultiprocessor
+__host__ __device__ constexpr int getCudaCoresPerMultiprocessor
 (
     int const majorVersion,
     int const minorVersion
 )
 {
-    if ( majorVersion == 2 && minorVersion == 0 ) /* Fermi   */ return 32 ;
-    if ( majorVersion == 2 && minorVersion == 1 ) /* Fermi   */ return 48 ;
-    if ( majorVersion == 3 )                      /* Kepler  */ return 192;
-    if ( majorVersion == 5 )                      /* Maxwell */ return 128;
-    if ( majorVersion == 6 )                      /* Pascal  */ return 64 ;
-    if ( majorVersion == 6 && minorVersion == 1 ) /* Pascal  */ return 128;
-    if ( majorVersion == 6 && minorVersion == 2 ) /* Pascal  */ return 128;
-    if ( majorVersion == 7 )                      /* Volta   */ return 64 ;
-    return 0; /* unknown, could also throw exception */
+    return getCudaArchitecture( majorVersion, minorVersion ).nCoresPerMultiprocessor;
 }
 /**
  * @see http://docs.nvidia.com/cuda/cuda-c-programming-guide/index.html#compute-capabilities
  *      from CUDA Toolkit v9.0.176
  **/
-inline int getCudaMaxConcurrentKernels
+__host__ __device__ constexpr int getCudaMaxConcurrentKernels
 (
     int const majorVersion,
     int const minorVersion
 )
 {
-    if ( majorVersion == 2 ) /* Fermi */ return 0;
-    if ( majorVersion == 3 && minorVersion == 0 ) /* Kepler  */ return 16 ;
-    if ( majorVersion == 3 && minorVersion == 2 ) /* Kepler  */ return 4  ;
-    if ( majorVersion == 3 && minorVersion == 5 ) /* Kepler  */ return 32 ;
-    if ( majorVersion == 3 && minorVersion == 7 ) /* Kepler  */ return 32 ;
-    if ( majorVersion == 5 && minorVersion == 0 ) /* Maxwell */ return 32 ;
-    if ( majorVersion == 5 && minorVersion == 2 ) /* Maxwell */ return 32 ;
-    if ( majorVersion == 5 && minorVersion == 3 ) /* Maxwell */ return 16 ;
-    if ( majorVersion == 6 && minorVersion == 0 ) /* Pascal  */ return 128;
-    if ( majorVersion == 6 && minorVersion == 1 ) /* Pascal  */ return 32 ;
-    if ( majorVersion == 6 && minorVersion == 2 ) /* Pascal  */ return 16 ;
-    if ( majorVersion == 7 && minorVersion == 0 ) /* Volta   */ return 128;
-    return 0;   /* unknown, could also throw exception */
+    return getCudaArchitecture( majorVersion, minorVersion ).nMaxConcurrentKernels;
 }
 
 /**
@@ -307,81 +286,51 @@ inline int getCudaMaxConcurrentKernels
 inline std::string getCudaCodeName
 (
     int const majorVersion,
-    int const = 0
+    int const minorVersion = 0
 )
 {
-    if ( majorVersion == 2 )
-        return "Fermi";
-    if ( majorVersion == 3 )
-        return "Kepler";
-    if ( majorVersion == 5 )
-        return "Maxwell";
-    if ( majorVersion == 6 )
-        return "Pascal";
-    if ( majorVersion == 7 )
-        return "Volta";
-    return 0; /* unknown, could also throw exception */
+    return getCudaArchitecture( majorVersion, minorVersion ).codeName;
 }
 
 
 #if defined( __CUDACC__ )
 
 /**
- * @return flops (not GFlops, ... )
+ * @return flops (not GFlops, ... ), counting an FMA as one operation
  */
 inline float getCudaPeakFlops( cudaDeviceProp const & props )
 {
-    return (float) props.multiProcessorCount * props.clockRate /* kHz */ * 1e3f *
-        getCudaCoresPerMultiprocessor( props.major, props.minor );
+    return (float)( getCudaPeakFmaFlops( props.multiProcessorCount, props.clockRate,
+        getCudaCoresPerMultiprocessor( props.major, props.minor ) ) / 2 );
 }
 
-#include <sstream>
-
 std::string getCudaCacheConfigString( void )
 {
-    std::stringstream out;
-    out << "Prefer ";
     cudaFuncCache funcCache;
     cudaDeviceGetCacheConfig( &funcCache );
-    switch ( funcCache )
-    {
-        case cudaFuncCachePreferNone  : out << "None"  ; break;
-        case cudaFuncCachePreferShared: out << "Shared"; break;
-        case cudaFuncCachePreferL1    : out << "L1"    ; break;
-        case cudaFuncCachePreferEqual : out << "Equal" ; break;
-        default: printf( "?" );
-    }
-    return out.str();
+    return getCudaCacheConfigName( funcCache );
 }
 
 std::string getCudaSharedMemBankSizeString( void )
 {
-    std::stringstream out;
     cudaSharedMemConfig config;
     cudaDeviceGetSharedMemConfig( &config );
-    switch ( config )
-    {
-        case cudaSharedMemBankSizeDefault  : out << "Default"; break;
-        case cudaSharedMemBankSizeFourByte : out << "4 Bytes"; break;
-        case cudaSharedMemBankSizeEightByte: out << "8 Bytes"; break;
-        default: printf( "?" );
-    }
-    return out.str();
+    return getCudaSharedMemBankSizeName( config );
 }
 
 
 std::string printSharedMemoryConfig( void )
 {
-    std::stringstream out;
-    out << "[Shared Memory] Config: " << getCudaCacheConfigString()
-        << ", Bank Size: " << getCudaSharedMemBankSizeString() << "\n";
-    return out.str();
+    return std::string( "[Shared Memory] Config: " ) + getCudaCacheConfigString()
+           + ", Bank Size: " + getCudaSharedMemBankSizeString() + "\n";
 }
 
 /**
- * @param[out] rpDeviceProperties - Array of cudaDeviceProp of length rnDevices
- *             the user will need to free (C-style) this data on program exit!
- * @param[out] rnDevices - will hold number of cuda devices
+ * @return properties of all cuda devices in device order
+ * @param[in] rPrintInfo - print the properties as table to stdout
+ *
+ * The devices are queried concurrently on a cache miss,
+ * @see queryCudaDeviceSnapshots
  *
  * Most of these can also be queried using cuDeviceGetAttribute from the
  * cuda_runtime_api.h header
@@ -494,120 +443,45 @@ CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK_OPTIN = 97
     Maximum optin shared memory per block
 CU_DEVICE_ATTRIBUTE_MAX
  */
-inline void getCudaDeviceProperties
+inline std::vector< cudaDeviceProp > getCudaDeviceProperties
 (
-    cudaDeviceProp **       rpDeviceProperties = NULL,
-    int             *       rnDevices          = NULL,
-    bool              const rPrintInfo         = true
+    bool const rPrintInfo = true
 )
 {
-    printf( "Getting Device Informations. As this is the first command, "
-            "it can take ca.30s, because the GPU must be initialized.\n" );
-    fflush( stdout );
-
-    int fallbackNDevices;
-    if ( rnDevices == NULL )
-        rnDevices = &fallbackNDevices;
-    CUDA_ERROR( cudaGetDeviceCount( rnDevices ) );
+    /* only the first query is slow, later runs use the on-disk snapshot */
+    CudaDeviceSnapshotKey const snapshotKey = probeCudaDeviceSnapshotKey();
+    std::vector< CudaDeviceSnapshot > snapshots;
+    if ( ! loadCudaDeviceSnapshots( &snapshots, getCudaDeviceCachePath(), snapshotKey ) )
+    {
+        fprintf( stderr, "Getting Device Informations. As this is the first command, "
+                 "it can take ca.30s, because the GPU must be initialized.\n" );
+        queryCudaDeviceSnapshots( &snapshots );
+        saveCudaDeviceSnapshots( snapshots, getCudaDeviceCachePath(), snapshotKey );
+    }
 
-    cudaDeviceProp * fallbackPropArray;
-    if ( rpDeviceProperties == NULL )
-        rpDeviceProperties = &fallbackPropArray;
-    *rpDeviceProperties = (cudaDeviceProp*) malloc( (*rnDevices) * sizeof(cudaDeviceProp) );
-    assert( *rpDeviceProperties != NULL );
+    std::vector< cudaDeviceProp > properties( snapshots.size() );
 
-    for ( int iDevice = 0; iDevice < (*rnDevices); ++iDevice )
+    /* one report reused for all devices, all written with one buffer */
+    BufferedWriter out( stdout );
+    CudaDeviceReport report;
+    for ( int iDevice = 0; iDevice < (int) snapshots.size(); ++iDevice )
     {
-        cudaDeviceProp * prop = &( (*rpDeviceProperties)[iDevice] );
-        CUDA_ERROR( cudaGetDeviceProperties( prop, iDevice ) );
+        cudaDeviceProp * prop = &properties[ iDevice ];
+        *prop = snapshots[ iDevice ].properties;
 
-		if ( not rPrintInfo )
-			continue;
+        if ( not rPrintInfo )
+            continue;
 
         if ( iDevice == 0 && prop->major == 9999 && prop->minor == 9999 )
-            printf("There is no device supporting CUDA.\n");
+            out.write( "There is no device supporting CUDA.\n" );
 
-		const char cms[5][20] =
-			{ "Default", "Exclusive", "Prohibited", "ExclusiveProcess", "Unknown" };
-		const char * computeModeString;
-		switch ( prop->computeMode )
-        {
-			case cudaComputeModeDefault          : computeModeString = cms[0];
-			case cudaComputeModeExclusive        : computeModeString = cms[1];
-			case cudaComputeModeProhibited       : computeModeString = cms[2];
-			case cudaComputeModeExclusiveProcess : computeModeString = cms[3];
-			default                              : computeModeString = cms[4];
-		}
-        int   const coresPerSM = getCudaCoresPerMultiprocessor( prop->major, prop->minor );
-        float const peakFlops  = getCudaPeakFlops( *prop );
-
-        printf( "\n================== Device Number %i ==================\n",iDevice );
-        printf( "| Device name              : %s\n"        , prop->name );
-        printf( "| Computability            : %i.%i\n"     , prop->major,
-                                                             prop->minor );
-        printf( "| Code Name                : %s\n"        , getCudaCodeName( prop->major, prop->minor ).c_str() );
-        printf( "| PCI Bus ID               : %i\n"        , prop->pciBusID );
-        printf( "| PCI Device ID            : %i\n"        , prop->pciDeviceID );
-        printf( "| PCI Domain ID            : %i\n"        , prop->pciDomainID );
-		printf( "|------------------- Architecture -------------------\n" );
-        printf( "| Number of SMX            : %i\n"        , prop->multiProcessorCount );
-        printf( "| Max Threads per SMX      : %i\n"        , prop->maxThreadsPerMultiProcessor );
-        printf( "| Max Threads per Block    : %i\n"        , prop->maxThreadsPerBlock );
-        printf( "| Warp Size                : %i\n"        , prop->warpSize );
-        printf( "| Clock Rate               : %f GHz\n"    , prop->clockRate/1.0e6f );
-        printf( "| Max Block Size           : (%i,%i,%i)\n", prop->maxThreadsDim[0],
-                                                             prop->maxThreadsDim[1],
-                                                             prop->maxThreadsDim[2] );
-        printf( "| Max Grid Size            : (%i,%i,%i)\n", prop->maxGridSize[0],
-                                                             prop->maxGridSize[1],
-                                                             prop->maxGridSize[2] );
-		printf( "|  => Max conc. Threads    : %i\n"        , prop->multiProcessorCount *
-		                                                     prop->maxThreadsPerMultiProcessor );
-		printf( "|  => Warps per SMX        : %i\n"        , prop->maxThreadsPerMultiProcessor /
-		                                                     prop->warpSize );
-        printf( "| CUDA Cores per Multiproc.: %i\n"        , coresPerSM );
-        printf( "| Total CUDA Cores         : %i\n"        , prop->multiProcessorCount * coresPerSM );
-        printf( "| Peak FLOPS               : %f GFLOPS\n" , peakFlops / 1e9f );
-		printf( "|---------------------- Memory ----------------------\n" );
-        printf( "| Total Global Memory      : %lu Bytes\n" , prop->totalGlobalMem );
-        printf( "| Total Constant Memory    : %lu Bytes\n" , prop->totalConstMem );
-        printf( "| Shared Memory per Block  : %lu Bytes\n" , prop->sharedMemPerBlock );
-        printf( "| L2 Cache Size            : %u Bytes\n"  , prop->l2CacheSize );
-        printf( "| Registers per Block      : %i\n"        , prop->regsPerBlock );
-        printf( "| Memory Bus Width         : %i Bits\n"   , prop->memoryBusWidth );
-        printf( "| Memory Clock Rate        : %f GHz\n"    , prop->memoryClockRate/1.0e6f );
-        printf( "| Memory Pitch             : %lu\n"       , prop->memPitch );
-        printf( "| Unified Addressing       : %i\n"        , prop->unifiedAddressing );
-        printf( "| Texture Alignment        :  %ld\n"      , prop->textureAlignment );
-        printf( "| Max 1D Texture Size      : %i\n"        , prop->maxTexture1D );
-        printf( "| Max 2D Texture Size      : (%i,%i)\n"   , prop->maxTexture2D[0],
-                                                             prop->maxTexture2D[1] );
-        // this really is ONLY in CUDA 3.2. (maybe 3.x) available Oo
-        //printf( "| Max 2D Texture Array Size: (%i,%i)\n"   , prop->maxTexture2DArray[0],
-        //                                                     prop->maxTexture2DArray[1] );
-        printf( "| Max 3D Texture Size      : (%i,%i,%i)\n", prop->maxTexture3D[0],
-                                                             prop->maxTexture3D[1] ,
-                                                             prop->maxTexture3D[2] );
-        printf( "| Cache Configuration      : %s\n"        , getCudaCacheConfigString().c_str() );
-        printf( "| Shared Memory Bank Size  : %s\n"        , getCudaSharedMemBankSizeString().c_str() );
-		printf( "|--------------------- Graphics ---------------------\n" );
-		printf( "| Compute mode             : %s\n"        ,      computeModeString );
-		printf( "|---------------------- Other -----------------------\n" );
-        printf( "| Can map Host Memory      : %s\n"        , prop->canMapHostMemory  ? "true" : "false" );
-        printf( "| Can run Kernels conc.    : %s\n"        , prop->concurrentKernels ? "true" : "false" );
-        printf( "|   => max. conc. kernels  : %i\n"        , getCudaMaxConcurrentKernels( prop->major, prop->minor ) );
-		printf( "| Number of Asyn. Engines  : %i\n"        , prop->asyncEngineCount );
-        printf( "| Can Copy and Kernel conc.: %s\n"        , prop->deviceOverlap     ? "true" : "false" );
-        printf( "| ECC Enabled              : %s\n"        , prop->ECCEnabled        ? "true" : "false" );
-        printf( "| Device is Integrated     : %s\n"        , prop->integrated        ? "true" : "false" );
-        printf( "| Kernel Timeout Enabled   : %s\n"        , prop->kernelExecTimeoutEnabled ? "true" : "false" );
-        printf( "| Uses TESLA Driver        : %s\n"        , prop->tccDriver         ? "true" : "false" );
-        printf( "=====================================================\n" );
-        fflush(stdout);
-    }
-
-    if ( rpDeviceProperties == &fallbackPropArray )
-        free( fallbackPropArray );
+        makeCudaDeviceReport( snapshots[ iDevice ], iDevice, report );
+        writeCudaDeviceReportTable( out, report );
+        out.fill( '=', 53 ).put( '\n' );
+    }
+    out.flush();
+
+    return properties;
 }
 
 #endif
@@ -643,7 +517,78 @@ template< class T >
 class MirroredTexture;
 
 
-#if defined( __CUDACC__ )
+#if defined( __CUDACC__ ) || defined( CUDA_HOST_RUNTIME )
+
+/**
+ * How the host side of a MirroredVector is allocated:
+ *  - Pageable  : plain malloc. Transfers are staged by the driver through a
+ *                pinned bounce buffer and therefore synchronous, even when
+ *                using cudaMemcpyAsync.
+ *  - Pinned    : cudaHostAlloc, page-locked, so that transfers are DMAs and
+ *                really asynchronous. Pinning too much memory slows down the
+ *                whole system though.
+ *  - Registered: page-locks an already existing buffer with cudaHostRegister,
+ *                e.g. one from another library, without copying it.
+ *  - Mapped    : zero-copy, i.e. pinned memory which kernels access directly
+ *                over PCIe, so push and pop don't copy anything. Only worth
+ *                it for data read or written once and only possible if the
+ *                device reports canMapHostMemory.
+ *  - Managed   : cudaMallocManaged, i.e. one buffer which host and gpu both
+ *                point to and which the driver migrates page by page on
+ *                access, so that vectors can be larger than the device
+ *                memory. push and pop only prefetch, @see prefetchToDevice,
+ *                and kernels work unchanged. Only possible if the device
+ *                reports managedMemory. Prefetches and advices need
+ *                concurrentManagedAccess, i.e. Pascal or newer on Linux,
+ *                and are skipped otherwise. Without it, the host must not
+ *                touch the buffer while any kernel runs. Never NUMA bound.
+ * Device memory and pinned host memory are taken from the caching pools in
+ * cudamemorypool.hpp, so that short-lived vectors don't call cudaFree, which
+ * synchronizes the whole device. Define CUDACOMMON_NO_MEMORY_POOL to
+ * allocate them directly instead.
+ * @see https://devblogs.nvidia.com/how-optimize-data-transfers-cuda-cc/
+ *
+ * Independently of the mode, the host buffer can be bound to a NUMA node,
+ * normally the one the GPU is attached to, so that transfers don't have to
+ * cross sockets. Such buffers are whole pages bound with mbind and touched
+ * before being page-locked with cudaHostRegister, i.e. they bypass the
+ * pinned memory pool, which isn't NUMA-aware, @see cudanuma.hpp
+ */
+enum MirroredHostMemory
+{
+    MirroredHostPageable   = 0,
+    MirroredHostPinned     = 1,
+    MirroredHostRegistered = 2,
+    MirroredHostMapped     = 3,
+    MirroredHostManaged    = 4
+};
+
+/* hints for managed MirroredVectors, @see MirroredVector::advise */
+enum MirroredManagedAdvice
+{
+    /* keep read-only copies on host and device instead of migrating */
+    MirroredAdviseReadMostly    = 0,
+    /* migrate to the device of the vector resp. to the host on faults */
+    MirroredAdvisePreferDevice  = 1,
+    MirroredAdvisePreferHost    = 2
+};
+
+/* NUMA nodes for MirroredVector besides the node numbers themselves */
+constexpr int MirroredNumaAny    = -1;  /* wherever the first touching thread runs */
+constexpr int MirroredNumaDevice = -2;  /* the one of the current device */
+
+inline char const * getMirroredHostMemoryString( MirroredHostMemory const rMode )
+{
+    switch ( rMode )
+    {
+        case MirroredHostPageable  : return "pageable"  ;
+        case MirroredHostPinned    : return "pinned"    ;
+        case MirroredHostRegistered: return "registered";
+        case MirroredHostMapped    : return "mapped"    ;
+        case MirroredHostManaged   : return "managed"   ;
+    }
+    return "unknown";
+}
 
 /**
  * https://stackoverflow.com/questions/10535667/does-it-make-any-sense-to-use-inline-keyword-with-templates
@@ -655,34 +600,304 @@ class MirroredVector
 public:
     typedef T value_type;
 
-    T *                host     ;
-    T *                gpu      ;
-    size_t       const nElements;
-    size_t       const nBytes   ;
-    cudaStream_t const mStream  ;   /* not implemented yet */
-    bool         const mAsync   ;
+    T *                      host       ;
+    /* mutable, because push reallocates it if the vector grew. Only has
+     * room for nElements after the first push or gpuData following a size
+     * change! */
+    mutable T *              gpu        ;
+    size_t                   nElements  ;
+    size_t                   nBytes     ;
+    cudaStream_t             mStream    ;
+    bool                     mAsync     ;
+    MirroredHostMemory       mHostMemory;
+    /* false for registered buffers given by the user */
+    bool                     mOwnsHost  ;
+    /* node the host buffer is bound to, or MirroredNumaAny */
+    int                      mNumaNode  ;
+
+private:
+    /* allocated elements on the host and on the device */
+    size_t                      mnCapacity      ;
+    mutable size_t              mnDeviceCapacity;
+    /* chunks changed on the host, i.e. to push, and on the device, i.e. to
+     * pop. Only used after enableDirtyTracking. Mutable, because push and
+     * pop are const, which only refers to the contents. */
+    bool                        mbTrackDirty ;
+    mutable DirtyChunkSet       mHostDirty   ;
+    mutable DirtyChunkSet       mDeviceDirty ;
+    /* pool gpu was taken from, because the current device might change */
+    mutable CachingMemoryPool * mpDevicePool ;
+    /* device gpu was first allocated on and stays on, -1 before that */
+    mutable int                 miDevice     ;
+    /* whether the device supports prefetching managed memory */
+    mutable bool                mbConcurrentManaged;
+
+    /* mapped and managed memory have no own device buffer, gpu points to host */
+    inline bool hasOwnDeviceBuffer( void ) const
+    {
+        return mHostMemory != MirroredHostMapped && mHostMemory != MirroredHostManaged;
+    }
+
+    /* returns NULL on failure, except for CUDA errors */
+    inline T * allocateHost( size_t const rnElements ) const
+    {
+        size_t const nAllocBytes = rnElements * sizeof(T);
+        #if DEBUG_MIRRORED_VECTOR > 10
+            std::cerr << "[" << __FILENAME__ << "::MirroredVector::allocateHost]"
+                << "Allocate " << prettyPrintBytes( nAllocBytes ) << " "
+                << getMirroredHostMemoryString( mHostMemory ) << " on host.\n";
+        #endif
+        T * pointer = NULL;
+        if ( mNumaNode >= 0 )
+        {
+            if ( mHostMemory == MirroredHostMapped )
+                checkCanMapHostMemory();
+            pointer = (T*) allocateNumaMemory( nAllocBytes, mNumaNode );
+            if ( pointer != NULL && mHostMemory != MirroredHostPageable )
+            {
+                /* whole pages, so that registering 0 elements works, too */
+                CUDA_ERROR( cudaHostRegister( pointer, roundUpToPageSize( std::max( nAllocBytes, (size_t) 1 ) ),
+                    mHostMemory == MirroredHostMapped ? cudaHostRegisterMapped : cudaHostRegisterDefault ) );
+            }
+            return pointer;
+        }
+        switch ( mHostMemory )
+        {
+            case MirroredHostPageable:
+                pointer = (T*) ::malloc( nAllocBytes );
+                break;
+            case MirroredHostPinned:
+                #ifdef CUDACOMMON_NO_MEMORY_POOL
+                    CUDA_ERROR( cudaHostAlloc( (void**) &pointer, nAllocBytes, cudaHostAllocDefault ) );
+                #else
+                    pointer = (T*) getCudaPinnedMemoryPool().allocate( nAllocBytes, mStream );
+                #endif
+                break;
+            case MirroredHostRegistered:
+                pointer = (T*) ::malloc( nAllocBytes );
+                if ( pointer != NULL && nAllocBytes > 0 )
+                    CUDA_ERROR( cudaHostRegister( pointer, nAllocBytes, cudaHostRegisterDefault ) );
+                break;
+            case MirroredHostMapped:
+                checkCanMapHostMemory();
+                CUDA_ERROR( cudaHostAlloc( (void**) &pointer, nAllocBytes, cudaHostAllocMapped ) );
+                break;
+            case MirroredHostManaged:
+                checkCanUseManagedMemory();
+                /* 0 bytes are invalid for cudaMallocManaged */
+                CUDA_ERROR( cudaMallocManaged( (void**) &pointer, std::max( nAllocBytes, (size_t) 1 ),
+                                               cudaMemAttachGlobal ) );
+                break;
+        }
+        return pointer;
+    }
+
+    /* also remembers whether prefetches and advices are supported */
+    inline void checkCanUseManagedMemory( void ) const
+    {
+        int iDevice = 0, bManagedMemory = 0, bConcurrentManaged = 0;
+        CUDA_ERROR( cudaGetDevice( &iDevice ) );
+        CUDA_ERROR( cudaDeviceGetAttribute( &bManagedMemory, cudaDevAttrManagedMemory, iDevice ) );
+        CUDA_ERROR( cudaDeviceGetAttribute( &bConcurrentManaged, cudaDevAttrConcurrentManagedAccess, iDevice ) );
+        if ( ! bManagedMemory )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::MirroredVector::allocateHost] "
+                << "Device " << iDevice << " doesn't support managed memory, "
+                << "use pinned memory instead.";
+            throw std::runtime_error( msg.str() );
+        }
+        mbConcurrentManaged = bConcurrentManaged != 0;
+    }
+
+    inline void checkCanMapHostMemory( void ) const
+    {
+        /* since CUDA 4 with unified addressing cudaDeviceMapHost
+         * needn't be set explicitly */
+        int iDevice = 0, bCanMapHostMemory = 0;
+        CUDA_ERROR( cudaGetDevice( &iDevice ) );
+        CUDA_ERROR( cudaDeviceGetAttribute( &bCanMapHostMemory, cudaDevAttrCanMapHostMemory, iDevice ) );
+        if ( ! bCanMapHostMemory )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::MirroredVector::allocateHost] "
+                << "Device " << iDevice << " can't map host memory, "
+                << "use pinned memory instead.";
+            throw std::runtime_error( msg.str() );
+        }
+    }
+
+    /* @return node of the current device for MirroredNumaDevice */
+    static inline int resolveNumaNode( int const rNumaNode )
+    {
+        if ( rNumaNode != MirroredNumaDevice )
+            return rNumaNode;
+        int iDevice = 0;
+        CUDA_ERROR( cudaGetDevice( &iDevice ) );
+        return getCudaDeviceNumaNode( iDevice );
+    }
+
+    inline void freeHost
+    (
+        T      * const rpHost    ,
+        size_t   const rnElements
+    ) const
+    {
+        if ( mNumaNode >= 0 )
+        {
+            if ( mHostMemory != MirroredHostPageable )
+                CUDA_ERROR( cudaHostUnregister( rpHost ) );
+            freeNumaMemory( rpHost, rnElements * sizeof(T) );
+            return;
+        }
+        switch ( mHostMemory )
+        {
+            case MirroredHostPageable:
+                ::free( rpHost );
+                break;
+            case MirroredHostPinned:
+                #ifdef CUDACOMMON_NO_MEMORY_POOL
+                    CUDA_ERROR( cudaFreeHost( rpHost ) );
+                #else
+                    /* host accesses aren't stream-ordered, so an asynchronous
+                     * pop still writing into the block must finish before
+                     * it can be handed to the next vector */
+                    CUDA_ERROR( cudaStreamSynchronize( mStream ) );
+                    getCudaPinnedMemoryPool().deallocate( rpHost );
+                #endif
+                break;
+            case MirroredHostMapped:
+                CUDA_ERROR( cudaFreeHost( rpHost ) );
+                break;
+            case MirroredHostManaged:
+                CUDA_ERROR( cudaFree( rpHost ) );
+                break;
+            case MirroredHostRegistered:
+                if ( rnElements > 0 )
+                    CUDA_ERROR( cudaHostUnregister( rpHost ) );
+                if ( mOwnsHost )
+                    ::free( rpHost );
+                break;
+        }
+    }
+
+    /* mapped and managed memory have no own device buffer, but the host one */
+    inline T * allocateDevice
+    (
+        size_t                      const rnElements,
+        CachingMemoryPool * &             rpPool
+    ) const
+    {
+        #if DEBUG_MIRRORED_VECTOR > 10
+            std::cerr << "[" << __FILENAME__ << "::MirroredVector::allocateDevice]"
+                << "Allocate " << prettyPrintBytes( rnElements * sizeof(T) ) << " on GPU.\n";
+        #endif
+        T * pointer = NULL;
+        rpPool = NULL;
+        /* reallocations, e.g. in a push after growing, stay on the device of
+         * the first allocation, even if another device is current now */
+        if ( miDevice < 0 )
+            CUDA_ERROR( cudaGetDevice( &miDevice ) );
+        CudaDeviceScope const scope( miDevice );
+        /* no else, because CUDA_ERROR ends with a semicolon */
+        if ( mHostMemory == MirroredHostMapped )
+            CUDA_ERROR( cudaHostGetDevicePointer( (void**) &pointer, host, 0 ) );
+        if ( mHostMemory == MirroredHostManaged )
+            pointer = host;
+        if ( hasOwnDeviceBuffer() )
+        {
+            #ifdef CUDACOMMON_NO_MEMORY_POOL
+                CUDA_ERROR( cudaMalloc( (void**) &pointer, rnElements * sizeof(T) ) );
+            #else
+                rpPool  = &getCudaDeviceMemoryPool();
+                pointer = (T*) rpPool->allocate( rnElements * sizeof(T), mStream );
+            #endif
+        }
+        return pointer;
+    }
+
+    inline void freeDevice
+    (
+        T                 * const rpGpu ,
+        CachingMemoryPool * const rpPool
+    ) const
+    {
+        if ( rpPool != NULL )
+            rpPool->deallocate( rpGpu );
+        else if ( hasOwnDeviceBuffer() )
+        {
+            CUDA_ERROR( cudaFree( rpGpu ) );
+        }
+    }
 
+    /* adjusts the dirty chunks, new elements are dirty on the host */
+    inline void setSize( size_t const rnElements )
+    {
+        size_t const nOldBytes = nBytes;
+        nElements = rnElements;
+        nBytes    = rnElements * sizeof(T);
+        if ( mbTrackDirty )
+        {
+            mHostDirty  .resize( nBytes );
+            mDeviceDirty.resize( nBytes );
+            if ( nBytes > nOldBytes )
+                mHostDirty.mark( nOldBytes, nBytes );
+        }
+    }
+
+    /* takes over everything from rOther and leaves it empty */
+    inline void moveFrom( MirroredVector & rOther )
+    {
+        host             = rOther.host            ;
+        gpu              = rOther.gpu             ;
+        nElements        = rOther.nElements       ;
+        nBytes           = rOther.nBytes          ;
+        mStream          = rOther.mStream         ;
+        mAsync           = rOther.mAsync          ;
+        mHostMemory      = rOther.mHostMemory     ;
+        mOwnsHost        = rOther.mOwnsHost       ;
+        mNumaNode        = rOther.mNumaNode       ;
+        mnCapacity       = rOther.mnCapacity      ;
+        mnDeviceCapacity = rOther.mnDeviceCapacity;
+        mbTrackDirty     = rOther.mbTrackDirty    ;
+        mHostDirty       = std::move( rOther.mHostDirty   );
+        mDeviceDirty     = std::move( rOther.mDeviceDirty );
+        mpDevicePool     = rOther.mpDevicePool    ;
+        miDevice         = rOther.miDevice        ;
+        mbConcurrentManaged = rOther.mbConcurrentManaged;
+
+        rOther.host             = NULL;
+        rOther.gpu              = NULL;
+        rOther.nElements        = 0;
+        rOther.nBytes           = 0;
+        rOther.mOwnsHost        = true;
+        rOther.mnCapacity       = 0;
+        rOther.mnDeviceCapacity = 0;
+        rOther.mbTrackDirty     = false;
+        rOther.mHostDirty       = DirtyChunkSet();
+        rOther.mDeviceDirty     = DirtyChunkSet();
+        rOther.mpDevicePool     = NULL;
+        rOther.miDevice         = -1;
+    }
+
+public:
     inline MirroredVector()
-     : host( NULL ), gpu( NULL ), nElements( 0 ), nBytes( 0 ), mStream( 0 ), mAsync( false )
+     : host( NULL ), gpu( NULL ), nElements( 0 ), nBytes( 0 ), mStream( 0 ),
+       mAsync( false ), mHostMemory( MirroredHostPageable ), mOwnsHost( true ),
+       mNumaNode( MirroredNumaAny ), mnCapacity( 0 ),
+       mnDeviceCapacity( 0 ), mbTrackDirty( false ),
+       mpDevicePool( NULL ), miDevice( -1 ), mbConcurrentManaged( false )
     {}
 
     inline void malloc()
     {
+        mnCapacity = std::max( mnCapacity, nElements );
         if ( host == NULL )
+            host = allocateHost( mnCapacity );
+        if ( gpu == NULL && host != NULL )
         {
-            #if DEBUG_MIRRORED_VECTOR > 10
-                std::cerr << "[" << __FILENAME__ << "::MirroredVector::malloc]"
-                    << "Allocate " << prettyPrintBytes( nBytes ) << " on host.\n";
-            #endif
-            host = (T*) ::malloc( nBytes );
-        }
-        if ( gpu == NULL )
-        {
-            #if DEBUG_MIRRORED_VECTOR > 10
-                std::cerr << "[" << __FILENAME__ << "::MirroredVector::malloc]"
-                    << "Allocate " << prettyPrintBytes( nBytes ) << " on GPU.\n";
-            #endif
-            CUDA_ERROR( cudaMalloc( (void**) &gpu, nBytes ) );
+            gpu = allocateDevice( mnCapacity, mpDevicePool );
+            mnDeviceCapacity = mnCapacity;
         }
         if ( ! ( host != NULL && gpu != NULL ) )
         {
@@ -695,27 +910,225 @@ public:
         }
     }
 
+    /**
+     * @param[in] rAsync if true, push and pop won't synchronize the stream.
+     *            Note that this only overlaps with the host for pinned,
+     *            registered and mapped host memory.
+     * @param[in] rNumaNode node to bind the host buffer to, e.g.
+     *            MirroredNumaDevice for the one of the current device. If
+     *            that is unknown, it behaves like MirroredNumaAny.
+     */
     inline MirroredVector
     (
-        size_t const rnElements,
-        cudaStream_t rStream = 0,
-        bool const   rAsync  = false
+        size_t             const rnElements,
+        cudaStream_t             rStream     = 0,
+        bool               const rAsync      = false,
+        MirroredHostMemory const rHostMemory = MirroredHostPageable,
+        int                const rNumaNode   = MirroredNumaAny
     )
      : host( NULL ), gpu( NULL ), nElements( rnElements ),
        nBytes( rnElements * sizeof(T) ), mStream( rStream ),
-       mAsync( rAsync )
+       mAsync( rAsync ), mHostMemory( rHostMemory ), mOwnsHost( true ),
+       mNumaNode( rHostMemory == MirroredHostManaged ? MirroredNumaAny : resolveNumaNode( rNumaNode ) ),
+       mnCapacity( rnElements ),
+       mnDeviceCapacity( 0 ), mbTrackDirty( false ),
+       mpDevicePool( NULL ), miDevice( -1 ), mbConcurrentManaged( false )
     {
         this->malloc();
     }
 
+    /**
+     * Mirrors an existing host buffer, which will be page-locked until
+     * this object is destroyed, but not freed. It can't grow beyond
+     * rnElements.
+     */
+    inline MirroredVector
+    (
+        T            * const rpHost    ,
+        size_t         const rnElements,
+        cudaStream_t         rStream = 0,
+        bool           const rAsync  = false
+    )
+     : host( rpHost ), gpu( NULL ), nElements( rnElements ),
+       nBytes( rnElements * sizeof(T) ), mStream( rStream ),
+       mAsync( rAsync ), mHostMemory( MirroredHostRegistered ), mOwnsHost( false ),
+       mNumaNode( MirroredNumaAny ), mnCapacity( rnElements ),
+       mnDeviceCapacity( 0 ), mbTrackDirty( false ),
+       mpDevicePool( NULL ), miDevice( -1 ), mbConcurrentManaged( false )
+    {
+        if ( host != NULL && nBytes > 0 )
+            CUDA_ERROR( cudaHostRegister( host, nBytes, cudaHostRegisterDefault ) );
+        this->malloc();
+    }
+
+    /* copying would need to allocate and copy both sides, so it isn't
+     * done implicitly */
+    MirroredVector( MirroredVector const & ) = delete;
+    MirroredVector & operator=( MirroredVector const & ) = delete;
+
+    /* leaves rOther empty with the same stream and host memory mode */
+    inline MirroredVector( MirroredVector && rOther )
+     : MirroredVector()
+    {
+        moveFrom( rOther );
+    }
+
+    inline MirroredVector & operator=( MirroredVector && rOther )
+    {
+        if ( this != &rOther )
+        {
+            this->free();
+            moveFrom( rOther );
+        }
+        return *this;
+    }
+
+    inline size_t size    ( void ) const { return nElements     ; }
+    inline size_t capacity( void ) const { return mnCapacity    ; }
+    inline bool   empty   ( void ) const { return nElements == 0; }
+    /* node the host buffer is bound to or MirroredNumaAny */
+    inline int    numaNode( void ) const { return mNumaNode     ; }
+    /* device the gpu buffer is allocated on, -1 before malloc */
+    inline int    device  ( void ) const { return miDevice      ; }
+    /* elements gpu has room for, less than size() until the next push
+     * resp. gpuData if the vector grew */
+    inline size_t deviceCapacity( void ) const { return mnDeviceCapacity; }
+
+    /**
+     * Grows the device buffer to the host capacity if it is too small for
+     * nElements, which push does automatically. Has to be called before
+     * using gpu directly after the vector grew, @see gpuData. The old
+     * contents are kept when tracking dirty chunks, because then push
+     * won't copy everything.
+     */
+    inline void reserveDevice( void ) const
+    {
+        if ( mnDeviceCapacity >= nElements && gpu != NULL )
+            return;
+        CachingMemoryPool * newPool = NULL;
+        T * const newGpu = allocateDevice( mnCapacity, newPool );
+        if ( newGpu == NULL )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::MirroredVector::reserveDevice] "
+                << "Could not allocate " << mnCapacity * sizeof(T) << " B on the GPU.";
+            throw std::runtime_error( msg.str() );
+        }
+        if ( gpu != NULL )
+        {
+            if ( mbTrackDirty && mnDeviceCapacity > 0 )
+            {
+                CUDA_ERROR( cudaMemcpyAsync( newGpu, gpu, std::min( mnDeviceCapacity, nElements ) * sizeof(T),
+                                             cudaMemcpyDeviceToDevice, mStream ) );
+            }
+            freeDevice( gpu, mpDevicePool );
+        }
+        gpu              = newGpu;
+        mpDevicePool     = newPool;
+        mnDeviceCapacity = mnCapacity;
+    }
+
+    /* @return gpu after growing it to room for all elements */
+    inline T * gpuData( void ) const
+    {
+        if ( host != NULL )
+            reserveDevice();
+        return gpu;
+    }
+
+    /**
+     * Grows the host buffer to at least rnElements keeping its contents.
+     * The device buffer is only grown on the next push, so that a vector
+     * can be built up on the host without touching the GPU.
+     * Invalidates host and, for mapped and managed memory, gpu.
+     */
+    inline void reserve( size_t const rnElements )
+    {
+        if ( rnElements <= mnCapacity )
+            return;
+        if ( ! mOwnsHost )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::MirroredVector::reserve] "
+                << "Can't grow the registered host buffer given by the user "
+                << "beyond its " << mnCapacity << " elements.";
+            throw std::runtime_error( msg.str() );
+        }
+
+        T * const newHost = allocateHost( rnElements );
+        if ( newHost == NULL )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::MirroredVector::reserve] "
+                << "Could not allocate " << rnElements * sizeof(T) << " B on the host.";
+            throw std::runtime_error( msg.str() );
+        }
+        if ( host != NULL )
+        {
+            /* an asynchronous pop might still be writing to it */
+            CUDA_ERROR( cudaStreamSynchronize( mStream ) );
+            memcpy( newHost, host, nBytes );
+            if ( ! hasOwnDeviceBuffer() )
+                gpu = NULL;
+            freeHost( host, mnCapacity );
+        }
+        host       = newHost;
+        mnCapacity = rnElements;
+        if ( ! hasOwnDeviceBuffer() )
+        {
+            gpu = allocateDevice( mnCapacity, mpDevicePool );
+            mnDeviceCapacity = mnCapacity;
+        }
+    }
+
+    /**
+     * New elements are set to rValue. Growing beyond the capacity at least
+     * doubles it, so that repeated resizes by small amounts are amortized
+     * O(1) like push_back.
+     */
+    inline void resize
+    (
+        size_t const   rnElements,
+        T      const & rValue     = T()
+    )
+    {
+        if ( rnElements > mnCapacity )
+            reserve( std::max( rnElements, 2 * mnCapacity ) );
+        for ( size_t i = nElements; i < rnElements; ++i )
+            host[i] = rValue;
+        setSize( rnElements );
+    }
+
+    inline void push_back( T const & rValue )
+    {
+        if ( nElements == mnCapacity )
+            reserve( std::max( (size_t) 1, 2 * mnCapacity ) );
+        host[ nElements ] = rValue;
+        setSize( nElements + 1 );
+    }
+
+    template< typename... T_Args >
+    inline void emplace_back( T_Args && ... rArgs )
+    {
+        if ( nElements == mnCapacity )
+            reserve( std::max( (size_t) 1, 2 * mnCapacity ) );
+        host[ nElements ] = T( std::forward< T_Args >( rArgs )... );
+        setSize( nElements + 1 );
+    }
+
+    /* keeps the capacity on host and device */
+    inline void clear( void ) { setSize( 0 ); }
+
     /**
      * Uses async, but not that by default the memcpy gets queued into the
      * same stream as subsequent kernel calls will, so that a synchronization
-     * will be implied
+     * will be implied.
+     * If the vector grew since the last push, the device buffer is
+     * reallocated first, i.e. gpu changes.
      */
     inline void push( int const rAsync = -1 ) const
     {
-        if ( ! ( host != NULL || gpu != NULL || nBytes == 0 ) )
+        if ( ! ( host != NULL || nBytes == 0 ) )
         {
             std::stringstream msg;
             msg << "[" << __FILENAME__ << "::MirroredVector::push] "
@@ -724,42 +1137,268 @@ public:
                 << ", nBytes=" << nBytes << std::endl;
             throw std::runtime_error( msg.str() );
         }
-        CUDA_ERROR( cudaMemcpyAsync( (void*) gpu, (void*) host, nBytes,
-                                     cudaMemcpyHostToDevice, mStream ) );
-        CUDA_ERROR( cudaPeekAtLastError() );
+        if ( host != NULL )
+            reserveDevice();
+        /* mapped memory is read by the kernels directly and managed
+         * memory migrated on access, which prefetching speeds up */
+        if ( mHostMemory == MirroredHostManaged )
+            prefetchToDevice();
+        if ( hasOwnDeviceBuffer() )
+        {
+            if ( mbTrackDirty )
+            {
+                mHostDirty.forEachRange( [this]( size_t const iByte, size_t const n )
+                {
+                    CUDA_ERROR( cudaMemcpyAsync( (char*) gpu + iByte, (char*) host + iByte, n,
+                                                 cudaMemcpyHostToDevice, mStream ) );
+                } );
+            }
+            else
+            {
+                CUDA_ERROR( cudaMemcpyAsync( (void*) gpu, (void*) host, nBytes,
+                                             cudaMemcpyHostToDevice, mStream ) );
+            }
+            CUDA_ERROR( cudaPeekAtLastError() );
+        }
+        mHostDirty.clear();
         if ( ( rAsync == -1 && ! mAsync ) || ! rAsync )
             CUDA_ERROR( cudaStreamSynchronize( mStream ) );
     }
 
+    /**
+     * For mapped memory this only waits for the kernels writing to it,
+     * unless called asynchronously. Managed memory is prefetched to the
+     * host before that.
+     */
     inline void pop( int const rAsync = -1 ) const
     {
-        if ( ! ( host != NULL || gpu != NULL || nBytes == 0 ) )
+        if ( ! ( ( host != NULL && gpu != NULL && mnDeviceCapacity >= nElements ) || nBytes == 0 ) )
         {
             std::stringstream msg;
             msg << "[" << __FILENAME__ << "::MirroredVector::pop] "
-                << "Can't pop, need non NULL pointers and more than 0 elements. "
+                << "Can't pop, need non NULL pointers and a device buffer "
+                << "with room for all elements, i.e. push after growing. "
                 << "(host=" << (void*) host << ", gpu=" << (void*) gpu
-                << ", nBytes=" << nBytes << std::endl;
+                << ", nBytes=" << nBytes << ", device capacity="
+                << mnDeviceCapacity * sizeof(T) << " B)" << std::endl;
             throw std::runtime_error( msg.str() );
         }
-        CUDA_ERROR( cudaMemcpyAsync( (void*) host, (void*) gpu, nBytes,
-                                     cudaMemcpyDeviceToHost, mStream ) );
-        CUDA_ERROR( cudaPeekAtLastError() );
+        if ( mHostMemory == MirroredHostManaged )
+            prefetchToHost();
+        if ( hasOwnDeviceBuffer() )
+        {
+            if ( mbTrackDirty )
+            {
+                mDeviceDirty.forEachRange( [this]( size_t const iByte, size_t const n )
+                {
+                    CUDA_ERROR( cudaMemcpyAsync( (char*) host + iByte, (char*) gpu + iByte, n,
+                                                 cudaMemcpyDeviceToHost, mStream ) );
+                } );
+            }
+            else
+            {
+                CUDA_ERROR( cudaMemcpyAsync( (void*) host, (void*) gpu, nBytes,
+                                             cudaMemcpyDeviceToHost, mStream ) );
+            }
+            CUDA_ERROR( cudaPeekAtLastError() );
+        }
+        mDeviceDirty.clear();
         if ( ( rAsync == -1 && ! mAsync ) || ! rAsync )
             CUDA_ERROR( cudaStreamSynchronize( mStream ) );
     }
 
-    inline void free()
+    /**
+     * Queue the migration of all elements of managed memory to the device
+     * resp. the host into the stream and return immediately, so that the
+     * next kernel resp. host access doesn't fault page by page. Called by
+     * push and pop. Like the advices only hints, i.e. they do nothing for
+     * the other modes and devices without concurrent managed access.
+     */
+    inline void prefetchToDevice( void ) const
     {
-        if ( host != NULL )
+        if ( mHostMemory == MirroredHostManaged && mbConcurrentManaged && host != NULL && nBytes > 0 )
+            CUDA_ERROR( cudaMemPrefetchAsync( host, nBytes, miDevice, mStream ) );
+    }
+
+    inline void prefetchToHost( void ) const
+    {
+        if ( mHostMemory == MirroredHostManaged && mbConcurrentManaged && host != NULL && nBytes > 0 )
+            CUDA_ERROR( cudaMemPrefetchAsync( host, nBytes, cudaCpuDeviceId, mStream ) );
+    }
+
+    /**
+     * Sets or unsets an access hint for the whole managed buffer, e.g.
+     * MirroredAdviseReadMostly for lookup tables read by kernels and the
+     * host. Reallocations in reserve lose them.
+     */
+    inline void advise
+    (
+        MirroredManagedAdvice const rAdvice,
+        bool                  const rbSet   = true
+    )
+    {
+        if ( mHostMemory != MirroredHostManaged || ! mbConcurrentManaged || host == NULL )
+            return;
+        size_t const nCapacityBytes = std::max( mnCapacity * sizeof(T), (size_t) 1 );
+        switch ( rAdvice )
         {
-            ::free( host );
-            host = NULL;
+            case MirroredAdviseReadMostly:
+                CUDA_ERROR( cudaMemAdvise( host, nCapacityBytes, rbSet ? cudaMemAdviseSetReadMostly
+                                           : cudaMemAdviseUnsetReadMostly, miDevice ) );
+                break;
+            case MirroredAdvisePreferDevice:
+            case MirroredAdvisePreferHost:
+                CUDA_ERROR( cudaMemAdvise( host, nCapacityBytes, rbSet ? cudaMemAdviseSetPreferredLocation
+                                           : cudaMemAdviseUnsetPreferredLocation,
+                                           rAdvice == MirroredAdvisePreferHost ? cudaCpuDeviceId : miDevice ) );
+                break;
+        }
+    }
+
+    /**
+     * Replaces the device contents with those of rSource, which may live on
+     * another device, without going through the host buffers. Copies
+     * between devices are routed over peer links, @see copyCudaPeerRouted.
+     * The host contents of this vector become outdated, i.e. pop to see
+     * the copy. The copy is queued into the stream of this vector after
+     * waiting for the one of rSource.
+     */
+    inline void copyFromDevice
+    (
+        MirroredVector const & rSource,
+        int            const   rAsync = -1
+    )
+    {
+        if ( rSource.nElements != nElements )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::MirroredVector::copyFromDevice] "
+                << "Can't copy " << rSource.nElements << " elements into a vector of "
+                << nElements << " elements.";
+            throw std::invalid_argument( msg.str() );
+        }
+        if ( nBytes == 0 )
+            return;
+        if ( rSource.gpu == NULL || rSource.mnDeviceCapacity < rSource.nElements )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::MirroredVector::copyFromDevice] "
+                << "The source has no device buffer with room for all elements, "
+                << "i.e. push it after growing.";
+            throw std::invalid_argument( msg.str() );
+        }
+        reserveDevice();
+        if ( rSource.mStream != mStream )
+            CUDA_ERROR( cudaStreamSynchronize( rSource.mStream ) );
+        /* mapped and managed buffers are no device allocations, but with
+         * unified addressing plain copies work between them and any device */
+        if ( ! hasOwnDeviceBuffer() || ! rSource.hasOwnDeviceBuffer() )
+        {
+            CUDA_ERROR( cudaMemcpyAsync( (void*) gpu, (void*) rSource.gpu, nBytes,
+                                         cudaMemcpyDeviceToDevice, mStream ) );
+        }
+        else
+            copyCudaPeerRouted( gpu, miDevice, rSource.gpu, rSource.miDevice, nBytes, mStream );
+        if ( mbTrackDirty )
+        {
+            mHostDirty.clear();
+            mDeviceDirty.markAll();
+        }
+        if ( ( rAsync == -1 && ! mAsync ) || ! rAsync )
+            CUDA_ERROR( cudaStreamSynchronize( mStream ) );
+    }
+
+    /**
+     * From now on push and pop only transfer chunks marked as changed,
+     * coalesced into as few copies as possible. Changes on the host can be
+     * marked with markDirty or by writing through hostView. Kernels can't be
+     * tracked, so the ranges they wrote have to be marked with
+     * markDeviceDirty, else pop won't copy them!
+     * Everything on the host starts out dirty, so that the first push is
+     * complete.
+     *
+     * @param[in] rnChunkBytes granularity, e.g. 4096 for pages. Smaller
+     *            chunks copy less, but need more copy calls for scattered
+     *            changes, each of which costs some microseconds.
+     */
+    inline void enableDirtyTracking( size_t const rnChunkBytes = 4096 )
+    {
+        mbTrackDirty = true;
+        mHostDirty  .reset( nBytes, rnChunkBytes );
+        mDeviceDirty.reset( nBytes, rnChunkBytes );
+        mHostDirty.markAll();
+    }
+
+    inline bool isTrackingDirty( void ) const { return mbTrackDirty; }
+
+    /* marks the elements [riBegin, riEnd) as changed on the host */
+    inline void markDirty( size_t const riBegin, size_t const riEnd )
+    {
+        if ( mbTrackDirty )
+            mHostDirty.mark( riBegin * sizeof(T), riEnd * sizeof(T) );
+    }
+
+    /* marks the elements [riBegin, riEnd) as changed by a kernel */
+    inline void markDeviceDirty( size_t const riBegin, size_t const riEnd )
+    {
+        if ( mbTrackDirty )
+            mDeviceDirty.mark( riBegin * sizeof(T), riEnd * sizeof(T) );
+    }
+
+    inline void markAllDirty      ( void ) { markDirty      ( 0, nElements ); }
+    inline void markAllDeviceDirty( void ) { markDeviceDirty( 0, nElements ); }
+
+    inline DirtyChunkSet const & hostDirty  ( void ) const { return mHostDirty  ; }
+    inline DirtyChunkSet const & deviceDirty( void ) const { return mDeviceDirty; }
+
+    /**
+     * Host access which marks every element written via the non-const
+     * operator[] as dirty, e.g.:
+     *   auto view = vector.hostView();
+     *   for ( auto i : changedIndices ) view[i] = newValue( i );
+     *   vector.push();
+     */
+    class HostView
+    {
+    public:
+        inline explicit HostView( MirroredVector & rVector ) : mVector( rVector ) {}
+
+        inline T & operator[]( size_t const i )
+        {
+            assert( i < mVector.nElements );
+            if ( mVector.mbTrackDirty )
+                mVector.mHostDirty.markByte( i * sizeof(T) );
+            return mVector.host[i];
         }
+
+        inline T const & operator[]( size_t const i ) const
+        {
+            assert( i < mVector.nElements );
+            return mVector.host[i];
+        }
+
+        inline size_t size( void ) const { return mVector.nElements; }
+
+    private:
+        MirroredVector & mVector;
+    };
+
+    inline HostView hostView( void ) { return HostView( *this ); }
+
+    inline void free()
+    {
         if ( gpu != NULL )
         {
-            CUDA_ERROR( cudaFree( gpu ) );
+            freeDevice( gpu, mpDevicePool );
             gpu = NULL;
+            mpDevicePool = NULL;
+            mnDeviceCapacity = 0;
+        }
+        if ( host != NULL )
+        {
+            freeHost( host, mnCapacity );
+            host = NULL;
+            mnCapacity = 0;
         }
     }
 
@@ -782,6 +1421,15 @@ std::ostream & operator<<( std::ostream & out, MirroredVector<T> const & x )
     return out;
 }
 
+#endif
+
+#if defined( __CUDACC__ )
+
+/**
+ * The texture object is created once for the device buffer and size given
+ * at construction, therefore the size can't be changed afterwards, which
+ * would reallocate gpu on the next push.
+ */
 template< class T >
 class MirroredTexture : public MirroredVector<T>
 {
@@ -790,6 +1438,12 @@ public:
     cudaTextureDesc     mTexDesc;
     cudaTextureObject_t texture ;
 
+    void reserve( size_t ) = delete;
+    void resize( size_t, T const & = T() ) = delete;
+    void push_back( T const & ) = delete;
+    template< typename... T_Args > void emplace_back( T_Args && ... ) = delete;
+    void clear( void ) = delete;
+
     /**
      * @see http://docs.nvidia.com/cuda/cuda-runtime-api/group__CUDART__TEXTURE__OBJECT.html
      * @see https://devblogs.nvidia.com/parallelforall/cuda-pro-tip-kepler-texture-objects-improve-performance-and-flexibility/
@@ -853,7 +1507,14 @@ public:
 #endif
 
 
-template< class T > __device__ inline void swap( T & a, T & b )
+/**
+ * Only for arithmetic types, which have no associated namespace, so that
+ * argument-dependent lookup never finds this next to std::swap, e.g. in
+ * std::sort over types declared in the global namespace.
+ */
+template< class T > __device__ inline
+typename std::enable_if< std::is_arithmetic< T >::value >::type
+swap( T & a, T & b )
 {
     T const c = a;
     a = b;
@@ -870,47 +1531,61 @@ int snprintInt
     unsigned short int const base = 10u
 )
 {
-    assert( base <= ( '9' - '0' + 1 ) + ( 'Z' - 'A' + 1 ) && "base was chosen too high, not sure how to convert that to characters!" );
+    assert( base >= 2u && base <= ( '9' - '0' + 1 ) + ( 'Z' - 'A' + 1 ) && "base was chosen too high, not sure how to convert that to characters!" );
 
-    unsigned int nCharsWritten = 0u;
-    if ( nCharsWritten+1 >= nChars )
-        return 0;
-    else if ( number < 0 )
+    if ( nChars <= 1u )
     {
-        msg[ nCharsWritten++ ] = '-';
-        number = -number;
+        if ( nChars == 1u )
+            msg[0] = '\0';
+        return 0;
     }
 
-    unsigned int expFloorLogBase = 1;
-    while ( number / expFloorLogBase >= base )
-        expFloorLogBase *= base;
-
-    /* e.g. a possible run for 1230:
-     *   digit 0 = 1 = 1230 / 1000
-     *   digit 1 = 2 = 230  / 100
-     *   digit 2 = 3 = 30   / 10
-     *   digit 3 = 0 = 0    / 1 */
-    while ( expFloorLogBase != 0 )
+    /* format directly into msg if it is large enough, else cut off the last digits */
+    int nCharsWritten = 0;
+    if ( nChars > (unsigned int) nMaxFormattedIntegerChars )
+        nCharsWritten = formatInteger( msg, number, base );
+    else
     {
-        unsigned int const digit = number / expFloorLogBase;
-        number          %= expFloorLogBase;
-        expFloorLogBase /= base;
-        assert( digit <= base );
+        char digits[ nMaxFormattedIntegerChars ];
+        nCharsWritten = formatInteger( digits, number, base );
+        if ( (unsigned int) nCharsWritten > nChars - 1u )
+            nCharsWritten = nChars - 1u;
+        memcpy( msg, digits, nCharsWritten );
+    }
+    msg[ nCharsWritten ] = '\0';
+    return nCharsWritten;
+}
 
-        if ( nCharsWritten+1 < nChars )
-        {
-            if ( digit < '9' - '0' + 1 )
-                msg[ nCharsWritten++ ] = '0' + (unsigned char) digit;
-            else if ( digit - ( '9' - '0' + 1 ) < 'Z' - 'A' + 1u )
-                msg[ nCharsWritten++ ] = 'Z' + (unsigned char)( digit - ( '9' - '0' + 1u ) );
-            else
-                assert( false && "base was chosen too high, not sure how to convert that to characters!" );
-        }
-        else
-            break;
+/**
+ * Writes the shortest number reading back as the same float,
+ * @see formatFloat. Too long numbers are cut off.
+ */
+__host__ __device__ inline
+int snprintFloat
+(
+    char        * const msg   ,
+    unsigned int  const nChars,
+    float         const number
+)
+{
+    if ( nChars <= 1u )
+    {
+        if ( nChars == 1u )
+            msg[0] = '\0';
+        return 0;
     }
 
-    assert( nCharsWritten+1 <= nChars ); // includes nChars > 0
+    int nCharsWritten = 0;
+    if ( nChars > (unsigned int) nMaxFormattedFloatChars )
+        nCharsWritten = formatFloat( msg, number );
+    else
+    {
+        char digits[ nMaxFormattedFloatChars ];
+        nCharsWritten = formatFloat( digits, number );
+        if ( (unsigned int) nCharsWritten > nChars - 1u )
+            nCharsWritten = nChars - 1u;
+        memcpy( msg, digits, nCharsWritten );
+    }
     msg[ nCharsWritten ] = '\0';
     return nCharsWritten;
 }
@@ -930,8 +1605,7 @@ int snprintFloatArray
         if ( nCharsWritten + 1 >= nChars )
             break;
         msg[ nCharsWritten++ ] = ' ';
-        //nCharsWritten += snprintFloat( msg, nChars - nCharsWritten, gpData[j] );
-        nCharsWritten += snprintInt( msg + nCharsWritten, nChars - nCharsWritten, (int)( 10000 * gpData[j] ) );
+        nCharsWritten += snprintFloat( msg + nCharsWritten, nChars - nCharsWritten, gpData[j] );
     }
     assert( nCharsWritten < nChars );
     msg[ nCharsWritten ] = '\0';
@@ -1015,9 +1689,7 @@ inline bool inRange( T_Value const & x )
 #ifdef CUDACOMMON_GPUINFO_MAIN
     int main( void )
     {
-        cudaDeviceProp * pGpus = NULL;
-        int              nGpus = 0   ;
-        getCudaDeviceProperties( &pGpus, &nGpus, true );
+        getCudaDeviceProperties( true );
         return 0;
     }
 #endif
@@ -0,0 +1,452 @@
+/**
+ * Measured peak arithmetic throughput to validate the theoretical one,
+ * which is computed from the table in cudaarchitectures.hpp and the base
+ * clock, i.e. ignores boost clocks and throttling and is 0 for unknown
+ * architectures:
+ *
+ *   BenchmarkSuite host( "host" );
+ *   addHostComputeStrategies( host, pool );
+ *   auto results = host.run( { nHostFlops }, 5 );
+ *   ...
+ *   printComputePeaks( makeHostComputePeaks( results, pool.size() ) );
+ *
+ * Each thread runs several independent chains of FMAs, enough to hide the
+ * latency of the FMA pipelines, on values which stay in registers. On the
+ * GPU these are single and double precision FMAs and 32-bit integer
+ * multiply-adds (IMAD), on the host single and double precision FMAs in
+ * AVX-512 or AVX2 registers, chosen at compile time like in
+ * cudahostwarp.hpp, so the host part has to be compiled with -march=native
+ * to be meaningful. The strategies are measured with the BenchmarkSuite of
+ * cudabenchmarkharness.hpp, i.e. the throughput is the mean of several runs
+ * with a confidence interval, in FLOPS resp. integer operations per second
+ * counting an FMA as two operations.
+ *
+ * The theoretical host peak assumes two FMA units per core, as in all
+ * x86 server CPUs since Haswell resp. Zen 2 except some AVX-512 SKUs with
+ * only one, and the maximum clock from cpufreq. Achieving more than 100%
+ * hints at a higher clock than assumed, e.g. boost, and much less at
+ * throttling or, for the host, at hyper-threads sharing the FMA units.
+ */
+
+#pragma once
+
+#include <algorithm>                    // max
+#include <chrono>
+#include <cstdint>                      // uint32_t, uint64_t
+#include <cstdio>                       // printf, sscanf
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined( __AVX2__ ) || defined( __AVX512F__ )
+    /* the AVX-512 intrinsics of GCC 12 initialize _mm512_undefined_* with
+     * themselves, which triggers -Wuninitialized in every user */
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wuninitialized"
+#   pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#   include <immintrin.h>
+#   pragma GCC diagnostic pop
+#endif
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"
+#endif
+
+#include "cudaarchitectures.hpp"        // getCudaArchitecture
+#include "cudabenchmarkharness.hpp"     // BenchmarkSuite, BenchmarkResult
+#include "cudadevicecache.hpp"          // readSmallFile
+#include "cudahostbackend.hpp"          // HostThreadPool
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+/* independent accumulators per thread, FMA latency times FMA units, e.g. 4 x 2 */
+int const nComputeBenchmarkChains = 12;
+
+#if defined( __AVX512F__ )
+#   define HOST_FMA_SIMD "AVX-512"
+#elif defined( __AVX2__ ) && defined( __FMA__ )
+#   define HOST_FMA_SIMD "AVX2"
+#else
+#   define HOST_FMA_SIMD "scalar"
+#endif
+
+/**
+ * One register of FMAs for T, i.e. the widest one available at compile
+ * time, else a scalar, for which the compiler may or may not emit an FMA.
+ */
+template< typename T >
+struct HostFmaVector
+{
+    typedef T value_type;
+    static int const nLanes = 1;
+    static inline value_type set1( T const x ){ return x; }
+    static inline value_type fma( value_type const a, value_type const b, value_type const c ){ return a * b + c; }
+    static inline T sum( value_type const x ){ return x; }
+};
+
+#if defined( __AVX512F__ )
+
+template<> struct HostFmaVector< float >
+{
+    typedef __m512 value_type;
+    static int const nLanes = 16;
+    static inline value_type set1( float const x ){ return _mm512_set1_ps( x ); }
+    static inline value_type fma( value_type const a, value_type const b, value_type const c ){ return _mm512_fmadd_ps( a, b, c ); }
+    static inline float sum( value_type const x ){ return _mm512_reduce_add_ps( x ); }
+};
+
+template<> struct HostFmaVector< double >
+{
+    typedef __m512d value_type;
+    static int const nLanes = 8;
+    static inline value_type set1( double const x ){ return _mm512_set1_pd( x ); }
+    static inline value_type fma( value_type const a, value_type const b, value_type const c ){ return _mm512_fmadd_pd( a, b, c ); }
+    static inline double sum( value_type const x ){ return _mm512_reduce_add_pd( x ); }
+};
+
+#elif defined( __AVX2__ ) && defined( __FMA__ )
+
+template<> struct HostFmaVector< float >
+{
+    typedef __m256 value_type;
+    static int const nLanes = 8;
+    static inline value_type set1( float const x ){ return _mm256_set1_ps( x ); }
+    static inline value_type fma( value_type const a, value_type const b, value_type const c ){ return _mm256_fmadd_ps( a, b, c ); }
+    static inline float sum( value_type const x )
+    {
+        float lanes[ nLanes ];
+        _mm256_storeu_ps( lanes, x );
+        float result = 0;
+        for ( int i = 0; i < nLanes; ++i )
+            result += lanes[i];
+        return result;
+    }
+};
+
+template<> struct HostFmaVector< double >
+{
+    typedef __m256d value_type;
+    static int const nLanes = 4;
+    static inline value_type set1( double const x ){ return _mm256_set1_pd( x ); }
+    static inline value_type fma( value_type const a, value_type const b, value_type const c ){ return _mm256_fmadd_pd( a, b, c ); }
+    static inline double sum( value_type const x )
+    {
+        double lanes[ nLanes ];
+        _mm256_storeu_pd( lanes, x );
+        double result = 0;
+        for ( int i = 0; i < nLanes; ++i )
+            result += lanes[i];
+        return result;
+    }
+};
+
+#endif
+
+/**
+ * Runs rnIterations times nComputeBenchmarkChains FMAs on full registers.
+ * The chains converge to rAdd / ( 1 - rMultiplier ), so that there are no
+ * overflows or denormals, which would be slower.
+ * @return sum of all lanes, which has to be used to keep the FMAs
+ */
+template< typename T >
+inline T runHostFmaChains
+(
+    uint64_t const rnIterations,
+    T        const rMultiplier = T( 0.999 ),
+    T        const rAdd        = T( 0.001 )
+)
+{
+    typedef HostFmaVector< T > Vector;
+    typename Vector::value_type const multiplier = Vector::set1( rMultiplier );
+    typename Vector::value_type const add        = Vector::set1( rAdd );
+    typename Vector::value_type chains[ nComputeBenchmarkChains ];
+    for ( int i = 0; i < nComputeBenchmarkChains; ++i )
+        chains[i] = Vector::set1( T( i ) );
+    for ( uint64_t iIteration = 0; iIteration < rnIterations; ++iIteration )
+    {
+        /* else -O2 keeps the chains in memory, which limits them to the store forwarding latency */
+        #pragma GCC unroll 16
+        for ( int i = 0; i < nComputeBenchmarkChains; ++i )
+            chains[i] = Vector::fma( chains[i], multiplier, add );
+    }
+    T result = 0;
+    for ( int i = 0; i < nComputeBenchmarkChains; ++i )
+        result += Vector::sum( chains[i] );
+    return result;
+}
+
+/**
+ * @return maximum clock of the first CPU in Hz from cpufreq, else the
+ *         current one from /proc/cpuinfo, e.g. in virtual machines, or 0
+ */
+inline double getHostMaxClockHz( std::string const & rRootPath = "" )
+{
+    double kiloHertz = 0;
+    if ( sscanf( readSmallFile( rRootPath + "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq" ).c_str(),
+                 "%lf", &kiloHertz ) == 1 && kiloHertz > 0 )
+        return kiloHertz * 1e3;
+
+    std::ifstream cpuinfo( ( rRootPath + "/proc/cpuinfo" ).c_str() );
+    std::string line;
+    while ( std::getline( cpuinfo, line ) )
+    {
+        double megaHertz = 0;
+        if ( line.compare( 0, 7, "cpu MHz" ) == 0 && line.find( ':' ) != std::string::npos &&
+             sscanf( line.c_str() + line.find( ':' ) + 1, "%lf", &megaHertz ) == 1 )
+            return megaHertz * 1e6;
+    }
+    return 0;
+}
+
+/**
+ * @return FLOPS of FMAs in the widest registers HostFmaVector uses on all
+ *         given threads, or 0 if the clock is unknown
+ */
+template< typename T >
+inline double getHostPeakFlops
+(
+    unsigned int const rnThreads,
+    double       const rClockHz ,
+    int          const rnFmaUnitsPerCore = 2
+)
+{
+    return (double) rnThreads * rClockHz * rnFmaUnitsPerCore * HostFmaVector< T >::nLanes * 2 /* FMA */;
+}
+
+/**
+ * Runs the FMA chains on each thread of the pool, as many iterations as
+ * give at least rnFlops operations in total.
+ * @return seconds scaled to exactly rnFlops operations
+ */
+template< typename T >
+inline double measureHostFmaChains
+(
+    HostThreadPool       & rPool ,
+    uint64_t       const   rnFlops
+)
+{
+    uint64_t const nFlopsPerIteration = 2 * nComputeBenchmarkChains * HostFmaVector< T >::nLanes * rPool.size();
+    uint64_t const nIterations = std::max< uint64_t >( ( rnFlops + nFlopsPerIteration - 1 ) / nFlopsPerIteration, 1 );
+    /* written by the workers, so that the chains can't be optimized out */
+    std::vector< T > results( rPool.size() );
+    auto const t0 = std::chrono::steady_clock::now();
+    rPool.parallelFor( rPool.size(), [&]( uint64_t const iThread )
+    {
+        results[ iThread ] = runHostFmaChains< T >( nIterations );
+    } );
+    auto const t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration< double >( t1 - t0 ).count() * rnFlops / ( nIterations * nFlopsPerIteration );
+}
+
+/**
+ * Adds the strategies SP and DP to the group FMA_PEAK, which run the FMA
+ * chains on each thread of the pool. The sizes given to the suite are the
+ * number of floating point operations.
+ */
+inline void addHostComputeStrategies
+(
+    BenchmarkSuite       & rSuite,
+    HostThreadPool       & rPool
+)
+{
+    rSuite.add( "FMA_PEAK", "SP", [&rPool]( uint64_t const n ){ return measureHostFmaChains< float  >( rPool, n ); } );
+    rSuite.add( "FMA_PEAK", "DP", [&rPool]( uint64_t const n ){ return measureHostFmaChains< double >( rPool, n ); } );
+}
+
+#ifdef __CUDACC__
+
+#define TMP_CHECK( CALL ) \
+{ \
+    cudaError_t const error = CALL; \
+    if ( error != cudaSuccess ) \
+    { \
+        std::stringstream msg; \
+        msg << "[" << __FILENAME__ << "::addCudaComputeStrategies] " \
+            << #CALL << " failed with: " << cudaGetErrorString( error ); \
+        throw std::runtime_error( msg.str() ); \
+    } \
+}
+
+/**
+ * Each thread runs rnIterations times nComputeBenchmarkChains FMAs, resp.
+ * IMADs for uint32_t, which is unsigned, because the chains overflow
+ * within a few iterations, which would be undefined for signed integers
+ * and could let the compiler transform the timed loop. The result is only written if it has an impossible
+ * value, so that there is no memory traffic, but the compiler can't
+ * remove the loop.
+ */
+template< typename T >
+__global__ void kernelFmaChains( T * const rOut, int const rnIterations, T const rMultiplier, T const rAdd )
+{
+    T chains[ nComputeBenchmarkChains ];
+    #pragma unroll
+    for ( int i = 0; i < nComputeBenchmarkChains; ++i )
+        chains[i] = T( threadIdx.x + i );
+    #pragma unroll 16
+    for ( int iIteration = 0; iIteration < rnIterations; ++iIteration )
+    {
+        #pragma unroll
+        for ( int i = 0; i < nComputeBenchmarkChains; ++i )
+            chains[i] = chains[i] * rMultiplier + rAdd;
+    }
+    T result = 0;
+    #pragma unroll
+    for ( int i = 0; i < nComputeBenchmarkChains; ++i )
+        result += chains[i];
+    if ( result == T( -1 ) )
+        *rOut = result;
+}
+
+/**
+ * Adds the strategies SP, DP and INT32 to the group FMA_PEAK for the
+ * current device, which launch enough blocks of kernelFmaChains to keep
+ * all multiprocessors busy and are timed with events. The sizes are the
+ * number of operations like for addHostComputeStrategies.
+ */
+inline void addCudaComputeStrategies( BenchmarkSuite & rSuite )
+{
+    int iDevice = 0, nMultiprocessors = 0;
+    TMP_CHECK( cudaGetDevice( &iDevice ) )
+    TMP_CHECK( cudaDeviceGetAttribute( &nMultiprocessors, cudaDevAttrMultiProcessorCount, iDevice ) )
+    int const nThreadsPerBlock = 256;
+    int const nBlocks = nMultiprocessors * 8;
+    uint64_t const nThreads = (uint64_t) nBlocks * nThreadsPerBlock;
+
+    #define TMP_ADD( STRATEGY, T, MULTIPLIER, ADD )                                                 \
+    rSuite.add( "FMA_PEAK", STRATEGY, [=]( uint64_t const n )                                       \
+    {                                                                                               \
+        uint64_t const nOpsPerIteration = 2 * nComputeBenchmarkChains * nThreads;                   \
+        int const nIterations = (int) std::max< uint64_t >( n / nOpsPerIteration, 16 );             \
+        T * out = NULL;                                                                             \
+        TMP_CHECK( cudaMalloc( (void**) &out, sizeof( T ) ) )                                       \
+        cudaEvent_t start, stop;                                                                    \
+        TMP_CHECK( cudaEventCreate( &start ) )                                                      \
+        TMP_CHECK( cudaEventCreate( &stop ) )                                                       \
+        TMP_CHECK( cudaEventRecord( start ) )                                                       \
+        kernelFmaChains< T ><<< nBlocks, nThreadsPerBlock >>>( out, nIterations, MULTIPLIER, ADD ); \
+        TMP_CHECK( cudaEventRecord( stop ) )                                                        \
+        TMP_CHECK( cudaEventSynchronize( stop ) )                                                   \
+        float milliseconds = 0;                                                                     \
+        TMP_CHECK( cudaEventElapsedTime( &milliseconds, start, stop ) )                             \
+        TMP_CHECK( cudaEventDestroy( start ) )                                                      \
+        TMP_CHECK( cudaEventDestroy( stop ) )                                                       \
+        TMP_CHECK( cudaFree( out ) )                                                                \
+        return milliseconds / 1e3 * n / ( (double) nIterations * nOpsPerIteration );                \
+    } );
+    TMP_ADD( "SP"   , float  , 0.999f, 0.001f )
+    TMP_ADD( "DP"   , double , 0.999 , 0.001  )
+    TMP_ADD( "INT32", uint32_t, 3    , 1      )
+    #undef TMP_ADD
+}
+
+#undef TMP_CHECK
+
+#endif // __CUDACC__
+
+struct ComputePeak
+{
+    std::string target     ;
+    std::string strategy   ;
+    /* operations per second */
+    double      achieved   ;
+    double      ci95       ;
+    /* 0 if unknown */
+    double      theoretical;
+};
+
+/**
+ * @return the results of addHostComputeStrategies with the theoretical
+ *         peaks for rnThreads threads
+ */
+inline std::vector< ComputePeak > makeHostComputePeaks
+(
+    std::vector< BenchmarkResult > const & rResults ,
+    unsigned int                   const   rnThreads,
+    double                         const   rClockHz = getHostMaxClockHz()
+)
+{
+    std::vector< ComputePeak > peaks;
+    for ( auto const & result : rResults )
+    {
+        ComputePeak peak = { "host " HOST_FMA_SIMD " x" + std::to_string( rnThreads ),
+                             result.strategy, result.throughput, result.ci95, 0 };
+        if ( result.strategy == "SP" )
+            peak.theoretical = getHostPeakFlops< float  >( rnThreads, rClockHz );
+        else if ( result.strategy == "DP" )
+            peak.theoretical = getHostPeakFlops< double >( rnThreads, rClockHz );
+        peaks.push_back( peak );
+    }
+    return peaks;
+}
+
+/**
+ * @return the results of addCudaComputeStrategies with the theoretical
+ *         peaks of the device. INT32 assumes that all cores can do IMADs,
+ *         which overestimates e.g. 8.6, where half of them are FP32 only.
+ */
+inline std::vector< ComputePeak > makeCudaComputePeaks
+(
+    std::vector< BenchmarkResult > const & rResults   ,
+    cudaDeviceProp                 const & rProperties
+)
+{
+    CudaArchitecture const architecture = getCudaArchitecture( rProperties.major, rProperties.minor );
+    std::vector< ComputePeak > peaks;
+    for ( auto const & result : rResults )
+    {
+        ComputePeak peak = { rProperties.name, result.strategy, result.throughput, result.ci95, 0 };
+        if ( result.strategy == "SP" || result.strategy == "INT32" )
+            peak.theoretical = getCudaPeakFmaFlops( rProperties.multiProcessorCount, rProperties.clockRate,
+                                                    architecture.nCoresPerMultiprocessor );
+        else if ( result.strategy == "DP" )
+            peak.theoretical = getCudaPeakFmaFlops( rProperties.multiProcessorCount, rProperties.clockRate,
+                                                    architecture.nDoublePrecisionUnitsPerMultiprocessor );
+        peaks.push_back( peak );
+    }
+    return peaks;
+}
+
+/**
+ * Prints achieved versus theoretical peaks and, for each strategy measured
+ * on the host and on devices, how many times faster each device is than
+ * the host, which is what a scheduler needs to split work between them.
+ */
+inline void printComputePeaks( std::vector< ComputePeak > const & rPeaks )
+{
+    printf( "===================== Compute Peaks =====================\n" );
+    printf( "| Target                   | Type  | G(FL)OPS   | +-95%%     | Theoretical | Efficiency\n" );
+    for ( auto const & peak : rPeaks )
+    {
+        char theoretical[32] = "unknown";
+        char efficiency [32] = "-";
+        if ( peak.theoretical > 0 )
+        {
+            snprintf( theoretical, sizeof( theoretical ), "%.2f", peak.theoretical / 1e9 );
+            snprintf( efficiency , sizeof( efficiency  ), "%.1f%%", 100 * peak.achieved / peak.theoretical );
+        }
+        printf( "| %-24.24s | %-5s | %10.2f | %9.2f | %11s | %s\n", peak.target.c_str(), peak.strategy.c_str(),
+                peak.achieved / 1e9, peak.ci95 / 1e9, theoretical, efficiency );
+    }
+
+    for ( auto const & host : rPeaks )
+    {
+        if ( host.target.compare( 0, 5, "host " ) != 0 || host.achieved <= 0 )
+            continue;
+        for ( auto const & device : rPeaks )
+        {
+            if ( device.target.compare( 0, 5, "host " ) != 0 && device.strategy == host.strategy )
+            {
+                printf( "| %s %s / host: %.2f\n", device.target.c_str(), device.strategy.c_str(),
+                        device.achieved / host.achieved );
+            }
+        }
+    }
+    printf( "=========================================================\n" );
+}
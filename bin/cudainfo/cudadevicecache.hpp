@@ -0,0 +1,494 @@
+/**
+ * On-disk cache for the device properties, because the first query of them
+ * has to initialize the GPUs, which can take ca. 30s, while only reading the
+ * cache takes some microseconds.
+ *
+ * The snapshot is a binary dump of cudaDeviceProp and some additional
+ * attributes per device. It is tagged with a key which can be obtained
+ * without initializing any GPU:
+ *   - the driver version as reported by the runtime and the full version
+ *     string in /proc/driver/nvidia/version, i.e. also patch releases
+ *   - the PCI domain, bus and device IDs of all NVIDIA display controllers
+ *     found in /sys/bus/pci/devices
+ *   - CUDA_VISIBLE_DEVICES and CUDA_DEVICE_ORDER, which change the order
+ *     and number of devices seen by the runtime
+ * If any of these differ, or the file is corrupt, the cache is ignored.
+ *
+ * Without nvcc this works on the synthetic devices of cudahostruntime.hpp
+ * and the root for /proc and /sys can be changed, so that e.g. a change of
+ * the PCI topology can be simulated.
+ */
+
+#pragma once
+
+#include <algorithm>                    // sort, min
+#include <atomic>
+#include <cerrno>
+#include <cstdint>                      // uint32_t, uint64_t
+#include <cstdio>                       // FILE, fopen, fread, rename, snprintf, sscanf
+#include <cstdlib>                      // getenv
+#include <cstring>                      // memcpy, memcmp, memset
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>                     // opendir, readdir
+#include <sys/stat.h>                   // mkdir
+#include <unistd.h>                     // getpid
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"
+#endif
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+/**
+ * Attributes stored additionally to cudaDeviceProp. Only append to this
+ * list or else bump CUDA_DEVICE_SNAPSHOT_FORMAT_VERSION.
+ */
+static cudaDeviceAttr const cudaSnapshotAttributes[] =
+{
+    cudaDevAttrStreamPrioritiesSupported       , // 78
+    cudaDevAttrGlobalL1CacheSupported          , // 79
+    cudaDevAttrLocalL1CacheSupported           , // 80
+    cudaDevAttrMaxSharedMemoryPerMultiprocessor, // 81
+    cudaDevAttrMaxRegistersPerMultiprocessor   , // 82
+    cudaDevAttrManagedMemory                   , // 83
+    cudaDevAttrIsMultiGpuBoard                 , // 84
+    cudaDevAttrMultiGpuBoardGroupID            , // 85
+    cudaDevAttrSingleToDoublePrecisionPerfRatio, // 87
+    cudaDevAttrPageableMemoryAccess            , // 88
+    cudaDevAttrConcurrentManagedAccess           // 89
+};
+
+#define CUDA_DEVICE_SNAPSHOT_FORMAT_VERSION 1
+
+struct CudaDeviceSnapshot
+{
+    cudaDeviceProp properties;
+    /* values for cudaSnapshotAttributes, -1 if not supported */
+    int            attributes[ sizeof( cudaSnapshotAttributes ) / sizeof( cudaSnapshotAttributes[0] ) ];
+};
+
+/**
+ * @return value of the given attribute or -1 if it isn't stored in the
+ *         snapshot or wasn't supported by the driver
+ */
+inline int getCudaSnapshotAttribute
+(
+    CudaDeviceSnapshot const & rSnapshot,
+    int                const   rAttribute
+)
+{
+    for ( size_t i = 0; i < sizeof( cudaSnapshotAttributes ) / sizeof( cudaSnapshotAttributes[0] ); ++i )
+        if ( cudaSnapshotAttributes[i] == rAttribute )
+            return rSnapshot.attributes[i];
+    return -1;
+}
+
+struct CudaPciLocation
+{
+    int32_t domain;
+    int32_t bus   ;
+    int32_t device;
+};
+
+inline bool operator<( CudaPciLocation const & a, CudaPciLocation const & b )
+{
+    if ( a.domain != b.domain ) return a.domain < b.domain;
+    if ( a.bus    != b.bus    ) return a.bus    < b.bus   ;
+    return a.device < b.device;
+}
+
+struct CudaDeviceSnapshotKey
+{
+    int32_t                        driverVersion    ;
+    uint64_t                       driverStringHash ;
+    uint64_t                       environmentHash  ;
+    std::vector< CudaPciLocation > pciDevices       ;
+};
+
+/**
+ * 64-bit FNV-1a, only used to detect changes, not for security
+ */
+inline uint64_t hashFnv1a
+(
+    void     const * const rData ,
+    size_t           const rnBytes,
+    uint64_t               hash = 14695981039346656037ull
+)
+{
+    unsigned char const * const data = (unsigned char const *) rData;
+    for ( size_t i = 0; i < rnBytes; ++i )
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @return whole file contents or an empty string if it can't be read
+ */
+inline std::string readSmallFile( std::string const & rPath )
+{
+    std::string contents;
+    FILE * const file = fopen( rPath.c_str(), "rb" );
+    if ( file == NULL )
+        return contents;
+    char buffer[4096];
+    size_t nRead;
+    while ( ( nRead = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+        contents.append( buffer, nRead );
+    fclose( file );
+    return contents;
+}
+
+/**
+ * Lists NVIDIA (vendor 0x10de) VGA and 3D controllers (class 0x0300, 0x0302)
+ * without needing the driver, sorted by their location.
+ * @param[in] rRootPath prefix for /sys, e.g. for testing
+ */
+inline std::vector< CudaPciLocation > findNvidiaPciDevices
+(
+    std::string const & rRootPath = ""
+)
+{
+    std::vector< CudaPciLocation > locations;
+    std::string const devicesPath = rRootPath + "/sys/bus/pci/devices";
+    DIR * const directory = opendir( devicesPath.c_str() );
+    if ( directory == NULL )
+        return locations;
+
+    while ( struct dirent const * const entry = readdir( directory ) )
+    {
+        /* e.g. 0000:01:00.0 */
+        unsigned int domain, bus, device, function;
+        if ( sscanf( entry->d_name, "%x:%x:%x.%x", &domain, &bus, &device, &function ) != 4 )
+            continue;
+        std::string const path = devicesPath + "/" + entry->d_name;
+        if ( readSmallFile( path + "/vendor" ).compare( 0, 6, "0x10de" ) != 0 )
+            continue;
+        std::string const deviceClass = readSmallFile( path + "/class" );
+        if ( deviceClass.compare( 0, 6, "0x0300" ) != 0 &&
+             deviceClass.compare( 0, 6, "0x0302" ) != 0 )
+            continue;
+
+        CudaPciLocation const location = { (int32_t) domain, (int32_t) bus, (int32_t) device };
+        locations.push_back( location );
+    }
+    closedir( directory );
+
+    std::sort( locations.begin(), locations.end() );
+    return locations;
+}
+
+/**
+ * Gathers everything the validity of the snapshot depends on. This must
+ * not initialize the GPUs, else the cache would be pointless.
+ */
+inline CudaDeviceSnapshotKey probeCudaDeviceSnapshotKey
+(
+    std::string const & rRootPath = ""
+)
+{
+    CudaDeviceSnapshotKey key;
+
+    int driverVersion = 0;
+    if ( cudaDriverGetVersion( &driverVersion ) != cudaSuccess )
+    {
+        cudaGetLastError();
+        driverVersion = -1;
+    }
+    key.driverVersion = driverVersion;
+
+    std::string const driverString = readSmallFile( rRootPath + "/proc/driver/nvidia/version" );
+    key.driverStringHash = hashFnv1a( driverString.data(), driverString.size() );
+
+    key.environmentHash = hashFnv1a( NULL, 0 );
+    char const * const variables[] = { "CUDA_VISIBLE_DEVICES", "CUDA_DEVICE_ORDER" };
+    for ( size_t i = 0; i < sizeof( variables ) / sizeof( variables[0] ); ++i )
+    {
+        char const * const value = getenv( variables[i] );
+        /* distinguish unset from empty */
+        std::string const entry = value == NULL ? std::string( "\x01" ) : std::string( value ) + '\x02';
+        key.environmentHash = hashFnv1a( entry.data(), entry.size(), key.environmentHash );
+    }
+
+    key.pciDevices = findNvidiaPciDevices( rRootPath );
+    return key;
+}
+
+/**
+ * @return $CUDAINFO_CACHE, else $XDG_CACHE_HOME/cudainfo/devices.bin,
+ *         else ~/.cache/cudainfo/devices.bin or "" if none are set
+ */
+inline std::string getCudaDeviceCachePath( void )
+{
+    if ( char const * const path = getenv( "CUDAINFO_CACHE" ) )
+        return path;
+    if ( char const * const cache = getenv( "XDG_CACHE_HOME" ) )
+        if ( cache[0] != '\0' )
+            return std::string( cache ) + "/cudainfo/devices.bin";
+    if ( char const * const home = getenv( "HOME" ) )
+        return std::string( home ) + "/.cache/cudainfo/devices.bin";
+    return "";
+}
+
+/**
+ * Serializes key and snapshots into the on-disk format:
+ *   char[8]  magic "CUDASNAP"
+ *   uint32_t format version, sizeof( CudaDeviceSnapshot )
+ *   int32_t  runtime version compiled against (0 for the host runtime),
+ *            driver version
+ *   uint64_t driver string hash, environment hash
+ *   uint32_t number of PCI devices, number of CUDA devices
+ *   CudaPciLocation[], CudaDeviceSnapshot[]
+ *   uint64_t FNV-1a of all preceding bytes
+ * The result is only meant to be read on the same machine, i.e. no care
+ * is taken about endianness.
+ */
+inline std::vector< char > serializeCudaDeviceSnapshots
+(
+    std::vector< CudaDeviceSnapshot > const & rSnapshots,
+    CudaDeviceSnapshotKey             const & rKey
+)
+{
+    std::vector< char > data;
+    #define TMP_APPEND( POINTER, NBYTES ) \
+        data.insert( data.end(), (char const *)( POINTER ), (char const *)( POINTER ) + ( NBYTES ) );
+    #define TMP_APPEND_VALUE( TYPE, VALUE ) \
+        { TYPE const tmp = ( VALUE ); TMP_APPEND( &tmp, sizeof( tmp ) ) }
+
+    TMP_APPEND( "CUDASNAP", 8 )
+    TMP_APPEND_VALUE( uint32_t, CUDA_DEVICE_SNAPSHOT_FORMAT_VERSION )
+    TMP_APPEND_VALUE( uint32_t, sizeof( CudaDeviceSnapshot ) )
+    #ifdef CUDA_HOST_RUNTIME
+        TMP_APPEND_VALUE( int32_t, 0 )
+    #else
+        TMP_APPEND_VALUE( int32_t, CUDART_VERSION )
+    #endif
+    TMP_APPEND_VALUE( int32_t , rKey.driverVersion     )
+    TMP_APPEND_VALUE( uint64_t, rKey.driverStringHash  )
+    TMP_APPEND_VALUE( uint64_t, rKey.environmentHash   )
+    TMP_APPEND_VALUE( uint32_t, rKey.pciDevices.size() )
+    TMP_APPEND_VALUE( uint32_t, rSnapshots.size()      )
+    if ( ! rKey.pciDevices.empty() )
+        TMP_APPEND( &rKey.pciDevices[0], rKey.pciDevices.size() * sizeof( CudaPciLocation ) )
+    if ( ! rSnapshots.empty() )
+        TMP_APPEND( &rSnapshots[0], rSnapshots.size() * sizeof( CudaDeviceSnapshot ) )
+    TMP_APPEND_VALUE( uint64_t, hashFnv1a( &data[0], data.size() ) )
+
+    #undef TMP_APPEND
+    #undef TMP_APPEND_VALUE
+    return data;
+}
+
+/**
+ * @param[out] rSnapshots will only be modified on success
+ * @return false if the cache doesn't exist, is corrupt, or was written for
+ *         a different driver, PCI topology, or visible devices
+ */
+inline bool loadCudaDeviceSnapshots
+(
+    std::vector< CudaDeviceSnapshot > *         rSnapshots,
+    std::string                         const & rCachePath = getCudaDeviceCachePath(),
+    CudaDeviceSnapshotKey               const & rKey       = probeCudaDeviceSnapshotKey()
+)
+{
+    if ( rCachePath.empty() )
+        return false;
+    std::string const data = readSmallFile( rCachePath );
+
+    /* the header is everything up to the device count, which isn't part of the key */
+    std::vector< CudaDeviceSnapshot > const noSnapshots;
+    std::vector< char > const expected = serializeCudaDeviceSnapshots( noSnapshots, rKey );
+    size_t const nBytesHeader = 8 + 4 + 4 + 4 + 4 + 8 + 8 + 4;
+    size_t const nBytesPci    = rKey.pciDevices.size() * sizeof( CudaPciLocation );
+    if ( data.size() < nBytesHeader + 4 + nBytesPci + 8 ||
+         memcmp( data.data(), &expected[0], nBytesHeader ) != 0 ||
+         memcmp( data.data() + nBytesHeader + 4, &expected[ nBytesHeader + 4 ], nBytesPci ) != 0 )
+        return false;
+
+    uint32_t nDevices;
+    memcpy( &nDevices, data.data() + nBytesHeader, sizeof( nDevices ) );
+    size_t const nBytesTotal = nBytesHeader + 4 + nBytesPci + nDevices * sizeof( CudaDeviceSnapshot ) + 8;
+    if ( data.size() != nBytesTotal )
+        return false;
+
+    uint64_t checksum;
+    memcpy( &checksum, data.data() + nBytesTotal - 8, sizeof( checksum ) );
+    if ( checksum != hashFnv1a( data.data(), nBytesTotal - 8 ) )
+        return false;
+
+    rSnapshots->resize( nDevices );
+    if ( nDevices > 0 )
+        memcpy( &(*rSnapshots)[0], data.data() + nBytesHeader + 4 + nBytesPci,
+                nDevices * sizeof( CudaDeviceSnapshot ) );
+    return true;
+}
+
+/**
+ * Creates missing parent directories and replaces the cache atomically,
+ * so that concurrently started processes never read a partial file.
+ * @return false if the cache couldn't be written, which is not an error
+ *         as it only makes the next start slower
+ */
+inline bool saveCudaDeviceSnapshots
+(
+    std::vector< CudaDeviceSnapshot > const & rSnapshots,
+    std::string                       const & rCachePath = getCudaDeviceCachePath(),
+    CudaDeviceSnapshotKey             const & rKey       = probeCudaDeviceSnapshotKey()
+)
+{
+    if ( rCachePath.empty() )
+        return false;
+
+    for ( size_t i = rCachePath.find( '/', 1 ); i != std::string::npos; i = rCachePath.find( '/', i + 1 ) )
+        if ( mkdir( rCachePath.substr( 0, i ).c_str(), 0755 ) != 0 && errno != EEXIST )
+            return false;
+
+    std::stringstream tmpPath;
+    tmpPath << rCachePath << ".tmp." << getpid();
+    FILE * const file = fopen( tmpPath.str().c_str(), "wb" );
+    if ( file == NULL )
+        return false;
+    std::vector< char > const data = serializeCudaDeviceSnapshots( rSnapshots, rKey );
+    bool const bWritten = fwrite( &data[0], 1, data.size(), file ) == data.size();
+    if ( fclose( file ) != 0 || ! bWritten || rename( tmpPath.str().c_str(), rCachePath.c_str() ) != 0 )
+    {
+        remove( tmpPath.str().c_str() );
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Fills rSnapshot with the properties and attributes of one device.
+ * @return error of cudaGetDeviceProperties, unsupported attributes are
+ *         no error, but set to -1
+ */
+inline cudaError_t queryCudaDeviceSnapshot
+(
+    CudaDeviceSnapshot * const rSnapshot,
+    int                  const riDevice
+)
+{
+    memset( rSnapshot, 0, sizeof( *rSnapshot ) );
+    cudaError_t const error = cudaGetDeviceProperties( &rSnapshot->properties, riDevice );
+    if ( error != cudaSuccess )
+    {
+        /* the error state is per thread, so it has to be reset here */
+        cudaGetLastError();
+        return error;
+    }
+    for ( size_t i = 0; i < sizeof( cudaSnapshotAttributes ) / sizeof( cudaSnapshotAttributes[0] ); ++i )
+    {
+        if ( cudaDeviceGetAttribute( &rSnapshot->attributes[i], cudaSnapshotAttributes[i], riDevice ) != cudaSuccess )
+        {
+            cudaGetLastError();
+            rSnapshot->attributes[i] = -1;
+        }
+    }
+    return cudaSuccess;
+}
+
+/**
+ * Queries all devices using the runtime, which is the slow part, because
+ * the first query of each device initializes it. Therefore the devices
+ * are queried concurrently, each result being written to the slot of its
+ * device, i.e. the order is the same as for a serial query.
+ * No device at all is not an error, but results in an empty vector.
+ *
+ * @param[in] rnMaxThreads number of threads querying devices, 0 for one
+ *            per device, 1 queries all devices in the calling thread
+ * @throws std::runtime_error for the lowest device which couldn't be
+ *         queried, after all threads finished
+ */
+inline void queryCudaDeviceSnapshots
+(
+    std::vector< CudaDeviceSnapshot > * const rSnapshots,
+    unsigned int                        const rnMaxThreads = 0
+)
+{
+    int nDevices = 0;
+    cudaError_t const error = cudaGetDeviceCount( &nDevices );
+    if ( error != cudaSuccess )
+    {
+        cudaGetLastError();
+        if ( error != cudaErrorNoDevice )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::queryCudaDeviceSnapshots] "
+                << "Could not get the number of devices: " << cudaGetErrorString( error );
+            throw std::runtime_error( msg.str() );
+        }
+        nDevices = 0;
+    }
+
+    rSnapshots->resize( nDevices );
+    std::vector< cudaError_t > errors( nDevices, cudaSuccess );
+    /* devices are taken one by one, so that a slow device doesn't delay the others */
+    std::atomic< int > iNextDevice( 0 );
+    auto const queryDevices = [&]()
+    {
+        for ( int iDevice; ( iDevice = iNextDevice++ ) < nDevices; )
+            errors[ iDevice ] = queryCudaDeviceSnapshot( &(*rSnapshots)[ iDevice ], iDevice );
+    };
+
+    unsigned int const nThreads = rnMaxThreads == 0 ? nDevices : std::min( rnMaxThreads, (unsigned int) nDevices );
+    if ( nThreads <= 1 )
+        queryDevices();
+    else
+    {
+        std::vector< std::thread > threads;
+        for ( unsigned int iThread = 0; iThread < nThreads; ++iThread )
+            threads.push_back( std::thread( queryDevices ) );
+        for ( auto & thread : threads )
+            thread.join();
+    }
+
+    for ( int iDevice = 0; iDevice < nDevices; ++iDevice )
+    {
+        if ( errors[ iDevice ] != cudaSuccess )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::queryCudaDeviceSnapshots] "
+                << "Could not get properties of device " << iDevice << ": "
+                << cudaGetErrorString( errors[ iDevice ] );
+            throw std::runtime_error( msg.str() );
+        }
+    }
+}
+
+/**
+ * Returns the cached snapshots if still valid, else queries the devices
+ * and updates the cache.
+ * @param[out] rpbCached if not NULL, will be set to whether the cache was used
+ */
+inline std::vector< CudaDeviceSnapshot > getCudaDeviceSnapshots
+(
+    bool        * const   rpbCached  = NULL,
+    std::string   const & rCachePath = getCudaDeviceCachePath(),
+    std::string   const & rRootPath  = ""
+)
+{
+    CudaDeviceSnapshotKey const key = probeCudaDeviceSnapshotKey( rRootPath );
+    std::vector< CudaDeviceSnapshot > snapshots;
+    bool const bCached = loadCudaDeviceSnapshots( &snapshots, rCachePath, key );
+    if ( ! bCached )
+    {
+        queryCudaDeviceSnapshots( &snapshots );
+        saveCudaDeviceSnapshots( snapshots, rCachePath, key );
+    }
+    if ( rpbCached != NULL )
+        *rpbCached = bCached;
+    return snapshots;
+}
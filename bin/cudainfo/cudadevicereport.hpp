@@ -0,0 +1,568 @@
+/**
+ * The device properties as a flat list of named values grouped into
+ * sections, from which the human-readable table of getCudaDeviceProperties
+ * as well as machine-readable JSON and CSV are rendered:
+ *
+ *   std::vector< CudaDeviceSnapshot > const snapshots = getCudaDeviceSnapshots();
+ *   BufferedWriter out( stdout );
+ *   writeCudaDeviceReports( out, snapshots, CudaReportFormatJson );
+ *
+ * JSON is an array with one object per device and line, containing one
+ * object per section, e.g. {"device":0,"general":{"name":"GTX 760",...},
+ * "architecture":{...},...}. CSV has one header line with the columns
+ * named section.key and one line per device. Values of attributes the
+ * driver didn't support are null in JSON and empty in CSV. Units are only
+ * shown in the table, the keys of the machine-readable formats name them
+ * if necessary, e.g. clockRateGHz. The table keeps the rows of the former
+ * printf version, so a few fields are shown in parentheses or not at all,
+ * @see CudaReportTableStyle.
+ *
+ * Building a report doesn't allocate. Strings point into the snapshot,
+ * which therefore has to outlive the report.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cmath>                        // isfinite
+#include <cstdint>                      // int64_t
+#include <cstring>                      // strcmp, strlen
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"
+#endif
+
+#include "bufferedwriter.hpp"           // BufferedWriter
+#include "cudaarchitectures.hpp"        // getCudaArchitecture
+#include "cudadevicecache.hpp"          // CudaDeviceSnapshot, getCudaSnapshotAttribute
+#include "cudaroofline.hpp"             // getCudaPeakBandwidth
+
+
+enum CudaReportFormat
+{
+    CudaReportFormatTable,
+    CudaReportFormatJson ,
+    CudaReportFormatCsv
+};
+
+/* @return false if rName is none of table, json and csv */
+inline bool parseCudaReportFormat( char const * const rName, CudaReportFormat * const rFormat )
+{
+    if      ( strcmp( rName, "table" ) == 0 ) *rFormat = CudaReportFormatTable;
+    else if ( strcmp( rName, "json"  ) == 0 ) *rFormat = CudaReportFormatJson ;
+    else if ( strcmp( rName, "csv"   ) == 0 ) *rFormat = CudaReportFormatCsv  ;
+    else
+        return false;
+    return true;
+}
+
+enum CudaReportValueType
+{
+    CudaReportSection,              /* starts a new group of values */
+    CudaReportString ,
+    CudaReportInteger,
+    CudaReportFloat  ,
+    CudaReportBool   ,
+    CudaReportTuple  ,              /* nIntegers integers, e.g. max. block size */
+    CudaReportVersion,              /* major.minor */
+    CudaReportUnknown               /* unsupported attribute */
+};
+
+/* how a field appears in the table, JSON and CSV contain all fields */
+enum CudaReportTableStyle
+{
+    CudaReportTableRow        ,     /* own row */
+    CudaReportTableParentheses,     /* appended to the previous row, e.g. "32 (24)" */
+    CudaReportTableHidden
+};
+
+struct CudaReportField
+{
+    CudaReportValueType  type    ;
+    /* JSON key and CSV column, e.g. "totalGlobalMemory" */
+    char const *         key     ;
+    /* row label and unit for the table, unit may be NULL */
+    char const *         label   ;
+    char const *         unit    ;
+    char const *         string  ;
+    int64_t              integers[3];
+    int                  nIntegers;
+    double               number  ;
+    CudaReportTableStyle tableStyle;
+};
+
+struct CudaDeviceReport
+{
+    static int const nMaxFields = 96;
+
+    int             iDevice;
+    int             nFields;
+    CudaReportField fields[ nMaxFields ];
+
+    inline CudaReportField & add
+    (
+        CudaReportValueType const rType ,
+        char const *        const rKey  ,
+        char const *        const rLabel,
+        char const *        const rUnit = NULL
+    )
+    {
+        assert( nFields < nMaxFields );
+        CudaReportField & field = fields[ nFields++ ];
+        field.type      = rType;
+        field.key       = rKey;
+        field.label     = rLabel;
+        field.unit      = rUnit;
+        field.string    = NULL;
+        field.nIntegers = 0;
+        field.number    = 0;
+        field.tableStyle = CudaReportTableRow;
+        return field;
+    }
+
+    inline CudaReportField & last( void )
+    {
+        assert( nFields > 0 );
+        return fields[ nFields - 1 ];
+    }
+
+    inline void addSection( char const * const rKey, char const * const rLabel )
+    {
+        add( CudaReportSection, rKey, rLabel );
+    }
+
+    inline void addString( char const * const rKey, char const * const rLabel, char const * const rValue )
+    {
+        add( CudaReportString, rKey, rLabel ).string = rValue;
+    }
+
+    inline void addInteger( char const * const rKey, char const * const rLabel, int64_t const rValue,
+                            char const * const rUnit = NULL )
+    {
+        CudaReportField & field = add( CudaReportInteger, rKey, rLabel, rUnit );
+        field.integers[0] = rValue;
+        field.nIntegers   = 1;
+    }
+
+    inline void addFloat( char const * const rKey, char const * const rLabel, double const rValue,
+                          char const * const rUnit = NULL )
+    {
+        add( CudaReportFloat, rKey, rLabel, rUnit ).number = rValue;
+    }
+
+    inline void addBool( char const * const rKey, char const * const rLabel, bool const rValue )
+    {
+        add( CudaReportBool, rKey, rLabel ).integers[0] = rValue ? 1 : 0;
+    }
+
+    inline void addTuple( char const * const rKey, char const * const rLabel, int const * const rValues,
+                          int const rnValues )
+    {
+        assert( rnValues <= 3 );
+        CudaReportField & field = add( CudaReportTuple, rKey, rLabel );
+        for ( int i = 0; i < rnValues; ++i )
+            field.integers[i] = rValues[i];
+        field.nIntegers = rnValues;
+    }
+
+    /* rValue is -1 if the attribute is not supported, @see getCudaSnapshotAttribute */
+    inline void addAttribute( char const * const rKey, char const * const rLabel, int const rValue,
+                              char const * const rUnit = NULL )
+    {
+        if ( rValue < 0 )
+            add( CudaReportUnknown, rKey, rLabel );
+        else
+            addInteger( rKey, rLabel, rValue, rUnit );
+    }
+
+    inline void addBoolAttribute( char const * const rKey, char const * const rLabel, int const rValue )
+    {
+        if ( rValue < 0 )
+            add( CudaReportUnknown, rKey, rLabel );
+        else
+            addBool( rKey, rLabel, rValue != 0 );
+    }
+};
+
+inline char const * getCudaComputeModeName( int const rComputeMode )
+{
+    /* values of cudaComputeMode */
+    switch ( rComputeMode )
+    {
+        case 0 : return "Default";
+        case 1 : return "Exclusive";
+        case 2 : return "Prohibited";
+        case 3 : return "ExclusiveProcess";
+        default: return "Unknown";
+    }
+}
+
+#ifdef __CUDACC__
+
+inline char const * getCudaCacheConfigName( cudaFuncCache const rConfig )
+{
+    switch ( rConfig )
+    {
+        case cudaFuncCachePreferNone  : return "Prefer None";
+        case cudaFuncCachePreferShared: return "Prefer Shared";
+        case cudaFuncCachePreferL1    : return "Prefer L1";
+        case cudaFuncCachePreferEqual : return "Prefer Equal";
+        default: return "?";
+    }
+}
+
+inline char const * getCudaSharedMemBankSizeName( cudaSharedMemConfig const rConfig )
+{
+    switch ( rConfig )
+    {
+        case cudaSharedMemBankSizeDefault  : return "Default";
+        case cudaSharedMemBankSizeFourByte : return "4 Bytes";
+        case cudaSharedMemBankSizeEightByte: return "8 Bytes";
+        default: return "?";
+    }
+}
+
+#endif // __CUDACC__
+
+/**
+ * @param[out] rReport filled with the values of rSnapshot, which must
+ *             outlive it. The cache and shared memory bank configuration
+ *             can't be cached, therefore they are queried from the current
+ *             device, but only when compiled with nvcc.
+ */
+inline void makeCudaDeviceReport
+(
+    CudaDeviceSnapshot const & rSnapshot,
+    int                const   riDevice ,
+    CudaDeviceReport         & rReport
+)
+{
+    cudaDeviceProp const & prop = rSnapshot.properties;
+    CudaArchitecture const arch = getCudaArchitecture( prop.major, prop.minor );
+    rReport.iDevice = riDevice;
+    rReport.nFields = 0;
+
+    double const peakSPFlops = getCudaPeakFmaFlops( prop.multiProcessorCount, prop.clockRate,
+                                                    arch.nCoresPerMultiprocessor );
+    double const peakDPFlops = getCudaPeakFmaFlops( prop.multiProcessorCount, prop.clockRate,
+                                                    arch.nDoublePrecisionUnitsPerMultiprocessor );
+    double const peakBandwidth = getCudaPeakBandwidth( prop );
+    #define TMP_ATTRIBUTE( NAME ) getCudaSnapshotAttribute( rSnapshot, cudaDevAttr##NAME )
+
+    rReport.addSection( "general", "" );
+    rReport.addString ( "name"             , "Device name"              , prop.name );
+    CudaReportField & version = rReport.add( CudaReportVersion, "computeCapability", "Computability" );
+    version.integers[0] = prop.major;
+    version.integers[1] = prop.minor;
+    version.nIntegers   = 2;
+    rReport.addString ( "codeName"         , "Code Name"                , arch.codeName );
+    rReport.addInteger( "pciBusId"         , "PCI Bus ID"               , prop.pciBusID );
+    rReport.addInteger( "pciDeviceId"      , "PCI Device ID"            , prop.pciDeviceID );
+    rReport.addInteger( "pciDomainId"      , "PCI Domain ID"            , prop.pciDomainID );
+
+    rReport.addSection( "architecture", "Architecture" );
+    rReport.addInteger( "multiprocessors"  , "Number of SMX"            , prop.multiProcessorCount );
+    rReport.addInteger( "maxThreadsPerMultiprocessor", "Max Threads per SMX", prop.maxThreadsPerMultiProcessor );
+    rReport.addInteger( "maxThreadsPerBlock", "Max Threads per Block"   , prop.maxThreadsPerBlock );
+    rReport.addInteger( "warpSize"         , "Warp Size"                , prop.warpSize );
+    rReport.addInteger( "warpSchedulersPerMultiprocessor", "Warp Schedulers per MP", arch.nWarpSchedulersPerMultiprocessor );
+    rReport.addFloat  ( "clockRateGHz"     , "Clock Rate"               , prop.clockRate / 1e6, "GHz" );
+    rReport.addTuple  ( "maxBlockSize"     , "Max Block Size"           , prop.maxThreadsDim, 3 );
+    rReport.addTuple  ( "maxGridSize"      , "Max Grid Size"            , prop.maxGridSize  , 3 );
+    rReport.addInteger( "maxConcurrentThreads", " => Max conc. Threads" ,
+                        (int64_t) prop.multiProcessorCount * prop.maxThreadsPerMultiProcessor );
+    rReport.addInteger( "warpsPerMultiprocessor", " => Warps per SMX"   ,
+                        prop.warpSize > 0 ? prop.maxThreadsPerMultiProcessor / prop.warpSize : 0 );
+    rReport.addInteger( "coresPerMultiprocessor", "CUDA Cores per Multiproc.", arch.nCoresPerMultiprocessor );
+    rReport.addInteger( "cores"            , "Total CUDA Cores"         ,
+                        (int64_t) prop.multiProcessorCount * arch.nCoresPerMultiprocessor );
+    rReport.addFloat  ( "peakSPGFlops"     , "Peak SP-FLOPS"            , peakSPFlops / 1e9, "GFLOPS" );
+    rReport.addFloat  ( "peakDPGFlops"     , "Peak DP-FLOPS"            , peakDPFlops / 1e9, "GFLOPS" );
+    rReport.addAttribute( "spToDpFlopsRatio", "Peak SP/DP-FLOPS"        , TMP_ATTRIBUTE( SingleToDoublePrecisionPerfRatio ) );
+    /* the ratio of the units as a cross-check for the one reported by the driver */
+    rReport.addAttribute( "spToDpCoresRatio", "Peak SP/DP-Cores"        ,
+                          arch.nDoublePrecisionUnitsPerMultiprocessor > 0 ?
+                          arch.nCoresPerMultiprocessor / arch.nDoublePrecisionUnitsPerMultiprocessor : -1 );
+    rReport.last().tableStyle = CudaReportTableParentheses;
+    rReport.addInteger( "specialFunctionUnitsPerMultiprocessor", "Special Fun. Units per MP", arch.nSpecialFunctionUnitsPerMultiprocessor );
+
+    rReport.addSection( "memory", "Memory" );
+    rReport.addInteger( "totalGlobalMemory", "Total Global Memory"      , prop.totalGlobalMem   , "Bytes" );
+    rReport.addInteger( "totalConstantMemory", "Total Constant Memory"  , prop.totalConstMem    , "Bytes" );
+    rReport.addInteger( "sharedMemoryPerBlock", "Shared Memory per Block", prop.sharedMemPerBlock, "Bytes" );
+    rReport.addAttribute( "sharedMemoryPerMultiprocessor", "Shared Memory per Multip.", TMP_ATTRIBUTE( MaxSharedMemoryPerMultiprocessor ), "Bytes" );
+    rReport.addBoolAttribute( "globalL1CacheSupported", "Global L1 Cache supported", TMP_ATTRIBUTE( GlobalL1CacheSupported ) );
+    rReport.addBoolAttribute( "localL1CacheSupported" , "Local  L1 Cache supported", TMP_ATTRIBUTE( LocalL1CacheSupported  ) );
+    rReport.addInteger( "l2CacheSize"      , "L2 Cache Size"            , prop.l2CacheSize      , "Bytes" );
+    rReport.addInteger( "registersPerBlock", "Registers per Block"      , prop.regsPerBlock );
+    rReport.addAttribute( "registersPerMultiprocessor", "Registers per Multiproc.", TMP_ATTRIBUTE( MaxRegistersPerMultiprocessor ) );
+    rReport.addInteger( "memoryBusWidth"   , "Memory Bus Width"         , prop.memoryBusWidth   , "Bits" );
+    rReport.addFloat  ( "memoryClockRateGHz", "Memory Clock Rate"       , prop.memoryClockRate / 1e6, "GHz" );
+    rReport.addFloat  ( "peakBandwidthGBs" , "Peak Bandwidth"           , peakBandwidth / 1e9, "GB/s" );
+    rReport.addFloat  ( "ridgePointSP"     , "Ridge Point SP"           , peakBandwidth > 0 ? peakSPFlops / peakBandwidth : 0, "FLOP/Byte" );
+    rReport.addFloat  ( "ridgePointDP"     , "Ridge Point DP"           , peakBandwidth > 0 ? peakDPFlops / peakBandwidth : 0, "FLOP/Byte" );
+    rReport.addInteger( "memoryPitch"      , "Memory Pitch"             , prop.memPitch );
+    rReport.addInteger( "unifiedAddressing", "Unified Addressing"       , prop.unifiedAddressing );
+    rReport.addBoolAttribute( "managedMemory", "Managed Memory"         , TMP_ATTRIBUTE( ManagedMemory ) );
+    rReport.addBoolAttribute( "concurrentManagedAccess", "Conc. Managed Access", TMP_ATTRIBUTE( ConcurrentManagedAccess ) );
+    rReport.addBoolAttribute( "pageableMemoryAccess", "Pageable Memory Access", TMP_ATTRIBUTE( PageableMemoryAccess ) );
+    rReport.addInteger( "textureAlignment" , "Texture Alignment"        , prop.textureAlignment );
+    rReport.addInteger( "maxTexture1D"     , "Max 1D Texture Size"      , prop.maxTexture1D );
+    rReport.addTuple  ( "maxTexture2D"     , "Max 2D Texture Size"      , prop.maxTexture2D, 2 );
+    rReport.addTuple  ( "maxTexture3D"     , "Max 3D Texture Size"      , prop.maxTexture3D, 3 );
+    #ifdef __CUDACC__
+    {
+        cudaFuncCache cacheConfig;
+        cudaSharedMemConfig bankSize;
+        if ( cudaDeviceGetCacheConfig( &cacheConfig ) == cudaSuccess )
+            rReport.addString( "cacheConfiguration", "Cache Configuration", getCudaCacheConfigName( cacheConfig ) );
+        if ( cudaDeviceGetSharedMemConfig( &bankSize ) == cudaSuccess )
+            rReport.addString( "sharedMemoryBankSize", "Shared Memory Bank Size", getCudaSharedMemBankSizeName( bankSize ) );
+    }
+    #endif
+
+    rReport.addSection( "graphics", "Graphics" );
+    rReport.addString ( "computeMode"      , "Compute mode"             , getCudaComputeModeName( prop.computeMode ) );
+
+    rReport.addSection( "other", "Other" );
+    rReport.addBool   ( "canMapHostMemory" , "Can map Host Memory"      , prop.canMapHostMemory  != 0 );
+    rReport.addBool   ( "concurrentKernels", "Can run Kernels conc."    , prop.concurrentKernels != 0 );
+    rReport.addInteger( "maxConcurrentKernels", "  => max. conc. kernels", arch.nMaxConcurrentKernels );
+    rReport.addInteger( "asyncEngines"     , "Number of Asyn. Engines"  , prop.asyncEngineCount );
+    rReport.addBool   ( "deviceOverlap"    , "Can Copy and Kernel conc.", prop.deviceOverlap     != 0 );
+    rReport.addBool   ( "eccEnabled"       , "ECC Enabled"              , prop.ECCEnabled        != 0 );
+    rReport.addBool   ( "integrated"       , "Device is Integrated"     , prop.integrated        != 0 );
+    rReport.addBool   ( "kernelTimeoutEnabled", "Kernel Timeout Enabled", prop.kernelExecTimeoutEnabled != 0 );
+    rReport.addBool   ( "tccDriver"        , "Uses TESLA Driver"        , prop.tccDriver         != 0 );
+    rReport.addBoolAttribute( "streamPrioritiesSupported", "Stream Priorities Supp.", TMP_ATTRIBUTE( StreamPrioritiesSupported ) );
+    rReport.addBoolAttribute( "multiGpuBoard", "Multi-GPU Board"        , TMP_ATTRIBUTE( IsMultiGpuBoard ) );
+    rReport.addAttribute( "multiGpuBoardGroupId", "Multi-GPU Board ID"  , TMP_ATTRIBUTE( MultiGpuBoardGroupID ) );
+    /* kept for devices on single-GPU boards, so that all CSV rows have the same columns */
+    if ( TMP_ATTRIBUTE( IsMultiGpuBoard ) <= 0 )
+        rReport.last().tableStyle = CudaReportTableHidden;
+
+    #undef TMP_ATTRIBUTE
+}
+
+/* writes the value like in JSON, but without quotes and tuples in parentheses */
+inline void writeCudaReportPlainValue( BufferedWriter & rOut, CudaReportField const & rField )
+{
+    switch ( rField.type )
+    {
+        case CudaReportSection: break;
+        case CudaReportString : rOut.write( rField.string ); break;
+        case CudaReportInteger: rOut.writeInteger( rField.integers[0] ); break;
+        case CudaReportFloat  : rOut.writeFloat( (float) rField.number ); break;
+        case CudaReportBool   : rOut.write( rField.integers[0] != 0 ? "true" : "false" ); break;
+        case CudaReportUnknown: rOut.write( "unknown" ); break;
+        case CudaReportVersion:
+            rOut.writeInteger( rField.integers[0] ).put( '.' ).writeInteger( rField.integers[1] );
+            break;
+        case CudaReportTuple:
+            rOut.put( '(' );
+            for ( int i = 0; i < rField.nIntegers; ++i )
+            {
+                if ( i > 0 )
+                    rOut.put( ',' );
+                rOut.writeInteger( rField.integers[i] );
+            }
+            rOut.put( ')' );
+            break;
+    }
+}
+
+/**
+ * Writes the same table as getCudaDeviceProperties, but without the
+ * closing line, so that more rows can be appended.
+ */
+inline void writeCudaDeviceReportTable( BufferedWriter & rOut, CudaDeviceReport const & rReport )
+{
+    int const nWidth = 52;
+    rOut.write( "\n================== Device Number " ).writeInteger( rReport.iDevice )
+        .write( " ==================\n" );
+    for ( int i = 0; i < rReport.nFields; ++i )
+    {
+        CudaReportField const & field = rReport.fields[i];
+        if ( field.type == CudaReportSection )
+        {
+            /* e.g. |------------------- Architecture ------------------- */
+            int const nChars = (int) strlen( field.label );
+            if ( nChars == 0 )
+                continue;
+            int const nLeft = ( nWidth - nChars - 2 ) / 2;
+            rOut.put( '|' ).fill( '-', nLeft ).put( ' ' ).write( field.label ).put( ' ' )
+                .fill( '-', nWidth - nChars - 2 - nLeft ).put( '\n' );
+            continue;
+        }
+        if ( field.tableStyle != CudaReportTableRow )
+            continue;
+        int const nChars = (int) strlen( field.label );
+        rOut.write( "| " ).write( field.label ).fill( ' ', 25 - nChars ).write( ": " );
+        writeCudaReportPlainValue( rOut, field );
+        if ( field.unit != NULL && field.type != CudaReportUnknown )
+            rOut.put( ' ' ).write( field.unit );
+        for ( int j = i + 1; j < rReport.nFields && rReport.fields[j].tableStyle == CudaReportTableParentheses; ++j )
+        {
+            rOut.write( " (" );
+            writeCudaReportPlainValue( rOut, rReport.fields[j] );
+            rOut.put( ')' );
+        }
+        rOut.put( '\n' );
+    }
+}
+
+inline void writeCudaReportJsonValue( BufferedWriter & rOut, CudaReportField const & rField )
+{
+    switch ( rField.type )
+    {
+        case CudaReportSection: break;
+        case CudaReportString : rOut.writeJsonString( rField.string ); break;
+        case CudaReportInteger: rOut.writeInteger( rField.integers[0] ); break;
+        case CudaReportBool   : rOut.write( rField.integers[0] != 0 ? "true" : "false" ); break;
+        case CudaReportUnknown: rOut.write( "null" ); break;
+        case CudaReportFloat  :
+            if ( std::isfinite( rField.number ) )
+                rOut.writeFloat( (float) rField.number );
+            else
+                rOut.write( "null" );
+            break;
+        case CudaReportVersion:
+            rOut.put( '"' ).writeInteger( rField.integers[0] ).put( '.' )
+                .writeInteger( rField.integers[1] ).put( '"' );
+            break;
+        case CudaReportTuple:
+            rOut.put( '[' );
+            for ( int i = 0; i < rField.nIntegers; ++i )
+            {
+                if ( i > 0 )
+                    rOut.put( ',' );
+                rOut.writeInteger( rField.integers[i] );
+            }
+            rOut.put( ']' );
+            break;
+    }
+}
+
+inline void writeCudaDeviceReportJson( BufferedWriter & rOut, CudaDeviceReport const & rReport )
+{
+    rOut.write( "{\"device\":" ).writeInteger( rReport.iDevice );
+    bool bInSection = false;
+    bool bFirstInSection = true;
+    for ( int i = 0; i < rReport.nFields; ++i )
+    {
+        CudaReportField const & field = rReport.fields[i];
+        if ( field.type == CudaReportSection )
+        {
+            if ( bInSection )
+                rOut.put( '}' );
+            rOut.put( ',' ).writeJsonString( field.key ).write( ":{" );
+            bInSection = true;
+            bFirstInSection = true;
+            continue;
+        }
+        if ( ! bFirstInSection || ! bInSection )
+            rOut.put( ',' );
+        bFirstInSection = false;
+        rOut.writeJsonString( field.key ).put( ':' );
+        writeCudaReportJsonValue( rOut, field );
+    }
+    if ( bInSection )
+        rOut.put( '}' );
+    rOut.put( '}' );
+}
+
+/* header line with the column names, e.g. device,general.name,... */
+inline void writeCudaDeviceReportCsvHeader( BufferedWriter & rOut, CudaDeviceReport const & rReport )
+{
+    rOut.write( "device" );
+    char const * section = NULL;
+    for ( int i = 0; i < rReport.nFields; ++i )
+    {
+        CudaReportField const & field = rReport.fields[i];
+        if ( field.type == CudaReportSection )
+        {
+            section = field.key;
+            continue;
+        }
+        rOut.put( ',' );
+        if ( section != NULL )
+            rOut.write( section ).put( '.' );
+        rOut.write( field.key );
+    }
+    rOut.put( '\n' );
+}
+
+inline void writeCudaDeviceReportCsv( BufferedWriter & rOut, CudaDeviceReport const & rReport )
+{
+    rOut.writeInteger( rReport.iDevice );
+    for ( int i = 0; i < rReport.nFields; ++i )
+    {
+        CudaReportField const & field = rReport.fields[i];
+        if ( field.type == CudaReportSection )
+            continue;
+        rOut.put( ',' );
+        switch ( field.type )
+        {
+            case CudaReportString : rOut.writeCsvField( field.string ); break;
+            case CudaReportUnknown: break;
+            case CudaReportFloat  :
+                if ( std::isfinite( field.number ) )
+                    rOut.writeFloat( (float) field.number );
+                break;
+            case CudaReportTuple:
+                /* the comma separated tuple has to be quoted */
+                rOut.put( '"' );
+                writeCudaReportPlainValue( rOut, field );
+                rOut.put( '"' );
+                break;
+            default:
+                writeCudaReportPlainValue( rOut, field );
+                break;
+        }
+    }
+    rOut.put( '\n' );
+}
+
+/**
+ * Writes the reports of all devices in the given format. The table is
+ * closed with a line of '=' per device.
+ */
+inline void writeCudaDeviceReports
+(
+    BufferedWriter                          & rOut      ,
+    std::vector< CudaDeviceSnapshot > const & rSnapshots,
+    CudaReportFormat                  const   rFormat
+)
+{
+    /* one report reused for all devices */
+    CudaDeviceReport report;
+    if ( rFormat == CudaReportFormatJson )
+        rOut.put( '[' );
+    for ( size_t iDevice = 0; iDevice < rSnapshots.size(); ++iDevice )
+    {
+        makeCudaDeviceReport( rSnapshots[ iDevice ], (int) iDevice, report );
+        switch ( rFormat )
+        {
+            case CudaReportFormatTable:
+                writeCudaDeviceReportTable( rOut, report );
+                rOut.fill( '=', 53 ).put( '\n' );
+                break;
+            case CudaReportFormatJson:
+                if ( iDevice > 0 )
+                    rOut.put( ',' );
+                rOut.put( '\n' );
+                writeCudaDeviceReportJson( rOut, report );
+                break;
+            case CudaReportFormatCsv:
+                if ( iDevice == 0 )
+                    writeCudaDeviceReportCsvHeader( rOut, report );
+                writeCudaDeviceReportCsv( rOut, report );
+                break;
+        }
+    }
+    if ( rFormat == CudaReportFormatJson )
+        rOut.write( "\n]\n" );
+}
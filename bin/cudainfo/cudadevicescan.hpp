@@ -0,0 +1,711 @@
+/**
+ * Device-wide prefix sums and stream compaction for arrays of any length,
+ * i.e. what blockReduceCumSum and blockReduceCumSumPredicate in gpuinfo.cu
+ * do for one block, but across all blocks in a single pass:
+ *
+ *   deviceInclusiveScan( in, out, n )      out[i] = in[0] + ... + in[i]
+ *   deviceExclusiveScan( in, out, n )      out[i] = in[0] + ... + in[i-1]
+ *   deviceCompactIf( in, out, n, pred )    kept elements in order
+ *   devicePartition( in, out, n, pred )    kept in order, then the others
+ *
+ * Each block scans one tile and gets the sum of all tiles before it by
+ * decoupled look-back: tiles publish their own sum (aggregate) as soon as
+ * it is known and their inclusive prefix as soon as that is known. A tile
+ * walks back over its predecessors, adding aggregates, until it finds a
+ * published prefix. Therefore each element is read and written only once,
+ * instead of twice for reduce-then-scan with a separate pass over the
+ * tile sums. Tile indexes are taken from an atomic counter, so that all
+ * predecessors of a tile are guaranteed to already be running.
+ *
+ * The host versions, e.g. hostInclusiveScan, have the same interface and
+ * results and run on all cores with HostThreadPool and the SIMD warp
+ * scans of cudahostwarp.hpp. Without nvcc the device versions run them
+ * in the given stream of the emulated runtime.
+ *
+ * @see https://research.nvidia.com/publication/single-pass-parallel-prefix-scan-decoupled-look-back
+ */
+
+#pragma once
+
+#include <algorithm>                    // min
+#include <cstddef>                      // size_t
+#include <cstdint>                      // uint64_t
+#include <cstring>                      // memcpy, memmove
+#include <memory>                       // unique_ptr
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>                  // is_arithmetic
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"       // cudaStream_t, enqueueHostRuntimeStream
+#endif
+
+#include "cudahostbackend.hpp"          // HostThreadPool, __device__
+#include "cudahostwarp.hpp"             // hostBlockReduceCumSum, hostCompact
+#include "cudamemorypool.hpp"           // getCudaDeviceMemoryPool
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+/*************************** host versions ***************************/
+
+/* elements per task, i.e. large enough to amortize the task overhead and
+ * small enough to balance the load and to stay in the L2 cache between
+ * the two passes over a chunk */
+size_t const hostScanChunkElements = 64 * 1024;
+
+/**
+ * Reduce-then-scan: the first pass sums each chunk, the chunk sums are
+ * scanned sequentially and the second pass scans each chunk starting with
+ * its carry. rpIn and rpOut may be the same.
+ */
+template< typename T >
+inline void hostScan
+(
+    T              const * const rpIn       ,
+    T                    * const rpOut      ,
+    size_t                 const rn         ,
+    bool                   const rbExclusive,
+    HostThreadPool             & rPool
+)
+{
+    size_t const nChunks = ( rn + hostScanChunkElements - 1 ) / hostScanChunkElements;
+    std::vector< T > carries( nChunks );
+    rPool.parallelFor( nChunks, [&]( uint64_t const iChunk )
+    {
+        size_t const iBegin = iChunk * hostScanChunkElements;
+        size_t const n = std::min( hostScanChunkElements, rn - iBegin );
+        carries[ iChunk ] = hostBlockReduceSum( rpIn + iBegin, n );
+    } );
+
+    T carry = T( 0 );
+    for ( auto & chunkCarry : carries )
+    {
+        T const sum = chunkCarry;
+        chunkCarry = carry;
+        carry += sum;
+    }
+
+    rPool.parallelFor( nChunks, [&]( uint64_t const iChunk )
+    {
+        size_t const iBegin = iChunk * hostScanChunkElements;
+        size_t const n = std::min( hostScanChunkElements, rn - iBegin );
+        T * const out = rpOut + iBegin;
+        if ( rpIn != rpOut )
+            memcpy( out, rpIn + iBegin, n * sizeof( T ) );
+        hostBlockReduceCumSum( out, n, carries[ iChunk ] );
+        if ( rbExclusive )
+        {
+            memmove( out + 1, out, ( n - 1 ) * sizeof( T ) );
+            out[0] = carries[ iChunk ];
+        }
+    } );
+}
+
+template< typename T >
+inline void hostInclusiveScan
+(
+    T              const * const rpIn ,
+    T                    * const rpOut,
+    size_t                 const rn   ,
+    HostThreadPool             & rPool = getHostThreadPool()
+)
+{
+    hostScan( rpIn, rpOut, rn, false, rPool );
+}
+
+template< typename T >
+inline void hostExclusiveScan
+(
+    T              const * const rpIn ,
+    T                    * const rpOut,
+    size_t                 const rn   ,
+    HostThreadPool             & rPool = getHostThreadPool()
+)
+{
+    hostScan( rpIn, rpOut, rn, true, rPool );
+}
+
+/**
+ * First pass: evaluates the predicate once per element into a bool array
+ * and counts the kept ones per chunk. Second pass: compacts each chunk
+ * with hostCompact to its offset. For a partition the rejected elements
+ * are written backwards from the end, like by the device version.
+ * rpIn and rpOut must not overlap.
+ *
+ * @return number of kept elements
+ */
+template< typename T, typename T_Predicate >
+inline size_t hostSelect
+(
+    T              const * const rpIn       ,
+    T                    * const rpOut      ,
+    size_t                 const rn         ,
+    T_Predicate    const &       rPredicate ,
+    bool                   const rbPartition,
+    HostThreadPool             & rPool
+)
+{
+    size_t const nChunks = ( rn + hostScanChunkElements - 1 ) / hostScanChunkElements;
+    std::unique_ptr< bool[] > const keep( new bool[ rn ] );
+    std::vector< size_t > offsets( nChunks );
+    rPool.parallelFor( nChunks, [&]( uint64_t const iChunk )
+    {
+        size_t const iBegin = iChunk * hostScanChunkElements;
+        size_t const iEnd   = std::min( iBegin + hostScanChunkElements, rn );
+        for ( size_t i = iBegin; i < iEnd; ++i )
+            keep[i] = rPredicate( rpIn[i] );
+        offsets[ iChunk ] = hostBlockReduceSumPredicate( keep.get() + iBegin, iEnd - iBegin );
+    } );
+
+    size_t nKept = 0;
+    for ( auto & offset : offsets )
+    {
+        size_t const nChunkKept = offset;
+        offset = nKept;
+        nKept += nChunkKept;
+    }
+
+    rPool.parallelFor( nChunks, [&]( uint64_t const iChunk )
+    {
+        size_t const iBegin = iChunk * hostScanChunkElements;
+        size_t const iEnd   = std::min( iBegin + hostScanChunkElements, rn );
+        hostCompact( rpIn + iBegin, keep.get() + iBegin, iEnd - iBegin, rpOut + offsets[ iChunk ] );
+        if ( ! rbPartition )
+            return;
+        size_t iRejected = iBegin - offsets[ iChunk ];
+        for ( size_t i = iBegin; i < iEnd; ++i )
+        {
+            if ( ! keep[i] )
+                rpOut[ rn - 1 - iRejected++ ] = rpIn[i];
+        }
+    } );
+    return nKept;
+}
+
+template< typename T, typename T_Predicate >
+inline size_t hostCompactIf
+(
+    T              const * const rpIn      ,
+    T                    * const rpOut     ,
+    size_t                 const rn        ,
+    T_Predicate    const &       rPredicate,
+    HostThreadPool             & rPool = getHostThreadPool()
+)
+{
+    return hostSelect( rpIn, rpOut, rn, rPredicate, false, rPool );
+}
+
+/**
+ * Writes the kept elements in order to the front and the rejected ones in
+ * reverse order to the back of rpOut, which is not stable for the latter,
+ * but needs no second pass.
+ * @return number of kept elements, i.e. the index of the first rejected one
+ */
+template< typename T, typename T_Predicate >
+inline size_t hostPartition
+(
+    T              const * const rpIn      ,
+    T                    * const rpOut     ,
+    size_t                 const rn        ,
+    T_Predicate    const &       rPredicate,
+    HostThreadPool             & rPool = getHostThreadPool()
+)
+{
+    return hostSelect( rpIn, rpOut, rn, rPredicate, true, rPool );
+}
+
+
+/************************** device versions **************************/
+
+inline void checkDeviceScanError( cudaError_t const rError, char const * const rWhat )
+{
+    if ( rError == cudaSuccess )
+        return;
+    std::stringstream msg;
+    msg << "[" << __FILENAME__ << "::deviceScan] "
+        << "Failed to " << rWhat << ": " << cudaGetErrorString( rError );
+    throw std::runtime_error( msg.str() );
+}
+
+#ifdef __CUDACC__
+
+#if CUDART_VERSION >= 9000
+#   define TMP_SHFL_UP( x, delta ) __shfl_up_sync ( 0xFFFFFFFFu, x, delta )
+#   define TMP_SHFL_XOR( x, mask ) __shfl_xor_sync( 0xFFFFFFFFu, x, mask  )
+#   define TMP_BALLOT( x )         __ballot_sync  ( 0xFFFFFFFFu, x )
+#   define TMP_ANY( x )            __any_sync     ( 0xFFFFFFFFu, x )
+#else
+#   define TMP_SHFL_UP( x, delta ) __shfl_up ( x, delta )
+#   define TMP_SHFL_XOR( x, mask ) __shfl_xor( x, mask  )
+#   define TMP_BALLOT( x )         __ballot( x )
+#   define TMP_ANY( x )            __any( x )
+#endif
+
+int const deviceScanThreads = 256;
+/* consecutive elements per thread, which are scanned sequentially */
+int const deviceScanItems   = 8;
+int const deviceScanTileElements = deviceScanThreads * deviceScanItems;
+
+/* states of a tile, the flags are reset to invalid before each scan */
+int const DeviceScanInvalid   = 0;
+int const DeviceScanAggregate = 1;   /* sum of the tile itself is published */
+int const DeviceScanPrefix    = 2;   /* sum of all tiles up to this one is published */
+
+template< typename T >
+struct DeviceScanTileState
+{
+    unsigned long long int * tileCounter;
+    int                    * flags      ;
+    T                      * aggregates ;
+    T                      * prefixes   ;
+    T                      * total      ;
+};
+
+/* like warpReduceCumSum in gpuinfo.cu, but for any type __shfl supports */
+template< typename T > __device__ inline
+T deviceWarpInclusiveScan( T x )
+{
+    int const laneId = threadIdx.x & 0x1F;
+    #pragma unroll
+    for ( int delta = 1; delta < 32; delta <<= 1 )
+    {
+        T const y = TMP_SHFL_UP( x, delta );
+        if ( laneId >= delta )
+            x += y;
+    }
+    return x;
+}
+
+template< typename T > __device__ inline
+T deviceWarpAllReduceSum( T x )
+{
+    #pragma unroll
+    for ( int mask = 16; mask > 0; mask >>= 1 )
+        x += TMP_SHFL_XOR( x, mask );
+    return x;
+}
+
+/**
+ * Called by the whole first warp of a block. Publishes the tile aggregate
+ * and then looks at the 32 preceding tiles at once, one per lane, waiting
+ * until all of them published at least their aggregate. If any of them
+ * has a prefix, the nearest one ends the look-back, else the window moves
+ * 32 tiles further back.
+ *
+ * @return sum of all tiles before riTile
+ */
+template< typename T > __device__ inline
+T deviceScanLookBack
+(
+    DeviceScanTileState< T > const & rState    ,
+    size_t                   const   riTile    ,
+    T                        const   rAggregate
+)
+{
+    int const laneId = threadIdx.x & 0x1F;
+    /* volatile, so that the spinning really rereads the global memory */
+    int volatile * const flags      = rState.flags;
+    T   volatile * const aggregates = rState.aggregates;
+    T   volatile * const prefixes   = rState.prefixes;
+
+    /* the value must be visible before the flag announcing it */
+    if ( riTile == 0 )
+    {
+        if ( laneId == 0 )
+        {
+            prefixes[0] = rAggregate;
+            __threadfence();
+            flags[0] = DeviceScanPrefix;
+        }
+        return T( 0 );
+    }
+    if ( laneId == 0 )
+    {
+        aggregates[ riTile ] = rAggregate;
+        __threadfence();
+        flags[ riTile ] = DeviceScanAggregate;
+    }
+
+    T exclusive = T( 0 );
+    for ( long long int iWindow = (long long int) riTile - 1; ; iWindow -= 32 )
+    {
+        /* lanes before tile 0 act like prefixes of 0 */
+        long long int const iPredecessor = iWindow - laneId;
+        int flag;
+        do
+            flag = iPredecessor >= 0 ? flags[ iPredecessor ] : DeviceScanPrefix;
+        while ( TMP_ANY( flag == DeviceScanInvalid ) );
+        __threadfence();
+
+        T value = T( 0 );
+        if ( iPredecessor >= 0 )
+            value = flag == DeviceScanPrefix ? prefixes[ iPredecessor ] : aggregates[ iPredecessor ];
+        unsigned int const prefixLanes = TMP_BALLOT( flag == DeviceScanPrefix );
+        /* only tiles after the nearest prefix, i.e. lower lanes, count */
+        if ( prefixLanes != 0 && laneId > __ffs( prefixLanes ) - 1 )
+            value = T( 0 );
+        exclusive += deviceWarpAllReduceSum( value );
+        if ( prefixLanes != 0 )
+            break;
+    }
+
+    if ( laneId == 0 )
+    {
+        prefixes[ riTile ] = exclusive + rAggregate;
+        __threadfence();
+        flags[ riTile ] = DeviceScanPrefix;
+    }
+    return exclusive;
+}
+
+/**
+ * Scans the values rLoad( i ) over all i < rn and calls
+ * rStore( i, exclusivePrefix, value ) for each of them. Each element is
+ * only loaded and stored by the same thread, so that in place works.
+ * Needs one block of deviceScanThreads threads per tile.
+ */
+template< typename T_Value, typename T_Load, typename T_Store >
+__global__ void kernelDecoupledLookBackScan
+(
+    T_Load                         const rLoad ,
+    T_Store                        const rStore,
+    size_t                         const rn    ,
+    DeviceScanTileState< T_Value > const rState
+)
+{
+    int const nWarps = deviceScanThreads / 32;
+    __shared__ unsigned long long int smiTile;
+    __shared__ T_Value smWarpSums[ nWarps ];
+    __shared__ T_Value smTilePrefix;
+
+    if ( threadIdx.x == 0 )
+        smiTile = atomicAdd( rState.tileCounter, 1ull );
+    __syncthreads();
+
+    size_t const iFirst = ( smiTile * deviceScanThreads + threadIdx.x ) * deviceScanItems;
+    T_Value values[ deviceScanItems ];
+    T_Value sum = T_Value( 0 );
+    #pragma unroll
+    for ( int k = 0; k < deviceScanItems; ++k )
+    {
+        values[k] = iFirst + k < rn ? rLoad( iFirst + k ) : T_Value( 0 );
+        sum += values[k];
+    }
+
+    /* block scan of the per thread sums like blockReduceCumSum */
+    int const laneId = threadIdx.x & 0x1F;
+    int const iWarp  = threadIdx.x / 32;
+    T_Value const warpInclusive = deviceWarpInclusiveScan( sum );
+    T_Value warpExclusive = TMP_SHFL_UP( warpInclusive, 1 );
+    if ( laneId == 0 )
+        warpExclusive = T_Value( 0 );
+    if ( laneId == 31 )
+        smWarpSums[ iWarp ] = warpInclusive;
+    __syncthreads();
+    if ( iWarp == 0 )
+    {
+        T_Value x = laneId < nWarps ? smWarpSums[ laneId ] : T_Value( 0 );
+        x = deviceWarpInclusiveScan( x );
+        if ( laneId < nWarps )
+            smWarpSums[ laneId ] = x;
+    }
+    __syncthreads();
+
+    if ( iWarp == 0 )
+    {
+        T_Value const prefix = deviceScanLookBack( rState, smiTile, smWarpSums[ nWarps - 1 ] );
+        if ( laneId == 0 )
+            smTilePrefix = prefix;
+    }
+    __syncthreads();
+
+    T_Value running = smTilePrefix + ( iWarp > 0 ? smWarpSums[ iWarp - 1 ] : T_Value( 0 ) ) + warpExclusive;
+    #pragma unroll
+    for ( int k = 0; k < deviceScanItems; ++k )
+    {
+        if ( iFirst + k >= rn )
+            break;
+        rStore( iFirst + k, running, values[k] );
+        running += values[k];
+        if ( iFirst + k == rn - 1 && rState.total != NULL )
+            *rState.total = running;
+    }
+}
+
+template< typename T >
+struct DeviceScanLoadValue
+{
+    T const * in;
+    __device__ inline T operator()( size_t const i ) const { return in[i]; }
+};
+
+template< typename T >
+struct DeviceScanStoreScan
+{
+    T    * out       ;
+    bool   bExclusive;
+    __device__ inline void operator()( size_t const i, T const prefix, T const x ) const
+    {
+        out[i] = bExclusive ? prefix : prefix + x;
+    }
+};
+
+template< typename T, typename T_Predicate >
+struct DeviceScanLoadPredicate
+{
+    T           const * in       ;
+    T_Predicate         predicate;
+    __device__ inline unsigned long long int operator()( size_t const i ) const
+    {
+        return predicate( in[i] ) ? 1 : 0;
+    }
+};
+
+template< typename T >
+struct DeviceScanStoreSelect
+{
+    T const * in        ;
+    T       * out       ;
+    size_t    n         ;
+    bool      bPartition;
+    __device__ inline void operator()
+    (
+        size_t                 const i     ,
+        unsigned long long int const prefix,
+        unsigned long long int const bKeep
+    ) const
+    {
+        if ( bKeep )
+            out[ prefix ] = in[i];
+        else if ( bPartition )
+            out[ n - 1 - ( i - prefix ) ] = in[i];
+    }
+};
+
+/**
+ * Allocates the tile states from the device memory pool, resets them in
+ * rStream, launches the scan and returns the memory to the pool, which is
+ * per stream, i.e. it is only handed out again to later work in rStream.
+ * If rbTotal is true, the sum of all values is returned after
+ * synchronizing rStream, else 0 is returned immediately.
+ */
+template< typename T_Value, typename T_Load, typename T_Store >
+inline T_Value launchDecoupledLookBackScan
+(
+    T_Load       const & rLoad  ,
+    T_Store      const & rStore ,
+    size_t       const   rn     ,
+    bool         const   rbTotal,
+    cudaStream_t const   rStream
+)
+{
+    if ( rn == 0 )
+        return T_Value( 0 );
+    size_t const nTiles = ( rn + deviceScanTileElements - 1 ) / deviceScanTileElements;
+    if ( nTiles > 0x7FFFFFFFu )
+    {
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::launchDecoupledLookBackScan] "
+            << rn << " elements need more blocks than a grid can have.";
+        throw std::invalid_argument( msg.str() );
+    }
+
+    /* counter and flags first, so that one memset resets them */
+    size_t const nFlagBytes  = ( sizeof( unsigned long long int ) + nTiles * sizeof( int ) + 15 ) / 16 * 16;
+    size_t const nValueBytes = ( nTiles * sizeof( T_Value ) + 15 ) / 16 * 16;
+    CachingMemoryPool & pool = getCudaDeviceMemoryPool();
+    char * const buffer = (char*) pool.allocate( nFlagBytes + 2 * nValueBytes + sizeof( T_Value ), rStream );
+    if ( buffer == NULL )
+        checkDeviceScanError( cudaErrorMemoryAllocation, "allocate the tile states" );
+
+    DeviceScanTileState< T_Value > state;
+    state.tileCounter = (unsigned long long int *) buffer;
+    state.flags       = (int     *)( buffer + sizeof( unsigned long long int ) );
+    state.aggregates  = (T_Value *)( buffer + nFlagBytes );
+    state.prefixes    = (T_Value *)( buffer + nFlagBytes + nValueBytes );
+    state.total       = rbTotal ? (T_Value *)( buffer + nFlagBytes + 2 * nValueBytes ) : NULL;
+
+    T_Value total = T_Value( 0 );
+    try
+    {
+        checkDeviceScanError( cudaMemsetAsync( buffer, 0, nFlagBytes, rStream ), "reset the tile states" );
+        kernelDecoupledLookBackScan<<< nTiles, deviceScanThreads, 0, rStream >>>( rLoad, rStore, rn, state );
+        checkDeviceScanError( cudaPeekAtLastError(), "launch the scan kernel" );
+        if ( rbTotal )
+        {
+            checkDeviceScanError( cudaMemcpyAsync( &total, state.total, sizeof( T_Value ),
+                                                   cudaMemcpyDeviceToHost, rStream ), "download the total" );
+            checkDeviceScanError( cudaStreamSynchronize( rStream ), "synchronize" );
+        }
+    }
+    catch ( ... )
+    {
+        pool.deallocate( buffer );
+        throw;
+    }
+    pool.deallocate( buffer );
+    return total;
+}
+
+#undef TMP_SHFL_UP
+#undef TMP_SHFL_XOR
+#undef TMP_BALLOT
+#undef TMP_ANY
+
+#endif // __CUDACC__
+
+/**
+ * Queues the scan of the device array rpIn into rpOut, which may be the
+ * same, into rStream, i.e. returns before it finished.
+ * Supports the types __shfl supports, e.g. int, float, double.
+ */
+template< typename T >
+inline void deviceInclusiveScan
+(
+    T            const * const rpIn   ,
+    T                  * const rpOut  ,
+    size_t               const rn     ,
+    cudaStream_t         const rStream = 0
+)
+{
+    static_assert( std::is_arithmetic< T >::value && sizeof( T ) >= 4, "Type not supported by __shfl" );
+    #ifdef __CUDACC__
+        launchDecoupledLookBackScan< T >( DeviceScanLoadValue< T >{ rpIn },
+                                          DeviceScanStoreScan< T >{ rpOut, false }, rn, false, rStream );
+    #else
+        enqueueHostRuntimeStream( rStream, [=](){ hostInclusiveScan( rpIn, rpOut, rn ); } );
+    #endif
+}
+
+template< typename T >
+inline void deviceExclusiveScan
+(
+    T            const * const rpIn   ,
+    T                  * const rpOut  ,
+    size_t               const rn     ,
+    cudaStream_t         const rStream = 0
+)
+{
+    static_assert( std::is_arithmetic< T >::value && sizeof( T ) >= 4, "Type not supported by __shfl" );
+    #ifdef __CUDACC__
+        launchDecoupledLookBackScan< T >( DeviceScanLoadValue< T >{ rpIn },
+                                          DeviceScanStoreScan< T >{ rpOut, true }, rn, false, rStream );
+    #else
+        enqueueHostRuntimeStream( rStream, [=](){ hostExclusiveScan( rpIn, rpOut, rn ); } );
+    #endif
+}
+
+/**
+ * rPredicate must be callable on the device, e.g. a functor with a
+ * __device__ operator() or an __device__ lambda (nvcc --extended-lambda).
+ * Synchronizes rStream, because the number of kept elements is returned.
+ * rpIn and rpOut must not overlap.
+ */
+template< typename T, typename T_Predicate >
+inline size_t deviceCompactIf
+(
+    T            const * const   rpIn      ,
+    T                  * const   rpOut     ,
+    size_t               const   rn        ,
+    T_Predicate          const & rPredicate,
+    cudaStream_t         const   rStream = 0
+)
+{
+    #ifdef __CUDACC__
+        return launchDecoupledLookBackScan< unsigned long long int >(
+            DeviceScanLoadPredicate< T, T_Predicate >{ rpIn, rPredicate },
+            DeviceScanStoreSelect< T >{ rpIn, rpOut, rn, false }, rn, true, rStream );
+    #else
+        size_t nKept = 0;
+        enqueueHostRuntimeStream( rStream, [&](){ nKept = hostCompactIf( rpIn, rpOut, rn, rPredicate ); } );
+        checkDeviceScanError( cudaStreamSynchronize( rStream ), "synchronize" );
+        return nKept;
+    #endif
+}
+
+/**
+ * Kept elements in order to the front, rejected ones in reverse order to
+ * the back, @see hostPartition
+ */
+template< typename T, typename T_Predicate >
+inline size_t devicePartition
+(
+    T            const * const   rpIn      ,
+    T                  * const   rpOut     ,
+    size_t               const   rn        ,
+    T_Predicate          const & rPredicate,
+    cudaStream_t         const   rStream = 0
+)
+{
+    #ifdef __CUDACC__
+        return launchDecoupledLookBackScan< unsigned long long int >(
+            DeviceScanLoadPredicate< T, T_Predicate >{ rpIn, rPredicate },
+            DeviceScanStoreSelect< T >{ rpIn, rpOut, rn, true }, rn, true, rStream );
+    #else
+        size_t nKept = 0;
+        enqueueHostRuntimeStream( rStream, [&](){ nKept = hostPartition( rpIn, rpOut, rn, rPredicate ); } );
+        checkDeviceScanError( cudaStreamSynchronize( rStream ), "synchronize" );
+        return nKept;
+    #endif
+}
+
+
+/**
+ * For MirroredVector or anything else with gpuData(), deviceCapacity(),
+ * nElements and mStream. They work on the device data, i.e. push and pop
+ * are up to the caller, but device buffers of vectors which grew since
+ * the last push are grown first.
+ */
+template< typename T_Vector >
+inline void checkDeviceScanSizes
+(
+    T_Vector const & rIn ,
+    T_Vector const & rOut
+)
+{
+    rIn .gpuData();
+    rOut.gpuData();
+    if ( rIn.deviceCapacity() < rIn.nElements || rOut.deviceCapacity() < rIn.nElements )
+    {
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::checkDeviceScanSizes] "
+            << "Device buffers have room for " << rIn.deviceCapacity() << " input and "
+            << rOut.deviceCapacity() << " output elements, but the input has "
+            << rIn.nElements << ".";
+        throw std::invalid_argument( msg.str() );
+    }
+}
+
+template< typename T_Vector >
+inline void deviceInclusiveScan( T_Vector const & rIn, T_Vector & rOut )
+{
+    checkDeviceScanSizes( rIn, rOut );
+    deviceInclusiveScan( rIn.gpu, rOut.gpu, rIn.nElements, rIn.mStream );
+}
+
+template< typename T_Vector >
+inline void deviceExclusiveScan( T_Vector const & rIn, T_Vector & rOut )
+{
+    checkDeviceScanSizes( rIn, rOut );
+    deviceExclusiveScan( rIn.gpu, rOut.gpu, rIn.nElements, rIn.mStream );
+}
+
+template< typename T_Vector, typename T_Predicate >
+inline size_t deviceCompactIf( T_Vector const & rIn, T_Vector & rOut, T_Predicate const & rPredicate )
+{
+    checkDeviceScanSizes( rIn, rOut );
+    return deviceCompactIf( rIn.gpu, rOut.gpu, rIn.nElements, rPredicate, rIn.mStream );
+}
+
+template< typename T_Vector, typename T_Predicate >
+inline size_t devicePartition( T_Vector const & rIn, T_Vector & rOut, T_Predicate const & rPredicate )
+{
+    checkDeviceScanSizes( rIn, rOut );
+    return devicePartition( rIn.gpu, rOut.gpu, rIn.nElements, rPredicate, rIn.mStream );
+}
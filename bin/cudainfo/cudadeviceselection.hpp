@@ -0,0 +1,338 @@
+/**
+ * Chooses a device by a weighted score instead of simply taking the first
+ * one without kernel timeout:
+ *
+ *   CudaDeviceClaim claim;
+ *   int const iDevice = selectAndClaimCudaDevice(
+ *       makeCudaDeviceCandidates( getCudaDeviceSnapshots() ),
+ *       CudaDeviceSelectionPolicy(), claim );
+ *   cudaSetDevice( iDevice );
+ *
+ * The score rewards the peak FLOPS from the architecture table and the
+ * free memory, each relative to the best device, and penalizes a NUMA
+ * distance between the calling thread and the GPU, devices driving a
+ * display, i.e. with kernel timeout, and devices other processes have
+ * already claimed. With the default weights the number of processes per
+ * device dominates, so that several processes started on one node spread
+ * over the GPUs. Claims are files named after the PCI location and the
+ * process ID in a directory shared by all processes of the user, so they
+ * work for any way the processes were started. Claims of processes which
+ * don't exist anymore are ignored and removed.
+ *
+ * The scoring only works on CudaDeviceCandidate, so that it can be tested
+ * with synthetic device profiles.
+ */
+
+#pragma once
+
+#include <algorithm>                    // max, stable_sort
+#include <cerrno>
+#include <cstdint>                      // uint64_t
+#include <cstdio>                       // snprintf, sscanf, fopen
+#include <cstdlib>                      // getenv
+#include <string>
+#include <vector>
+
+#include <dirent.h>                     // opendir, readdir
+#include <fcntl.h>                      // open
+#include <signal.h>                     // kill
+#include <sys/file.h>                   // flock
+#include <sys/stat.h>                   // mkdir
+#include <unistd.h>                     // getpid, getuid, close, unlink
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"
+#endif
+
+#include "cudaarchitectures.hpp"        // getCudaArchitecture
+#include "cudadevicecache.hpp"          // CudaDeviceSnapshot, CudaPciLocation
+#include "cudanuma.hpp"                 // getPciDeviceNumaNode, getNumaDistance
+
+
+struct CudaDeviceCandidate
+{
+    int            iDevice     ;
+    cudaDeviceProp properties  ;
+    uint64_t       nBytesFree  ;
+    /* other processes having claimed this device */
+    int            nProcesses  ;
+    /* SLIT distance from the NUMA node of the calling thread, -1 if unknown */
+    int            numaDistance;
+};
+
+struct CudaDeviceSelectionPolicy
+{
+    /* added times the fraction of the highest peak FLOPS of all candidates */
+    double   peakFlopsWeight ;
+    /* added times the fraction of the most free memory of all candidates */
+    double   freeMemoryWeight;
+    /* subtracted times ( distance - 10 ) / 10, i.e. ca. 1 for a remote node */
+    double   numaWeight      ;
+    /* subtracted per process which already claimed the device */
+    double   processWeight   ;
+    /* subtracted if the device has a kernel timeout, i.e. drives a display */
+    double   displayWeight   ;
+    /* devices with less free memory aren't eligible at all */
+    uint64_t nMinBytesFree   ;
+
+    inline CudaDeviceSelectionPolicy()
+     : peakFlopsWeight( 1 ), freeMemoryWeight( 1 ), numaWeight( 0.5 ),
+       processWeight( 4 ), displayWeight( 2 ), nMinBytesFree( 0 )
+    {}
+};
+
+struct CudaDeviceScore
+{
+    int    iDevice  ;
+    double score    ;
+    bool   bEligible;
+};
+
+/**
+ * @return FLOPS of single precision FMAs on all cores or 0 for
+ *         architectures not in the table
+ */
+inline double getCudaArchitecturePeakFlops( cudaDeviceProp const & rProperties )
+{
+    return getCudaPeakFmaFlops( rProperties.multiProcessorCount, rProperties.clockRate,
+        getCudaArchitecture( rProperties.major, rProperties.minor ).nCoresPerMultiprocessor );
+}
+
+/**
+ * @return all candidates ordered by descending score, the eligible ones
+ *         first, devices with equal score in the order of the candidates
+ */
+inline std::vector< CudaDeviceScore > rankCudaDevices
+(
+    std::vector< CudaDeviceCandidate > const & rCandidates,
+    CudaDeviceSelectionPolicy          const & rPolicy
+)
+{
+    double maxFlops = 0;
+    double maxBytesFree = 0;
+    for ( auto const & candidate : rCandidates )
+    {
+        maxFlops     = std::max( maxFlops, getCudaArchitecturePeakFlops( candidate.properties ) );
+        maxBytesFree = std::max( maxBytesFree, (double) candidate.nBytesFree );
+    }
+
+    std::vector< CudaDeviceScore > scores;
+    for ( auto const & candidate : rCandidates )
+    {
+        CudaDeviceScore score;
+        score.iDevice   = candidate.iDevice;
+        score.bEligible = candidate.nBytesFree >= rPolicy.nMinBytesFree;
+        score.score     = 0;
+        if ( maxFlops > 0 )
+            score.score += rPolicy.peakFlopsWeight * getCudaArchitecturePeakFlops( candidate.properties ) / maxFlops;
+        if ( maxBytesFree > 0 )
+            score.score += rPolicy.freeMemoryWeight * candidate.nBytesFree / maxBytesFree;
+        if ( candidate.numaDistance > 10 )
+            score.score -= rPolicy.numaWeight * ( candidate.numaDistance - 10 ) / 10.0;
+        score.score -= rPolicy.processWeight * candidate.nProcesses;
+        if ( candidate.properties.kernelExecTimeoutEnabled )
+            score.score -= rPolicy.displayWeight;
+        scores.push_back( score );
+    }
+
+    std::stable_sort( scores.begin(), scores.end(),
+        []( CudaDeviceScore const & a, CudaDeviceScore const & b )
+        {
+            if ( a.bEligible != b.bEligible )
+                return a.bEligible;
+            return a.score > b.score;
+        } );
+    return scores;
+}
+
+/**
+ * @return device with the highest score or -1 if none is eligible
+ */
+inline int selectCudaDevice
+(
+    std::vector< CudaDeviceCandidate > const & rCandidates,
+    CudaDeviceSelectionPolicy          const & rPolicy = CudaDeviceSelectionPolicy()
+)
+{
+    std::vector< CudaDeviceScore > const scores = rankCudaDevices( rCandidates, rPolicy );
+    return scores.empty() || ! scores[0].bEligible ? -1 : scores[0].iDevice;
+}
+
+/**
+ * Makes candidates from the snapshots without initializing any GPU, i.e.
+ * the free memory is the total memory unless rbQueryFreeMemory is set,
+ * which creates a context on each device. Claims by other processes are
+ * not counted yet, @see selectAndClaimCudaDevice
+ * @param[in] rRootPath prefix for /sys, e.g. for testing
+ */
+inline std::vector< CudaDeviceCandidate > makeCudaDeviceCandidates
+(
+    std::vector< CudaDeviceSnapshot > const & rSnapshots,
+    bool                              const   rbQueryFreeMemory = false,
+    std::string                       const & rRootPath         = ""
+)
+{
+    int const threadNode = getCurrentNumaNode( rRootPath );
+    int iCurrentDevice = 0;
+    if ( rbQueryFreeMemory && cudaGetDevice( &iCurrentDevice ) != cudaSuccess )
+        cudaGetLastError();
+
+    std::vector< CudaDeviceCandidate > candidates( rSnapshots.size() );
+    for ( size_t i = 0; i < rSnapshots.size(); ++i )
+    {
+        CudaDeviceCandidate & candidate = candidates[i];
+        cudaDeviceProp const & prop = rSnapshots[i].properties;
+        candidate.iDevice      = (int) i;
+        candidate.properties   = prop;
+        candidate.nBytesFree   = prop.totalGlobalMem;
+        candidate.nProcesses   = 0;
+        candidate.numaDistance = getNumaDistance( threadNode, getPciDeviceNumaNode(
+            prop.pciDomainID, prop.pciBusID, prop.pciDeviceID, rRootPath ), rRootPath );
+
+        size_t nBytesFree = 0, nBytesTotal = 0;
+        if ( rbQueryFreeMemory )
+        {
+            if ( cudaSetDevice( (int) i ) == cudaSuccess && cudaMemGetInfo( &nBytesFree, &nBytesTotal ) == cudaSuccess )
+                candidate.nBytesFree = nBytesFree;
+            else
+                cudaGetLastError();
+        }
+    }
+
+    if ( rbQueryFreeMemory && cudaSetDevice( iCurrentDevice ) != cudaSuccess )
+        cudaGetLastError();
+    return candidates;
+}
+
+/**
+ * @return $XDG_RUNTIME_DIR/cudainfo-claims, else /tmp/cudainfo-claims-<uid>
+ */
+inline std::string getCudaDeviceClaimsPath( void )
+{
+    if ( char const * const runtime = getenv( "XDG_RUNTIME_DIR" ) )
+        if ( runtime[0] != '\0' )
+            return std::string( runtime ) + "/cudainfo-claims";
+    return "/tmp/cudainfo-claims-" + std::to_string( getuid() );
+}
+
+/**
+ * Marks a device as used by this process as long as the claim exists.
+ * Default constructed it claims nothing.
+ */
+class CudaDeviceClaim
+{
+public:
+    inline CudaDeviceClaim(){}
+    inline ~CudaDeviceClaim(){ release(); }
+
+    CudaDeviceClaim( CudaDeviceClaim const & ) = delete;
+    CudaDeviceClaim & operator=( CudaDeviceClaim const & ) = delete;
+
+    /* @return false if the claim file couldn't be created */
+    inline bool claim( std::string const & rClaimsPath, CudaPciLocation const & rLocation )
+    {
+        release();
+        char name[64];
+        snprintf( name, sizeof( name ), "/%04x:%02x:%02x.%i",
+                  rLocation.domain, rLocation.bus, rLocation.device, (int) getpid() );
+        std::string const path = rClaimsPath + name;
+        FILE * const file = fopen( path.c_str(), "w" );
+        if ( file == NULL )
+            return false;
+        fclose( file );
+        mPath = path;
+        return true;
+    }
+
+    inline void release( void )
+    {
+        if ( ! mPath.empty() )
+            unlink( mPath.c_str() );
+        mPath.clear();
+    }
+
+    inline bool claimed( void ) const { return ! mPath.empty(); }
+
+private:
+    std::string mPath;
+};
+
+/**
+ * @return number of processes other than this one which claimed the
+ *         device, claims of exited processes are removed
+ */
+inline int countCudaDeviceClaims
+(
+    std::string     const & rClaimsPath,
+    CudaPciLocation const & rLocation
+)
+{
+    int nClaims = 0;
+    DIR * const directory = opendir( rClaimsPath.c_str() );
+    if ( directory == NULL )
+        return 0;
+    while ( struct dirent const * const entry = readdir( directory ) )
+    {
+        unsigned int domain, bus, device;
+        int pid;
+        if ( sscanf( entry->d_name, "%x:%x:%x.%i", &domain, &bus, &device, &pid ) != 4 ||
+             (int) domain != rLocation.domain || (int) bus != rLocation.bus || (int) device != rLocation.device ||
+             pid == (int) getpid() )
+            continue;
+        /* EPERM means the process exists, but belongs to someone else */
+        if ( kill( pid, 0 ) == 0 || errno == EPERM )
+            ++nClaims;
+        else
+            unlink( ( rClaimsPath + "/" + entry->d_name ).c_str() );
+    }
+    closedir( directory );
+    return nClaims;
+}
+
+/**
+ * Counts the claims of other processes, selects the best device and
+ * claims it. Counting and claiming is done under a lock, so that
+ * processes started at the same time see each others claims. If claims
+ * can't be used, e.g. because the directory can't be created, the device
+ * is selected without them.
+ * @param[out] rClaim holds the claim, which should live as long as the
+ *             device is used
+ * @return selected device or -1 if none is eligible
+ */
+inline int selectAndClaimCudaDevice
+(
+    std::vector< CudaDeviceCandidate >         rCandidates,
+    CudaDeviceSelectionPolicy          const & rPolicy    ,
+    CudaDeviceClaim                          & rClaim     ,
+    std::string                        const & rClaimsPath = getCudaDeviceClaimsPath()
+)
+{
+    if ( mkdir( rClaimsPath.c_str(), 0700 ) != 0 && errno != EEXIST )
+        return selectCudaDevice( rCandidates, rPolicy );
+    int const lock = open( ( rClaimsPath + "/.lock" ).c_str(), O_RDWR | O_CREAT, 0600 );
+    if ( lock < 0 )
+        return selectCudaDevice( rCandidates, rPolicy );
+    flock( lock, LOCK_EX );
+
+    for ( auto & candidate : rCandidates )
+    {
+        CudaPciLocation const location = { candidate.properties.pciDomainID, candidate.properties.pciBusID,
+                                           candidate.properties.pciDeviceID };
+        candidate.nProcesses = countCudaDeviceClaims( rClaimsPath, location );
+    }
+    int const iDevice = selectCudaDevice( rCandidates, rPolicy );
+    for ( auto const & candidate : rCandidates )
+    {
+        if ( candidate.iDevice != iDevice )
+            continue;
+        CudaPciLocation const location = { candidate.properties.pciDomainID, candidate.properties.pciBusID,
+                                           candidate.properties.pciDeviceID };
+        rClaim.claim( rClaimsPath, location );
+    }
+
+    flock( lock, LOCK_UN );
+    close( lock );
+    return iDevice;
+}
@@ -0,0 +1,327 @@
+/**
+ * Samples the dynamic state of devices, i.e. free and used memory, clocks
+ * and compute mode, in fixed intervals and writes them as CSV in batches:
+ *
+ *   CudaDeviceWatcher watcher( file, nDevices, 100000 );  // every 100 ms
+ *   watcher.start();
+ *   ...
+ *   watcher.stop();
+ *
+ * A sampler thread pushes into a preallocated single-producer
+ * single-consumer ring buffer, which a writer thread drains only every
+ * flush interval, resulting in one write per batch. Apart from these two
+ * wake-ups nothing runs, so that watching 8 devices every 10 ms costs
+ * less than 1% of a core, @see benchmarkdevicewatch.cpp
+ * If the ring buffer overflows, e.g. because the file blocks, samples are
+ * dropped and counted instead of blocking the sampler.
+ *
+ * The metrics are read by a provider, which can be replaced, so that the
+ * scheduling and buffering can be tested without a GPU. The default one
+ * uses the runtime API, which only knows the maximum clocks. The current
+ * ones would need NVML.
+ */
+
+#pragma once
+
+#include <algorithm>                    // max
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>                      // int32_t, uint64_t
+#include <cstdio>                       // FILE
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"
+#endif
+
+#include "bufferedwriter.hpp"           // BufferedWriter
+#include "cudadevicereport.hpp"         // getCudaComputeModeName
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+struct CudaDeviceSample
+{
+    /* since the start of the watcher */
+    uint64_t timeMicroseconds   ;
+    int32_t  iDevice            ;
+    int32_t  computeMode        ;
+    uint64_t nBytesFree         ;
+    uint64_t nBytesTotal        ;
+    int32_t  clockRateKHz       ;
+    int32_t  memoryClockRateKHz ;
+};
+
+/**
+ * @return false if any of the values couldn't be queried
+ */
+inline bool sampleCudaDeviceMetrics
+(
+    int                const riDevice,
+    CudaDeviceSample * const rSample
+)
+{
+    size_t nBytesFree = 0, nBytesTotal = 0;
+    if ( cudaSetDevice( riDevice ) != cudaSuccess ||
+         cudaMemGetInfo( &nBytesFree, &nBytesTotal ) != cudaSuccess ||
+         cudaDeviceGetAttribute( &rSample->clockRateKHz, cudaDevAttrClockRate, riDevice ) != cudaSuccess ||
+         cudaDeviceGetAttribute( &rSample->memoryClockRateKHz, cudaDevAttrMemoryClockRate, riDevice ) != cudaSuccess ||
+         cudaDeviceGetAttribute( &rSample->computeMode, cudaDevAttrComputeMode, riDevice ) != cudaSuccess )
+    {
+        cudaGetLastError();
+        return false;
+    }
+    rSample->nBytesFree  = nBytesFree;
+    rSample->nBytesTotal = nBytesTotal;
+    return true;
+}
+
+/**
+ * Lock-free ring buffer for exactly one thread pushing and one thread
+ * popping. The capacity is rounded up to a power of two.
+ */
+template< typename T >
+class SpscRingBuffer
+{
+public:
+    inline explicit SpscRingBuffer( size_t const rnMinCapacity )
+     : mHead( 0 ), mTail( 0 )
+    {
+        size_t nCapacity = 1;
+        while ( nCapacity < rnMinCapacity )
+            nCapacity *= 2;
+        mValues.resize( nCapacity );
+        mMask = nCapacity - 1;
+    }
+
+    inline size_t capacity( void ) const { return mValues.size(); }
+
+    /* @return false if full, only to be called by the producer */
+    inline bool push( T const & rValue )
+    {
+        size_t const head = mHead.load( std::memory_order_relaxed );
+        if ( head - mTail.load( std::memory_order_acquire ) >= mValues.size() )
+            return false;
+        mValues[ head & mMask ] = rValue;
+        mHead.store( head + 1, std::memory_order_release );
+        return true;
+    }
+
+    /* @return number of values moved to rValues, only to be called by the consumer */
+    inline size_t pop( T * const rValues, size_t const rnMaxValues )
+    {
+        size_t const tail = mTail.load( std::memory_order_relaxed );
+        size_t const n = std::min( mHead.load( std::memory_order_acquire ) - tail, rnMaxValues );
+        for ( size_t i = 0; i < n; ++i )
+            rValues[i] = mValues[ ( tail + i ) & mMask ];
+        mTail.store( tail + n, std::memory_order_release );
+        return n;
+    }
+
+private:
+    std::vector< T >    mValues;
+    size_t              mMask  ;
+    /* on separate cache lines, so that producer and consumer don't slow
+     * down each other. Padded instead of alignas, which isn't honoured for
+     * heap allocations before C++17. */
+    char                  mPadding0[64];
+    std::atomic< size_t > mHead;
+    char                  mPadding1[64];
+    std::atomic< size_t > mTail;
+    char                  mPadding2[64];
+};
+
+class CudaDeviceWatcher
+{
+public:
+    /* fills the sample except for the time and device, @return false on error */
+    typedef std::function< bool( int, CudaDeviceSample * ) > MetricProvider;
+
+    /**
+     * @param[in] rFile CSV is written to, must stay open until stop
+     * @param[in] rFlushIntervalMicroseconds the ring buffer is sized for
+     *            twice the samples taken in this time
+     */
+    inline CudaDeviceWatcher
+    (
+        FILE           * const   rFile                      ,
+        int              const   rnDevices                  ,
+        uint64_t         const   rIntervalMicroseconds      ,
+        uint64_t         const   rFlushIntervalMicroseconds = 1000000,
+        MetricProvider   const & rProvider                  = sampleCudaDeviceMetrics
+    )
+     : mnDevices( rnDevices ),
+       mIntervalMicroseconds( std::max( rIntervalMicroseconds, (uint64_t) 1 ) ),
+       mFlushIntervalMicroseconds( std::max( rFlushIntervalMicroseconds, mIntervalMicroseconds ) ),
+       mProvider( rProvider ),
+       mSamples( 2 * rnDevices * ( mFlushIntervalMicroseconds / mIntervalMicroseconds + 1 ) ),
+       mBatch( mSamples.capacity() ),
+       mOut( rFile ),
+       mbRunning( false ), mbStop( false ), mbSamplerDone( false ),
+       mnSamples( 0 ), mnFailedSamples( 0 ), mnDroppedSamples( 0 ), mnMissedIntervals( 0 )
+    {
+        if ( rnDevices <= 0 )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::CudaDeviceWatcher] "
+                << "Need at least one device to watch, but got " << rnDevices << "!";
+            throw std::invalid_argument( msg.str() );
+        }
+    }
+
+    inline ~CudaDeviceWatcher(){ stop(); }
+
+    CudaDeviceWatcher( CudaDeviceWatcher const & ) = delete;
+    CudaDeviceWatcher & operator=( CudaDeviceWatcher const & ) = delete;
+
+    /* writes the CSV header and starts sampling immediately */
+    inline void start( void )
+    {
+        if ( mbRunning )
+            return;
+        mOut.write( "timeMicroseconds,device,memoryFreeBytes,memoryUsedBytes,memoryTotalBytes,"
+                    "clockRateKHz,memoryClockRateKHz,computeMode\n" );
+        mbStop        = false;
+        mbSamplerDone = false;
+        mbRunning     = true;
+        mStart        = std::chrono::steady_clock::now();
+        mSampler      = std::thread( &CudaDeviceWatcher::samplerMain, this );
+        mWriter       = std::thread( &CudaDeviceWatcher::writerMain , this );
+    }
+
+    /* takes no further samples, but writes all taken ones and flushes */
+    inline void stop( void )
+    {
+        if ( ! mbRunning )
+            return;
+        {
+            std::lock_guard< std::mutex > lock( mMutex );
+            mbStop = true;
+        }
+        mChanged.notify_all();
+        mSampler.join();
+        /* only now, so that the writer doesn't miss the samples of the last round */
+        {
+            std::lock_guard< std::mutex > lock( mMutex );
+            mbSamplerDone = true;
+        }
+        mChanged.notify_all();
+        mWriter.join();
+        mbRunning = false;
+    }
+
+    /* @return false if writing to the file failed */
+    inline bool good( void ) const { return mOut.good(); }
+
+    inline uint64_t getSampleCount        ( void ) const { return mnSamples        ; }
+    inline uint64_t getFailedSampleCount  ( void ) const { return mnFailedSamples  ; }
+    inline uint64_t getDroppedSampleCount ( void ) const { return mnDroppedSamples ; }
+    /* intervals skipped, because sampling all devices took longer than one */
+    inline uint64_t getMissedIntervalCount( void ) const { return mnMissedIntervals; }
+
+private:
+    inline void samplerMain( void )
+    {
+        std::chrono::microseconds const interval( mIntervalMicroseconds );
+        auto next = mStart;
+        std::unique_lock< std::mutex > lock( mMutex );
+        while ( ! mbStop )
+        {
+            lock.unlock();
+            for ( int iDevice = 0; iDevice < mnDevices; ++iDevice )
+            {
+                CudaDeviceSample sample = CudaDeviceSample();
+                if ( ! mProvider( iDevice, &sample ) )
+                {
+                    ++mnFailedSamples;
+                    continue;
+                }
+                sample.timeMicroseconds = std::chrono::duration_cast< std::chrono::microseconds >(
+                    std::chrono::steady_clock::now() - mStart ).count();
+                sample.iDevice = iDevice;
+                if ( mSamples.push( sample ) )
+                    ++mnSamples;
+                else
+                    ++mnDroppedSamples;
+            }
+
+            /* fixed schedule instead of sleeping for the interval, so that there is no drift */
+            next += interval;
+            auto const now = std::chrono::steady_clock::now();
+            for ( ; next <= now; next += interval )
+                ++mnMissedIntervals;
+
+            lock.lock();
+            mChanged.wait_until( lock, next, [this](){ return mbStop; } );
+        }
+    }
+
+    inline void writerMain( void )
+    {
+        std::chrono::microseconds const interval( mFlushIntervalMicroseconds );
+        auto next = mStart + interval;
+        bool bDone = false;
+        while ( ! bDone )
+        {
+            {
+                std::unique_lock< std::mutex > lock( mMutex );
+                mChanged.wait_until( lock, next, [this](){ return mbSamplerDone; } );
+                bDone = mbSamplerDone;
+            }
+            writeSamples();
+            next = std::max( next + interval, std::chrono::steady_clock::now() );
+        }
+    }
+
+    inline void writeSamples( void )
+    {
+        size_t const nSamples = mSamples.pop( &mBatch[0], mBatch.size() );
+        for ( size_t i = 0; i < nSamples; ++i )
+        {
+            CudaDeviceSample const & sample = mBatch[i];
+            mOut.writeInteger( sample.timeMicroseconds ).put( ',' )
+                .writeInteger( sample.iDevice          ).put( ',' )
+                .writeInteger( sample.nBytesFree       ).put( ',' )
+                .writeInteger( sample.nBytesTotal - std::min( sample.nBytesFree, sample.nBytesTotal ) ).put( ',' )
+                .writeInteger( sample.nBytesTotal      ).put( ',' )
+                .writeInteger( sample.clockRateKHz     ).put( ',' )
+                .writeInteger( sample.memoryClockRateKHz ).put( ',' )
+                .write( getCudaComputeModeName( sample.computeMode ) ).put( '\n' );
+        }
+        mOut.flush();
+    }
+
+    int              const mnDevices                ;
+    uint64_t         const mIntervalMicroseconds    ;
+    uint64_t         const mFlushIntervalMicroseconds;
+    MetricProvider   const mProvider                ;
+
+    SpscRingBuffer< CudaDeviceSample > mSamples;
+    /* only used by the writer */
+    std::vector< CudaDeviceSample >    mBatch  ;
+    BufferedWriter                     mOut    ;
+
+    std::chrono::steady_clock::time_point mStart;
+    std::thread             mSampler;
+    std::thread             mWriter ;
+    std::mutex              mMutex  ;
+    std::condition_variable mChanged;
+    bool                    mbRunning    ;
+    bool                    mbStop       ;
+    bool                    mbSamplerDone;
+
+    std::atomic< uint64_t > mnSamples        ;
+    std::atomic< uint64_t > mnFailedSamples  ;
+    std::atomic< uint64_t > mnDroppedSamples ;
+    std::atomic< uint64_t > mnMissedIntervals;
+};
@@ -0,0 +1,527 @@
+/**
+ * Allocation-free conversion of integers and floats to text which works in
+ * host as well as device code, e.g. for dumping arrays from inside kernels:
+ *
+ *   char buffer[ nMaxFormattedFloatChars ];
+ *   int const nChars = formatFloat( buffer, x );
+ *
+ * The format functions write no terminating '\0' and return the number of
+ * characters written. @see snprintInt, snprintFloat in cudacommon.hpp for
+ * the versions writing into a buffer of limited size.
+ *
+ * Decimal integers are written two digits at a time from a table of all
+ * pairs 00 to 99, which halves the number of divisions.
+ *
+ * Floats are written with the shortest digits which read back as the same
+ * float, like std::to_chars or printf( "%.9g" ) after trying all shorter
+ * precisions.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>                      // uint32_t, uint64_t
+#include <cstring>                      // memcpy
+#include <type_traits>                  // is_integral, is_signed
+
+/* make this header work even when not using CUDA */
+#if ! defined( __CUDACC__ ) && ! defined( __host__ ) && ! defined( __device__ )
+#   define __host__
+#   define __device__
+#endif
+
+
+/* sign and 64 binary digits of the smallest int64_t */
+constexpr int nMaxFormattedIntegerChars = 65;
+/* e.g. -0.0000123456789 or -1.23456789e-38 */
+constexpr int nMaxFormattedFloatChars   = 16;
+
+#define TMP_DIGIT_PAIRS                                                         \
+    "00010203040506070809" "10111213141516171819" "20212223242526272829"        \
+    "30313233343536373839" "40414243444546474849" "50515253545556575859"        \
+    "60616263646566676869" "70717273747576777879" "80818283848586878889"        \
+    "90919293949596979899"
+#ifdef __CUDACC__
+__constant__ char const formatDigitPairsDevice[ 201 ] = TMP_DIGIT_PAIRS;
+#endif
+static char const formatDigitPairsHost[ 201 ] = TMP_DIGIT_PAIRS;
+#undef TMP_DIGIT_PAIRS
+
+__host__ __device__ inline char const * getFormatDigitPairs( void )
+{
+    #ifdef __CUDA_ARCH__
+        return formatDigitPairsDevice;
+    #else
+        return formatDigitPairsHost;
+    #endif
+}
+
+/* @return number of decimal digits of rValue, 1 for 0 */
+__host__ __device__ inline int countDecimalDigits( uint64_t const rValue )
+{
+    int nDigits = 1;
+    for ( uint64_t power = 10; nDigits < 20 && rValue >= power; power *= 10 )
+        ++nDigits;
+    return nDigits;
+}
+
+/**
+ * Writes the digits of rValue backwards ending before rEnd. Device code
+ * benefits from doing the 64-bit divisions only as long as necessary.
+ */
+template< typename T >
+__host__ __device__ inline char * formatDecimalDigitsBackwards( char * rEnd, T rValue )
+{
+    char const * const pairs = getFormatDigitPairs();
+    while ( rValue >= T(100) )
+    {
+        unsigned int const i = (unsigned int)( rValue % T(100) ) * 2u;
+        rValue /= T(100);
+        *--rEnd = pairs[ i + 1 ];
+        *--rEnd = pairs[ i     ];
+    }
+    if ( rValue >= T(10) )
+    {
+        unsigned int const i = (unsigned int) rValue * 2u;
+        *--rEnd = pairs[ i + 1 ];
+        *--rEnd = pairs[ i     ];
+    }
+    else
+        *--rEnd = (char)( '0' + rValue );
+    return rEnd;
+}
+
+/**
+ * Writes rValue without sign in base 2 to 36 using 0-9 and A-Z as digits.
+ * @param[out] rBuffer must have space for 64 characters
+ */
+__host__ __device__ inline int formatUnsigned
+(
+    char         * const rBuffer,
+    uint64_t             rValue ,
+    unsigned int   const rBase = 10u
+)
+{
+    assert( rBase >= 2u && rBase <= 36u && "Base must be in [2,36] in order to be written with 0-9 and A-Z!" );
+
+    if ( rBase == 10u )
+    {
+        int const nDigits = countDecimalDigits( rValue );
+        char * end = rBuffer + nDigits;
+        if ( rValue >= 10000000000ull )
+        {
+            /* split off the last 10 digits, so that the rest fits into 32 bits */
+            char * const middle = formatDecimalDigitsBackwards( end, rValue % 10000000000ull );
+            end -= 10;
+            for ( char * p = end; p < middle; ++p )
+                *p = '0';
+            rValue /= 10000000000ull;
+        }
+        if ( rValue > 0xFFFFFFFFu )
+            formatDecimalDigitsBackwards( end, rValue );
+        else
+            formatDecimalDigitsBackwards( end, (uint32_t) rValue );
+        return nDigits;
+    }
+
+    int nDigits = 1;
+    for ( uint64_t rest = rValue / rBase; rest != 0; rest /= rBase )
+        ++nDigits;
+    char const * const digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    for ( char * p = rBuffer + nDigits; p != rBuffer; rValue /= rBase )
+        *--p = digits[ rValue % rBase ];
+    return nDigits;
+}
+
+template< typename T >
+__host__ __device__ inline bool isFormatNegative( T const rValue, std::true_type  ) { return rValue < T(0); }
+template< typename T >
+__host__ __device__ inline bool isFormatNegative( T const     , std::false_type ) { return false; }
+
+/**
+ * @param[out] rBuffer must have space for nMaxFormattedIntegerChars
+ */
+template< typename T >
+__host__ __device__ inline int formatInteger
+(
+    char         * const rBuffer,
+    T              const rValue ,
+    unsigned int   const rBase = 10u
+)
+{
+    static_assert( std::is_integral< T >::value, "Only integers can be formatted with formatInteger!" );
+    if ( isFormatNegative( rValue, typename std::is_signed< T >::type() ) )
+    {
+        rBuffer[0] = '-';
+        /* negating in unsigned arithmetic also works for the smallest value */
+        return 1 + formatUnsigned( rBuffer + 1, uint64_t(0) - (uint64_t)(int64_t) rValue, rBase );
+    }
+    return formatUnsigned( rBuffer, (uint64_t) rValue, rBase );
+}
+
+
+/**
+ * Floats are converted with Ryu, Ulf Adams, "Ryu: Fast Float-to-String
+ * Conversion", PLDI 2018, which works on the interval of real numbers
+ * rounding to the float and multiplies its bounds with 64-bit
+ * approximations of powers of 5 precise enough to give exact results.
+ */
+int const nFormatFloatPow5InvBits = 59;
+int const nFormatFloatPow5Bits    = 61;
+
+/* floor( 2^( pow5bits( i ) - 1 + 59 ) / 5^i ) + 1 */
+#define TMP_POW5_INV_SPLIT                                                      \
+    576460752303423489u, 461168601842738791u, 368934881474191033u,              \
+    295147905179352826u, 472236648286964522u, 377789318629571618u,              \
+    302231454903657294u, 483570327845851670u, 386856262276681336u,              \
+    309485009821345069u, 495176015714152110u, 396140812571321688u,              \
+    316912650057057351u, 507060240091291761u, 405648192073033409u,              \
+    324518553658426727u, 519229685853482763u, 415383748682786211u,              \
+    332306998946228969u, 531691198313966350u, 425352958651173080u,              \
+    340282366920938464u, 544451787073501542u, 435561429658801234u,              \
+    348449143727040987u, 557518629963265579u, 446014903970612463u,              \
+    356811923176489971u, 570899077082383953u, 456719261665907162u,              \
+    365375409332725730u, 292300327466180584u
+/* the highest 61 bits of 5^i */
+#define TMP_POW5_SPLIT                                                          \
+    1152921504606846976u, 1441151880758558720u, 1801439850948198400u,           \
+    2251799813685248000u, 1407374883553280000u, 1759218604441600000u,           \
+    2199023255552000000u, 1374389534720000000u, 1717986918400000000u,           \
+    2147483648000000000u, 1342177280000000000u, 1677721600000000000u,           \
+    2097152000000000000u, 1310720000000000000u, 1638400000000000000u,           \
+    2048000000000000000u, 1280000000000000000u, 1600000000000000000u,           \
+    2000000000000000000u, 1250000000000000000u, 1562500000000000000u,           \
+    1953125000000000000u, 1220703125000000000u, 1525878906250000000u,           \
+    1907348632812500000u, 1192092895507812500u, 1490116119384765625u,           \
+    1862645149230957031u, 1164153218269348144u, 1455191522836685180u,           \
+    1818989403545856475u, 2273736754432320594u, 1421085471520200371u,           \
+    1776356839400250464u, 2220446049250313080u, 1387778780781445675u,           \
+    1734723475976807094u, 2168404344971008868u, 1355252715606880542u,           \
+    1694065894508600678u, 2117582368135750847u, 1323488980084844279u,           \
+    1654361225106055349u, 2067951531382569187u, 1292469707114105741u,           \
+    1615587133892632177u, 2019483917365790221u, 1262177448353618888u
+#ifdef __CUDACC__
+__constant__ uint64_t const formatFloatPow5InvSplitDevice[ 32 ] = { TMP_POW5_INV_SPLIT };
+__constant__ uint64_t const formatFloatPow5SplitDevice   [ 48 ] = { TMP_POW5_SPLIT     };
+#endif
+static uint64_t const formatFloatPow5InvSplitHost[ 32 ] = { TMP_POW5_INV_SPLIT };
+static uint64_t const formatFloatPow5SplitHost   [ 48 ] = { TMP_POW5_SPLIT     };
+#undef TMP_POW5_INV_SPLIT
+#undef TMP_POW5_SPLIT
+
+/* @return the number of bits of 5^e for 0 <= e <= 3528 */
+__host__ __device__ inline int getPow5Bits( int const e ) { return int( ( uint32_t( e ) * 1217359u ) >> 19 ) + 1; }
+/* @return floor( log10( 2^e ) ) for 0 <= e <= 1650 */
+__host__ __device__ inline int getLog10Pow2( int const e ) { return int( ( uint32_t( e ) * 78913u ) >> 18 ); }
+/* @return floor( log10( 5^e ) ) for 0 <= e <= 2620 */
+__host__ __device__ inline int getLog10Pow5( int const e ) { return int( ( uint32_t( e ) * 732923u ) >> 20 ); }
+
+__host__ __device__ inline bool isMultipleOfPow5( uint32_t rValue, int const rExponent )
+{
+    int nFactors = 0;
+    for ( ; rValue % 5u == 0; rValue /= 5u )
+        ++nFactors;
+    return nFactors >= rExponent;
+}
+
+/* @return ( m * factor ) >> shift for shift > 32 without 128-bit integers */
+__host__ __device__ inline uint32_t mulShiftFormat( uint32_t const m, uint64_t const factor, int const shift )
+{
+    assert( shift > 32 );
+    uint64_t const low  = (uint64_t) m * (uint32_t) factor;
+    uint64_t const high = (uint64_t) m * (uint32_t)( factor >> 32 );
+    return (uint32_t)( ( ( low >> 32 ) + high ) >> ( shift - 32 ) );
+}
+
+__host__ __device__ inline uint32_t mulPow5InvDivPow2( uint32_t const m, int const q, int const j )
+{
+    #ifdef __CUDA_ARCH__
+        return mulShiftFormat( m, formatFloatPow5InvSplitDevice[q], j );
+    #else
+        return mulShiftFormat( m, formatFloatPow5InvSplitHost[q], j );
+    #endif
+}
+
+__host__ __device__ inline uint32_t mulPow5DivPow2( uint32_t const m, int const i, int const j )
+{
+    #ifdef __CUDA_ARCH__
+        return mulShiftFormat( m, formatFloatPow5SplitDevice[i], j );
+    #else
+        return mulShiftFormat( m, formatFloatPow5SplitHost[i], j );
+    #endif
+}
+
+/**
+ * Finds the shortest decimal number, which lies inside the interval of real
+ * numbers rounding to rValue, and out of those the closest one.
+ *
+ * @param[in]  rValue must be finite and positive
+ * @param[out] rExponent the value is the returned integer times 10^rExponent
+ * @return decimal digits of at most 9 digits
+ */
+__host__ __device__ inline uint32_t findShortestFloatDigits
+(
+    float const rValue   ,
+    int       & rExponent
+)
+{
+    uint32_t bits;
+    memcpy( &bits, &rValue, sizeof( bits ) );
+    uint32_t const biasedExponent = ( bits >> 23 ) & 0xFFu;
+    uint32_t const fraction = bits & 0x7FFFFFu;
+    assert( biasedExponent != 0xFFu && ( biasedExponent != 0 || fraction != 0 ) && ! ( bits >> 31 ) );
+
+    /* rValue = mantissa * 2^( exponent + 2 ), two more bits for the bounds */
+    uint32_t const mantissa = biasedExponent == 0 ? fraction : fraction | ( 1u << 23 );
+    int      const exponent = ( biasedExponent == 0 ? 1 : (int) biasedExponent ) - 127 - 23 - 2;
+    /* halfway points to the neighbors are included when rounding to even keeps rValue */
+    bool const bBoundsIncluded = ( mantissa & 1u ) == 0;
+
+    /* the value and the halfway points to the neighbors, the next lower float
+     * is closer for powers of 2 except the smallest normal one */
+    uint32_t const mv = 4 * mantissa;
+    uint32_t const mp = 4 * mantissa + 2;
+    uint32_t const mm = 4 * mantissa - 1 - ( fraction != 0 || biasedExponent <= 1 ? 1 : 0 );
+
+    /* vr, vp, vm = mv, mp, mm * 2^exponent / 10^e10 rounded down */
+    uint32_t vr, vp, vm;
+    int e10;
+    bool bVmTrailingZeros = false;
+    bool bVrTrailingZeros = false;
+    uint32_t lastRemovedDigit = 0;
+    if ( exponent >= 0 )
+    {
+        int const q = getLog10Pow2( exponent );
+        e10 = q;
+        int const k = nFormatFloatPow5InvBits + getPow5Bits( q ) - 1;
+        int const i = -exponent + q + k;
+        vr = mulPow5InvDivPow2( mv, q, i );
+        vp = mulPow5InvDivPow2( mp, q, i );
+        vm = mulPow5InvDivPow2( mm, q, i );
+        if ( q != 0 && ( vp - 1 ) / 10 <= vm / 10 )
+        {
+            /* the digit removed first in the loop below needs one more digit */
+            int const l = nFormatFloatPow5InvBits + getPow5Bits( q - 1 ) - 1;
+            lastRemovedDigit = mulPow5InvDivPow2( mv, q - 1, -exponent + q - 1 + l ) % 10;
+        }
+        if ( q <= 9 )
+        {
+            /* only one of mp, mv, mm can be a multiple of 5 */
+            if ( mv % 5 == 0 )
+                bVrTrailingZeros = isMultipleOfPow5( mv, q );
+            else if ( bBoundsIncluded )
+                bVmTrailingZeros = isMultipleOfPow5( mm, q );
+            else
+                vp -= isMultipleOfPow5( mp, q ) ? 1 : 0;
+        }
+    }
+    else
+    {
+        int const q = getLog10Pow5( -exponent );
+        e10 = q + exponent;
+        int const i = -exponent - q;
+        int const k = getPow5Bits( i ) - nFormatFloatPow5Bits;
+        int j = q - k;
+        vr = mulPow5DivPow2( mv, i, j );
+        vp = mulPow5DivPow2( mp, i, j );
+        vm = mulPow5DivPow2( mm, i, j );
+        if ( q != 0 && ( vp - 1 ) / 10 <= vm / 10 )
+        {
+            j = q - 1 - ( getPow5Bits( i + 1 ) - nFormatFloatPow5Bits );
+            lastRemovedDigit = mulPow5DivPow2( mv, i + 1, j ) % 10;
+        }
+        if ( q <= 1 )
+        {
+            /* mv = 4 * mantissa has at least 2 trailing zero bits */
+            bVrTrailingZeros = true;
+            if ( bBoundsIncluded )
+                bVmTrailingZeros = fraction != 0 || biasedExponent <= 1;
+            else
+                --vp;
+        }
+        else if ( q < 31 )
+            bVrTrailingZeros = ( mv & ( ( 1u << ( q - 1 ) ) - 1 ) ) == 0;
+    }
+
+    /* remove digits as long as the bounds differ in them */
+    int nRemoved = 0;
+    uint32_t output;
+    if ( bVmTrailingZeros || bVrTrailingZeros )
+    {
+        /* rare general case needing to track whether the removed digits are all 0 */
+        for ( ; vp / 10 > vm / 10; ++nRemoved )
+        {
+            bVmTrailingZeros &= vm % 10 == 0;
+            bVrTrailingZeros &= lastRemovedDigit == 0;
+            lastRemovedDigit = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+        }
+        if ( bVmTrailingZeros )
+        {
+            for ( ; vm % 10 == 0; ++nRemoved )
+            {
+                bVrTrailingZeros &= lastRemovedDigit == 0;
+                lastRemovedDigit = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+            }
+        }
+        /* round exact halfway cases to even */
+        if ( bVrTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0 )
+            lastRemovedDigit = 4;
+        output = vr + ( ( vr == vm && ( ! bBoundsIncluded || ! bVmTrailingZeros ) ) || lastRemovedDigit >= 5 ? 1 : 0 );
+    }
+    else
+    {
+        for ( ; vp / 10 > vm / 10; ++nRemoved )
+        {
+            lastRemovedDigit = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+        }
+        output = vr + ( vr == vm || lastRemovedDigit >= 5 ? 1 : 0 );
+    }
+
+    rExponent = e10 + nRemoved;
+    return output;
+}
+
+/**
+ * Writes the shortest representation reading back as rValue, e.g. 0.1,
+ * 123456.7, 1e+20, 1.5e-07, -0, inf and nan. Numbers from 1e-5 to below 1e9
+ * are written without exponent.
+ *
+ * @param[out] rBuffer must have space for nMaxFormattedFloatChars
+ */
+__host__ __device__ inline int formatFloat( char * const rBuffer, float const rValue )
+{
+    uint32_t bits;
+    memcpy( &bits, &rValue, sizeof( bits ) );
+    char * p = rBuffer;
+    if ( ( bits & 0x7FFFFFFFu ) > 0x7F800000u )
+    {
+        p[0] = 'n'; p[1] = 'a'; p[2] = 'n';
+        return 3;
+    }
+    if ( bits >> 31 )
+        *p++ = '-';
+    if ( ( bits & 0x7FFFFFFFu ) == 0x7F800000u )
+    {
+        p[0] = 'i'; p[1] = 'n'; p[2] = 'f';
+        return int( p - rBuffer ) + 3;
+    }
+    if ( ( bits & 0x7FFFFFFFu ) == 0 )
+    {
+        *p++ = '0';
+        return int( p - rBuffer );
+    }
+
+    float positive;
+    uint32_t const positiveBits = bits & 0x7FFFFFFFu;
+    memcpy( &positive, &positiveBits, sizeof( positive ) );
+    int exponent = 0;
+    uint32_t const output = findShortestFloatDigits( positive, exponent );
+    int const nDigits = countDecimalDigits( output );
+    assert( nDigits <= 9 );
+    char digits[ 9 ];
+    formatDecimalDigitsBackwards( digits + nDigits, output );
+
+    /* the value is 0.d1d2d3... * 10^nPointPosition */
+    int const nPointPosition = exponent + nDigits;
+    if ( nPointPosition > -5 && nPointPosition <= 9 )
+    {
+        if ( nPointPosition <= 0 )
+        {
+            /* 0.000ddd */
+            *p++ = '0';
+            *p++ = '.';
+            for ( int i = nPointPosition; i < 0; ++i )
+                *p++ = '0';
+            for ( int i = 0; i < nDigits; ++i )
+                *p++ = digits[i];
+        }
+        else
+        {
+            /* ddd000 or dd.ddd */
+            for ( int i = 0; i < nPointPosition || i < nDigits; ++i )
+            {
+                if ( i == nPointPosition )
+                    *p++ = '.';
+                *p++ = i < nDigits ? digits[i] : '0';
+            }
+        }
+    }
+    else
+    {
+        /* d.ddde-XX like printf, i.e. with sign and at least two digits */
+        *p++ = digits[0];
+        if ( nDigits > 1 )
+        {
+            *p++ = '.';
+            for ( int i = 1; i < nDigits; ++i )
+                *p++ = digits[i];
+        }
+        int const scientificExponent = nPointPosition - 1;
+        *p++ = 'e';
+        *p++ = scientificExponent < 0 ? '-' : '+';
+        unsigned int const magnitude = scientificExponent < 0 ? -scientificExponent : scientificExponent;
+        char const * const pair = getFormatDigitPairs() + 2 * magnitude;
+        *p++ = pair[0];
+        *p++ = pair[1];
+    }
+    assert( p - rBuffer <= nMaxFormattedFloatChars );
+    return int( p - rBuffer );
+}
+
+/* e.g. "1023 EiB 1023 PiB ... 1023 B" for the largest 64-bit number */
+constexpr int nMaxFormattedBytesChars = 7 * 9;
+
+/**
+ * Writes the number of bytes exactly, split into binary or decimal
+ * prefixes, e.g. 128427 as "125 kiB 427 B" or "128 kB 427 B". Parts which
+ * are 0 are left out.
+ *
+ * @param[out] rBuffer must have space for nMaxFormattedBytesChars
+ */
+__host__ __device__ inline int formatBytes
+(
+    char     * const rBuffer ,
+    uint64_t         rnBytes ,
+    bool       const rLogical = true
+)
+{
+    char const prefixes[] = { 'k', 'M', 'G', 'T', 'P', 'E' };
+    unsigned int const base = rLogical ? 1024u : 1000u;
+    unsigned int parts[ sizeof( prefixes ) + 1 ];
+    int nParts = 0;
+    do
+    {
+        parts[ nParts++ ] = (unsigned int)( rnBytes % base );
+        rnBytes /= base;
+    }
+    while ( rnBytes != 0 );
+
+    char * p = rBuffer;
+    for ( int i = nParts - 1; i >= 0; --i )
+    {
+        if ( i != nParts - 1 && parts[i] == 0 )
+            continue;
+        if ( p != rBuffer )
+            *p++ = ' ';
+        p += formatUnsigned( p, parts[i] );
+        *p++ = ' ';
+        if ( i > 0 )
+        {
+            *p++ = prefixes[ i - 1 ];
+            if ( rLogical )
+                *p++ = 'i';
+        }
+        *p++ = 'B';
+    }
+    assert( p - rBuffer <= nMaxFormattedBytesChars );
+    return int( p - rBuffer );
+}
@@ -0,0 +1,367 @@
+/**
+ * Host backend for running the grid-stride kernels written for CUDA on all
+ * CPU cores. When compiled without nvcc, threadIdx, blockIdx, blockDim and
+ * gridDim are emulated per task, so that getLinearGlobalId & co. from
+ * cudacommon.hpp work unchanged inside the kernel bodies, e.g.:
+ *
+ *   __device__ void kernelSaxpy( float a, float const * x, float * y, uint64_t n )
+ *   {
+ *       unsigned long long int i, nThreads;
+ *       getLinearGlobalIdSize( &i, &nThreads );
+ *       for ( ; i < n; i += nThreads )
+ *           y[i] = a * x[i] + y[i];
+ *   }
+ *   launchHostKernel( nBlocks, nThreads, kernelSaxpy, a, x, y, n );
+ *
+ * Each block is one task of a work-stealing thread pool. The threads of a
+ * block are run one after another by the same worker, i.e. kernels using
+ * __syncthreads or shared memory are not supported, only independent
+ * (grid-stride) threads are.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>                      // uint64_t
+#include <exception>                    // exception_ptr
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Thread pool which distributes the indexes [0,nTasks) of parallelFor
+ * evenly onto all workers at first. A worker which finished its own range
+ * steals the upper half of the largest remaining range of another worker,
+ * which balances kernels whose blocks have different run times without the
+ * contention of one shared task counter.
+ * The thread calling parallelFor works as worker 0, i.e. only size()-1
+ * threads are spawned.
+ */
+class HostThreadPool
+{
+private:
+    /**
+     * Padded by a whole cache line, so that the ranges of neighbouring
+     * workers never share one, which would make stealing slow. alignas
+     * can't be used, because std::vector ignores over-alignment before
+     * C++17.
+     */
+    struct WorkRange
+    {
+        std::mutex mutex;
+        uint64_t   begin;
+        uint64_t   end  ;
+        char       padding[64];
+
+        WorkRange() : begin( 0 ), end( 0 ) {}
+    };
+
+public:
+    inline explicit HostThreadPool( unsigned int rnThreads = 0 )
+     : mRanges( rnThreads > 0 ? rnThreads : defaultThreadCount() ),
+       mGeneration( 0 ), mnRunning( 0 ), mbStop( false )
+    {
+        for ( unsigned int iWorker = 1; iWorker < mRanges.size(); ++iWorker )
+            mWorkers.push_back( std::thread( &HostThreadPool::workerMain, this, iWorker ) );
+    }
+
+    inline ~HostThreadPool()
+    {
+        {
+            std::lock_guard< std::mutex > lock( mMutex );
+            mbStop = true;
+        }
+        mWakeUp.notify_all();
+        for ( auto & worker : mWorkers )
+            worker.join();
+    }
+
+    HostThreadPool( HostThreadPool const & ) = delete;
+    HostThreadPool & operator=( HostThreadPool const & ) = delete;
+
+    inline unsigned int size( void ) const { return mRanges.size(); }
+
+    /* of the spawned workers, i.e. not of worker 0, e.g. for pinning them */
+    inline std::vector< std::thread::native_handle_type > nativeHandles( void )
+    {
+        std::vector< std::thread::native_handle_type > handles;
+        for ( auto & worker : mWorkers )
+            handles.push_back( worker.native_handle() );
+        return handles;
+    }
+
+    static inline unsigned int defaultThreadCount( void )
+    {
+        unsigned int const nThreads = std::thread::hardware_concurrency();
+        return nThreads > 0 ? nThreads : 1;
+    }
+
+    /**
+     * Calls rFunctor( iTask ) for each iTask in [0,rnTasks) and returns
+     * after all of them finished. The first exception thrown by a task is
+     * rethrown here, the remaining tasks will still be worked on.
+     * Must not be called from inside a task of the same pool.
+     */
+    inline void parallelFor
+    (
+        uint64_t                                const rnTasks,
+        std::function< void( uint64_t ) > const &     rFunctor
+    )
+    {
+        if ( rnTasks == 0 )
+            return;
+
+        std::lock_guard< std::mutex > launchLock( mLaunchMutex );
+        mTask      = &rFunctor;
+        mException = nullptr;
+        for ( unsigned int iWorker = 0; iWorker < size(); ++iWorker )
+        {
+            std::lock_guard< std::mutex > lock( mRanges[iWorker].mutex );
+            mRanges[iWorker].begin = rnTasks *   iWorker       / size();
+            mRanges[iWorker].end   = rnTasks * ( iWorker + 1 ) / size();
+        }
+
+        {
+            std::lock_guard< std::mutex > lock( mMutex );
+            mnRunning = size() - 1;
+            ++mGeneration;
+        }
+        mWakeUp.notify_all();
+
+        runWorker( 0 );
+
+        std::unique_lock< std::mutex > lock( mMutex );
+        mDone.wait( lock, [this](){ return mnRunning == 0; } );
+        mTask = NULL;
+        if ( mException )
+            std::rethrow_exception( mException );
+    }
+
+private:
+    inline void workerMain( unsigned int const iWorker )
+    {
+        uint64_t lastGeneration = 0;
+        while ( true )
+        {
+            {
+                std::unique_lock< std::mutex > lock( mMutex );
+                mWakeUp.wait( lock, [&](){ return mbStop || mGeneration != lastGeneration; } );
+                if ( mbStop )
+                    return;
+                lastGeneration = mGeneration;
+            }
+
+            runWorker( iWorker );
+
+            std::lock_guard< std::mutex > lock( mMutex );
+            if ( --mnRunning == 0 )
+                mDone.notify_one();
+        }
+    }
+
+    /**
+     * @return true if a task could be taken from the own range
+     */
+    inline bool popOwn( unsigned int const iWorker, uint64_t * const riTask )
+    {
+        WorkRange & range = mRanges[iWorker];
+        std::lock_guard< std::mutex > lock( range.mutex );
+        if ( range.begin >= range.end )
+            return false;
+        *riTask = range.begin++;
+        return true;
+    }
+
+    /**
+     * Moves the upper half of the fullest range of the other workers into
+     * the own (empty) range.
+     * @return false if there was nothing left to steal
+     */
+    inline bool steal( unsigned int const iWorker )
+    {
+        while ( true )
+        {
+            /* look for the fullest victim, the sizes are only a hint, because
+             * they may change until the victim is locked again for stealing */
+            unsigned int iVictim   = iWorker;
+            uint64_t     nMaxTasks = 0;
+            for ( unsigned int i = 1; i < size(); ++i )
+            {
+                unsigned int const iCandidate = ( iWorker + i ) % size();
+                std::lock_guard< std::mutex > lock( mRanges[ iCandidate ].mutex );
+                uint64_t const nTasks = mRanges[ iCandidate ].end - mRanges[ iCandidate ].begin;
+                if ( mRanges[ iCandidate ].begin < mRanges[ iCandidate ].end && nTasks > nMaxTasks )
+                {
+                    nMaxTasks = nTasks;
+                    iVictim   = iCandidate;
+                }
+            }
+            if ( nMaxTasks == 0 )
+                return false;
+
+            uint64_t begin, end;
+            {
+                WorkRange & victim = mRanges[ iVictim ];
+                std::lock_guard< std::mutex > lock( victim.mutex );
+                if ( victim.begin >= victim.end )
+                    continue;   /* was emptied in the meantime, try again */
+                end   = victim.end;
+                begin = victim.begin + ( victim.end - victim.begin ) / 2;
+                victim.end = begin;
+            }
+            WorkRange & own = mRanges[ iWorker ];
+            std::lock_guard< std::mutex > lock( own.mutex );
+            own.begin = begin;
+            own.end   = end;
+            return true;
+        }
+    }
+
+    inline void runWorker( unsigned int const iWorker )
+    {
+        uint64_t iTask;
+        do
+        {
+            while ( popOwn( iWorker, &iTask ) )
+            {
+                try
+                {
+                    (*mTask)( iTask );
+                }
+                catch ( ... )
+                {
+                    std::lock_guard< std::mutex > lock( mMutex );
+                    if ( ! mException )
+                        mException = std::current_exception();
+                }
+            }
+        }
+        while ( steal( iWorker ) );
+    }
+
+    std::vector< WorkRange >                  mRanges     ;
+    std::vector< std::thread >                mWorkers    ;
+    std::function< void( uint64_t ) > const * mTask       ;
+    std::exception_ptr                        mException  ;
+    std::mutex                                mLaunchMutex;
+    std::mutex                                mMutex      ;
+    std::condition_variable                   mWakeUp     ;
+    std::condition_variable                   mDone       ;
+    uint64_t                                  mGeneration ;
+    unsigned int                              mnRunning   ;
+    bool                                      mbStop      ;
+};
+
+/**
+ * Pool shared by all host kernel launches which don't specify one.
+ * Created on first use with one worker per core.
+ */
+inline HostThreadPool & getHostThreadPool( void )
+{
+    static HostThreadPool pool;
+    return pool;
+}
+
+
+#if ! defined( __CUDACC__ )
+
+/* make this header work even when not using CUDA */
+#if ! defined( __host__ ) && ! defined( __device__ )
+#   define __host__
+#   define __device__
+#endif
+
+/* same as in CUDA's vector_types.h, unless that already was included */
+#if ! defined( __VECTOR_TYPES_H__ )
+struct uint3
+{
+    unsigned int x, y, z;
+};
+
+struct dim3
+{
+    unsigned int x, y, z;
+
+    inline dim3( unsigned int vx = 1, unsigned int vy = 1, unsigned int vz = 1 )
+     : x( vx ), y( vy ), z( vz ) {}
+    inline dim3( uint3 v ) : x( v.x ), y( v.y ), z( v.z ) {}
+    inline operator uint3( void ) const { uint3 t = { x, y, z }; return t; }
+};
+#endif
+
+/**
+ * The member names differ from the CUDA built-ins, because those are
+ * macros redirecting to the members of the calling worker's context.
+ */
+struct HostKernelContext
+{
+    uint3 threadIndex   ;
+    uint3 blockIndex    ;
+    dim3  blockDimension;
+    dim3  gridDimension ;
+};
+
+inline HostKernelContext & getHostKernelContext( void )
+{
+    static thread_local HostKernelContext context;
+    return context;
+}
+
+#define threadIdx ( getHostKernelContext().threadIndex    )
+#define blockIdx  ( getHostKernelContext().blockIndex     )
+#define blockDim  ( getHostKernelContext().blockDimension )
+#define gridDim   ( getHostKernelContext().gridDimension  )
+
+/**
+ * Host counterpart of kernel<<< rGridDim, rBlockDim >>>() for a kernel
+ * functor taking no arguments, e.g. a lambda capturing them.
+ * Each block becomes one task of the thread pool, its threads are iterated
+ * in the same order as threadIdx would be linearized, i.e. x fastest.
+ */
+template< class T_Kernel >
+inline void launchHostKernelOnPool
+(
+    HostThreadPool &       rPool    ,
+    dim3           const & rGridDim ,
+    dim3           const & rBlockDim,
+    T_Kernel       const & rKernel
+)
+{
+    uint64_t const nBlocks = (uint64_t) rGridDim.x * rGridDim.y * rGridDim.z;
+    rPool.parallelFor( nBlocks, [&]( uint64_t const iBlock )
+    {
+        HostKernelContext & context = getHostKernelContext();
+        context.gridDimension  = rGridDim;
+        context.blockDimension = rBlockDim;
+        context.blockIndex.x   =   iBlock % rGridDim.x;
+        context.blockIndex.y   = ( iBlock / rGridDim.x ) % rGridDim.y;
+        context.blockIndex.z   =   iBlock / ( (uint64_t) rGridDim.x * rGridDim.y );
+
+        uint3 & i = context.threadIndex;
+        for ( i.z = 0; i.z < rBlockDim.z; ++i.z )
+        for ( i.y = 0; i.y < rBlockDim.y; ++i.y )
+        for ( i.x = 0; i.x < rBlockDim.x; ++i.x )
+            rKernel();
+    } );
+}
+
+/**
+ * Host counterpart of kernel<<< rGridDim, rBlockDim >>>( args... ) using
+ * the shared thread pool.
+ */
+template< class T_Kernel, class... T_Args >
+inline void launchHostKernel
+(
+    dim3     const &    rGridDim ,
+    dim3     const &    rBlockDim,
+    T_Kernel const &    rKernel  ,
+    T_Args   const & ...rArgs
+)
+{
+    launchHostKernelOnPool( getHostThreadPool(), rGridDim, rBlockDim,
+                            [&](){ rKernel( rArgs... ); } );
+}
+
+#endif // ! __CUDACC__
@@ -0,0 +1,1129 @@
+/**
+ * Stand-in for the subset of the CUDA runtime API used by cudacommon.hpp,
+ * for builds without nvcc and without the CUDA headers. Devices are purely
+ * synthetic and can be set up freely, e.g.:
+ *
+ *   getHostRuntime().devices.push_back( makeHostRuntimeDevice( "Synthetic", 6, 1, 20 ) );
+ *
+ * Calls are counted, so that it can be checked whether e.g. a cache really
+ * avoided querying the device properties. Each device can be given a
+ * latency for querying its properties, standing in for the initialization
+ * the first query triggers on real GPUs. Device memory is host memory,
+ * but allocations are tracked, so that wrong pointers and pageable
+ * transfers can be detected. Managed memory is host memory, too, for which
+ * prefetches and advices are only validated and counted. Each stream is a
+ * worker thread executing its
+ * queue in order, so that overlap and ordering bugs show up without a GPU.
+ * If the real cuda_runtime_api.h was already included, this header does
+ * nothing.
+ */
+
+#pragma once
+
+#if ! defined( __CUDACC__ ) && ! defined( CUDART_VERSION )
+
+#define CUDA_HOST_RUNTIME 1
+
+#include <algorithm>                    // min
+#include <atomic>
+#include <chrono>                       // microseconds
+#include <condition_variable>
+#include <cstdlib>                      // malloc, free
+#include <cstring>                      // memset, strncpy, memcpy
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>                      // pair
+#include <vector>
+
+
+/* numbers are the same as for the real runtime */
+enum cudaError
+{
+    cudaSuccess                          = 0,
+    cudaErrorInvalidValue                = 1,
+    cudaErrorMemoryAllocation            = 2,
+    cudaErrorInitializationError         = 3,
+    cudaErrorInvalidHostPointer          = 16,
+    cudaErrorInvalidDevicePointer        = 17,
+    cudaErrorNoDevice                    = 100,
+    cudaErrorInvalidDevice               = 101,
+    cudaErrorPeerAccessUnsupported       = 217,
+    cudaErrorPeerAccessAlreadyEnabled    = 704,
+    cudaErrorPeerAccessNotEnabled        = 705,
+    cudaErrorHostMemoryAlreadyRegistered = 712,
+    cudaErrorHostMemoryNotRegistered     = 713,
+    cudaErrorNotSupported                = 801
+};
+typedef enum cudaError cudaError_t;
+
+enum cudaDeviceAttr
+{
+    cudaDevAttrMaxThreadsPerBlock                = 1,
+    cudaDevAttrClockRate                         = 13,
+    cudaDevAttrMultiProcessorCount               = 16,
+    cudaDevAttrCanMapHostMemory                  = 19,
+    cudaDevAttrComputeMode                       = 20,
+    cudaDevAttrPciBusId                          = 33,
+    cudaDevAttrPciDeviceId                       = 34,
+    cudaDevAttrMemoryClockRate                   = 36,
+    cudaDevAttrGlobalMemoryBusWidth              = 37,
+    cudaDevAttrPciDomainId                       = 50,
+    cudaDevAttrComputeCapabilityMajor            = 75,
+    cudaDevAttrComputeCapabilityMinor            = 76,
+    cudaDevAttrStreamPrioritiesSupported         = 78,
+    cudaDevAttrGlobalL1CacheSupported            = 79,
+    cudaDevAttrLocalL1CacheSupported             = 80,
+    cudaDevAttrMaxSharedMemoryPerMultiprocessor  = 81,
+    cudaDevAttrMaxRegistersPerMultiprocessor     = 82,
+    cudaDevAttrManagedMemory                     = 83,
+    cudaDevAttrIsMultiGpuBoard                   = 84,
+    cudaDevAttrMultiGpuBoardGroupID              = 85,
+    cudaDevAttrSingleToDoublePrecisionPerfRatio  = 87,
+    cudaDevAttrPageableMemoryAccess              = 88,
+    cudaDevAttrConcurrentManagedAccess           = 89
+};
+
+/**
+ * Same field names as the real cudaDeviceProp, but only those which are
+ * used somewhere. The layout differs, which is no problem, because binary
+ * dumps of it are tagged with sizeof and CUDA_HOST_RUNTIME.
+ */
+struct cudaDeviceProp
+{
+    char   name[256]                  ;
+    size_t totalGlobalMem             ;
+    size_t sharedMemPerBlock          ;
+    int    regsPerBlock               ;
+    int    warpSize                   ;
+    size_t memPitch                   ;
+    int    maxThreadsPerBlock         ;
+    int    maxThreadsDim[3]           ;
+    int    maxGridSize[3]             ;
+    int    clockRate                  ;
+    size_t totalConstMem              ;
+    int    major                      ;
+    int    minor                      ;
+    size_t textureAlignment           ;
+    int    deviceOverlap              ;
+    int    multiProcessorCount        ;
+    int    kernelExecTimeoutEnabled   ;
+    int    integrated                 ;
+    int    canMapHostMemory           ;
+    int    computeMode                ;
+    int    maxTexture1D               ;
+    int    maxTexture2D[2]            ;
+    int    maxTexture3D[3]            ;
+    int    concurrentKernels          ;
+    int    ECCEnabled                 ;
+    int    pciBusID                   ;
+    int    pciDeviceID                ;
+    int    pciDomainID                ;
+    int    tccDriver                  ;
+    int    asyncEngineCount           ;
+    int    unifiedAddressing          ;
+    int    memoryClockRate            ;
+    int    memoryBusWidth             ;
+    int    l2CacheSize                ;
+    int    maxThreadsPerMultiProcessor;
+    size_t sharedMemPerMultiprocessor ;
+    int    regsPerMultiprocessor      ;
+    int    managedMemory              ;
+    int    isMultiGpuBoard            ;
+    int    multiGpuBoardGroupID       ;
+    int    concurrentManagedAccess    ;
+};
+
+struct HostRuntimeDevice
+{
+    cudaDeviceProp       properties;
+    /* cudaDeviceAttr -> value for attributes not in cudaDeviceProp */
+    std::map< int, int > attributes;
+    /* time each cudaGetDeviceProperties for this device sleeps */
+    unsigned int         queryLatencyMicroseconds;
+};
+
+enum HostRuntimeMemoryKind
+{
+    HostRuntimeDeviceMemory     = 0,
+    /* cudaMallocHost, cudaHostAlloc */
+    HostRuntimePinnedMemory     = 1,
+    /* cudaHostRegister, i.e. not owned by the runtime */
+    HostRuntimeRegisteredMemory = 2,
+    /* cudaMallocManaged, not counted as used device memory, so that it
+     * can be larger than the device like on real GPUs since Pascal */
+    HostRuntimeManagedMemory    = 3
+};
+
+struct HostRuntimeAllocation
+{
+    size_t                nBytes ;
+    HostRuntimeMemoryKind kind   ;
+    unsigned int          flags  ;
+    /* current device when allocated, for cudaMemGetInfo */
+    int                   iDevice;
+};
+
+struct HostRuntimeStream;
+
+struct HostRuntime
+{
+    std::vector< HostRuntimeDevice > devices       ;
+    int                              driverVersion ;
+    int                              runtimeVersion;
+    /* number of calls to cudaGetDeviceProperties and cudaDeviceGetAttribute */
+    std::atomic< unsigned int >      nPropertyQueries ;
+    std::atomic< unsigned int >      nAttributeQueries;
+    /* property queries running right now and the maximum of that */
+    std::atomic< unsigned int >      nRunningPropertyQueries   ;
+    std::atomic< unsigned int >      nMaxRunningPropertyQueries;
+
+    /* all device, pinned and registered ranges by start address */
+    std::mutex                                    allocationsMutex;
+    std::map< char const *, HostRuntimeAllocation > allocations   ;
+    std::atomic< unsigned int >      nDeviceAllocations;
+    std::atomic< unsigned int >      nDeviceFrees      ;
+    std::atomic< unsigned int >      nManagedAllocations;
+    /* calls to cudaMemPrefetchAsync and cudaMemAdvise */
+    std::atomic< unsigned int >      nManagedPrefetches ;
+    std::atomic< unsigned int >      nManagedAdvices    ;
+    /* copies between device and page-locked host memory, which can be
+     * asynchronous, and copies from or to pageable memory, which the real
+     * driver stages through a pinned bounce buffer synchronously */
+    std::atomic< unsigned int >      nPinnedCopies     ;
+    std::atomic< unsigned int >      nPageableCopies   ;
+    /* copies between allocations of two different devices and those of
+     * them without peer access enabled, which the driver stages through
+     * host memory */
+    std::atomic< unsigned int >      nPeerCopies          ;
+    std::atomic< unsigned int >      nHostStagedPeerCopies;
+
+    /* ( device, peer ) -> performance rank for all pairs with peer access,
+     * lower ranks being faster links. Empty means no peer access at all. */
+    std::map< std::pair< int, int >, int > peerPerformanceRanks;
+    /* ( current device, peer ) for which cudaDeviceEnablePeerAccess was called */
+    std::mutex                             peerAccessMutex     ;
+    std::set< std::pair< int, int > >      enabledPeerAccesses ;
+
+    /* all streams created and not yet destroyed, for cudaDeviceSynchronize */
+    std::mutex                        streamsMutex;
+    std::set< HostRuntimeStream * >   streams     ;
+    /* stream operations executing right now and the maximum of that, i.e.
+     * how much copies and kernels in different streams overlapped */
+    std::atomic< unsigned int >      nRunningStreamTasks   ;
+    std::atomic< unsigned int >      nMaxRunningStreamTasks;
+
+    inline HostRuntime()
+     : driverVersion( 0 ), runtimeVersion( 0 ),
+       nPropertyQueries( 0 ), nAttributeQueries( 0 ),
+       nRunningPropertyQueries( 0 ), nMaxRunningPropertyQueries( 0 ),
+       nDeviceAllocations( 0 ), nDeviceFrees( 0 ),
+       nManagedAllocations( 0 ), nManagedPrefetches( 0 ), nManagedAdvices( 0 ),
+       nPinnedCopies( 0 ), nPageableCopies( 0 ), nPeerCopies( 0 ), nHostStagedPeerCopies( 0 ),
+       nRunningStreamTasks( 0 ), nMaxRunningStreamTasks( 0 )
+    {}
+};
+
+inline HostRuntime & getHostRuntime( void )
+{
+    static HostRuntime runtime;
+    return runtime;
+}
+
+inline int & getHostRuntimeCurrentDevice( void )
+{
+    static thread_local int iDevice = 0;
+    return iDevice;
+}
+
+/**
+ * Returns a device with plausible values for a desktop GPU of the given
+ * compute capability, which can then be adjusted as needed.
+ */
+inline HostRuntimeDevice makeHostRuntimeDevice
+(
+    char const * const rName,
+    int          const rMajor,
+    int          const rMinor,
+    int          const rnMultiprocessors
+)
+{
+    HostRuntimeDevice device;
+    cudaDeviceProp & prop = device.properties;
+    memset( &prop, 0, sizeof( prop ) );
+    strncpy( prop.name, rName, sizeof( prop.name ) - 1 );
+    prop.major                       = rMajor;
+    prop.minor                       = rMinor;
+    prop.multiProcessorCount         = rnMultiprocessors;
+    prop.totalGlobalMem              = size_t( 8 ) << 30;
+    prop.sharedMemPerBlock           = 48 * 1024;
+    prop.sharedMemPerMultiprocessor  = 96 * 1024;
+    prop.regsPerBlock                = 64 * 1024;
+    prop.regsPerMultiprocessor       = 64 * 1024;
+    prop.warpSize                    = 32;
+    prop.maxThreadsPerBlock          = 1024;
+    prop.maxThreadsDim[0]            = 1024;
+    prop.maxThreadsDim[1]            = 1024;
+    prop.maxThreadsDim[2]            = 64;
+    prop.maxGridSize[0]              = 2147483647;
+    prop.maxGridSize[1]              = 65535;
+    prop.maxGridSize[2]              = 65535;
+    prop.maxThreadsPerMultiProcessor = 2048;
+    prop.clockRate                   = 1500000; /* kHz */
+    prop.memoryClockRate             = 4000000; /* kHz */
+    prop.memoryBusWidth              = 256;
+    prop.l2CacheSize                 = 2 * 1024 * 1024;
+    prop.totalConstMem               = 64 * 1024;
+    prop.asyncEngineCount            = 2;
+    prop.deviceOverlap               = 1;
+    prop.concurrentKernels           = 1;
+    prop.canMapHostMemory            = 1;
+    prop.unifiedAddressing           = 1;
+    prop.managedMemory               = 1;
+    /* prefetching and advices need the page faulting engine since Pascal */
+    prop.concurrentManagedAccess     = rMajor >= 6;
+    device.attributes[ cudaDevAttrSingleToDoublePrecisionPerfRatio ] = 32;
+    device.queryLatencyMicroseconds  = 0;
+    return device;
+}
+
+inline char const * cudaGetErrorString( cudaError_t const error )
+{
+    switch ( error )
+    {
+        case cudaSuccess                         : return "no error";
+        case cudaErrorInvalidValue               : return "invalid argument";
+        case cudaErrorMemoryAllocation           : return "out of memory";
+        case cudaErrorInitializationError        : return "initialization error";
+        case cudaErrorInvalidHostPointer         : return "invalid host pointer";
+        case cudaErrorInvalidDevicePointer       : return "invalid device pointer";
+        case cudaErrorNoDevice                   : return "no CUDA-capable device is detected";
+        case cudaErrorInvalidDevice              : return "invalid device ordinal";
+        case cudaErrorHostMemoryAlreadyRegistered: return "part or all of the requested memory range is already mapped";
+        case cudaErrorHostMemoryNotRegistered    : return "pointer does not correspond to a registered memory region";
+        case cudaErrorPeerAccessUnsupported      : return "peer access is not supported between these two devices";
+        case cudaErrorPeerAccessAlreadyEnabled   : return "peer access is already enabled";
+        case cudaErrorPeerAccessNotEnabled       : return "peer access has not been enabled";
+        case cudaErrorNotSupported               : return "operation not supported";
+    }
+    return "unrecognized error code";
+}
+
+inline cudaError_t cudaGetLastError  ( void ) { return cudaSuccess; }
+inline cudaError_t cudaPeekAtLastError( void ) { return cudaSuccess; }
+
+inline cudaError_t cudaDriverGetVersion( int * const rVersion )
+{
+    if ( rVersion == NULL )
+        return cudaErrorInvalidValue;
+    *rVersion = getHostRuntime().driverVersion;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaRuntimeGetVersion( int * const rVersion )
+{
+    if ( rVersion == NULL )
+        return cudaErrorInvalidValue;
+    *rVersion = getHostRuntime().runtimeVersion;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaGetDeviceCount( int * const rnDevices )
+{
+    if ( rnDevices == NULL )
+        return cudaErrorInvalidValue;
+    *rnDevices = (int) getHostRuntime().devices.size();
+    return *rnDevices > 0 ? cudaSuccess : cudaErrorNoDevice;
+}
+
+inline bool isValidHostRuntimeDevice( int const iDevice )
+{
+    return iDevice >= 0 && iDevice < (int) getHostRuntime().devices.size();
+}
+
+inline cudaError_t cudaSetDevice( int const iDevice )
+{
+    if ( ! isValidHostRuntimeDevice( iDevice ) )
+        return cudaErrorInvalidDevice;
+    getHostRuntimeCurrentDevice() = iDevice;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaGetDevice( int * const riDevice )
+{
+    if ( riDevice == NULL )
+        return cudaErrorInvalidValue;
+    *riDevice = getHostRuntimeCurrentDevice();
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaGetDeviceProperties
+(
+    cudaDeviceProp * const rProp,
+    int              const iDevice
+)
+{
+    if ( rProp == NULL )
+        return cudaErrorInvalidValue;
+    if ( ! isValidHostRuntimeDevice( iDevice ) )
+        return cudaErrorInvalidDevice;
+    HostRuntime & runtime = getHostRuntime();
+    ++runtime.nPropertyQueries;
+    HostRuntimeDevice const & device = runtime.devices[ iDevice ];
+    unsigned int const nRunning = ++runtime.nRunningPropertyQueries;
+    unsigned int nMax = runtime.nMaxRunningPropertyQueries;
+    while ( nRunning > nMax && ! runtime.nMaxRunningPropertyQueries.compare_exchange_weak( nMax, nRunning ) ) {}
+    if ( device.queryLatencyMicroseconds > 0 )
+        std::this_thread::sleep_for( std::chrono::microseconds( device.queryLatencyMicroseconds ) );
+    *rProp = device.properties;
+    --runtime.nRunningPropertyQueries;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaDeviceGetAttribute
+(
+    int            * const rValue    ,
+    cudaDeviceAttr   const rAttribute,
+    int              const iDevice
+)
+{
+    if ( rValue == NULL )
+        return cudaErrorInvalidValue;
+    if ( ! isValidHostRuntimeDevice( iDevice ) )
+        return cudaErrorInvalidDevice;
+    ++getHostRuntime().nAttributeQueries;
+
+    HostRuntimeDevice const & device = getHostRuntime().devices[ iDevice ];
+    std::map< int, int >::const_iterator const it = device.attributes.find( rAttribute );
+    if ( it != device.attributes.end() )
+    {
+        *rValue = it->second;
+        return cudaSuccess;
+    }
+
+    cudaDeviceProp const & prop = device.properties;
+    switch ( rAttribute )
+    {
+        case cudaDevAttrMaxThreadsPerBlock              : *rValue = prop.maxThreadsPerBlock        ; break;
+        case cudaDevAttrClockRate                       : *rValue = prop.clockRate                 ; break;
+        case cudaDevAttrMultiProcessorCount             : *rValue = prop.multiProcessorCount       ; break;
+        case cudaDevAttrCanMapHostMemory                : *rValue = prop.canMapHostMemory          ; break;
+        case cudaDevAttrComputeMode                     : *rValue = prop.computeMode               ; break;
+        case cudaDevAttrPciBusId                        : *rValue = prop.pciBusID                  ; break;
+        case cudaDevAttrPciDeviceId                     : *rValue = prop.pciDeviceID               ; break;
+        case cudaDevAttrMemoryClockRate                 : *rValue = prop.memoryClockRate           ; break;
+        case cudaDevAttrGlobalMemoryBusWidth            : *rValue = prop.memoryBusWidth            ; break;
+        case cudaDevAttrPciDomainId                     : *rValue = prop.pciDomainID               ; break;
+        case cudaDevAttrComputeCapabilityMajor          : *rValue = prop.major                     ; break;
+        case cudaDevAttrComputeCapabilityMinor          : *rValue = prop.minor                     ; break;
+        case cudaDevAttrMaxSharedMemoryPerMultiprocessor: *rValue = prop.sharedMemPerMultiprocessor; break;
+        case cudaDevAttrMaxRegistersPerMultiprocessor   : *rValue = prop.regsPerMultiprocessor     ; break;
+        case cudaDevAttrManagedMemory                   : *rValue = prop.managedMemory             ; break;
+        case cudaDevAttrIsMultiGpuBoard                 : *rValue = prop.isMultiGpuBoard           ; break;
+        case cudaDevAttrMultiGpuBoardGroupID            : *rValue = prop.multiGpuBoardGroupID      ; break;
+        case cudaDevAttrConcurrentManagedAccess         : *rValue = prop.concurrentManagedAccess   ; break;
+        default: *rValue = 0;
+    }
+    return cudaSuccess;
+}
+
+/************************** Peer access **************************/
+
+enum cudaDeviceP2PAttr
+{
+    cudaDevP2PAttrPerformanceRank          = 1,
+    cudaDevP2PAttrAccessSupported          = 2,
+    cudaDevP2PAttrNativeAtomicSupported    = 3,
+    cudaDevP2PAttrCudaArrayAccessSupported = 4
+};
+
+inline cudaError_t cudaDeviceCanAccessPeer
+(
+    int * const rbCanAccess,
+    int   const riDevice   ,
+    int   const riPeer
+)
+{
+    if ( rbCanAccess == NULL )
+        return cudaErrorInvalidValue;
+    if ( ! isValidHostRuntimeDevice( riDevice ) || ! isValidHostRuntimeDevice( riPeer ) )
+        return cudaErrorInvalidDevice;
+    *rbCanAccess = riDevice != riPeer &&
+                   getHostRuntime().peerPerformanceRanks.count( std::make_pair( riDevice, riPeer ) ) > 0;
+    return cudaSuccess;
+}
+
+/* atomics and arrays are reported like access, i.e. like NVLink */
+inline cudaError_t cudaDeviceGetP2PAttribute
+(
+    int               * const rValue    ,
+    cudaDeviceP2PAttr   const rAttribute,
+    int                 const riSource  ,
+    int                 const riTarget
+)
+{
+    if ( rValue == NULL || riSource == riTarget )
+        return cudaErrorInvalidValue;
+    if ( ! isValidHostRuntimeDevice( riSource ) || ! isValidHostRuntimeDevice( riTarget ) )
+        return cudaErrorInvalidDevice;
+    auto const & ranks = getHostRuntime().peerPerformanceRanks;
+    auto const it = ranks.find( std::make_pair( riSource, riTarget ) );
+    *rValue = rAttribute == cudaDevP2PAttrPerformanceRank ? ( it == ranks.end() ? 0 : it->second )
+                                                          : ( it == ranks.end() ? 0 : 1 );
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaDeviceEnablePeerAccess( int const riPeer, unsigned int const rFlags )
+{
+    int const iDevice = getHostRuntimeCurrentDevice();
+    if ( rFlags != 0 )
+        return cudaErrorInvalidValue;
+    int bCanAccess = 0;
+    cudaError_t const error = cudaDeviceCanAccessPeer( &bCanAccess, iDevice, riPeer );
+    if ( error != cudaSuccess )
+        return error;
+    if ( ! bCanAccess )
+        return cudaErrorPeerAccessUnsupported;
+    HostRuntime & runtime = getHostRuntime();
+    std::lock_guard< std::mutex > lock( runtime.peerAccessMutex );
+    return runtime.enabledPeerAccesses.insert( std::make_pair( iDevice, riPeer ) ).second ?
+           cudaSuccess : cudaErrorPeerAccessAlreadyEnabled;
+}
+
+inline cudaError_t cudaDeviceDisablePeerAccess( int const riPeer )
+{
+    HostRuntime & runtime = getHostRuntime();
+    std::lock_guard< std::mutex > lock( runtime.peerAccessMutex );
+    return runtime.enabledPeerAccesses.erase( std::make_pair( getHostRuntimeCurrentDevice(), riPeer ) ) > 0 ?
+           cudaSuccess : cudaErrorPeerAccessNotEnabled;
+}
+
+inline bool isHostRuntimePeerAccessEnabled( int const riDevice, int const riPeer )
+{
+    HostRuntime & runtime = getHostRuntime();
+    std::lock_guard< std::mutex > lock( runtime.peerAccessMutex );
+    return runtime.enabledPeerAccesses.count( std::make_pair( riDevice, riPeer ) ) > 0;
+}
+
+/************************** Memory management **************************/
+
+enum cudaMemcpyKind
+{
+    cudaMemcpyHostToHost     = 0,
+    cudaMemcpyHostToDevice   = 1,
+    cudaMemcpyDeviceToHost   = 2,
+    cudaMemcpyDeviceToDevice = 3,
+    cudaMemcpyDefault        = 4
+};
+
+#define cudaHostAllocDefault       0x00
+#define cudaHostAllocPortable      0x01
+#define cudaHostAllocMapped        0x02
+#define cudaHostAllocWriteCombined 0x04
+#define cudaHostRegisterDefault    0x00
+#define cudaHostRegisterPortable   0x01
+#define cudaHostRegisterMapped     0x02
+#define cudaMemAttachGlobal        0x01
+#define cudaMemAttachHost          0x02
+#define cudaCpuDeviceId            ( -1 )
+
+enum cudaMemoryAdvise
+{
+    cudaMemAdviseSetReadMostly          = 1,
+    cudaMemAdviseUnsetReadMostly        = 2,
+    cudaMemAdviseSetPreferredLocation   = 3,
+    cudaMemAdviseUnsetPreferredLocation = 4,
+    cudaMemAdviseSetAccessedBy          = 5,
+    cudaMemAdviseUnsetAccessedBy        = 6
+};
+
+/************************** Streams **************************/
+
+/**
+ * Executes its queue in order in an own thread. Operations in the null
+ * stream behave like in the legacy default stream, i.e. they wait for all
+ * other streams and are finished on return.
+ */
+struct HostRuntimeStream
+{
+    std::mutex                            mutex   ;
+    std::condition_variable               changed ;
+    std::deque< std::function< void() > > queue   ;
+    /* a task was taken from the queue, but hasn't finished yet */
+    bool                                  bBusy   ;
+    bool                                  bStop   ;
+    std::thread                           worker  ;
+
+    inline HostRuntimeStream() : bBusy( false ), bStop( false )
+    {
+        worker = std::thread( &HostRuntimeStream::workerMain, this );
+    }
+
+    inline ~HostRuntimeStream()
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            bStop = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+
+    inline void push( std::function< void() > const & rTask )
+    {
+        {
+            std::lock_guard< std::mutex > lock( mutex );
+            queue.push_back( rTask );
+        }
+        changed.notify_all();
+    }
+
+    inline void synchronize( void )
+    {
+        std::unique_lock< std::mutex > lock( mutex );
+        changed.wait( lock, [this](){ return queue.empty() && ! bBusy; } );
+    }
+
+private:
+    inline void workerMain( void )
+    {
+        HostRuntime & runtime = getHostRuntime();
+        std::unique_lock< std::mutex > lock( mutex );
+        while ( true )
+        {
+            changed.wait( lock, [this](){ return bStop || ! queue.empty(); } );
+            if ( queue.empty() )
+                return;
+            std::function< void() > const task = queue.front();
+            queue.pop_front();
+            bBusy = true;
+            lock.unlock();
+
+            unsigned int const nRunning = ++runtime.nRunningStreamTasks;
+            unsigned int nMax = runtime.nMaxRunningStreamTasks;
+            while ( nRunning > nMax && ! runtime.nMaxRunningStreamTasks.compare_exchange_weak( nMax, nRunning ) ) {}
+            task();
+            --runtime.nRunningStreamTasks;
+
+            lock.lock();
+            bBusy = false;
+            changed.notify_all();
+        }
+    }
+};
+
+typedef HostRuntimeStream * cudaStream_t;
+
+inline cudaError_t cudaDeviceSynchronize( void )
+{
+    HostRuntime & runtime = getHostRuntime();
+    std::vector< HostRuntimeStream * > streams;
+    {
+        std::lock_guard< std::mutex > lock( runtime.streamsMutex );
+        streams.assign( runtime.streams.begin(), runtime.streams.end() );
+    }
+    for ( auto const stream : streams )
+        stream->synchronize();
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaStreamCreate( cudaStream_t * const rpStream )
+{
+    if ( rpStream == NULL )
+        return cudaErrorInvalidValue;
+    *rpStream = new HostRuntimeStream();
+    HostRuntime & runtime = getHostRuntime();
+    std::lock_guard< std::mutex > lock( runtime.streamsMutex );
+    runtime.streams.insert( *rpStream );
+    return cudaSuccess;
+}
+
+/* unlike the real runtime, waits for the queued work before returning */
+inline cudaError_t cudaStreamDestroy( cudaStream_t const rStream )
+{
+    if ( rStream == NULL )
+        return cudaErrorInvalidValue;
+    {
+        HostRuntime & runtime = getHostRuntime();
+        std::lock_guard< std::mutex > lock( runtime.streamsMutex );
+        if ( runtime.streams.erase( rStream ) == 0 )
+            return cudaErrorInvalidValue;
+    }
+    delete rStream;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaStreamSynchronize( cudaStream_t const rStream )
+{
+    if ( rStream == NULL )
+        return cudaDeviceSynchronize();
+    rStream->synchronize();
+    return cudaSuccess;
+}
+
+/**
+ * Queues rTask into rStream. This is also how emulated kernels get into
+ * a stream, @see cudaLaunchHostFunc
+ */
+inline void enqueueHostRuntimeStream
+(
+    cudaStream_t                    const   rStream,
+    std::function< void() >         const & rTask
+)
+{
+    if ( rStream == NULL )
+    {
+        cudaDeviceSynchronize();
+        rTask();
+    }
+    else
+        rStream->push( rTask );
+}
+
+typedef void (*cudaHostFn_t)( void * );
+
+inline cudaError_t cudaLaunchHostFunc
+(
+    cudaStream_t   const rStream  ,
+    cudaHostFn_t   const rFunction,
+    void         * const rUserData
+)
+{
+    if ( rFunction == NULL )
+        return cudaErrorInvalidValue;
+    enqueueHostRuntimeStream( rStream, [=](){ rFunction( rUserData ); } );
+    return cudaSuccess;
+}
+
+/**
+ * @return the allocation containing rPointer and its start address or
+ *         NULL if it isn't inside any device, pinned or registered range
+ */
+inline HostRuntimeAllocation const * findHostRuntimeAllocation
+(
+    void const   * const rPointer,
+    char const * *       rpStart = NULL
+)
+{
+    HostRuntime & runtime = getHostRuntime();
+    char const * const p = (char const *) rPointer;
+    std::lock_guard< std::mutex > lock( runtime.allocationsMutex );
+    auto it = runtime.allocations.upper_bound( p );
+    if ( it == runtime.allocations.begin() )
+        return NULL;
+    --it;
+    if ( p >= it->first + std::max( it->second.nBytes, (size_t) 1 ) )
+        return NULL;
+    if ( rpStart != NULL )
+        *rpStart = it->first;
+    return &it->second;
+}
+
+/* @return whether any tracked allocation overlaps [rpBegin, rpBegin + rnBytes) */
+inline bool overlapsHostRuntimeAllocation
+(
+    void const * const rpBegin,
+    size_t       const rnBytes
+)
+{
+    HostRuntime & runtime = getHostRuntime();
+    char const * const begin = (char const *) rpBegin;
+    std::lock_guard< std::mutex > lock( runtime.allocationsMutex );
+    /* the last allocation starting before the end of the range */
+    auto it = runtime.allocations.lower_bound( begin + rnBytes );
+    if ( it == runtime.allocations.begin() )
+        return false;
+    --it;
+    return it->first + std::max( it->second.nBytes, (size_t) 1 ) > begin;
+}
+
+inline void addHostRuntimeAllocation
+(
+    void                  * const rPointer,
+    size_t                  const rnBytes ,
+    HostRuntimeMemoryKind   const rKind   ,
+    unsigned int            const rFlags  = 0
+)
+{
+    HostRuntime & runtime = getHostRuntime();
+    HostRuntimeAllocation const allocation = { rnBytes, rKind, rFlags, getHostRuntimeCurrentDevice() };
+    std::lock_guard< std::mutex > lock( runtime.allocationsMutex );
+    runtime.allocations[ (char const *) rPointer ] = allocation;
+}
+
+/**
+ * @return false if rPointer isn't the start of an allocation of this kind
+ */
+inline bool removeHostRuntimeAllocation
+(
+    void                  * const rPointer,
+    HostRuntimeMemoryKind   const rKind
+)
+{
+    HostRuntime & runtime = getHostRuntime();
+    std::lock_guard< std::mutex > lock( runtime.allocationsMutex );
+    auto const it = runtime.allocations.find( (char const *) rPointer );
+    if ( it == runtime.allocations.end() || it->second.kind != rKind )
+        return false;
+    runtime.allocations.erase( it );
+    return true;
+}
+
+inline cudaError_t cudaMalloc( void ** const rpDevice, size_t const rnBytes )
+{
+    if ( rpDevice == NULL )
+        return cudaErrorInvalidValue;
+    /* like the real runtime, 0 bytes still give a unique pointer */
+    *rpDevice = malloc( std::max( rnBytes, (size_t) 1 ) );
+    if ( *rpDevice == NULL )
+        return cudaErrorMemoryAllocation;
+    addHostRuntimeAllocation( *rpDevice, rnBytes, HostRuntimeDeviceMemory );
+    ++getHostRuntime().nDeviceAllocations;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaFree( void * const rpDevice )
+{
+    if ( rpDevice == NULL )
+        return cudaSuccess;
+    /* like the real one, which is why caching allocators exist */
+    cudaDeviceSynchronize();
+    if ( removeHostRuntimeAllocation( rpDevice, HostRuntimeManagedMemory ) )
+    {
+        free( rpDevice );
+        return cudaSuccess;
+    }
+    if ( ! removeHostRuntimeAllocation( rpDevice, HostRuntimeDeviceMemory ) )
+        return cudaErrorInvalidDevicePointer;
+    ++getHostRuntime().nDeviceFrees;
+    free( rpDevice );
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaMallocManaged
+(
+    void         ** const rpManaged,
+    size_t          const rnBytes  ,
+    unsigned int    const rFlags   = cudaMemAttachGlobal
+)
+{
+    if ( rpManaged == NULL || rnBytes == 0 ||
+         ( rFlags != cudaMemAttachGlobal && rFlags != cudaMemAttachHost ) )
+        return cudaErrorInvalidValue;
+    int const iDevice = getHostRuntimeCurrentDevice();
+    if ( ! isValidHostRuntimeDevice( iDevice ) )
+        return cudaErrorInvalidDevice;
+    if ( ! getHostRuntime().devices[ iDevice ].properties.managedMemory )
+        return cudaErrorNotSupported;
+    *rpManaged = malloc( rnBytes );
+    if ( *rpManaged == NULL )
+        return cudaErrorMemoryAllocation;
+    addHostRuntimeAllocation( *rpManaged, rnBytes, HostRuntimeManagedMemory, rFlags );
+    ++getHostRuntime().nManagedAllocations;
+    return cudaSuccess;
+}
+
+/* @return whether [rpManaged, rpManaged + rnBytes) lies inside one managed allocation */
+inline bool isHostRuntimeManagedRange( void const * const rpManaged, size_t const rnBytes )
+{
+    char const * start = NULL;
+    HostRuntimeAllocation const * const allocation = findHostRuntimeAllocation( rpManaged, &start );
+    return allocation != NULL && allocation->kind == HostRuntimeManagedMemory &&
+           (char const *) rpManaged + rnBytes <= start + allocation->nBytes;
+}
+
+/**
+ * Validates like the real one, which needs concurrent managed access on
+ * the target device, but there is nothing to migrate.
+ */
+inline cudaError_t cudaMemPrefetchAsync
+(
+    void const   * const rpManaged,
+    size_t         const rnBytes  ,
+    int            const riDevice ,
+    cudaStream_t   const rStream  = 0
+)
+{
+    (void) rStream;
+    if ( ! isHostRuntimeManagedRange( rpManaged, rnBytes ) )
+        return cudaErrorInvalidValue;
+    if ( riDevice != cudaCpuDeviceId && ( ! isValidHostRuntimeDevice( riDevice ) ||
+         ! getHostRuntime().devices[ riDevice ].properties.concurrentManagedAccess ) )
+        return cudaErrorInvalidDevice;
+    ++getHostRuntime().nManagedPrefetches;
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaMemAdvise
+(
+    void const       * const rpManaged,
+    size_t             const rnBytes  ,
+    cudaMemoryAdvise   const rAdvice  ,
+    int                const riDevice
+)
+{
+    if ( ! isHostRuntimeManagedRange( rpManaged, rnBytes ) ||
+         rAdvice < cudaMemAdviseSetReadMostly || rAdvice > cudaMemAdviseUnsetAccessedBy )
+        return cudaErrorInvalidValue;
+    /* the read-mostly advices ignore the device */
+    if ( rAdvice != cudaMemAdviseSetReadMostly && rAdvice != cudaMemAdviseUnsetReadMostly &&
+         riDevice != cudaCpuDeviceId && ! isValidHostRuntimeDevice( riDevice ) )
+        return cudaErrorInvalidDevice;
+    ++getHostRuntime().nManagedAdvices;
+    return cudaSuccess;
+}
+
+/**
+ * Free memory is the total memory of the current device minus what was
+ * allocated with cudaMalloc while it was current.
+ */
+inline cudaError_t cudaMemGetInfo( size_t * const rnBytesFree, size_t * const rnBytesTotal )
+{
+    if ( rnBytesFree == NULL || rnBytesTotal == NULL )
+        return cudaErrorInvalidValue;
+    HostRuntime & runtime = getHostRuntime();
+    int const iDevice = getHostRuntimeCurrentDevice();
+    if ( ! isValidHostRuntimeDevice( iDevice ) )
+        return cudaErrorInvalidDevice;
+
+    size_t nBytesUsed = 0;
+    {
+        std::lock_guard< std::mutex > lock( runtime.allocationsMutex );
+        for ( auto const & allocation : runtime.allocations )
+            if ( allocation.second.kind == HostRuntimeDeviceMemory && allocation.second.iDevice == iDevice )
+                nBytesUsed += allocation.second.nBytes;
+    }
+    *rnBytesTotal = runtime.devices[ iDevice ].properties.totalGlobalMem;
+    *rnBytesFree  = *rnBytesTotal - std::min( nBytesUsed, *rnBytesTotal );
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaHostAlloc
+(
+    void         ** const rpHost ,
+    size_t          const rnBytes,
+    unsigned int    const rFlags
+)
+{
+    if ( rpHost == NULL )
+        return cudaErrorInvalidValue;
+    *rpHost = malloc( std::max( rnBytes, (size_t) 1 ) );
+    if ( *rpHost == NULL )
+        return cudaErrorMemoryAllocation;
+    addHostRuntimeAllocation( *rpHost, rnBytes, HostRuntimePinnedMemory, rFlags );
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaMallocHost( void ** const rpHost, size_t const rnBytes )
+{
+    return cudaHostAlloc( rpHost, rnBytes, cudaHostAllocDefault );
+}
+
+inline cudaError_t cudaFreeHost( void * const rpHost )
+{
+    if ( rpHost == NULL )
+        return cudaSuccess;
+    cudaDeviceSynchronize();
+    if ( ! removeHostRuntimeAllocation( rpHost, HostRuntimePinnedMemory ) )
+        return cudaErrorInvalidValue;
+    free( rpHost );
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaHostRegister
+(
+    void         * const rpHost ,
+    size_t         const rnBytes,
+    unsigned int   const rFlags
+)
+{
+    if ( rpHost == NULL || rnBytes == 0 )
+        return cudaErrorInvalidValue;
+    if ( overlapsHostRuntimeAllocation( rpHost, rnBytes ) )
+        return cudaErrorHostMemoryAlreadyRegistered;
+    addHostRuntimeAllocation( rpHost, rnBytes, HostRuntimeRegisteredMemory, rFlags );
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaHostUnregister( void * const rpHost )
+{
+    return removeHostRuntimeAllocation( rpHost, HostRuntimeRegisteredMemory ) ?
+           cudaSuccess : cudaErrorHostMemoryNotRegistered;
+}
+
+/**
+ * With unified addressing the device pointer of mapped memory is the
+ * host pointer, which is what all synthetic devices have.
+ */
+inline cudaError_t cudaHostGetDevicePointer
+(
+    void         ** const rpDevice,
+    void          * const rpHost  ,
+    unsigned int    const rFlags
+)
+{
+    if ( rpDevice == NULL || rFlags != 0 )
+        return cudaErrorInvalidValue;
+    char const * start = NULL;
+    HostRuntimeAllocation const * const allocation = findHostRuntimeAllocation( rpHost, &start );
+    if ( allocation == NULL || allocation->kind == HostRuntimeDeviceMemory ||
+         allocation->kind == HostRuntimeManagedMemory || ! ( allocation->flags & cudaHostAllocMapped ) )
+        return cudaErrorInvalidValue;
+    *rpDevice = rpHost;
+    return cudaSuccess;
+}
+
+inline bool isHostRuntimePageLocked( void const * const rpHost )
+{
+    HostRuntimeAllocation const * const allocation = findHostRuntimeAllocation( rpHost );
+    return allocation != NULL && allocation->kind != HostRuntimeDeviceMemory;
+}
+
+/**
+ * Copies pageable memory in chunks through a pinned bounce buffer like the
+ * real driver, so that the emulation shows a cost for pageable transfers.
+ */
+inline void copyHostRuntimeStaged
+(
+    void       * const rpTarget,
+    void const * const rpSource,
+    size_t       const rnBytes
+)
+{
+    size_t const nChunkBytes = 2 * 1024 * 1024;
+    static thread_local std::vector< char > bounceBuffer( nChunkBytes );
+    for ( size_t i = 0; i < rnBytes; i += nChunkBytes )
+    {
+        size_t const n = std::min( nChunkBytes, rnBytes - i );
+        memcpy( bounceBuffer.data(), (char const *) rpSource + i, n );
+        memcpy( (char *) rpTarget + i, bounceBuffer.data(), n );
+    }
+}
+
+inline cudaError_t cudaMemcpyAsync
+(
+    void           * const rpTarget,
+    void     const * const rpSource,
+    size_t           const rnBytes ,
+    cudaMemcpyKind   const rKind   ,
+    cudaStream_t     const rStream = 0
+)
+{
+    if ( rnBytes == 0 )
+        return cudaSuccess;
+    if ( rpTarget == NULL || rpSource == NULL )
+        return cudaErrorInvalidValue;
+
+    /* device pointers must lie inside a device allocation (or mapped
+     * memory) with enough space left, host pointers can be anything */
+    bool const bDeviceTarget = rKind == cudaMemcpyHostToDevice || rKind == cudaMemcpyDeviceToDevice;
+    bool const bDeviceSource = rKind == cudaMemcpyDeviceToHost || rKind == cudaMemcpyDeviceToDevice;
+    void const * const devicePointers[2] = { bDeviceTarget ? rpTarget : NULL,
+                                             bDeviceSource ? rpSource : NULL };
+    for ( auto const pointer : devicePointers )
+    {
+        if ( pointer == NULL )
+            continue;
+        char const * start = NULL;
+        HostRuntimeAllocation const * const allocation = findHostRuntimeAllocation( pointer, &start );
+        if ( allocation == NULL || ( allocation->kind != HostRuntimeDeviceMemory &&
+             allocation->kind != HostRuntimeManagedMemory &&
+             ! ( allocation->flags & cudaHostAllocMapped ) ) )
+            return cudaErrorInvalidDevicePointer;
+        if ( (char const *) pointer + rnBytes > start + allocation->nBytes )
+            return cudaErrorInvalidValue;
+    }
+
+    void const * const hostPointer = rKind == cudaMemcpyHostToDevice ? rpSource :
+                                     rKind == cudaMemcpyDeviceToHost ? rpTarget : NULL;
+    /* pageable transfers are synchronous even in other streams */
+    if ( hostPointer != NULL && ! isHostRuntimePageLocked( hostPointer ) )
+    {
+        ++getHostRuntime().nPageableCopies;
+        enqueueHostRuntimeStream( rStream, [=](){ copyHostRuntimeStaged( rpTarget, rpSource, rnBytes ); } );
+        return cudaStreamSynchronize( rStream );
+    }
+    if ( hostPointer != NULL )
+        ++getHostRuntime().nPinnedCopies;
+    enqueueHostRuntimeStream( rStream, [=](){ memcpy( rpTarget, rpSource, rnBytes ); } );
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaMemcpy
+(
+    void           * const rpTarget,
+    void     const * const rpSource,
+    size_t           const rnBytes ,
+    cudaMemcpyKind   const rKind
+)
+{
+    return cudaMemcpyAsync( rpTarget, rpSource, rnBytes, rKind, 0 );
+}
+
+/**
+ * Both pointers must lie inside device allocations made while the given
+ * devices were current, else cudaErrorInvalidDevicePointer is returned.
+ * Copies without peer access enabled are counted as staged through host
+ * memory, like the real driver does them.
+ */
+inline cudaError_t cudaMemcpyPeerAsync
+(
+    void           * const rpTarget      ,
+    int              const riTargetDevice,
+    void     const * const rpSource      ,
+    int              const riSourceDevice,
+    size_t           const rnBytes       ,
+    cudaStream_t     const rStream = 0
+)
+{
+    if ( rnBytes == 0 )
+        return cudaSuccess;
+    if ( ! isValidHostRuntimeDevice( riTargetDevice ) || ! isValidHostRuntimeDevice( riSourceDevice ) )
+        return cudaErrorInvalidDevice;
+    void const * const pointers[2] = { rpTarget, rpSource };
+    int const devices[2] = { riTargetDevice, riSourceDevice };
+    for ( int i = 0; i < 2; ++i )
+    {
+        char const * start = NULL;
+        HostRuntimeAllocation const * const allocation = findHostRuntimeAllocation( pointers[i], &start );
+        if ( allocation == NULL || allocation->kind != HostRuntimeDeviceMemory || allocation->iDevice != devices[i] )
+            return cudaErrorInvalidDevicePointer;
+        if ( (char const *) pointers[i] + rnBytes > start + allocation->nBytes )
+            return cudaErrorInvalidValue;
+    }
+    if ( riTargetDevice != riSourceDevice )
+    {
+        ++getHostRuntime().nPeerCopies;
+        /* the driver copies directly if either device has access to the other */
+        if ( ! isHostRuntimePeerAccessEnabled( riTargetDevice, riSourceDevice ) &&
+             ! isHostRuntimePeerAccessEnabled( riSourceDevice, riTargetDevice ) )
+            ++getHostRuntime().nHostStagedPeerCopies;
+    }
+    enqueueHostRuntimeStream( rStream, [=](){ memcpy( rpTarget, rpSource, rnBytes ); } );
+    return cudaSuccess;
+}
+
+inline cudaError_t cudaMemcpyPeer
+(
+    void           * const rpTarget      ,
+    int              const riTargetDevice,
+    void     const * const rpSource      ,
+    int              const riSourceDevice,
+    size_t           const rnBytes
+)
+{
+    return cudaMemcpyPeerAsync( rpTarget, riTargetDevice, rpSource, riSourceDevice, rnBytes, 0 );
+}
+
+inline cudaError_t cudaMemset( void * const rpDevice, int const rValue, size_t const rnBytes )
+{
+    if ( rnBytes > 0 && findHostRuntimeAllocation( rpDevice ) == NULL )
+        return cudaErrorInvalidDevicePointer;
+    enqueueHostRuntimeStream( NULL, [=](){ memset( rpDevice, rValue, rnBytes ); } );
+    return cudaSuccess;
+}
+
+#endif // ! __CUDACC__ && ! CUDART_VERSION
@@ -0,0 +1,460 @@
+/**
+ * Host versions of the warp and block reductions, scans and the compaction
+ * built on them in gpuinfo.cu, e.g. warpReduceSum, warpReduceCumSum and
+ * blockReduceCumSumPredicate.
+ *
+ * The host backend runs the threads of a block one after another, so that
+ * shuffles and ballots can't be emulated per thread. Instead these
+ * functions get all 32 lanes of a warp at once as an array, which maps onto
+ * four AVX2 or two AVX-512 registers. The shuffle sequences become in
+ * register shifts, e.g. for the cumulative sum the same log2 steps as the
+ * __shfl variant, but on 8 or 16 lanes at a time plus one carry between
+ * the registers. The instruction set is chosen at compile time, i.e. with
+ * -mavx2 or -march=native, else the generic loops are used, which also
+ * serve all types other than int32_t and float.
+ *
+ * Like on the GPU, the float results may differ in the last bits from a
+ * sequential sum, because the order of additions differs.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>                      // size_t
+#include <cstdint>                      // int32_t, uint32_t
+#include <cstring>                      // memcpy
+
+#if defined( __AVX2__ ) || defined( __AVX512F__ )
+    /* the AVX-512 intrinsics of GCC 12 initialize _mm512_undefined_* with
+     * themselves, which triggers -Wuninitialized in every user */
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wuninitialized"
+#   pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#   include <immintrin.h>
+#   pragma GCC diagnostic pop
+#endif
+
+
+static_assert( sizeof( bool ) == 1, "hostWarpBallot assumes one byte per bool" );
+
+#if defined( __AVX512F__ )
+#   define HOST_WARP_SIMD "AVX-512"
+#elif defined( __AVX2__ )
+#   define HOST_WARP_SIMD "AVX2"
+#else
+#   define HOST_WARP_SIMD "scalar"
+#endif
+
+int const hostWarpSize = 32;
+
+
+/************************** generic versions **************************/
+
+/* warpReduceSum, i.e. the sum of all lanes */
+template< typename T >
+inline T hostWarpReduceSum( T const (&x)[32] )
+{
+    T sum = x[0];
+    for ( int i = 1; i < hostWarpSize; ++i )
+        sum += x[i];
+    return sum;
+}
+
+/* warpAllReduceSum, i.e. every lane gets the sum of all lanes */
+template< typename T >
+inline void hostWarpAllReduceSum( T (&x)[32] )
+{
+    T const sum = hostWarpReduceSum( x );
+    for ( int i = 0; i < hostWarpSize; ++i )
+        x[i] = sum;
+}
+
+/**
+ * warpReduceCumSum, i.e. the inclusive prefix sum over the lanes, plus
+ * rCarry added to all of them, so that warps can be chained.
+ * @return the last lane, i.e. the carry for the next warp
+ */
+template< typename T >
+inline T hostWarpReduceCumSum
+(
+    T   (&x)[32]          ,
+    T   const rCarry = T( 0 )
+)
+{
+    x[0] += rCarry;
+    for ( int i = 1; i < hostWarpSize; ++i )
+        x[i] += x[i-1];
+    return x[ hostWarpSize - 1 ];
+}
+
+/**
+ * Writes the lanes with set ballot bits to rOut in order without branches,
+ * i.e. every lane is written, but the position only advances for kept
+ * ones. A buffer on the stack catches the writes after the last kept lane.
+ * @return number of kept lanes
+ */
+template< typename T >
+inline int hostWarpCompact
+(
+    T        const (&x)[32],
+    uint32_t const   rBallot,
+    T        * const rOut
+)
+{
+    T buffer[32];
+    int n = 0;
+    for ( int i = 0; i < hostWarpSize; ++i )
+    {
+        buffer[n] = x[i];
+        n += ( rBallot >> i ) & 1u;
+    }
+    memcpy( rOut, buffer, n * sizeof( T ) );
+    return n;
+}
+
+/* __ballot, i.e. bit i is set if x[i] is true */
+inline uint32_t hostWarpBallotScalar( bool const (&x)[32] )
+{
+    uint32_t mask = 0;
+    for ( int i = 0; i < hostWarpSize; ++i )
+        mask |= (uint32_t) x[i] << i;
+    return mask;
+}
+
+/* warpReduceSumPredicate */
+inline int hostWarpReduceSumPredicate( uint32_t const rBallot )
+{
+    return __builtin_popcount( rBallot );
+}
+
+
+/************************** SIMD versions **************************/
+
+#if defined( __AVX512F__ )
+
+/* inclusive prefix sum of the 16 lanes: shift by 1, 2, 4, 8 lanes and add */
+inline __m512i hostWarpScanRegister( __m512i x )
+{
+    __m512i const zero = _mm512_setzero_si512();
+    x = _mm512_add_epi32( x, _mm512_alignr_epi32( x, zero, 15 ) );
+    x = _mm512_add_epi32( x, _mm512_alignr_epi32( x, zero, 14 ) );
+    x = _mm512_add_epi32( x, _mm512_alignr_epi32( x, zero, 12 ) );
+    x = _mm512_add_epi32( x, _mm512_alignr_epi32( x, zero,  8 ) );
+    return x;
+}
+
+inline __m512 hostWarpScanRegister( __m512 x )
+{
+    __m512i const zero = _mm512_setzero_si512();
+    #define TMP_SHIFT_ADD( IMM ) \
+        x = _mm512_add_ps( x, _mm512_castsi512_ps( _mm512_alignr_epi32( _mm512_castps_si512( x ), zero, IMM ) ) );
+    TMP_SHIFT_ADD( 15 )
+    TMP_SHIFT_ADD( 14 )
+    TMP_SHIFT_ADD( 12 )
+    TMP_SHIFT_ADD(  8 )
+    #undef TMP_SHIFT_ADD
+    return x;
+}
+
+inline int32_t hostWarpReduceSum( int32_t const (&x)[32] )
+{
+    return _mm512_reduce_add_epi32( _mm512_add_epi32( _mm512_loadu_si512( x ), _mm512_loadu_si512( x + 16 ) ) );
+}
+
+inline float hostWarpReduceSum( float const (&x)[32] )
+{
+    return _mm512_reduce_add_ps( _mm512_add_ps( _mm512_loadu_ps( x ), _mm512_loadu_ps( x + 16 ) ) );
+}
+
+inline void hostWarpAllReduceSum( int32_t (&x)[32] )
+{
+    __m512i const sum = _mm512_set1_epi32( hostWarpReduceSum( x ) );
+    _mm512_storeu_si512( x, sum );
+    _mm512_storeu_si512( x + 16, sum );
+}
+
+inline void hostWarpAllReduceSum( float (&x)[32] )
+{
+    __m512 const sum = _mm512_set1_ps( hostWarpReduceSum( x ) );
+    _mm512_storeu_ps( x, sum );
+    _mm512_storeu_ps( x + 16, sum );
+}
+
+inline int32_t hostWarpReduceCumSum
+(
+    int32_t   (&x)[32]     ,
+    int32_t   const rCarry = 0
+)
+{
+    __m512i const low  = _mm512_add_epi32( _mm512_set1_epi32( rCarry ),
+                                           hostWarpScanRegister( _mm512_loadu_si512( x ) ) );
+    __m512i const high = _mm512_add_epi32( _mm512_permutexvar_epi32( _mm512_set1_epi32( 15 ), low ),
+                                           hostWarpScanRegister( _mm512_loadu_si512( x + 16 ) ) );
+    _mm512_storeu_si512( x, low );
+    _mm512_storeu_si512( x + 16, high );
+    return x[ hostWarpSize - 1 ];
+}
+
+inline float hostWarpReduceCumSum
+(
+    float   (&x)[32]     ,
+    float   const rCarry = 0
+)
+{
+    __m512 const low  = _mm512_add_ps( _mm512_set1_ps( rCarry ),
+                                       hostWarpScanRegister( _mm512_loadu_ps( x ) ) );
+    __m512 const high = _mm512_add_ps( _mm512_permutexvar_ps( _mm512_set1_epi32( 15 ), low ),
+                                       hostWarpScanRegister( _mm512_loadu_ps( x + 16 ) ) );
+    _mm512_storeu_ps( x, low );
+    _mm512_storeu_ps( x + 16, high );
+    return x[ hostWarpSize - 1 ];
+}
+
+/* AVX-512 has an instruction for exactly this */
+inline int hostWarpCompact
+(
+    int32_t  const (&x)[32],
+    uint32_t const   rBallot,
+    int32_t  * const rOut
+)
+{
+    __mmask16 const low = (__mmask16) rBallot;
+    _mm512_mask_compressstoreu_epi32( rOut, low, _mm512_loadu_si512( x ) );
+    _mm512_mask_compressstoreu_epi32( rOut + __builtin_popcount( low ), (__mmask16)( rBallot >> 16 ),
+                                      _mm512_loadu_si512( x + 16 ) );
+    return __builtin_popcount( rBallot );
+}
+
+inline int hostWarpCompact
+(
+    float    const (&x)[32],
+    uint32_t const   rBallot,
+    float    * const rOut
+)
+{
+    __mmask16 const low = (__mmask16) rBallot;
+    _mm512_mask_compressstoreu_ps( rOut, low, _mm512_loadu_ps( x ) );
+    _mm512_mask_compressstoreu_ps( rOut + __builtin_popcount( low ), (__mmask16)( rBallot >> 16 ),
+                                   _mm512_loadu_ps( x + 16 ) );
+    return __builtin_popcount( rBallot );
+}
+
+#elif defined( __AVX2__ )
+
+/**
+ * Inclusive prefix sum of the 8 lanes. The byte shifts only work inside
+ * each 128 bit half, so the last lane of the lower half is added to the
+ * upper one afterwards.
+ */
+inline __m256i hostWarpScanRegister( __m256i x )
+{
+    x = _mm256_add_epi32( x, _mm256_slli_si256( x, 4 ) );
+    x = _mm256_add_epi32( x, _mm256_slli_si256( x, 8 ) );
+    /* lower half zeroed, upper half gets the lower one */
+    __m256i const low = _mm256_permute2x128_si256( x, x, 0x08 );
+    return _mm256_add_epi32( x, _mm256_shuffle_epi32( low, 0xFF ) );
+}
+
+inline __m256 hostWarpScanRegister( __m256 x )
+{
+    x = _mm256_add_ps( x, _mm256_castsi256_ps( _mm256_slli_si256( _mm256_castps_si256( x ), 4 ) ) );
+    x = _mm256_add_ps( x, _mm256_castsi256_ps( _mm256_slli_si256( _mm256_castps_si256( x ), 8 ) ) );
+    __m256 const low = _mm256_permute2f128_ps( x, x, 0x08 );
+    return _mm256_add_ps( x, _mm256_permute_ps( low, 0xFF ) );
+}
+
+inline int32_t hostWarpReduceSum( int32_t const (&x)[32] )
+{
+    __m256i const v = _mm256_add_epi32(
+        _mm256_add_epi32( _mm256_loadu_si256( (__m256i const *)( x      ) ), _mm256_loadu_si256( (__m256i const *)( x +  8 ) ) ),
+        _mm256_add_epi32( _mm256_loadu_si256( (__m256i const *)( x + 16 ) ), _mm256_loadu_si256( (__m256i const *)( x + 24 ) ) ) );
+    __m128i s = _mm_add_epi32( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) );
+    s = _mm_add_epi32( s, _mm_shuffle_epi32( s, 0x4E ) );
+    s = _mm_add_epi32( s, _mm_shuffle_epi32( s, 0xB1 ) );
+    return _mm_cvtsi128_si32( s );
+}
+
+inline float hostWarpReduceSum( float const (&x)[32] )
+{
+    __m256 const v = _mm256_add_ps( _mm256_add_ps( _mm256_loadu_ps( x      ), _mm256_loadu_ps( x +  8 ) ),
+                                    _mm256_add_ps( _mm256_loadu_ps( x + 16 ), _mm256_loadu_ps( x + 24 ) ) );
+    __m128 s = _mm_add_ps( _mm256_castps256_ps128( v ), _mm256_extractf128_ps( v, 1 ) );
+    s = _mm_add_ps( s, _mm_movehl_ps( s, s ) );
+    s = _mm_add_ss( s, _mm_shuffle_ps( s, s, 0x55 ) );
+    return _mm_cvtss_f32( s );
+}
+
+inline void hostWarpAllReduceSum( int32_t (&x)[32] )
+{
+    __m256i const sum = _mm256_set1_epi32( hostWarpReduceSum( x ) );
+    for ( int i = 0; i < hostWarpSize; i += 8 )
+        _mm256_storeu_si256( (__m256i *)( x + i ), sum );
+}
+
+inline void hostWarpAllReduceSum( float (&x)[32] )
+{
+    __m256 const sum = _mm256_set1_ps( hostWarpReduceSum( x ) );
+    for ( int i = 0; i < hostWarpSize; i += 8 )
+        _mm256_storeu_ps( x + i, sum );
+}
+
+inline int32_t hostWarpReduceCumSum
+(
+    int32_t   (&x)[32]     ,
+    int32_t   const rCarry = 0
+)
+{
+    __m256i carry = _mm256_set1_epi32( rCarry );
+    for ( int i = 0; i < hostWarpSize; i += 8 )
+    {
+        __m256i const v = _mm256_add_epi32( carry, hostWarpScanRegister(
+                              _mm256_loadu_si256( (__m256i const *)( x + i ) ) ) );
+        _mm256_storeu_si256( (__m256i *)( x + i ), v );
+        carry = _mm256_permutevar8x32_epi32( v, _mm256_set1_epi32( 7 ) );
+    }
+    return x[ hostWarpSize - 1 ];
+}
+
+inline float hostWarpReduceCumSum
+(
+    float   (&x)[32]     ,
+    float   const rCarry = 0
+)
+{
+    __m256 carry = _mm256_set1_ps( rCarry );
+    for ( int i = 0; i < hostWarpSize; i += 8 )
+    {
+        __m256 const v = _mm256_add_ps( carry, hostWarpScanRegister( _mm256_loadu_ps( x + i ) ) );
+        _mm256_storeu_ps( x + i, v );
+        carry = _mm256_permutevar8x32_ps( v, _mm256_set1_epi32( 7 ) );
+    }
+    return x[ hostWarpSize - 1 ];
+}
+
+#endif
+
+inline uint32_t hostWarpBallot( bool const (&x)[32] )
+{
+#if defined( __AVX2__ )
+    __m256i const v = _mm256_loadu_si256( (__m256i const *) x );
+    return (uint32_t) _mm256_movemask_epi8( _mm256_cmpgt_epi8( v, _mm256_setzero_si256() ) );
+#else
+    return hostWarpBallotScalar( x );
+#endif
+}
+
+/**
+ * warpReduceCumSumPredicate, i.e. rCumSum[i] is the number of set bits at
+ * positions <= i. Instead of one popcount per lane, the bits are expanded
+ * to lanes and scanned, which vectorizes.
+ */
+inline void hostWarpReduceCumSumPredicate
+(
+    uint32_t const   rBallot,
+    int32_t        (&rCumSum)[32]
+)
+{
+    for ( int i = 0; i < hostWarpSize; ++i )
+        rCumSum[i] = ( rBallot >> i ) & 1u;
+    hostWarpReduceCumSum( rCumSum );
+}
+
+
+/************************** blocks of warps **************************/
+
+/**
+ * blockReduceSum for any number of lanes, i.e. a block is simply an array
+ * here. Full warps are reduced with the above, the tail sequentially.
+ */
+template< typename T >
+inline T hostBlockReduceSum
+(
+    T      const * const x ,
+    size_t const         rn
+)
+{
+    T sum = T( 0 );
+    size_t i = 0;
+    for ( ; i + hostWarpSize <= rn; i += hostWarpSize )
+        sum += hostWarpReduceSum( *reinterpret_cast< T const (*)[32] >( x + i ) );
+    for ( ; i < rn; ++i )
+        sum += x[i];
+    return sum;
+}
+
+/**
+ * blockReduceCumSum in place, i.e. warp scans plus the running carry,
+ * which starts with rCarry, so that blocks can be chained like warps.
+ * @return the last element, i.e. the carry for the next block
+ */
+template< typename T >
+inline T hostBlockReduceCumSum
+(
+    T      * const x ,
+    size_t   const rn,
+    T        const rCarry = T( 0 )
+)
+{
+    T carry = rCarry;
+    size_t i = 0;
+    for ( ; i + hostWarpSize <= rn; i += hostWarpSize )
+        carry = hostWarpReduceCumSum( *reinterpret_cast< T (*)[32] >( x + i ), carry );
+    for ( ; i < rn; ++i )
+        carry = x[i] += carry;
+    return carry;
+}
+
+inline size_t hostBlockReduceSumPredicate
+(
+    bool   const * const x ,
+    size_t const         rn
+)
+{
+    size_t sum = 0;
+    size_t i = 0;
+    for ( ; i + hostWarpSize <= rn; i += hostWarpSize )
+        sum += hostWarpReduceSumPredicate( hostWarpBallot( *reinterpret_cast< bool const (*)[32] >( x + i ) ) );
+    for ( ; i < rn; ++i )
+        sum += x[i];
+    return sum;
+}
+
+/**
+ * Copies all rIn[i] with rKeep[i] set to rOut in order, like the kernels
+ * filtering with blockReduceCumSumPredicate, but per warp using its ballot.
+ * Warps with all or no lanes kept are copied or skipped as a whole.
+ *
+ * @param[out] rOut needs room for as many elements as are kept
+ * @return number of kept elements
+ */
+template< typename T >
+inline size_t hostCompact
+(
+    T      const * const rIn  ,
+    bool   const * const rKeep,
+    size_t const         rn   ,
+    T            * const rOut
+)
+{
+    size_t nKept = 0;
+    size_t i = 0;
+    for ( ; i + hostWarpSize <= rn; i += hostWarpSize )
+    {
+        uint32_t const ballot = hostWarpBallot( *reinterpret_cast< bool const (*)[32] >( rKeep + i ) );
+        if ( ballot == 0 )
+            continue;
+        if ( ballot == 0xFFFFFFFFu )
+        {
+            memcpy( rOut + nKept, rIn + i, hostWarpSize * sizeof( T ) );
+            nKept += hostWarpSize;
+            continue;
+        }
+        nKept += hostWarpCompact( *reinterpret_cast< T const (*)[32] >( rIn + i ), ballot, rOut + nKept );
+    }
+    for ( ; i < rn; ++i )
+    {
+        if ( rKeep[i] )
+            rOut[ nKept++ ] = rIn[i];
+    }
+    return nKept;
+}
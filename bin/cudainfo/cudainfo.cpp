@@ -1,33 +1,66 @@
 /*
 nvcc -x cu --compiler-options -Wall,-Wextra -std=c++11 -DNDEBUG cudainfo.cpp
+
+Usage: cudainfo [--format table|json|csv]
+Without arguments the properties of all devices are printed as table, then
+the devices are listed by their score and the best one is chosen, @see
+cudadeviceselection.hpp. With --format all properties of all devices are
+written in the given format instead, @see cudadevicereport.hpp
 */
 
 #include "cudacommon.hpp"
+#include "cudadeviceselection.hpp"
 
 
-int main( void )
+int main( int argc, char ** argv )
 {
-    /* show debug CUDA information per graphic card found and chose graphic
-     * card without kernel timeout, if found, i.e. graphic card not used for
-     * display! */
+    if ( argc > 1 )
     {
-        int nCudaDevices = 0;
-        cudaDeviceProp * props = NULL;
-        getCudaDeviceProperties( &props, &nCudaDevices );
-        assert( props != NULL );
-        int iDeviceToUse = 0;
-        for ( auto iDevice = 0; iDevice < nCudaDevices; ++iDevice )
-            if ( ! props[iDevice].kernelExecTimeoutEnabled )
+        CudaReportFormat format;
+        if ( argc != 3 || strcmp( argv[1], "--format" ) != 0 || ! parseCudaReportFormat( argv[2], &format ) )
         {
-            {
-                iDeviceToUse = iDevice;
-                break;
-            }
+            fprintf( stderr, "Usage: %s [--format table|json|csv]\n", argv[0] );
+            return EXIT_FAILURE;
         }
-        CUDA_ERROR( cudaSetDevice( iDeviceToUse ) );
+        BufferedWriter out( stdout );
+        writeCudaDeviceReports( out, getCudaDeviceSnapshots(), format );
+        return out.flush() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-        free( props );
-        props = NULL;
+    /* show debug CUDA information per graphic card found and choose the
+     * graphic card with the best score, @see cudadeviceselection.hpp, e.g.
+     * one not used for display and not yet used by other processes. The
+     * properties come from the on-disk snapshot if possible, so that the
+     * GPUs don't have to be initialized just for choosing. */
+    {
+        bool bCached = false;
+        std::vector< CudaDeviceSnapshot > const devices = getCudaDeviceSnapshots( &bCached );
+        {
+            BufferedWriter out( stdout );
+            writeCudaDeviceReports( out, devices, CudaReportFormatTable );
+            if ( ! out.flush() )
+                return EXIT_FAILURE;
+        }
+        std::vector< CudaDeviceCandidate > const candidates = makeCudaDeviceCandidates( devices );
+        CudaDeviceSelectionPolicy const policy;
+        for ( auto const & score : rankCudaDevices( candidates, policy ) )
+        {
+            cudaDeviceProp const & prop = devices[ score.iDevice ].properties;
+            printf( "Device %i: %s (%i.%i), kernel timeout: %s, NUMA distance: %i, score: %.2f\n",
+                    score.iDevice, prop.name, prop.major, prop.minor,
+                    prop.kernelExecTimeoutEnabled ? "true" : "false",
+                    candidates[ score.iDevice ].numaDistance, score.score );
+        }
+        CudaDeviceClaim claim;
+        int const iDeviceToUse = selectAndClaimCudaDevice( candidates, policy, claim );
+        if ( iDeviceToUse < 0 )
+        {
+            fprintf( stderr, "There is no device supporting CUDA.\n" );
+            return EXIT_FAILURE;
+        }
+        printf( "Using device %i (properties %s)\n", iDeviceToUse,
+                bCached ? "from cache" : "queried" );
+        CUDA_ERROR( cudaSetDevice( iDeviceToUse ) );
     }
 
 }
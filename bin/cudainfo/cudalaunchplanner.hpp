@@ -0,0 +1,249 @@
+/**
+ * Chooses kernel launch configurations from the device properties and the
+ * resource usage of the kernel, replacing the fixed 256 threads per block
+ * of the former calcKernelConfig.
+ *
+ * The expensive part, i.e. trying out all block sizes for the theoretical
+ * occupancy, only depends on the registers, shared memory and
+ * dimensionality of the kernel and is memoized per device, so that planning
+ * a launch afterwards is O(1). The planner is pure host code and only
+ * needs a cudaDeviceProp, which can also be a synthetic one from
+ * cudahostruntime.hpp, e.g. for testing without GPU:
+ *
+ *   CudaLaunchPlanner const planner( makeHostRuntimeDevice( "Test", 6, 1, 20 ).properties );
+ *   CudaLaunchConfig const config = planner.plan( nElements, CudaKernelResources( 40 ) );
+ *   kernel<<< config.nBlocks, config.nThreads >>>( ... );
+ */
+
+#pragma once
+
+#include <algorithm>                    // min, max
+#include <cassert>
+#include <cstdint>                      // uint64_t
+#include <memory>                       // unique_ptr
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"       // cudaDeviceProp
+#   include "cudahostbackend.hpp"       // dim3
+#endif
+#include "cudadevicecache.hpp"          // getCudaDeviceSnapshots
+#include "cudaoccupancy.hpp"            // findBestCudaBlockSizes, CudaKernelResources
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+struct CudaLaunchConfig
+{
+    dim3 nBlocks ;
+    dim3 nThreads;
+    /* resident blocks per multiprocessor, 0 if the kernel can't run at all */
+    int  nBlocksPerMultiprocessor;
+};
+
+class CudaLaunchPlanner
+{
+public:
+    inline explicit CudaLaunchPlanner( cudaDeviceProp const & rProps )
+     : mProps( rProps )
+    {
+        if ( mProps.warpSize <= 0 || mProps.maxThreadsPerBlock < mProps.warpSize )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::CudaLaunchPlanner] "
+                << "Invalid device properties (warpSize=" << mProps.warpSize
+                << ", maxThreadsPerBlock=" << mProps.maxThreadsPerBlock << ")";
+            throw std::invalid_argument( msg.str() );
+        }
+    }
+
+    /**
+     * Plans a launch over nx * ny * nz elements. For ny == nz == 1 the
+     * result is meant to be used with a grid-stride loop, as described in
+     * calcKernelConfig, i.e. there are never more threads than elements.
+     * For 2D and 3D, the block is one warp wide in x for coalescing, or
+     * nx if that is narrower, and the remaining threads are distributed
+     * over y and z. If y and z can't take all of them, x gets wider again.
+     * The grid covers the elements, but at most as many blocks as are
+     * needed or can be resident, so the kernel has to check the bounds and
+     * loop over the elements not covered.
+     */
+    inline CudaLaunchConfig plan
+    (
+        uint64_t                    const rnx,
+        uint64_t                    const rny,
+        uint64_t                    const rnz,
+        CudaKernelResources const &       rResources = CudaKernelResources()
+    ) const
+    {
+        int const nDimensions = rnz > 1 ? 3 : rny > 1 ? 2 : 1;
+        BlockPlan const blockPlan = getBlockPlan( nDimensions, rResources );
+
+        CudaLaunchConfig config;
+        config.nBlocksPerMultiprocessor = blockPlan.nBlocksPerMultiprocessor;
+        if ( blockPlan.nBlocksPerMultiprocessor == 0 || rnx * rny * rnz == 0 )
+        {
+            config.nBlocks  = dim3( 0, 0, 0 );
+            config.nThreads = dim3( 0, 0, 0 );
+            return config;
+        }
+
+        uint64_t const nMinElements = rResources.nMinElementsPerThread > 0 ? rResources.nMinElementsPerThread : 1;
+        uint64_t const nThreadsNeeded = ( rnx * rny * rnz + nMinElements - 1 ) / nMinElements;
+        uint64_t const nMaxResidentBlocks = (uint64_t) blockPlan.nBlocksPerMultiprocessor
+                                          * mProps.multiProcessorCount;
+
+        if ( nDimensions == 1 )
+        {
+            /* rounding down, so that there are never more threads than
+             * elements, the grid-stride loop does the rest */
+            uint64_t const nThreads = std::min( (uint64_t) blockPlan.nThreadsPerBlock, nThreadsNeeded );
+            uint64_t nBlocks = std::max( (uint64_t) 1, nThreadsNeeded / nThreads );
+            if ( nBlocks > nMaxResidentBlocks )
+                nBlocks = nMaxResidentBlocks;
+            if ( nBlocks > (uint64_t) mProps.maxGridSize[0] )
+                nBlocks = mProps.maxGridSize[0];
+            config.nBlocks  = dim3( nBlocks );
+            config.nThreads = dim3( nThreads );
+            assert( (uint64_t) config.nBlocks.x * config.nThreads.x <= rnx );
+            return config;
+        }
+
+        /* one warp wide in x, or narrower if nx is, the rest distributed
+         * over y and z, for 3D with more in z than in y */
+        uint64_t const nBlockThreads = blockPlan.nThreadsPerBlock;
+        uint64_t const nMaxY = std::min( rny, (uint64_t) mProps.maxThreadsDim[1] );
+        uint64_t const nMaxZ = std::min( rnz, (uint64_t) mProps.maxThreadsDim[2] );
+        uint64_t       bx = std::min( std::min( (uint64_t) mProps.warpSize, rnx ), (uint64_t) mProps.maxThreadsDim[0] );
+        uint64_t const nBlockRest = nBlockThreads / bx;
+        uint64_t       by = std::min( nBlockRest, nMaxY );
+        uint64_t       bz = 1;
+        if ( nDimensions == 3 )
+        {
+            by = 1;
+            while ( by * by * 4 <= nBlockRest )
+                by *= 2;
+            by = std::min( by, nMaxY );
+            bz = std::min( nBlockRest / by, nMaxZ );
+            by = std::min( nBlockRest / bz, nMaxY );
+        }
+        /* x is widened in whole warps by the threads y and z couldn't take */
+        uint64_t const nWiderX = std::min( std::min( nBlockThreads / ( by * bz ), rnx ),
+                                           (uint64_t) mProps.maxThreadsDim[0] );
+        if ( nWiderX >= (uint64_t) mProps.warpSize )
+            bx = std::max( bx, nWiderX / mProps.warpSize * mProps.warpSize );
+
+        uint64_t g[3] = { ( rnx + bx - 1 ) / bx, ( rny + by - 1 ) / by, ( rnz + bz - 1 ) / bz };
+        uint64_t const nThreadsPerBlock = bx * by * bz;
+        uint64_t const nMaxBlocks = std::max( (uint64_t) 1, std::min( nMaxResidentBlocks,
+            ( nThreadsNeeded + nThreadsPerBlock - 1 ) / nThreadsPerBlock ) );
+        /* shrink the largest dimension just enough, so that there are still
+         * at least nMaxBlocks, the kernel has to loop over the rest. Only if
+         * the other dimensions alone already exceed it, it is shrunk to 1. */
+        while ( g[0] * g[1] * g[2] > nMaxBlocks )
+        {
+            int const iMax = g[0] >= g[1] && g[0] >= g[2] ? 0 : g[1] >= g[2] ? 1 : 2;
+            uint64_t const nOthers = g[0] * g[1] * g[2] / g[ iMax ];
+            if ( nOthers < nMaxBlocks )
+            {
+                g[ iMax ] = ( nMaxBlocks + nOthers - 1 ) / nOthers;
+                break;
+            }
+            g[ iMax ] = 1;
+        }
+        for ( int i = 0; i < 3; ++i )
+            g[i] = std::min( g[i], (uint64_t) mProps.maxGridSize[i] );
+
+        config.nBlocks  = dim3( g[0], g[1], g[2] );
+        config.nThreads = dim3( bx, by, bz );
+        return config;
+    }
+
+    inline CudaLaunchConfig plan
+    (
+        uint64_t                    const rnElements,
+        CudaKernelResources const &       rResources = CudaKernelResources()
+    ) const
+    {
+        return plan( rnElements, 1, 1, rResources );
+    }
+
+    inline cudaDeviceProp const & properties( void ) const { return mProps; }
+
+private:
+    struct BlockPlan
+    {
+        int nThreadsPerBlock        ;
+        int nBlocksPerMultiprocessor;
+    };
+
+    inline BlockPlan calcBlockPlan( CudaKernelResources const & rResources ) const
+    {
+        std::vector< CudaOccupancy > const best = findBestCudaBlockSizes( mProps, rResources, 1 );
+        BlockPlan blockPlan = { mProps.warpSize, 0 };
+        if ( ! best.empty() )
+        {
+            blockPlan.nThreadsPerBlock         = best[0].nThreadsPerBlock;
+            blockPlan.nBlocksPerMultiprocessor = best[0].nBlocksPerMultiprocessor;
+        }
+        return blockPlan;
+    }
+
+    inline BlockPlan getBlockPlan
+    (
+        int                         const rnDimensions,
+        CudaKernelResources const &       rResources
+    ) const
+    {
+        /* registers < 2^16, dimensions < 4, shared memory < 2^46 */
+        uint64_t const key = (uint64_t)( rResources.nRegistersPerThread & 0xFFFF )
+                           | (uint64_t) rnDimensions << 16
+                           | (uint64_t) rResources.nBytesSharedPerBlock << 18;
+
+        std::lock_guard< std::mutex > lock( mMutex );
+        auto const match = mBlockPlans.find( key );
+        if ( match != mBlockPlans.end() )
+            return match->second;
+        BlockPlan const blockPlan = calcBlockPlan( rResources );
+        mBlockPlans[ key ] = blockPlan;
+        return blockPlan;
+    }
+
+    cudaDeviceProp const                               mProps     ;
+    mutable std::mutex                                 mMutex     ;
+    mutable std::unordered_map< uint64_t, BlockPlan > mBlockPlans;
+};
+
+/**
+ * Planner for the given device, created on first use from the (cached)
+ * device properties, so that no runtime calls happen per launch.
+ */
+inline CudaLaunchPlanner const & getCudaLaunchPlanner( int const iDevice )
+{
+    /* pointers, because the planners can't be moved because of their mutex */
+    typedef std::vector< std::unique_ptr< CudaLaunchPlanner const > > Planners;
+    static Planners const planners = [](){
+        Planners list;
+        for ( auto const & snapshot : getCudaDeviceSnapshots() )
+            list.push_back( std::unique_ptr< CudaLaunchPlanner const >( new CudaLaunchPlanner( snapshot.properties ) ) );
+        return list;
+    }();
+
+    if ( iDevice < 0 || iDevice >= (int) planners.size() )
+    {
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::getCudaLaunchPlanner] "
+            << "Device " << iDevice << " does not exist, only found "
+            << planners.size() << " devices.";
+        throw std::invalid_argument( msg.str() );
+    }
+    return *planners[ iDevice ];
+}
@@ -0,0 +1,378 @@
+/**
+ * Measured memory bandwidths to put next to the theoretical ones:
+ *  - host STREAM copy, scale and triad per NUMA node and thread count,
+ *    with the arrays bound to the node and the threads pinned to it
+ *  - host to device, device to host and both at once in two streams, for
+ *    pageable and pinned buffers over a sweep of transfer sizes, compared
+ *    to the PCIe link read from sysfs
+ *  - device to device copies compared to the DRAM bandwidth computed from
+ *    memoryClockRate and memoryBusWidth
+ * The host part doesn't need a GPU, so it can be used on every node type,
+ * e.g. to size host staging buffers:
+ *
+ *   printHostStreamBenchmarks( benchmarkHostStream() );
+ *   if ( cudaGetDeviceCount( &nDevices ) == cudaSuccess && nDevices > 0 )
+ *       printCudaTransferBenchmarks( 0, benchmarkCudaTransfers( 0 ) );
+ *
+ * All results are the best of several repetitions in bytes per second,
+ * where a copy counts the bytes read and written like STREAM does, but a
+ * transfer only counts the bytes transferred like bandwidthTest does.
+ * Transfers are timed with the host clock after synchronizing the stream.
+ * @see https://www.cs.virginia.edu/stream/ref.html
+ */
+
+#pragma once
+
+#include <algorithm>                    // min, max
+#include <chrono>
+#include <cstdint>                      // uint64_t
+#include <cstdio>                       // printf, sscanf
+#include <cstdlib>                      // malloc, free
+#include <cstring>                      // memset
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"
+#endif
+
+#include "cudadevicecache.hpp"          // readSmallFile
+#include "cudaformat.hpp"               // formatBytes
+#include "cudahostbackend.hpp"          // HostThreadPool
+#include "cudanuma.hpp"                 // getNumaNodes, allocateNumaMemory, pinThreadPoolToNumaNode
+#include "cudaroofline.hpp"             // getCudaPeakBandwidth
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+template< typename T_Functor >
+inline double measureBestSeconds( int const rnRepeats, T_Functor const & rFunctor )
+{
+    double tMin = 0;
+    for ( int iRepeat = 0; iRepeat < std::max( rnRepeats, 1 ); ++iRepeat )
+    {
+        auto const t0 = std::chrono::steady_clock::now();
+        rFunctor();
+        auto const t1 = std::chrono::steady_clock::now();
+        double const t = std::chrono::duration< double >( t1 - t0 ).count();
+        if ( iRepeat == 0 || t < tMin )
+            tMin = t;
+    }
+    return tMin;
+}
+
+struct HostStreamResult
+{
+    /* -1 if the machine has no NUMA information */
+    int          node    ;
+    unsigned int nThreads;
+    /* bytes / s */
+    double       copy    ;
+    double       scale   ;
+    double       triad   ;
+};
+
+/**
+ * Runs STREAM for each NUMA node with 1, 2, 4, ... threads up to the
+ * number of CPUs of the node. The three arrays of rnElements doubles
+ * each should be much larger than the last level cache.
+ * @param[in] rRootPath prefix for /sys, e.g. for testing
+ */
+inline std::vector< HostStreamResult > benchmarkHostStream
+(
+    size_t              const   rnElements = size_t( 1 ) << 23,
+    int                 const   rnRepeats  = 5,
+    std::string         const & rRootPath  = ""
+)
+{
+    std::vector< int > nodes = getNumaNodes( rRootPath );
+    if ( nodes.empty() )
+        nodes.push_back( -1 );
+
+    std::vector< HostStreamResult > results;
+    for ( auto const node : nodes )
+    {
+        unsigned int nCpus = node >= 0 ? getNumaNodeCpus( node, rRootPath ).size() : 0;
+        /* memory-only nodes, e.g. of HBM or CXL, are measured from all CPUs */
+        if ( nCpus == 0 )
+            nCpus = HostThreadPool::defaultThreadCount();
+
+        size_t const nBytes = rnElements * sizeof( double );
+        double * const a = (double*) allocateNumaMemory( nBytes, node );
+        double * const b = (double*) allocateNumaMemory( nBytes, node );
+        double * const c = (double*) allocateNumaMemory( nBytes, node );
+        if ( a == NULL || b == NULL || c == NULL )
+        {
+            freeNumaMemory( a, nBytes );
+            freeNumaMemory( b, nBytes );
+            freeNumaMemory( c, nBytes );
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::benchmarkHostStream] "
+                << "Could not allocate 3x " << nBytes << " B on NUMA node " << node << ".";
+            throw std::runtime_error( msg.str() );
+        }
+
+        std::vector< unsigned int > threadCounts;
+        for ( unsigned int nThreads = 1; nThreads < nCpus; nThreads *= 2 )
+            threadCounts.push_back( nThreads );
+        threadCounts.push_back( nCpus );
+
+        for ( auto const nThreads : threadCounts )
+        {
+            HostThreadPool pool( nThreads );
+            /* the calling thread is worker 0, so it is pinned for the run only */
+            cpu_set_t oldAffinity;
+            bool const bRestore = pthread_getaffinity_np( pthread_self(), sizeof( oldAffinity ), &oldAffinity ) == 0;
+            pinThreadPoolToNumaNode( pool, node, rRootPath );
+            pinThreadToNumaNode( node, rRootPath );
+
+            /* one chunk per thread like the OpenMP static schedule of STREAM */
+            auto const forChunks = [&]( std::function< void( size_t, size_t ) > const & rKernel )
+            {
+                pool.parallelFor( nThreads, [&]( uint64_t const iThread )
+                {
+                    rKernel( rnElements * iThread / nThreads, rnElements * ( iThread + 1 ) / nThreads );
+                } );
+            };
+            double const scalar = 3;
+            forChunks( [&]( size_t const iBegin, size_t const iEnd )
+            {
+                for ( size_t i = iBegin; i < iEnd; ++i )
+                {
+                    a[i] = 1;
+                    b[i] = 2;
+                    c[i] = 0;
+                }
+            } );
+
+            HostStreamResult result;
+            result.node     = node;
+            result.nThreads = nThreads;
+            result.copy  = 2 * nBytes / measureBestSeconds( rnRepeats, [&](){ forChunks(
+                [&]( size_t const iBegin, size_t const iEnd ){ for ( size_t i = iBegin; i < iEnd; ++i ) c[i] = a[i]; } ); } );
+            result.scale = 2 * nBytes / measureBestSeconds( rnRepeats, [&](){ forChunks(
+                [&]( size_t const iBegin, size_t const iEnd ){ for ( size_t i = iBegin; i < iEnd; ++i ) b[i] = scalar * c[i]; } ); } );
+            result.triad = 3 * nBytes / measureBestSeconds( rnRepeats, [&](){ forChunks(
+                [&]( size_t const iBegin, size_t const iEnd ){ for ( size_t i = iBegin; i < iEnd; ++i ) a[i] = b[i] + scalar * c[i]; } ); } );
+            results.push_back( result );
+
+            if ( bRestore )
+                pthread_setaffinity_np( pthread_self(), sizeof( oldAffinity ), &oldAffinity );
+        }
+
+        freeNumaMemory( a, nBytes );
+        freeNumaMemory( b, nBytes );
+        freeNumaMemory( c, nBytes );
+    }
+    return results;
+}
+
+inline void printHostStreamBenchmarks( std::vector< HostStreamResult > const & rResults )
+{
+    printf( "================= Host Memory (STREAM) =================\n" );
+    printf( "| NUMA node | Threads | Copy GB/s | Scale GB/s | Triad GB/s\n" );
+    for ( auto const & result : rResults )
+    {
+        char node[16] = "-";
+        if ( result.node >= 0 )
+            snprintf( node, sizeof( node ), "%i", result.node );
+        printf( "| %9s | %7u | %9.2f | %10.2f | %10.2f\n", node, result.nThreads,
+                result.copy / 1e9, result.scale / 1e9, result.triad / 1e9 );
+    }
+    printf( "=========================================================\n" );
+}
+
+/**
+ * @return theoretical bandwidth per direction of the current PCIe link of
+ *         the device in bytes per second, after the line encoding, or 0
+ *         if unknown. Reads e.g. "8.0 GT/s PCIe" and "16".
+ */
+inline double getPciLinkBandwidth
+(
+    int                 const   rDomain,
+    int                 const   rBus   ,
+    int                 const   rDevice,
+    std::string         const & rRootPath = ""
+)
+{
+    char address[32];
+    snprintf( address, sizeof( address ), "%04x:%02x:%02x.0", rDomain, rBus, rDevice );
+    std::string const path = rRootPath + "/sys/bus/pci/devices/" + address;
+    double gigaTransfers = 0;
+    int nLanes = 0;
+    if ( sscanf( readSmallFile( path + "/current_link_speed" ).c_str(), "%lf", &gigaTransfers ) != 1 ||
+         sscanf( readSmallFile( path + "/current_link_width" ).c_str(), "%i" , &nLanes        ) != 1 ||
+         gigaTransfers <= 0 || nLanes <= 0 )
+        return 0;
+    /* PCIe 1 and 2 use 8b/10b, 3 to 5 128b/130b, 6 FLIT mode with 242B/256B */
+    double const encoding = gigaTransfers < 8 ? 8. / 10 : gigaTransfers < 64 ? 128. / 130 : 242. / 256;
+    return gigaTransfers * 1e9 * encoding * nLanes / 8;
+}
+
+#define TMP_CHECK( CALL ) \
+{ \
+    cudaError_t const error = CALL; \
+    if ( error != cudaSuccess ) \
+    { \
+        std::stringstream msg; \
+        msg << "[" << __FILENAME__ << "::" << __func__ << "] " \
+            << #CALL << " failed with: " << cudaGetErrorString( error ); \
+        throw std::runtime_error( msg.str() ); \
+    } \
+}
+
+struct CudaTransferResult
+{
+    size_t nBytes        ;
+    bool   bPinned       ;
+    /* bytes / s */
+    double hostToDevice  ;
+    double deviceToHost  ;
+    /* sum of both directions transferring at the same time */
+    double bidirectional ;
+};
+
+/**
+ * Sweeps transfer sizes from 4 KiB to rnMaxBytes by factors of 4 with
+ * pageable and pinned host buffers on the current device.
+ */
+inline std::vector< CudaTransferResult > benchmarkCudaTransfers
+(
+    size_t const rnMaxBytes = size_t( 64 ) << 20,
+    int    const rnRepeats  = 5
+)
+{
+    std::vector< CudaTransferResult > results;
+    cudaStream_t streams[2];
+    TMP_CHECK( cudaStreamCreate( &streams[0] ) )
+    TMP_CHECK( cudaStreamCreate( &streams[1] ) )
+    for ( int iPinned = 0; iPinned < 2; ++iPinned )
+    {
+        /* two buffers each, because the bidirectional transfer needs separate ones */
+        char * hosts[2] = { NULL, NULL };
+        char * gpus [2] = { NULL, NULL };
+        for ( int i = 0; i < 2; ++i )
+        {
+            if ( iPinned )
+                TMP_CHECK( cudaHostAlloc( (void**) &hosts[i], rnMaxBytes, cudaHostAllocDefault ) )
+            else
+                hosts[i] = (char*) malloc( rnMaxBytes );
+            if ( hosts[i] == NULL )
+                TMP_CHECK( cudaErrorMemoryAllocation )
+            /* touch the pages, else the first transfer would measure page faults */
+            memset( hosts[i], 0, rnMaxBytes );
+            TMP_CHECK( cudaMalloc( (void**) &gpus[i], rnMaxBytes ) )
+        }
+
+        for ( size_t nBytes = 4096; nBytes <= rnMaxBytes; nBytes *= 4 )
+        {
+            CudaTransferResult result;
+            result.nBytes  = nBytes;
+            result.bPinned = iPinned != 0;
+            result.hostToDevice = nBytes / measureBestSeconds( rnRepeats, [&]()
+            {
+                TMP_CHECK( cudaMemcpyAsync( gpus[0], hosts[0], nBytes, cudaMemcpyHostToDevice, streams[0] ) )
+                TMP_CHECK( cudaStreamSynchronize( streams[0] ) )
+            } );
+            result.deviceToHost = nBytes / measureBestSeconds( rnRepeats, [&]()
+            {
+                TMP_CHECK( cudaMemcpyAsync( hosts[0], gpus[0], nBytes, cudaMemcpyDeviceToHost, streams[0] ) )
+                TMP_CHECK( cudaStreamSynchronize( streams[0] ) )
+            } );
+            result.bidirectional = 2 * nBytes / measureBestSeconds( rnRepeats, [&]()
+            {
+                TMP_CHECK( cudaMemcpyAsync( gpus[0], hosts[0], nBytes, cudaMemcpyHostToDevice, streams[0] ) )
+                TMP_CHECK( cudaMemcpyAsync( hosts[1], gpus[1], nBytes, cudaMemcpyDeviceToHost, streams[1] ) )
+                TMP_CHECK( cudaStreamSynchronize( streams[0] ) )
+                TMP_CHECK( cudaStreamSynchronize( streams[1] ) )
+            } );
+            results.push_back( result );
+        }
+
+        for ( int i = 0; i < 2; ++i )
+        {
+            if ( iPinned )
+                TMP_CHECK( cudaFreeHost( hosts[i] ) )
+            else
+                free( hosts[i] );
+            TMP_CHECK( cudaFree( gpus[i] ) )
+        }
+    }
+    TMP_CHECK( cudaStreamDestroy( streams[0] ) )
+    TMP_CHECK( cudaStreamDestroy( streams[1] ) )
+    return results;
+}
+
+/**
+ * @return bytes read plus written per second when copying rnBytes inside
+ *         the memory of the current device
+ */
+inline double benchmarkCudaDeviceCopy
+(
+    size_t const rnBytes   = size_t( 256 ) << 20,
+    int    const rnRepeats = 5
+)
+{
+    char * gpus[2] = { NULL, NULL };
+    for ( int i = 0; i < 2; ++i )
+        TMP_CHECK( cudaMalloc( (void**) &gpus[i], rnBytes ) )
+    TMP_CHECK( cudaMemset( gpus[0], 0, rnBytes ) )
+    TMP_CHECK( cudaDeviceSynchronize() )
+    double const bandwidth = 2. * rnBytes / measureBestSeconds( rnRepeats, [&]()
+    {
+        TMP_CHECK( cudaMemcpy( gpus[1], gpus[0], rnBytes, cudaMemcpyDeviceToDevice ) )
+        TMP_CHECK( cudaDeviceSynchronize() )
+    } );
+    for ( int i = 0; i < 2; ++i )
+        TMP_CHECK( cudaFree( gpus[i] ) )
+    return bandwidth;
+}
+
+#undef TMP_CHECK
+
+/**
+ * Prints the transfers next to the PCIe link bandwidth and the device
+ * copy next to the DRAM bandwidth, each with the measured fraction of it.
+ */
+inline void printCudaTransferBenchmarks
+(
+    cudaDeviceProp                    const & rProperties,
+    std::vector< CudaTransferResult > const & rTransfers ,
+    double                            const   rDeviceCopy,
+    std::string                       const & rRootPath  = ""
+)
+{
+    double const link = getPciLinkBandwidth( rProperties.pciDomainID, rProperties.pciBusID,
+                                             rProperties.pciDeviceID, rRootPath );
+    printf( "============== Transfers for %s ==============\n", rProperties.name );
+    if ( link > 0 )
+        printf( "| PCIe link (theoretical)  : %.2f GB/s per direction\n", link / 1e9 );
+    else
+        printf( "| PCIe link (theoretical)  : unknown\n" );
+    printf( "| Host mem | Size      | H2D GB/s | D2H GB/s | Both GB/s | H2D/Link | D2H/Link | Both/Link\n" );
+    for ( auto const & transfer : rTransfers )
+    {
+        char size[ nMaxFormattedBytesChars + 1 ];
+        size[ formatBytes( size, transfer.nBytes ) ] = '\0';
+        char ratios[64] = "";
+        if ( link > 0 )
+        {
+            snprintf( ratios, sizeof( ratios ), " | %7.1f%% | %7.1f%% | %8.1f%%", 100 * transfer.hostToDevice / link,
+                      100 * transfer.deviceToHost / link, 100 * transfer.bidirectional / ( 2 * link ) );
+        }
+        printf( "| %-8s | %-9s | %8.2f | %8.2f | %9.2f%s\n", transfer.bPinned ? "pinned" : "pageable", size,
+                transfer.hostToDevice / 1e9, transfer.deviceToHost / 1e9, transfer.bidirectional / 1e9, ratios );
+    }
+    double const peak = getCudaPeakBandwidth( rProperties );
+    printf( "| Device copy              : %.2f GB/s of %.2f GB/s theoretical (%.1f%%, %i bit at %.0f MHz)\n",
+            rDeviceCopy / 1e9, peak / 1e9, peak > 0 ? 100 * rDeviceCopy / peak : 0.,
+            rProperties.memoryBusWidth, rProperties.memoryClockRate / 1e3 );
+    printf( "=====================================================\n" );
+}
@@ -0,0 +1,337 @@
+/**
+ * Caching allocator in front of cudaMalloc / cudaHostAlloc. cudaFree
+ * synchronizes the whole device and both calls are slow, so freed blocks
+ * are kept in per size class free lists and handed out again for the next
+ * request of the same class. The backing allocator is a pair of plain
+ * functions, so the pool logic can be used and tested with malloc and free.
+ *
+ * Size classes are powers of two starting at 256 B. Requests larger than
+ * mnMaxCachedBytes are passed through uncached, because rounding them up
+ * would waste too much memory.
+ *
+ * @see https://nvlabs.github.io/cub/structcub_1_1_caching_device_allocator.html
+ */
+
+#pragma once
+
+#include <algorithm>                    // max
+#include <cstddef>                      // size_t
+#include <cstdint>                      // uint64_t
+#include <cstdlib>                      // malloc, free
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <utility>                      // pair
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"       // cudaStream_t, cudaMalloc
+#endif
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+struct CachingMemoryPoolStats
+{
+    uint64_t nAllocations     ;   /* requests, including uncached ones */
+    uint64_t nHits            ;   /* served from the cache */
+    uint64_t nMisses          ;   /* needed the backing allocator */
+    uint64_t nFrees           ;
+    size_t   nBytesRequested  ;   /* currently in use as requested */
+    size_t   nBytesInUse      ;   /* currently in use including rounding */
+    size_t   nBytesCached     ;   /* freed, but kept for reuse */
+    size_t   nPeakBytes       ;   /* maximum of in use + cached */
+
+    inline double hitRate( void ) const
+    {
+        return nAllocations > 0 ? (double) nHits / nAllocations : 0;
+    }
+
+    /* internal fragmentation, i.e. fraction of memory in use wasted by rounding */
+    inline double fragmentation( void ) const
+    {
+        return nBytesInUse > 0 ? 1.0 - (double) nBytesRequested / nBytesInUse : 0;
+    }
+};
+
+class CachingMemoryPool
+{
+public:
+    typedef void * (*Allocate  )( size_t );
+    typedef void   (*Deallocate)( void * );
+
+    /**
+     * @param[in] rbPerStream if true, freed blocks are only reused for the
+     *            same stream, so that a block still used by an asynchronous
+     *            copy or kernel in one stream can't be handed to another.
+     *            Else all blocks are shared, which is fine as long as the
+     *            memory is only freed after synchronizing.
+     */
+    inline CachingMemoryPool
+    (
+        Allocate   const rAllocate  ,
+        Deallocate const rDeallocate,
+        bool       const rbPerStream      = false,
+        size_t     const rnMaxCachedBytes = size_t( 1 ) << 30
+    )
+     : mAllocate( rAllocate ), mDeallocate( rDeallocate ),
+       mbPerStream( rbPerStream ), mnMaxCachedBytes( rnMaxCachedBytes )
+    {
+        mStats = CachingMemoryPoolStats();
+    }
+
+    inline ~CachingMemoryPool()
+    {
+        trim( 0 );
+    }
+
+    static inline size_t getSizeClass( size_t const rnBytes )
+    {
+        size_t nClassBytes = 256;
+        while ( nClassBytes < rnBytes )
+            nClassBytes *= 2;
+        return nClassBytes;
+    }
+
+    /**
+     * @return NULL if the backing allocator failed even after releasing all
+     *         cached blocks
+     */
+    inline void * allocate
+    (
+        size_t       const rnBytes    ,
+        cudaStream_t const rStream = 0
+    )
+    {
+        bool   const bCached = rnBytes <= mnMaxCachedBytes;
+        size_t const nBlockBytes = bCached ? getSizeClass( rnBytes ) : rnBytes;
+        FreeListKey const key( nBlockBytes, mbPerStream ? rStream : cudaStream_t( 0 ) );
+
+        std::lock_guard< std::mutex > lock( mMutex );
+        ++mStats.nAllocations;
+
+        void * pointer = NULL;
+        auto const freeList = mFreeLists.find( key );
+        if ( bCached && freeList != mFreeLists.end() && ! freeList->second.empty() )
+        {
+            pointer = freeList->second.back();
+            freeList->second.pop_back();
+            mStats.nBytesCached -= nBlockBytes;
+            ++mStats.nHits;
+        }
+        else
+        {
+            pointer = mAllocate( nBlockBytes );
+            if ( pointer == NULL )
+            {
+                /* cached blocks of other sizes might be the reason */
+                trimLocked( 0 );
+                pointer = mAllocate( nBlockBytes );
+                if ( pointer == NULL )
+                    return NULL;
+            }
+            ++mStats.nMisses;
+        }
+
+        Block const block = { rnBytes, nBlockBytes, key.second, bCached };
+        mBlocks[ pointer ] = block;
+        mStats.nBytesRequested += rnBytes;
+        mStats.nBytesInUse     += nBlockBytes;
+        mStats.nPeakBytes = std::max( mStats.nPeakBytes, mStats.nBytesInUse + mStats.nBytesCached );
+        return pointer;
+    }
+
+    inline void deallocate( void * const rPointer )
+    {
+        if ( rPointer == NULL )
+            return;
+
+        std::lock_guard< std::mutex > lock( mMutex );
+        auto const it = mBlocks.find( rPointer );
+        if ( it == mBlocks.end() )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::CachingMemoryPool::deallocate] "
+                << "Pointer " << rPointer << " was not allocated by this pool.";
+            throw std::invalid_argument( msg.str() );
+        }
+        Block const block = it->second;
+        mBlocks.erase( it );
+
+        ++mStats.nFrees;
+        mStats.nBytesRequested -= block.nBytesRequested;
+        mStats.nBytesInUse     -= block.nBytes;
+        if ( block.bCached )
+        {
+            mFreeLists[ FreeListKey( block.nBytes, block.stream ) ].push_back( rPointer );
+            mStats.nBytesCached += block.nBytes;
+        }
+        else
+            mDeallocate( rPointer );
+    }
+
+    /**
+     * Returns cached blocks to the backing allocator, largest first, until
+     * at most rnBytesToKeep are cached.
+     * @return number of bytes released
+     */
+    inline size_t trim( size_t const rnBytesToKeep = 0 )
+    {
+        std::lock_guard< std::mutex > lock( mMutex );
+        return trimLocked( rnBytesToKeep );
+    }
+
+    inline CachingMemoryPoolStats stats( void ) const
+    {
+        std::lock_guard< std::mutex > lock( mMutex );
+        return mStats;
+    }
+
+private:
+    typedef std::pair< size_t, cudaStream_t > FreeListKey;
+
+    struct Block
+    {
+        size_t       nBytesRequested;
+        size_t       nBytes         ;
+        cudaStream_t stream         ;
+        bool         bCached        ;
+    };
+
+    inline size_t trimLocked( size_t const rnBytesToKeep )
+    {
+        size_t nReleased = 0;
+        for ( auto freeList = mFreeLists.rbegin(); freeList != mFreeLists.rend(); ++freeList )
+        {
+            while ( mStats.nBytesCached > rnBytesToKeep && ! freeList->second.empty() )
+            {
+                mDeallocate( freeList->second.back() );
+                freeList->second.pop_back();
+                mStats.nBytesCached -= freeList->first.first;
+                nReleased           += freeList->first.first;
+            }
+        }
+        return nReleased;
+    }
+
+    Allocate                                          const mAllocate       ;
+    Deallocate                                        const mDeallocate     ;
+    bool                                              const mbPerStream     ;
+    size_t                                            const mnMaxCachedBytes;
+    mutable std::mutex                                      mMutex          ;
+    std::map< FreeListKey, std::vector< void * > >          mFreeLists      ;
+    std::map< void *, Block >                               mBlocks         ;
+    CachingMemoryPoolStats                                  mStats          ;
+};
+
+
+/* backing allocators, which return NULL on failure instead of exiting */
+
+inline void * allocateCudaDeviceMemory( size_t const rnBytes )
+{
+    void * pointer = NULL;
+    if ( cudaMalloc( &pointer, rnBytes ) != cudaSuccess )
+    {
+        cudaGetLastError(); /* reset the error, the pool may retry */
+        return NULL;
+    }
+    return pointer;
+}
+
+/* errors are ignored, because this may run on exit after the runtime shut down */
+inline void freeCudaDeviceMemory( void * const rPointer )
+{
+    cudaFree( rPointer );
+}
+
+inline void * allocateCudaPinnedMemory( size_t const rnBytes )
+{
+    void * pointer = NULL;
+    if ( cudaHostAlloc( &pointer, rnBytes, cudaHostAllocDefault ) != cudaSuccess )
+    {
+        cudaGetLastError();
+        return NULL;
+    }
+    return pointer;
+}
+
+inline void freeCudaPinnedMemory( void * const rPointer )
+{
+    cudaFreeHost( rPointer );
+}
+
+/**
+ * The default pools used by MirroredVector. They are per stream, because
+ * MirroredVector::free doesn't synchronize before returning device memory,
+ * i.e. kernels and asynchronous copies in its stream might still use it,
+ * which is fine as long as only later work in the same stream gets it.
+ * That doesn't hold for pinned host memory, because the host reads and
+ * writes it outside of any stream, so the stream has to be synchronized
+ * before deallocating a pinned block, which MirroredVector does.
+ * The pools are never destroyed, because on exit the CUDA runtime might
+ * already have been shut down.
+ */
+struct CudaMemoryPools
+{
+    std::mutex                          mutex ;
+    std::map< int, CachingMemoryPool* > device;
+    CachingMemoryPool                 * pinned;
+};
+
+inline CudaMemoryPools & getCudaMemoryPools( void )
+{
+    static CudaMemoryPools * const pools = new CudaMemoryPools{
+        {}, {}, new CachingMemoryPool( allocateCudaPinnedMemory, freeCudaPinnedMemory, true ) };
+    return *pools;
+}
+
+/**
+ * Pool for device memory on the given device. cudaMalloc allocates on the
+ * current device, so the caller must have set it to riDevice.
+ */
+inline CachingMemoryPool & getCudaDeviceMemoryPool( int const riDevice )
+{
+    CudaMemoryPools & pools = getCudaMemoryPools();
+    std::lock_guard< std::mutex > lock( pools.mutex );
+    CachingMemoryPool * & pool = pools.device[ riDevice ];
+    if ( pool == NULL )
+        pool = new CachingMemoryPool( allocateCudaDeviceMemory, freeCudaDeviceMemory, true );
+    return *pool;
+}
+
+inline CachingMemoryPool & getCudaDeviceMemoryPool( void )
+{
+    int iDevice = 0;
+    cudaGetDevice( &iDevice );
+    return getCudaDeviceMemoryPool( iDevice );
+}
+
+/**
+ * Pool for pinned host memory. Synchronize the stream a block was used in
+ * before deallocating it, else a pending copy might overwrite the host
+ * writes of whoever gets it next.
+ */
+inline CachingMemoryPool & getCudaPinnedMemoryPool( void )
+{
+    return *getCudaMemoryPools().pinned;
+}
+
+/**
+ * Releases all cached blocks of the default pools, e.g. before handing the
+ * memory to a library not using them.
+ * @return number of bytes released
+ */
+inline size_t trimCudaMemoryPools( void )
+{
+    CudaMemoryPools & pools = getCudaMemoryPools();
+    size_t nReleased = pools.pinned->trim();
+    std::lock_guard< std::mutex > lock( pools.mutex );
+    for ( auto const & pool : pools.device )
+        nReleased += pool.second->trim();
+    return nReleased;
+}
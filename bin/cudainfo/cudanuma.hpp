@@ -0,0 +1,340 @@
+/**
+ * NUMA topology as far as needed for placing work near a GPU, read from
+ * sysfs without libnuma:
+ *
+ *   int const gpuNode    = getPciDeviceNumaNode( 0, 0x3b, 0 );   // 0000:3b:00.0
+ *   int const threadNode = getCurrentNumaNode();
+ *   int const distance   = getNumaDistance( threadNode, gpuNode ); // 10 if local
+ *
+ * Distances are those of the ACPI SLIT, i.e. 10 for the same node and
+ * usually 20 or more for remote ones. Everything returns -1 if unknown,
+ * e.g. on machines without NUMA, where the PCI devices report -1 as node.
+ * The root for /sys can be changed, so that other topologies can be tested.
+ *
+ * Memory is bound to a node with the mbind system call and threads are
+ * pinned to the CPUs of a node, so that e.g. the host buffers for a GPU
+ * and the threads filling them are on the socket the GPU is attached to:
+ *
+ *   int const node = getCudaDeviceNumaNode( iDevice );
+ *   pinThreadToNumaNode( node );
+ *   void * const p = allocateNumaMemory( nBytes, node );
+ *   ...
+ *   freeNumaMemory( p, nBytes );
+ *
+ * Binding fails silently, e.g. without NUMA support in the kernel or if
+ * seccomp forbids mbind, because the memory is usable anyway.
+ */
+
+#pragma once
+
+#include <algorithm>                    // find, max
+#include <cstdio>                       // snprintf, sscanf
+#include <cstdlib>                      // strtol
+#include <string>
+#include <vector>
+
+#include <pthread.h>                    // pthread_setaffinity_np
+#include <sched.h>                      // sched_getcpu, cpu_set_t
+#include <sys/mman.h>                   // mmap, munmap
+#include <sys/syscall.h>                // SYS_mbind, SYS_get_mempolicy
+#include <unistd.h>                     // access, sysconf, syscall
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"
+#endif
+
+#include "cudadevicecache.hpp"          // readSmallFile
+#include "cudahostbackend.hpp"          // HostThreadPool
+
+
+/**
+ * @return NUMA node of the PCI device or -1 if unknown
+ */
+inline int getPciDeviceNumaNode
+(
+    int                 const   rDomain,
+    int                 const   rBus   ,
+    int                 const   rDevice,
+    std::string         const & rRootPath = ""
+)
+{
+    char address[32];
+    snprintf( address, sizeof( address ), "%04x:%02x:%02x.0", rDomain, rBus, rDevice );
+    std::string const contents = readSmallFile( rRootPath + "/sys/bus/pci/devices/" + address + "/numa_node" );
+    int node = -1;
+    if ( sscanf( contents.c_str(), "%i", &node ) != 1 )
+        return -1;
+    return node;
+}
+
+/**
+ * @return NUMA node of the PCI slot of the device or -1 if unknown
+ */
+inline int getCudaDeviceNumaNode
+(
+    int                 const   riDevice,
+    std::string         const & rRootPath = ""
+)
+{
+    int domain = 0, bus = 0, device = 0;
+    if ( cudaDeviceGetAttribute( &domain, cudaDevAttrPciDomainId, riDevice ) != cudaSuccess ||
+         cudaDeviceGetAttribute( &bus   , cudaDevAttrPciBusId   , riDevice ) != cudaSuccess ||
+         cudaDeviceGetAttribute( &device, cudaDevAttrPciDeviceId, riDevice ) != cudaSuccess )
+    {
+        cudaGetLastError();
+        return -1;
+    }
+    return getPciDeviceNumaNode( domain, bus, device, rRootPath );
+}
+
+/**
+ * @return numbers of a sysfs list like "0-15,32-47", i.e. comma separated
+ *         numbers and inclusive ranges
+ */
+inline std::vector< int > parseSysfsList( std::string const & rList )
+{
+    std::vector< int > numbers;
+    char const * p = rList.c_str();
+    while ( true )
+    {
+        char * end = NULL;
+        long const first = strtol( p, &end, 10 );
+        if ( end == p )
+            break;
+        long last = first;
+        p = end;
+        if ( *p == '-' )
+        {
+            last = strtol( p + 1, &end, 10 );
+            p = end;
+        }
+        for ( long i = first; i <= last; ++i )
+            numbers.push_back( (int) i );
+        if ( *p != ',' )
+            break;
+        ++p;
+    }
+    return numbers;
+}
+
+/**
+ * @return all online NUMA nodes, empty if unknown, e.g. without NUMA
+ *         support in the kernel
+ */
+inline std::vector< int > getNumaNodes( std::string const & rRootPath = "" )
+{
+    return parseSysfsList( readSmallFile( rRootPath + "/sys/devices/system/node/online" ) );
+}
+
+/**
+ * @return NUMA node the given CPU belongs to or -1 if unknown
+ */
+inline int getCpuNumaNode
+(
+    int                 const   riCpu,
+    std::string         const & rRootPath = ""
+)
+{
+    if ( riCpu < 0 )
+        return -1;
+    /* each node directory contains links to its CPUs, e.g. node1/cpu12.
+     * Node numbers needn't be contiguous, e.g. 0 and 2 with node 1 offline. */
+    char cpu[32];
+    snprintf( cpu, sizeof( cpu ), "/cpu%i", riCpu );
+    for ( auto const iNode : getNumaNodes( rRootPath ) )
+    {
+        std::string const node = rRootPath + "/sys/devices/system/node/node" + std::to_string( iNode );
+        if ( access( ( node + cpu ).c_str(), F_OK ) == 0 )
+            return iNode;
+    }
+    return -1;
+}
+
+/**
+ * @return NUMA node of the CPU the calling thread runs on right now, which
+ *         only stays valid if the thread is pinned, or -1 if unknown
+ */
+inline int getCurrentNumaNode( std::string const & rRootPath = "" )
+{
+    return getCpuNumaNode( sched_getcpu(), rRootPath );
+}
+
+/**
+ * @return SLIT distance between both nodes or -1 if unknown
+ */
+inline int getNumaDistance
+(
+    int                 const   rNodeFrom,
+    int                 const   rNodeTo  ,
+    std::string         const & rRootPath = ""
+)
+{
+    if ( rNodeFrom < 0 || rNodeTo < 0 )
+        return -1;
+    /* one line of distances to all online nodes in ascending order, e.g.
+     * "10 21", so the column is the position of the node in that list */
+    std::vector< int > const nodes = getNumaNodes( rRootPath );
+    auto const itNode = std::find( nodes.begin(), nodes.end(), rNodeTo );
+    if ( itNode == nodes.end() )
+        return -1;
+    std::string const distances = readSmallFile( rRootPath + "/sys/devices/system/node/node"
+                                                 + std::to_string( rNodeFrom ) + "/distance" );
+    char const * p = distances.c_str();
+    for ( auto iNode = nodes.begin(); ; ++iNode )
+    {
+        char * end = NULL;
+        long const distance = strtol( p, &end, 10 );
+        if ( end == p )
+            return -1;
+        if ( iNode == itNode )
+            return (int) distance;
+        p = end;
+    }
+}
+
+/**
+ * @return CPUs of the node, empty if unknown
+ */
+inline std::vector< int > getNumaNodeCpus
+(
+    int                 const   rNode,
+    std::string         const & rRootPath = ""
+)
+{
+    if ( rNode < 0 )
+        return std::vector< int >();
+    return parseSysfsList( readSmallFile( rRootPath + "/sys/devices/system/node/node"
+                                          + std::to_string( rNode ) + "/cpulist" ) );
+}
+
+/**
+ * Restricts the thread to the CPUs of the node, e.g. for workers of a
+ * HostThreadPool preparing data for a GPU on that node.
+ * @return false if the node is unknown or the affinity couldn't be set
+ */
+inline bool pinThreadToNumaNode
+(
+    int                 const   rNode,
+    std::string         const & rRootPath = "",
+    pthread_t           const   rThread   = pthread_self()
+)
+{
+    std::vector< int > const cpus = getNumaNodeCpus( rNode, rRootPath );
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    for ( auto const iCpu : cpus )
+        if ( iCpu < CPU_SETSIZE )
+            CPU_SET( iCpu, &set );
+    if ( CPU_COUNT( &set ) == 0 )
+        return false;
+    return pthread_setaffinity_np( rThread, sizeof( set ), &set ) == 0;
+}
+
+/**
+ * Pins all spawned workers of the pool to the node. Worker 0 is the thread
+ * calling parallelFor, which has to be pinned with pinThreadToNumaNode.
+ * @return false if any worker couldn't be pinned
+ */
+inline bool pinThreadPoolToNumaNode
+(
+    HostThreadPool            & rPool,
+    int                 const   rNode,
+    std::string         const & rRootPath = ""
+)
+{
+    bool bPinned = true;
+    for ( auto const handle : rPool.nativeHandles() )
+        bPinned = pinThreadToNumaNode( rNode, rRootPath, handle ) && bPinned;
+    return bPinned;
+}
+
+/* values of the kernel's numaif.h, which needs libnuma to be installed */
+#define TMP_MPOL_PREFERRED  1
+#define TMP_MPOL_BIND       2
+#define TMP_MPOL_MF_MOVE    ( 1 << 1 )
+#define TMP_MPOL_F_NODE     ( 1 << 0 )
+#define TMP_MPOL_F_ADDR     ( 1 << 1 )
+
+/**
+ * Sets the memory policy of the page-aligned range to the node. Pages
+ * already touched are moved.
+ * @param[in] rbStrict if false the kernel may fall back to other nodes
+ *            when the node is full, else it fails the allocation
+ * @return false if the range couldn't be bound
+ */
+inline bool bindMemoryToNumaNode
+(
+    void   * const rpMemory,
+    size_t   const rnBytes ,
+    int      const rNode   ,
+    bool     const rbStrict = false
+)
+{
+    unsigned long const nBitsPerWord = 8 * sizeof( unsigned long );
+    unsigned long mask[ 1024 / ( 8 * sizeof( unsigned long ) ) ] = { 0 };
+    if ( rNode < 0 || rNode >= 1024 || rpMemory == NULL || rnBytes == 0 )
+        return false;
+    mask[ rNode / nBitsPerWord ] |= 1ul << ( rNode % nBitsPerWord );
+    return syscall( SYS_mbind, rpMemory, rnBytes, rbStrict ? TMP_MPOL_BIND : TMP_MPOL_PREFERRED,
+                    mask, (unsigned long) 1024 + 1, (unsigned int) TMP_MPOL_MF_MOVE ) == 0;
+}
+
+/**
+ * @return node the page containing the address is on, after touching it,
+ *         or -1 if unknown
+ */
+inline int getNumaNodeOfAddress( void * const rpMemory )
+{
+    int node = -1;
+    if ( syscall( SYS_get_mempolicy, &node, NULL, 0ul, rpMemory, TMP_MPOL_F_NODE | TMP_MPOL_F_ADDR ) != 0 )
+        return -1;
+    return node;
+}
+
+#undef TMP_MPOL_PREFERRED
+#undef TMP_MPOL_BIND
+#undef TMP_MPOL_MF_MOVE
+#undef TMP_MPOL_F_NODE
+#undef TMP_MPOL_F_ADDR
+
+inline size_t roundUpToPageSize( size_t const rnBytes )
+{
+    size_t const nPageBytes = (size_t) sysconf( _SC_PAGESIZE );
+    return ( rnBytes + nPageBytes - 1 ) / nPageBytes * nPageBytes;
+}
+
+/**
+ * Allocates whole pages bound to the node and touches them, so that they
+ * are physically allocated on it before e.g. cudaHostRegister pins them.
+ * If binding fails, the memory is allocated anyway.
+ * @return NULL if no memory could be allocated
+ */
+inline void * allocateNumaMemory
+(
+    size_t const rnBytes,
+    int    const rNode
+)
+{
+    size_t const nBytes = roundUpToPageSize( std::max( rnBytes, (size_t) 1 ) );
+    void * const pointer = mmap( NULL, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( pointer == MAP_FAILED )
+        return NULL;
+    bindMemoryToNumaNode( pointer, nBytes, rNode );
+    size_t const nPageBytes = (size_t) sysconf( _SC_PAGESIZE );
+    for ( size_t i = 0; i < nBytes; i += nPageBytes )
+        ( (volatile char *) pointer )[i] = 0;
+    return pointer;
+}
+
+/* @param[in] rnBytes the same as given to allocateNumaMemory */
+inline void freeNumaMemory
+(
+    void   * const rpMemory,
+    size_t   const rnBytes
+)
+{
+    if ( rpMemory != NULL )
+        munmap( rpMemory, roundUpToPageSize( std::max( rnBytes, (size_t) 1 ) ) );
+}
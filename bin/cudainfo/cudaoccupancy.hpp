@@ -0,0 +1,219 @@
+/**
+ * Theoretical occupancy like in NVIDIA's CUDA_Occupancy_Calculator.xls, i.e.
+ * how many blocks and warps of a kernel with the given register and shared
+ * memory usage can be resident on one multiprocessor and which resource
+ * limits it. This is pure host code working on cudaDeviceProp, so it also
+ * works with the synthetic devices of cudahostruntime.hpp.
+ *
+ * @see http://docs.nvidia.com/cuda/cuda-c-programming-guide/index.html#compute-capabilities
+ * @see http://docs.nvidia.com/cuda/cuda-occupancy-calculator/index.html
+ */
+
+#pragma once
+
+#include <algorithm>                    // sort
+#include <cstdint>                      // uint64_t
+#include <cstdlib>                      // abs
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"       // cudaDeviceProp
+#endif
+#include "cudaarchitectures.hpp"        // getCudaArchitecture
+
+
+/**
+ * Resource usage of a kernel as reported by nvcc --ptxas-options=-v or
+ * cudaFuncGetAttributes. nMinElementsPerThread is the least amount of
+ * work per thread for which it is worth to start another thread instead of
+ * looping longer in the existing ones. It is only used for planning
+ * launches, not for the occupancy.
+ */
+struct CudaKernelResources
+{
+    int    nRegistersPerThread  ;
+    size_t nBytesSharedPerBlock ;   /* static + dynamic */
+    int    nMinElementsPerThread;
+
+    inline CudaKernelResources
+    (
+        int    const rnRegistersPerThread   = 32,
+        size_t const rnBytesSharedPerBlock  = 0 ,
+        int    const rnMinElementsPerThread = 32
+    )
+     : nRegistersPerThread  ( rnRegistersPerThread   ),
+       nBytesSharedPerBlock ( rnBytesSharedPerBlock  ),
+       nMinElementsPerThread( rnMinElementsPerThread )
+    {}
+};
+
+/* 32 for architectures newer than the table, which is the most common value */
+inline int getCudaMaxBlocksPerMultiprocessor
+(
+    int const majorVersion,
+    int const minorVersion
+)
+{
+    int const nMaxBlocks = getCudaArchitecture( majorVersion, minorVersion ).nMaxBlocksPerMultiprocessor;
+    return nMaxBlocks > 0 ? nMaxBlocks : 32;
+}
+
+/* registers are allocated per warp in these units */
+inline int getCudaRegisterAllocationUnit( int const majorVersion, int const )
+{
+    return majorVersion == 2 ? 64 : 256;
+}
+
+inline int getCudaMaxRegistersPerThread( int const majorVersion, int const minorVersion )
+{
+    return majorVersion == 2 || ( majorVersion == 3 && minorVersion == 0 ) ? 63 : 255;
+}
+
+inline int getCudaSharedAllocationUnit( int const majorVersion, int const )
+{
+    return majorVersion == 2 ? 128 : 256;
+}
+
+/* shared memory reserved by the system for each block since Ampere */
+inline int getCudaReservedSharedPerBlock( int const majorVersion, int const )
+{
+    return majorVersion >= 8 ? 1024 : 0;
+}
+
+enum CudaOccupancyLimiter
+{
+    CudaOccupancyLimitedByThreads      = 0,
+    CudaOccupancyLimitedByBlocks       = 1,
+    CudaOccupancyLimitedByRegisters    = 2,
+    CudaOccupancyLimitedBySharedMemory = 3,
+    /* a single block already needs more than available */
+    CudaOccupancyInfeasible            = 4
+};
+
+inline char const * getCudaOccupancyLimiterString( CudaOccupancyLimiter const rLimiter )
+{
+    switch ( rLimiter )
+    {
+        case CudaOccupancyLimitedByThreads     : return "threads"   ;
+        case CudaOccupancyLimitedByBlocks      : return "blocks"    ;
+        case CudaOccupancyLimitedByRegisters   : return "registers" ;
+        case CudaOccupancyLimitedBySharedMemory: return "shared mem";
+        case CudaOccupancyInfeasible           : return "infeasible";
+    }
+    return "unknown";
+}
+
+struct CudaOccupancy
+{
+    int                  nThreadsPerBlock          ;
+    int                  nBlocksPerMultiprocessor  ;
+    int                  nWarpsPerMultiprocessor   ;
+    int                  nMaxWarpsPerMultiprocessor;
+    CudaOccupancyLimiter limiter                   ;
+
+    /* ratio of resident warps to the maximum possible in [0,1] */
+    inline double occupancy( void ) const
+    {
+        return nMaxWarpsPerMultiprocessor > 0 ?
+               (double) nWarpsPerMultiprocessor / nMaxWarpsPerMultiprocessor : 0;
+    }
+};
+
+/**
+ * @param[in] rnThreadsPerBlock needs not be a multiple of the warp size,
+ *            but the last warp will be allocated fully anyway.
+ */
+inline CudaOccupancy calcCudaOccupancy
+(
+    cudaDeviceProp      const & rProps           ,
+    int                 const   rnThreadsPerBlock,
+    CudaKernelResources const & rResources
+)
+{
+    CudaOccupancy result;
+    result.nThreadsPerBlock           = rnThreadsPerBlock;
+    result.nBlocksPerMultiprocessor   = 0;
+    result.nWarpsPerMultiprocessor    = 0;
+    result.nMaxWarpsPerMultiprocessor = rProps.maxThreadsPerMultiProcessor / rProps.warpSize;
+    result.limiter                    = CudaOccupancyInfeasible;
+
+    int    const nWarps = ( rnThreadsPerBlock + rProps.warpSize - 1 ) / rProps.warpSize;
+    int    const nRegistersUnit = getCudaRegisterAllocationUnit( rProps.major, rProps.minor );
+    int    const nSharedUnit    = getCudaSharedAllocationUnit  ( rProps.major, rProps.minor );
+    size_t const nBytesShared   = ( rResources.nBytesSharedPerBlock + nSharedUnit - 1 ) / nSharedUnit * nSharedUnit
+                                + getCudaReservedSharedPerBlock( rProps.major, rProps.minor );
+    int    const nRegistersPerWarp = ( rResources.nRegistersPerThread * rProps.warpSize
+                                     + nRegistersUnit - 1 ) / nRegistersUnit * nRegistersUnit;
+
+    if ( rnThreadsPerBlock <= 0 || rnThreadsPerBlock > rProps.maxThreadsPerBlock ||
+         rResources.nRegistersPerThread > getCudaMaxRegistersPerThread( rProps.major, rProps.minor ) ||
+         rResources.nBytesSharedPerBlock > rProps.sharedMemPerBlock ||
+         (uint64_t) nRegistersPerWarp * nWarps > (uint64_t) rProps.regsPerBlock )
+        return result;
+
+    /* the order decides which limiter is reported if several are equal */
+    int const nMaxBlocks = getCudaMaxBlocksPerMultiprocessor( rProps.major, rProps.minor );
+    int const limits[4] = {
+        rProps.maxThreadsPerMultiProcessor / ( nWarps * rProps.warpSize ),
+        nMaxBlocks,
+        nRegistersPerWarp == 0 ? nMaxBlocks : rProps.regsPerMultiprocessor / nRegistersPerWarp / nWarps,
+        nBytesShared      == 0 ? nMaxBlocks : (int)( rProps.sharedMemPerMultiprocessor / nBytesShared )
+    };
+    int iMin = 0;
+    for ( int i = 1; i < 4; ++i )
+        if ( limits[i] < limits[iMin] )
+            iMin = i;
+    if ( limits[iMin] <= 0 )
+        return result;
+
+    result.nBlocksPerMultiprocessor = limits[iMin];
+    result.nWarpsPerMultiprocessor  = limits[iMin] * nWarps;
+    result.limiter                  = (CudaOccupancyLimiter) iMin;
+    return result;
+}
+
+/**
+ * Tries all block sizes which are a multiple of the warp size and returns
+ * them sorted by occupancy. Of those with the same occupancy, the ones
+ * closer to 256 threads are preferred, because that is a good compromise
+ * between having enough blocks for load balancing and few enough for the
+ * per-block overhead, e.g., of reductions over shared memory, and of
+ * equally close ones the smaller.
+ *
+ * @param[in] rnBest number of results to return at most
+ * @return configurations with zero occupancy are left out
+ */
+inline std::vector< CudaOccupancy > findBestCudaBlockSizes
+(
+    cudaDeviceProp      const & rProps    ,
+    CudaKernelResources const & rResources,
+    unsigned int        const   rnBest = 1
+)
+{
+    int const nPreferredThreads = 256;
+
+    auto const isBetter = [nPreferredThreads]( CudaOccupancy const & a, CudaOccupancy const & b )
+    {
+        if ( a.nWarpsPerMultiprocessor != b.nWarpsPerMultiprocessor )
+            return a.nWarpsPerMultiprocessor > b.nWarpsPerMultiprocessor;
+        int const distanceA = std::abs( a.nThreadsPerBlock - nPreferredThreads );
+        int const distanceB = std::abs( b.nThreadsPerBlock - nPreferredThreads );
+        if ( distanceA != distanceB )
+            return distanceA < distanceB;
+        return a.nThreadsPerBlock < b.nThreadsPerBlock;
+    };
+
+    std::vector< CudaOccupancy > candidates;
+    for ( int nThreads = rProps.warpSize; nThreads <= rProps.maxThreadsPerBlock; nThreads += rProps.warpSize )
+    {
+        CudaOccupancy const candidate = calcCudaOccupancy( rProps, nThreads, rResources );
+        if ( candidate.nWarpsPerMultiprocessor > 0 )
+            candidates.push_back( candidate );
+    }
+    std::sort( candidates.begin(), candidates.end(), isBetter );
+    if ( candidates.size() > rnBest )
+        candidates.resize( rnBest );
+    return candidates;
+}
@@ -0,0 +1,400 @@
+/**
+ * Which devices can copy directly to each other and how fast, as an N x N
+ * matrix of cudaDeviceCanAccessPeer and the performance rank of the link,
+ * where lower ranks are faster, e.g. NVLink before PCIe switches:
+ *
+ *   CudaPeerTopology const & topology = getCudaPeerTopology();
+ *   printCudaPeerTopology( topology );
+ *   copyCudaPeerRouted( target, 1, source, 0, nBytes, stream );
+ *
+ * getCudaPeerTopology queries the matrix once per process. Copies between
+ * devices are routed over the direct link if there is one, else over the
+ * intermediate device with the best links to both, and only without either
+ * through host memory, which is what cudaMemcpyPeer does for all pairs
+ * without peer access enabled. Peer access is enabled on first use and only
+ * for the pairs a copy is routed over, because each enabled pair costs
+ * memory mappings and there is a hardware limit on peers per device.
+ *
+ * Topologies can also be parsed from a description like:
+ *
+ *   X 0 - -
+ *   0 X 1 -
+ *   - 1 X 0
+ *   - - 0 X
+ *
+ * i.e. one row per device with the rank of the link to each other device,
+ * "-" for no peer access and "X" on the diagonal, so that the routing can
+ * be tested and, with setHostRuntimePeerTopology, the emulated devices of
+ * cudahostruntime.hpp be connected.
+ */
+
+#pragma once
+
+#include <cstddef>                      // size_t
+#include <cstdio>                       // printf
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>                      // pair
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"
+#endif
+
+#include "cudamemorypool.hpp"           // getCudaDeviceMemoryPool
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+#define TMP_CHECK( CALL ) \
+{ \
+    cudaError_t const error = CALL; \
+    if ( error != cudaSuccess ) \
+    { \
+        std::stringstream msg; \
+        msg << "[" << __FILENAME__ << "::" << __func__ << "] " \
+            << #CALL << " failed with: " << cudaGetErrorString( error ); \
+        throw std::runtime_error( msg.str() ); \
+    } \
+}
+
+/* sets the device and restores the previous one when going out of scope */
+class CudaDeviceScope
+{
+public:
+    inline explicit CudaDeviceScope( int const riDevice )
+    {
+        TMP_CHECK( cudaGetDevice( &miPrevious ) )
+        TMP_CHECK( cudaSetDevice( riDevice ) )
+    }
+
+    inline ~CudaDeviceScope(){ cudaSetDevice( miPrevious ); }
+
+    CudaDeviceScope( CudaDeviceScope const & ) = delete;
+    CudaDeviceScope & operator=( CudaDeviceScope const & ) = delete;
+
+private:
+    int miPrevious;
+};
+
+struct CudaPeerLink
+{
+    bool bAccess         ;
+    /* lower is faster, only meaningful with access */
+    int  performanceRank ;
+    bool bNativeAtomics  ;
+};
+
+struct CudaPeerTopology
+{
+    int                          nDevices;
+    /* row-major, i.e. link from device i to device j at i * nDevices + j */
+    std::vector< CudaPeerLink >  links   ;
+
+    inline CudaPeerLink const & link( int const iFrom, int const iTo ) const
+    {
+        return links[ (size_t) iFrom * nDevices + iTo ];
+    }
+};
+
+inline CudaPeerTopology queryCudaPeerTopology( void )
+{
+    CudaPeerTopology topology;
+    topology.nDevices = 0;
+    if ( cudaGetDeviceCount( &topology.nDevices ) != cudaSuccess )
+    {
+        cudaGetLastError();
+        topology.nDevices = 0;
+    }
+    CudaPeerLink const none = { false, 0, false };
+    topology.links.assign( (size_t) topology.nDevices * topology.nDevices, none );
+    for ( int iFrom = 0; iFrom < topology.nDevices; ++iFrom )
+    for ( int iTo = 0; iTo < topology.nDevices; ++iTo )
+    {
+        if ( iFrom == iTo )
+            continue;
+        CudaPeerLink & link = topology.links[ (size_t) iFrom * topology.nDevices + iTo ];
+        int bAccess = 0;
+        TMP_CHECK( cudaDeviceCanAccessPeer( &bAccess, iFrom, iTo ) )
+        link.bAccess = bAccess != 0;
+        if ( ! link.bAccess )
+            continue;
+        int bAtomics = 0;
+        TMP_CHECK( cudaDeviceGetP2PAttribute( &link.performanceRank, cudaDevP2PAttrPerformanceRank, iFrom, iTo ) )
+        TMP_CHECK( cudaDeviceGetP2PAttribute( &bAtomics, cudaDevP2PAttrNativeAtomicSupported, iFrom, iTo ) )
+        link.bNativeAtomics = bAtomics != 0;
+    }
+    return topology;
+}
+
+/**
+ * Parses the description explained at the top of this file. Empty lines
+ * are ignored.
+ */
+inline CudaPeerTopology parseCudaPeerTopology( std::string const & rDescription )
+{
+    std::vector< std::vector< std::string > > rows;
+    std::istringstream lines( rDescription );
+    std::string line;
+    while ( std::getline( lines, line ) )
+    {
+        std::istringstream tokens( line );
+        std::vector< std::string > row;
+        std::string token;
+        while ( tokens >> token )
+            row.push_back( token );
+        if ( ! row.empty() )
+            rows.push_back( row );
+    }
+
+    CudaPeerTopology topology;
+    topology.nDevices = (int) rows.size();
+    CudaPeerLink const none = { false, 0, false };
+    topology.links.assign( rows.size() * rows.size(), none );
+    for ( size_t iFrom = 0; iFrom < rows.size(); ++iFrom )
+    {
+        if ( rows[ iFrom ].size() != rows.size() )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::parseCudaPeerTopology] "
+                << "Row " << iFrom << " has " << rows[ iFrom ].size() << " entries, but there are "
+                << rows.size() << " rows!";
+            throw std::invalid_argument( msg.str() );
+        }
+        for ( size_t iTo = 0; iTo < rows.size(); ++iTo )
+        {
+            std::string const & token = rows[ iFrom ][ iTo ];
+            CudaPeerLink & link = topology.links[ iFrom * rows.size() + iTo ];
+            if ( iFrom == iTo || token == "-" )
+            {
+                if ( token == ( iFrom == iTo ? "X" : "-" ) )
+                    continue;
+            }
+            else
+            {
+                char * end = NULL;
+                long const rank = strtol( token.c_str(), &end, 10 );
+                if ( ! token.empty() && *end == '\0' && rank >= 0 )
+                {
+                    link.bAccess         = true;
+                    link.performanceRank = (int) rank;
+                    link.bNativeAtomics  = true;
+                    continue;
+                }
+            }
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::parseCudaPeerTopology] "
+                << "Invalid entry '" << token << "' for the link from " << iFrom << " to " << iTo
+                << ", expected " << ( iFrom == iTo ? "X" : "a rank >= 0 or -" ) << "!";
+            throw std::invalid_argument( msg.str() );
+        }
+    }
+    return topology;
+}
+
+inline void printCudaPeerTopology( CudaPeerTopology const & rTopology )
+{
+    printf( "============= Peer-to-peer performance rank =============\n" );
+    printf( "| from \\ to |" );
+    for ( int iTo = 0; iTo < rTopology.nDevices; ++iTo )
+        printf( " %4i |", iTo );
+    printf( "\n" );
+    for ( int iFrom = 0; iFrom < rTopology.nDevices; ++iFrom )
+    {
+        printf( "| %9i |", iFrom );
+        for ( int iTo = 0; iTo < rTopology.nDevices; ++iTo )
+        {
+            CudaPeerLink const & link = rTopology.link( iFrom, iTo );
+            if ( iFrom == iTo )
+                printf( "    X |" );
+            else if ( ! link.bAccess )
+                printf( "    - |" );
+            else
+                printf( " %3i%c |", link.performanceRank, link.bNativeAtomics ? ' ' : '*' );
+        }
+        printf( "\n" );
+    }
+    printf( "| - no peer access, * no native atomics, lower ranks are faster\n" );
+    printf( "=========================================================\n" );
+}
+
+struct CudaPeerRoute
+{
+    /* devices the data passes through from source to target including
+     * both, i.e. 2 for a direct copy and 3 with an intermediate */
+    std::vector< int > devices     ;
+    bool               bThroughHost;
+};
+
+/**
+ * @return the direct link if there is one, else the intermediate device
+ *         with the lowest sum of performance ranks, the first one of equal
+ *         ones, else the route through host memory
+ */
+inline CudaPeerRoute routeCudaPeerCopy
+(
+    CudaPeerTopology const & rTopology,
+    int              const   riSource ,
+    int              const   riTarget
+)
+{
+    CudaPeerRoute route;
+    route.bThroughHost = false;
+    route.devices.push_back( riSource );
+    if ( riSource == riTarget || rTopology.link( riSource, riTarget ).bAccess )
+    {
+        route.devices.push_back( riTarget );
+        return route;
+    }
+
+    int iBest = -1;
+    long bestCost = std::numeric_limits< long >::max();
+    for ( int iVia = 0; iVia < rTopology.nDevices; ++iVia )
+    {
+        if ( iVia == riSource || iVia == riTarget )
+            continue;
+        CudaPeerLink const & first  = rTopology.link( riSource, iVia );
+        CudaPeerLink const & second = rTopology.link( iVia, riTarget );
+        if ( ! first.bAccess || ! second.bAccess )
+            continue;
+        /* + 1 per hop, so that two rank 0 links still cost more than one */
+        long const cost = (long) first.performanceRank + second.performanceRank + 2;
+        if ( cost < bestCost )
+        {
+            iBest    = iVia;
+            bestCost = cost;
+        }
+    }
+    if ( iBest >= 0 )
+        route.devices.push_back( iBest );
+    else
+        route.bThroughHost = true;
+    route.devices.push_back( riTarget );
+    return route;
+}
+
+/**
+ * Enables peer access from riDevice to riPeer, only trying it the first
+ * time per pair and process.
+ * @return false if it failed, e.g. because riDevice has too many peers
+ *         already, in which case copies between both are staged through
+ *         host memory by the driver
+ */
+inline bool enableCudaPeerAccessOnce( int const riDevice, int const riPeer )
+{
+    static std::mutex mutex;
+    static std::map< std::pair< int, int >, bool > enabled;
+    std::lock_guard< std::mutex > lock( mutex );
+    auto const key = std::make_pair( riDevice, riPeer );
+    auto const it = enabled.find( key );
+    if ( it != enabled.end() )
+        return it->second;
+
+    cudaError_t enableError = cudaSuccess;
+    {
+        CudaDeviceScope const scope( riDevice );
+        enableError = cudaDeviceEnablePeerAccess( riPeer, 0 );
+    }
+    if ( enableError != cudaSuccess )
+        cudaGetLastError();
+    bool const bEnabled = enableError == cudaSuccess || enableError == cudaErrorPeerAccessAlreadyEnabled;
+    enabled[ key ] = bEnabled;
+    return bEnabled;
+}
+
+/** Topology of the devices queried on first use, @see queryCudaPeerTopology */
+inline CudaPeerTopology const & getCudaPeerTopology( void )
+{
+    static CudaPeerTopology const topology = queryCudaPeerTopology();
+    return topology;
+}
+
+/**
+ * Copies rnBytes from device memory of riSourceDevice to device memory of
+ * riTargetDevice along routeCudaPeerCopy and enables peer access for each
+ * hop of the route. Both hops of a route over an intermediate device are
+ * queued into rStream through a staging buffer from the memory pool of that
+ * device. If peer access can't be enabled for a hop, the data is copied
+ * directly with cudaMemcpyPeerAsync instead, i.e. through host memory.
+ * Returns before the copy finished.
+ *
+ * @param[in] rpTopology NULL for getCudaPeerTopology, which isn't queried
+ *            for copies inside a device
+ */
+inline void copyCudaPeerRouted
+(
+    void                   * const   rpTarget      ,
+    int                      const   riTargetDevice,
+    void             const * const   rpSource      ,
+    int                      const   riSourceDevice,
+    size_t                   const   rnBytes       ,
+    cudaStream_t             const   rStream    = 0,
+    CudaPeerTopology const * const   rpTopology = NULL
+)
+{
+    if ( rnBytes == 0 )
+        return;
+    if ( riSourceDevice == riTargetDevice )
+    {
+        TMP_CHECK( cudaMemcpyAsync( rpTarget, rpSource, rnBytes, cudaMemcpyDeviceToDevice, rStream ) )
+        return;
+    }
+
+    CudaPeerTopology const & topology = rpTopology == NULL ? getCudaPeerTopology() : *rpTopology;
+    CudaPeerRoute const route = routeCudaPeerCopy( topology, riSourceDevice, riTargetDevice );
+    bool bPeerAccess = ! route.bThroughHost;
+    for ( size_t iHop = 0; bPeerAccess && iHop + 1 < route.devices.size(); ++iHop )
+        bPeerAccess = enableCudaPeerAccessOnce( route.devices[ iHop ], route.devices[ iHop + 1 ] );
+    if ( route.devices.size() == 2 || ! bPeerAccess )
+    {
+        TMP_CHECK( cudaMemcpyPeerAsync( rpTarget, riTargetDevice, rpSource, riSourceDevice, rnBytes, rStream ) )
+        return;
+    }
+
+    int const iVia = route.devices[1];
+    CachingMemoryPool & pool = getCudaDeviceMemoryPool( iVia );
+    void * staging = NULL;
+    {
+        /* the pool allocates on the current device */
+        CudaDeviceScope const scope( iVia );
+        staging = pool.allocate( rnBytes, rStream );
+    }
+    if ( staging == NULL )
+    {
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::copyCudaPeerRouted] "
+            << "Could not allocate " << rnBytes << " B for staging on device " << iVia << ".";
+        throw std::runtime_error( msg.str() );
+    }
+    TMP_CHECK( cudaMemcpyPeerAsync( staging , iVia          , rpSource, riSourceDevice, rnBytes, rStream ) )
+    TMP_CHECK( cudaMemcpyPeerAsync( rpTarget, riTargetDevice, staging , iVia          , rnBytes, rStream ) )
+    /* only handed out again for work queued after this in the same stream */
+    pool.deallocate( staging );
+}
+
+#ifdef CUDA_HOST_RUNTIME
+
+/* connects the emulated devices like described by the topology */
+inline void setHostRuntimePeerTopology( CudaPeerTopology const & rTopology )
+{
+    HostRuntime & runtime = getHostRuntime();
+    runtime.peerPerformanceRanks.clear();
+    for ( int iFrom = 0; iFrom < rTopology.nDevices; ++iFrom )
+    for ( int iTo = 0; iTo < rTopology.nDevices; ++iTo )
+    {
+        if ( iFrom != iTo && rTopology.link( iFrom, iTo ).bAccess )
+            runtime.peerPerformanceRanks[ std::make_pair( iFrom, iTo ) ] = rTopology.link( iFrom, iTo ).performanceRank;
+    }
+}
+
+#endif
+
+#undef TMP_CHECK
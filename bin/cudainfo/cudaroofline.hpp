@@ -0,0 +1,223 @@
+/**
+ * Roofline model: the attainable FLOPS of a kernel are limited either by the
+ * peak compute throughput or by the peak memory bandwidth times the
+ * arithmetic intensity, i.e. FLOPs per byte transferred from DRAM. The
+ * ridge point is the intensity at which both limits are equal. Kernels
+ * left of it are memory-bound, kernels right of it compute-bound.
+ *
+ * This is pure host code. The peak FLOPS are taken as arguments, because
+ * the cores per multiprocessor are architecture dependent,
+ * @see getCudaPeakSPFlops
+ * @see https://crd.lbl.gov/departments/computer-science/par/research/roofline/
+ */
+
+#pragma once
+
+#include <algorithm>                    // min
+#include <cstdlib>                      // strtod
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"       // cudaDeviceProp
+#endif
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+/**
+ * @return theoretical DRAM bandwidth in bytes per second. memoryClockRate
+ *         is in kHz and the factor 2 is for the double data rate, like in
+ *         the bandwidthTest CUDA sample.
+ */
+inline double getCudaPeakBandwidth( cudaDeviceProp const & props )
+{
+    return (double) props.memoryClockRate * 1e3 * 2 * props.memoryBusWidth / 8;
+}
+
+struct CudaRoofline
+{
+    double peakBandwidth;   /* bytes / s */
+    double peakSPFlops  ;   /* FLOP  / s */
+    double peakDPFlops  ;   /* FLOP  / s */
+
+    inline double peakFlops( bool const doublePrecision ) const
+    {
+        return doublePrecision ? peakDPFlops : peakSPFlops;
+    }
+
+    /* arithmetic intensity in FLOP / byte where the roofs meet */
+    inline double ridgePoint( bool const doublePrecision ) const
+    {
+        return peakBandwidth > 0 ? peakFlops( doublePrecision ) / peakBandwidth : 0;
+    }
+
+    inline double attainableFlops
+    (
+        double const rIntensity,
+        bool   const doublePrecision
+    ) const
+    {
+        return std::min( peakFlops( doublePrecision ), rIntensity * peakBandwidth );
+    }
+};
+
+inline CudaRoofline makeCudaRoofline
+(
+    cudaDeviceProp const & props      ,
+    double         const   rPeakSPFlops,
+    double         const   rPeakDPFlops
+)
+{
+    CudaRoofline roofline;
+    roofline.peakBandwidth = getCudaPeakBandwidth( props );
+    roofline.peakSPFlops   = rPeakSPFlops;
+    roofline.peakDPFlops   = rPeakDPFlops;
+    return roofline;
+}
+
+/**
+ * What a user measured for a kernel, e.g. with nvprof, where the bytes are
+ * those transferred from and to DRAM, not the ones requested by the kernel.
+ */
+struct KernelMeasurement
+{
+    std::string name           ;
+    double      nFlops         ;
+    double      nBytes         ;
+    double      seconds        ;
+    bool        doublePrecision;
+};
+
+struct RooflinePlacement
+{
+    double intensity      ;   /* FLOP / byte */
+    double achievedFlops  ;
+    double attainableFlops;   /* roof at the kernel's intensity */
+    bool   memoryBound    ;
+    /* achieved / attainable in [0,1], i.e. 1 means the kernel is at the roof */
+    double fractionOfRoof ;
+};
+
+inline RooflinePlacement placeOnRoofline
+(
+    CudaRoofline      const & rRoofline,
+    KernelMeasurement const & rKernel
+)
+{
+    if ( ! ( rKernel.nBytes > 0 ) || ! ( rKernel.seconds > 0 ) || rKernel.nFlops < 0 )
+    {
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::placeOnRoofline] "
+            << "Kernel '" << rKernel.name << "' needs positive bytes and time "
+            << "and non-negative FLOPs, but got " << rKernel.nFlops << " FLOP, "
+            << rKernel.nBytes << " B, " << rKernel.seconds << " s";
+        throw std::invalid_argument( msg.str() );
+    }
+
+    RooflinePlacement placement;
+    placement.intensity       = rKernel.nFlops / rKernel.nBytes;
+    placement.achievedFlops   = rKernel.nFlops / rKernel.seconds;
+    placement.attainableFlops = rRoofline.attainableFlops( placement.intensity, rKernel.doublePrecision );
+    placement.memoryBound     = placement.intensity < rRoofline.ridgePoint( rKernel.doublePrecision );
+    placement.fractionOfRoof  = placement.attainableFlops > 0 ?
+                                placement.achievedFlops / placement.attainableFlops : 0;
+    return placement;
+}
+
+/**
+ * Parses "name:flops:bytes:seconds[:dp]" as given on the command line,
+ * e.g. "saxpy:2e9:12e9:0.05" for single and "dgemm:2e12:4.8e9:1.3:dp" for
+ * double precision.
+ */
+inline KernelMeasurement parseKernelMeasurement( std::string const & rSpec )
+{
+    std::vector< std::string > parts;
+    std::stringstream in( rSpec );
+    for ( std::string part; std::getline( in, part, ':' ); )
+        parts.push_back( part );
+
+    KernelMeasurement kernel;
+    bool valid = parts.size() == 4 || ( parts.size() == 5 && ( parts[4] == "dp" || parts[4] == "sp" ) );
+    if ( valid )
+    {
+        kernel.name            = parts[0];
+        kernel.doublePrecision = parts.size() == 5 && parts[4] == "dp";
+        char * end = NULL;
+        double * const values[3] = { &kernel.nFlops, &kernel.nBytes, &kernel.seconds };
+        for ( int i = 0; i < 3 && valid; ++i )
+        {
+            *values[i] = strtod( parts[i+1].c_str(), &end );
+            valid = ! parts[i+1].empty() && *end == '\0';
+        }
+    }
+    if ( ! valid )
+    {
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::parseKernelMeasurement] "
+            << "Expected name:flops:bytes:seconds[:dp] but got '" << rSpec << "'";
+        throw std::invalid_argument( msg.str() );
+    }
+    return kernel;
+}
+
+inline std::string quoteCsvField( std::string const & rField )
+{
+    std::string quoted = "\"";
+    for ( auto const c : rField )
+        quoted += c == '"' ? std::string( "\"\"" ) : std::string( 1, c );
+    return quoted + "\"";
+}
+
+inline void writeRooflineCsvHeader( std::ostream & out )
+{
+    out << "device,kernel,precision,flops,bytes,seconds,intensity,"
+           "achieved_gflops,attainable_gflops,peak_gflops,bandwidth_gbs,"
+           "ridge_point,bound,fraction_of_roof\n";
+}
+
+/**
+ * Writes one row per precision describing the roof itself, with the kernel
+ * columns left empty, and one row per kernel, so that dashboards can plot
+ * both from the same file.
+ */
+inline void writeRooflineCsv
+(
+    std::ostream                           & out      ,
+    std::string                      const & rDevice  ,
+    CudaRoofline                     const & rRoofline,
+    std::vector< KernelMeasurement > const & rKernels
+)
+{
+    std::string const device = quoteCsvField( rDevice );
+
+    for ( int dp = 0; dp < 2; ++dp )
+    {
+        out << device << ",," << ( dp ? "dp" : "sp" ) << ",,,,,,,"
+            << rRoofline.peakFlops( dp ) / 1e9 << ","
+            << rRoofline.peakBandwidth / 1e9 << ","
+            << rRoofline.ridgePoint( dp ) << ",,\n";
+    }
+    for ( auto const & kernel : rKernels )
+    {
+        RooflinePlacement const placement = placeOnRoofline( rRoofline, kernel );
+        out << device << "," << quoteCsvField( kernel.name ) << ","
+            << ( kernel.doublePrecision ? "dp" : "sp" ) << ","
+            << kernel.nFlops << "," << kernel.nBytes << "," << kernel.seconds << ","
+            << placement.intensity << ","
+            << placement.achievedFlops / 1e9 << ","
+            << placement.attainableFlops / 1e9 << ","
+            << rRoofline.peakFlops( kernel.doublePrecision ) / 1e9 << ","
+            << rRoofline.peakBandwidth / 1e9 << ","
+            << rRoofline.ridgePoint( kernel.doublePrecision ) << ","
+            << ( placement.memoryBound ? "memory" : "compute" ) << ","
+            << placement.fractionOfRoof << "\n";
+    }
+}
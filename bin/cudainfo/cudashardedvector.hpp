@@ -0,0 +1,380 @@
+/**
+ * One logical array partitioned into contiguous shards, one per device,
+ * each mirrored by its own MirroredVector on that device:
+ *
+ *   ShardedMirroredVector< float > x( n, {}, 1 );   // all devices, 1 halo element
+ *   for ( size_t i = 0; i < n; ++i )
+ *       x[i] = f( i );
+ *   x.push();
+ *   for ( size_t iShard = 0; iShard < x.shardCount(); ++iShard )
+ *   {
+ *       auto & shard = x.shard( iShard );
+ *       CUDA_ERROR( cudaSetDevice( shard.iDevice ) );
+ *       kernel<<< ..., shard.stream >>>( shard.data.gpu, shard.data.size() );
+ *   }
+ *   x.exchangeHalos();
+ *   x.pop();
+ *   x.gather( result );
+ *
+ * Shard sizes are proportional to the peak FLOPS of the devices from the
+ * architecture table, @see getCudaArchitecturePeakFlops, so that all
+ * shards take about the same time. If no device is known, all get the
+ * same size. Boundaries can be rounded to a granularity, e.g. the number of
+ * elements per block.
+ *
+ * Each shard holds its owned range plus up to nHalo elements on either
+ * side, which are copies of the elements owned by the neighbouring shards,
+ * e.g. for stencils. exchangeHalos updates them on the devices from the
+ * owners with peer copies routed over the best links, @see
+ * copyCudaPeerRouted, i.e. after kernels wrote the owned ranges. A
+ * halo may span several shards, e.g. for small or empty shards. Host
+ * writes with operator[] only change the owner, scatter sets the halos,
+ * too.
+ *
+ * The host buffers are pinned and bound to the NUMA node of their device,
+ * and each shard has its own stream, so that push and pop run concurrently
+ * on all devices. All methods restore the current device.
+ */
+
+#pragma once
+
+#include <algorithm>                    // min, max, upper_bound, sort
+#include <cmath>                        // floor, isfinite
+#include <cstddef>                      // size_t
+#include <cstring>                      // memcpy
+#include <sstream>
+#include <stdexcept>
+#include <utility>                      // move
+#include <vector>
+
+#include "cudacommon.hpp"               // MirroredVector, CUDA_ERROR
+#include "cudadeviceselection.hpp"      // getCudaArchitecturePeakFlops
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+/**
+ * Splits rnElements into rWeights.size() contiguous ranges proportional to
+ * the weights with the largest remainder method, i.e. each size differs
+ * by less than one granule from the exact share. Non-finite or negative
+ * weights count as 0, if all are 0 they count as equal.
+ *
+ * @param[in] rnGranularity all boundaries except the end are multiples of it
+ * @return rWeights.size() + 1 boundaries starting with 0 and ending with
+ *         rnElements, shard i being [ boundaries[i], boundaries[i+1] )
+ */
+inline std::vector< size_t > partitionShards
+(
+    size_t                const   rnElements,
+    std::vector< double > const & rWeights  ,
+    size_t                const   rnGranularity = 1
+)
+{
+    if ( rWeights.empty() || rnGranularity == 0 )
+    {
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::partitionShards] "
+            << "Need at least one shard and a granularity > 0, but got "
+            << rWeights.size() << " and " << rnGranularity << "!";
+        throw std::invalid_argument( msg.str() );
+    }
+
+    std::vector< double > weights( rWeights.size(), 0 );
+    double sum = 0;
+    for ( size_t i = 0; i < rWeights.size(); ++i )
+    {
+        if ( std::isfinite( rWeights[i] ) && rWeights[i] > 0 )
+            weights[i] = rWeights[i];
+        sum += weights[i];
+    }
+    if ( sum <= 0 )
+    {
+        std::fill( weights.begin(), weights.end(), 1.0 );
+        sum = weights.size();
+    }
+
+    size_t const nGranules = ceilDiv( rnElements, rnGranularity );
+    std::vector< size_t > nShardGranules( weights.size() );
+    std::vector< std::pair< double, size_t > > remainders( weights.size() );
+    size_t nAssigned = 0;
+    for ( size_t i = 0; i < weights.size(); ++i )
+    {
+        double const quota = nGranules * ( weights[i] / sum );
+        nShardGranules[i] = std::min( (size_t) std::floor( quota ), nGranules - nAssigned );
+        nAssigned += nShardGranules[i];
+        /* stably sorted below, so that equal remainders go to the first shards */
+        remainders[i] = std::make_pair( quota - nShardGranules[i], i );
+    }
+    std::stable_sort( remainders.begin(), remainders.end(),
+        []( std::pair< double, size_t > const & a, std::pair< double, size_t > const & b ){ return a.first > b.first; } );
+    for ( size_t i = 0; nAssigned < nGranules; i = ( i + 1 ) % remainders.size() )
+    {
+        if ( weights[ remainders[i].second ] > 0 )
+        {
+            ++nShardGranules[ remainders[i].second ];
+            ++nAssigned;
+        }
+    }
+
+    std::vector< size_t > boundaries( 1, 0 );
+    for ( auto const n : nShardGranules )
+        boundaries.push_back( std::min( boundaries.back() + n * rnGranularity, rnElements ) );
+    return boundaries;
+}
+
+/**
+ * @return peak FLOPS of each device as weights for partitionShards, 0 for
+ *         unknown architectures
+ */
+inline std::vector< double > getCudaShardWeights( std::vector< int > const & rDevices )
+{
+    std::vector< double > weights;
+    for ( auto const iDevice : rDevices )
+    {
+        cudaDeviceProp prop;
+        CUDA_ERROR( cudaGetDeviceProperties( &prop, iDevice ) );
+        weights.push_back( getCudaArchitecturePeakFlops( prop ) );
+    }
+    return weights;
+}
+
+#if defined( __CUDACC__ ) || defined( CUDA_HOST_RUNTIME )
+
+template< class T >
+class ShardedMirroredVector
+{
+public:
+    typedef T value_type;
+
+    struct Shard
+    {
+        int               iDevice   ;
+        /* owned range of the logical array */
+        size_t            iBegin    ;
+        size_t            iEnd      ;
+        /* halo elements stored before and after the owned range */
+        size_t            nHaloLeft ;
+        size_t            nHaloRight;
+        cudaStream_t      stream    ;
+        /* halo, owned and halo elements, i.e. data[0] is iBegin - nHaloLeft */
+        MirroredVector<T> data      ;
+
+        inline size_t size     ( void ) const { return iEnd - iBegin; }
+        inline size_t iFirst   ( void ) const { return iBegin - nHaloLeft; }
+        inline T *    hostOwned( void ) const { return data.host + nHaloLeft; }
+        inline T *    gpuOwned ( void ) const { return data.gpu  + nHaloLeft; }
+    };
+
+private:
+    size_t                mnElements ;
+    size_t                mnHalo     ;
+    std::vector< size_t > mBoundaries;
+    std::vector< Shard >  mShards    ;
+
+    static inline std::vector< int > getAllDevices( void )
+    {
+        int nDevices = 0;
+        CUDA_ERROR( cudaGetDeviceCount( &nDevices ) );
+        std::vector< int > devices;
+        for ( int iDevice = 0; iDevice < nDevices; ++iDevice )
+            devices.push_back( iDevice );
+        return devices;
+    }
+
+    /* copies the part of the global range [riBegin,riEnd) owned by other shards into the device halo of rTarget */
+    inline void copyHalo
+    (
+        Shard        & rTarget,
+        size_t const   riBegin,
+        size_t const   riEnd
+    )
+    {
+        for ( size_t iShard = findShard( riBegin ); iShard < mShards.size() && mBoundaries[ iShard ] < riEnd; ++iShard )
+        {
+            Shard const & source = mShards[ iShard ];
+            size_t const iBegin = std::max( riBegin, source.iBegin );
+            size_t const iEnd   = std::min( riEnd  , source.iEnd   );
+            if ( iBegin >= iEnd )
+                continue;
+            /* waits for the kernels of the source, which run in its stream */
+            CUDA_ERROR( cudaStreamSynchronize( source.stream ) );
+            copyCudaPeerRouted( rTarget.data.gpu + ( iBegin - rTarget.iFirst() ), rTarget.iDevice,
+                                source.data.gpu  + ( iBegin - source .iFirst() ), source .iDevice,
+                                ( iEnd - iBegin ) * sizeof(T), rTarget.stream );
+        }
+    }
+
+public:
+    /**
+     * @param[in] rDevices devices to shard over in this order, all if empty.
+     *            A device may occur more than once.
+     * @param[in] rnHalo elements each shard additionally stores of its
+     *            neighbours on either side
+     * @param[in] rWeights relative shard sizes, the peak FLOPS if empty
+     */
+    inline ShardedMirroredVector
+    (
+        size_t                const   rnElements ,
+        std::vector< int >    const & rDevices    = std::vector< int >(),
+        size_t                const   rnHalo      = 0,
+        size_t                const   rnGranularity = 1,
+        std::vector< double > const & rWeights    = std::vector< double >(),
+        MirroredHostMemory    const   rHostMemory = MirroredHostPinned
+    )
+     : mnElements( rnElements ), mnHalo( rnHalo )
+    {
+        std::vector< int > const devices = rDevices.empty() ? getAllDevices() : rDevices;
+        if ( ! rWeights.empty() && rWeights.size() != devices.size() )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::ShardedMirroredVector] "
+                << "Got " << rWeights.size() << " weights for " << devices.size() << " devices!";
+            throw std::invalid_argument( msg.str() );
+        }
+        mBoundaries = partitionShards( rnElements, rWeights.empty() ? getCudaShardWeights( devices ) : rWeights,
+                                       rnGranularity );
+
+        mShards.reserve( devices.size() );
+        for ( size_t iShard = 0; iShard < devices.size(); ++iShard )
+        {
+            CudaDeviceScope const scope( devices[ iShard ] );
+            Shard shard;
+            shard.iDevice    = devices[ iShard ];
+            shard.iBegin     = mBoundaries[ iShard ];
+            shard.iEnd       = mBoundaries[ iShard + 1 ];
+            shard.nHaloLeft  = std::min( rnHalo, shard.iBegin );
+            shard.nHaloRight = std::min( rnHalo, rnElements - shard.iEnd );
+            CUDA_ERROR( cudaStreamCreate( &shard.stream ) );
+            /* asynchronous, so that the shards are transferred concurrently */
+            shard.data = MirroredVector<T>( shard.nHaloLeft + shard.size() + shard.nHaloRight,
+                                            shard.stream, true, rHostMemory, MirroredNumaDevice );
+            mShards.push_back( std::move( shard ) );
+        }
+    }
+
+    ShardedMirroredVector( ShardedMirroredVector const & ) = delete;
+    ShardedMirroredVector & operator=( ShardedMirroredVector const & ) = delete;
+
+    inline ~ShardedMirroredVector()
+    {
+        for ( auto & shard : mShards )
+        {
+            CudaDeviceScope const scope( shard.iDevice );
+            shard.data.free();
+            CUDA_ERROR( cudaStreamDestroy( shard.stream ) );
+        }
+    }
+
+    inline size_t size      ( void ) const { return mnElements    ; }
+    inline size_t halo      ( void ) const { return mnHalo        ; }
+    inline size_t shardCount( void ) const { return mShards.size(); }
+
+    inline Shard       & shard( size_t const iShard )       { return mShards[ iShard ]; }
+    inline Shard const & shard( size_t const iShard ) const { return mShards[ iShard ]; }
+
+    /* @return boundaries of the owned ranges like partitionShards */
+    inline std::vector< size_t > const & boundaries( void ) const { return mBoundaries; }
+
+    /* @return shard owning element i, the first non-empty one after empty ones */
+    inline size_t findShard( size_t const i ) const
+    {
+        return std::upper_bound( mBoundaries.begin() + 1, mBoundaries.end() - 1, i ) - ( mBoundaries.begin() + 1 );
+    }
+
+    /* host copy in the owning shard */
+    inline T & operator[]( size_t const i )
+    {
+        assert( i < mnElements );
+        Shard const & shard = mShards[ findShard( i ) ];
+        return shard.data.host[ i - shard.iFirst() ];
+    }
+
+    inline T const & operator[]( size_t const i ) const
+    {
+        assert( i < mnElements );
+        Shard const & shard = mShards[ findShard( i ) ];
+        return shard.data.host[ i - shard.iFirst() ];
+    }
+
+    /* sets the host copies of all shards including the halos from rpHost[0,size()) */
+    inline void scatter( T const * const rpHost )
+    {
+        for ( auto const & shard : mShards )
+        {
+            CUDA_ERROR( cudaStreamSynchronize( shard.stream ) );
+            std::copy( rpHost + shard.iFirst(), rpHost + shard.iFirst() + shard.data.size(), shard.data.host );
+        }
+    }
+
+    /* writes the owned host elements of all shards to rpHost[0,size()) */
+    inline void gather( T * const rpHost ) const
+    {
+        for ( auto const & shard : mShards )
+        {
+            CUDA_ERROR( cudaStreamSynchronize( shard.stream ) );
+            std::copy( shard.hostOwned(), shard.hostOwned() + shard.size(), rpHost + shard.iBegin );
+        }
+    }
+
+    inline void pushShard( size_t const iShard, bool const rAsync = false ) const
+    {
+        CudaDeviceScope const scope( mShards[ iShard ].iDevice );
+        mShards[ iShard ].data.push( rAsync );
+    }
+
+    inline void popShard( size_t const iShard, bool const rAsync = false ) const
+    {
+        CudaDeviceScope const scope( mShards[ iShard ].iDevice );
+        mShards[ iShard ].data.pop( rAsync );
+    }
+
+    /* all shards concurrently, returns after all finished unless rAsync */
+    inline void push( bool const rAsync = false ) const
+    {
+        for ( size_t iShard = 0; iShard < mShards.size(); ++iShard )
+            pushShard( iShard, true );
+        if ( ! rAsync )
+            synchronize();
+    }
+
+    inline void pop( bool const rAsync = false ) const
+    {
+        for ( size_t iShard = 0; iShard < mShards.size(); ++iShard )
+            popShard( iShard, true );
+        if ( ! rAsync )
+            synchronize();
+    }
+
+    /**
+     * Copies the owned elements of each shard on the devices into the halos
+     * of the shards next to it. Returns after all copies finished unless
+     * rAsync, in which case the stream of each shard has to be synchronized
+     * before using its halos.
+     */
+    inline void exchangeHalos( bool const rAsync = false )
+    {
+        if ( mnHalo == 0 )
+            return;
+        for ( auto & shard : mShards )
+        {
+            CudaDeviceScope const scope( shard.iDevice );
+            copyHalo( shard, shard.iFirst(), shard.iBegin );
+            copyHalo( shard, shard.iEnd, shard.iEnd + shard.nHaloRight );
+        }
+        if ( ! rAsync )
+            synchronize();
+    }
+
+    inline void synchronize( void ) const
+    {
+        for ( auto const & shard : mShards )
+        {
+            CudaDeviceScope const scope( shard.iDevice );
+            CUDA_ERROR( cudaStreamSynchronize( shard.stream ) );
+        }
+    }
+};
+
+#endif
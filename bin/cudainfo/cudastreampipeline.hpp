@@ -0,0 +1,219 @@
+/**
+ * Overlaps transfers with computation by splitting a mirrored buffer into
+ * chunks and rotating them over several streams. Each chunk is copied to
+ * the device, processed by the user kernel and copied back, all in one
+ * stream, so that no events are needed. While chunk i is being processed,
+ * chunk i+1 can already be uploaded and chunk i-1 downloaded:
+ *
+ *   stream 0: [H2D 0][kernel 0][D2H 0]       [H2D 3][kernel 3][D2H 3]
+ *   stream 1:        [H2D 1   ][kernel 1][D2H 1]       [H2D 4] ...
+ *   stream 2:               [H2D 2   ][kernel 2][D2H 2]       ...
+ *
+ * This only overlaps if the host memory is page-locked, i.e. pinned,
+ * registered or mapped, because pageable transfers are synchronous.
+ * How many copies can run concurrently with kernels is given by
+ * asyncEngineCount: with one copy engine uploads and downloads serialize,
+ * so that two streams suffice, with two engines three streams keep all of
+ * them busy.
+ *
+ *   CudaStreamPipeline pipeline( props );
+ *   pipeline.run( vector, [&]( float * gpu, size_t n, size_t, cudaStream_t stream )
+ *   {
+ *       kernel<<< nBlocks, nThreads, 0, stream >>>( gpu, n );
+ *   } );
+ *
+ * @see https://devblogs.nvidia.com/how-overlap-data-transfers-cuda-cc/
+ */
+
+#pragma once
+
+#include <algorithm>                    // min, max
+#include <cstddef>                      // size_t
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __CUDACC__
+#   include <cuda_runtime_api.h>
+#else
+#   include "cudahostruntime.hpp"       // cudaDeviceProp, cudaStream_t
+#endif
+
+#ifndef __FILENAME__
+#   define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+
+struct CudaPipelineConfig
+{
+    int    nStreams   ;
+    size_t nChunkBytes;
+};
+
+/**
+ * Chunks should be large enough that the per-copy overhead of some
+ * microseconds is negligible, i.e. a few MiB at PCIe bandwidths, and small
+ * enough that there are several rounds over all streams, because the upload
+ * of the first and the download of the last chunk can't be hidden.
+ *
+ * @param[in] rnBytes size of the whole buffer
+ */
+inline CudaPipelineConfig planCudaPipeline
+(
+    cudaDeviceProp const & props          ,
+    size_t         const   rnBytes        ,
+    size_t         const   rnMinChunkBytes = 1024 * 1024
+)
+{
+    CudaPipelineConfig config;
+    /* without copy engines copies can't overlap with anything */
+    config.nStreams = props.asyncEngineCount <= 0 ? 1 : 1 + std::min( props.asyncEngineCount, 2 );
+
+    size_t const nRounds = 4;
+    size_t nChunkBytes = rnBytes / ( nRounds * config.nStreams );
+    nChunkBytes = std::max( nChunkBytes, rnMinChunkBytes );
+    /* multiples of 256 B keep chunks as aligned as cudaMalloc */
+    nChunkBytes = ( nChunkBytes + 255 ) / 256 * 256;
+    config.nChunkBytes = std::min( nChunkBytes, std::max( rnBytes, (size_t) 1 ) );
+
+    size_t const nChunks = ( rnBytes + config.nChunkBytes - 1 ) / config.nChunkBytes;
+    config.nStreams = (int) std::max( (size_t) 1, std::min( (size_t) config.nStreams, nChunks ) );
+    return config;
+}
+
+class CudaStreamPipeline
+{
+public:
+    inline explicit CudaStreamPipeline( int const rnStreams )
+     : mProps()
+    {
+        init( rnStreams );
+    }
+
+    /* stream count from planCudaPipeline, i.e. from asyncEngineCount */
+    inline explicit CudaStreamPipeline( cudaDeviceProp const & props )
+     : mProps( props )
+    {
+        init( planCudaPipeline( props, size_t( 1 ) << 40 ).nStreams );
+    }
+
+    inline ~CudaStreamPipeline()
+    {
+        for ( auto const stream : mStreams )
+            cudaStreamDestroy( stream );
+    }
+
+    CudaStreamPipeline( CudaStreamPipeline const & ) = delete;
+    CudaStreamPipeline & operator=( CudaStreamPipeline const & ) = delete;
+
+    inline int nStreams( void ) const { return (int) mStreams.size(); }
+    inline cudaStream_t stream( int const i ) const { return mStreams.at( i ); }
+
+    /**
+     * Calls rKernel( gpu + iOffset, nChunkElements, iOffset, stream ) for
+     * each chunk after queueing its upload and queues the download
+     * afterwards. rKernel must only queue work into the given stream and
+     * only touch the given chunk. Returns after everything finished.
+     * If host and gpu are the same, i.e. mapped memory, nothing is copied.
+     *
+     * @return number of chunks
+     */
+    template< typename T, typename T_Kernel >
+    inline size_t run
+    (
+        T        * const   rpHost          ,
+        T        * const   rpGpu           ,
+        size_t     const   rnElements      ,
+        size_t     const   rnChunkElements ,
+        T_Kernel   const & rKernel         ,
+        bool       const   rbPush = true   ,
+        bool       const   rbPop  = true
+    )
+    {
+        if ( rnElements > 0 && ( rpHost == NULL || rpGpu == NULL || rnChunkElements == 0 ) )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::CudaStreamPipeline::run] "
+                << "Need non NULL pointers and a chunk size larger than 0 "
+                << "(host=" << (void*) rpHost << ", gpu=" << (void*) rpGpu
+                << ", nChunkElements=" << rnChunkElements << ")";
+            throw std::invalid_argument( msg.str() );
+        }
+
+        bool const bCopy = (void*) rpHost != (void*) rpGpu;
+        size_t nChunks = 0;
+        for ( size_t iOffset = 0; iOffset < rnElements; iOffset += rnChunkElements, ++nChunks )
+        {
+            size_t       const n      = std::min( rnChunkElements, rnElements - iOffset );
+            cudaStream_t const stream = mStreams[ nChunks % mStreams.size() ];
+            if ( rbPush && bCopy )
+            {
+                check( cudaMemcpyAsync( rpGpu + iOffset, rpHost + iOffset, n * sizeof(T),
+                                        cudaMemcpyHostToDevice, stream ), "push" );
+            }
+            rKernel( rpGpu + iOffset, n, iOffset, stream );
+            if ( rbPop && bCopy )
+            {
+                check( cudaMemcpyAsync( rpHost + iOffset, rpGpu + iOffset, n * sizeof(T),
+                                        cudaMemcpyDeviceToHost, stream ), "pop" );
+            }
+        }
+        check( cudaPeekAtLastError(), "kernel" );
+        for ( auto const stream : mStreams )
+            check( cudaStreamSynchronize( stream ), "synchronize" );
+        return nChunks;
+    }
+
+    /**
+     * For MirroredVector or anything else with host, gpuData() and
+     * nElements, where gpuData grows the device buffer if necessary.
+     * The chunk size is chosen with planCudaPipeline, if the pipeline was
+     * created from device properties, else one chunk per stream is used.
+     * Dirty tracking is ignored, i.e. all chunks are copied.
+     */
+    template< typename T_Vector, typename T_Kernel >
+    inline size_t run
+    (
+        T_Vector       & rVector,
+        T_Kernel const & rKernel,
+        bool     const   rbPush = true,
+        bool     const   rbPop  = true
+    )
+    {
+        size_t const nElementBytes = sizeof( *rVector.host );
+        size_t nChunkElements = ( rVector.nElements + mStreams.size() - 1 ) / mStreams.size();
+        if ( mProps.multiProcessorCount > 0 )
+            nChunkElements = planCudaPipeline( mProps, rVector.nElements * nElementBytes ).nChunkBytes / nElementBytes;
+        return run( rVector.host, rVector.gpuData(), rVector.nElements,
+                    std::max( nChunkElements, (size_t) 1 ), rKernel, rbPush, rbPop );
+    }
+
+private:
+    inline void init( int const rnStreams )
+    {
+        if ( rnStreams <= 0 )
+        {
+            std::stringstream msg;
+            msg << "[" << __FILENAME__ << "::CudaStreamPipeline] "
+                << "Need at least one stream, but got " << rnStreams;
+            throw std::invalid_argument( msg.str() );
+        }
+        mStreams.resize( rnStreams );
+        for ( auto & stream : mStreams )
+            check( cudaStreamCreate( &stream ), "create stream" );
+    }
+
+    static inline void check( cudaError_t const rError, char const * const rWhat )
+    {
+        if ( rError == cudaSuccess )
+            return;
+        std::stringstream msg;
+        msg << "[" << __FILENAME__ << "::CudaStreamPipeline] "
+            << "Failed to " << rWhat << ": " << cudaGetErrorString( rError );
+        throw std::runtime_error( msg.str() );
+    }
+
+    /* zeroed if the pipeline was created with a stream count */
+    cudaDeviceProp               mProps  ;
+    std::vector< cudaStream_t >  mStreams;
+};
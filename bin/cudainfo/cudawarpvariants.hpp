@@ -0,0 +1,278 @@
+/**
+ * The alternative formulations of the warp reductions and scans in
+ * gpuinfo.cu as named strategies, so that they can be benchmarked against
+ * each other, @see benchmarkwarpvariants.cpp, and the fastest one per
+ * architecture can be chosen at build time instead of with #if 0:
+ *
+ *   GPUINFO_WARP_REDUCE_SUM     UNROLLED, LOOP
+ *   GPUINFO_WARP_REDUCE_CUMSUM  SHFL_WIDTH, LOOP, MASKED_LANE
+ *   GPUINFO_VECTOR_ADD          SCALAR, SIMD_VIDEO (__vadd4, __vadd2)
+ *
+ * E.g. -DGPUINFO_WARP_REDUCE_SUM=GPUINFO_WARP_REDUCE_SUM_LOOP or
+ * -DGPUINFO_VARIANTS_HEADER='"gpuinfovariants.hpp"' for the header written
+ * by the benchmark. The defaults are the previously hard-coded choices.
+ *
+ * Each device variant has an emulated host version doing the same shuffle
+ * steps lane by lane on an array of 32 lanes, so that the suite also runs
+ * on machines without a GPU. Those are meant for comparing the
+ * formulations, for fast host code use cudahostwarp.hpp.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>                      // uint32_t
+
+#ifdef GPUINFO_VARIANTS_HEADER
+#   include GPUINFO_VARIANTS_HEADER
+#endif
+
+#define GPUINFO_WARP_REDUCE_SUM_UNROLLED        0
+#define GPUINFO_WARP_REDUCE_SUM_LOOP            1
+#define GPUINFO_WARP_REDUCE_CUMSUM_SHFL_WIDTH   0
+#define GPUINFO_WARP_REDUCE_CUMSUM_LOOP         1
+#define GPUINFO_WARP_REDUCE_CUMSUM_MASKED_LANE  2
+#define GPUINFO_VECTOR_ADD_SCALAR               0
+#define GPUINFO_VECTOR_ADD_SIMD_VIDEO           1
+
+#ifndef GPUINFO_WARP_REDUCE_SUM
+#   define GPUINFO_WARP_REDUCE_SUM GPUINFO_WARP_REDUCE_SUM_UNROLLED
+#endif
+#ifndef GPUINFO_WARP_REDUCE_CUMSUM
+#   define GPUINFO_WARP_REDUCE_CUMSUM GPUINFO_WARP_REDUCE_CUMSUM_SHFL_WIDTH
+#endif
+/* preliminary benchmarks indicated __vadd2 being slower than two adds */
+#ifndef GPUINFO_VECTOR_ADD
+#   define GPUINFO_VECTOR_ADD GPUINFO_VECTOR_ADD_SCALAR
+#endif
+
+
+#if defined( __CUDACC__ ) && ( ! defined( __CUDA_ARCH__ ) || __CUDA_ARCH__ >= 300 )
+
+/* since CUDA 9 the shuffles got a suffix '_sync' and a mask of the lanes */
+#if CUDART_VERSION >= 9000
+#   define TMP_SHFL( x, lane, width ) __shfl_sync     ( 0xFFFFFFFFu, x, lane, width )
+#   define TMP_SHFL_DOWN( x, delta )  __shfl_down_sync( 0xFFFFFFFFu, x, delta )
+#else
+#   define TMP_SHFL( x, lane, width ) __shfl     ( x, lane, width )
+#   define TMP_SHFL_DOWN( x, delta )  __shfl_down( x, delta )
+#endif
+
+template< typename T > __device__ inline
+T warpReduceSumLoop( T x )
+{
+    #pragma unroll
+    for ( int delta = warpSize >> 1; delta > 0; delta >>= 1 )
+        x += TMP_SHFL_DOWN( x, delta );
+    return x;
+}
+
+template< typename T > __device__ inline
+T warpReduceSumUnrolled( T x )
+{
+    assert( warpSize == 32 );
+    x += TMP_SHFL_DOWN( x, 16 );
+    x += TMP_SHFL_DOWN( x,  8 );
+    x += TMP_SHFL_DOWN( x,  4 );
+    x += TMP_SHFL_DOWN( x,  2 );
+    x += TMP_SHFL_DOWN( x,  1 );
+    return x;
+}
+
+template< typename T > __device__ inline
+T warpReduceCumSumLoop( T x )
+{
+    int const laneId = threadIdx.x & 0x1F;
+    for ( int width = 1; width < warpSize; width <<= 1 )
+    {
+        int const srcId = ( laneId & ~( width-1 ) ) - 1;
+        T const dx = TMP_SHFL( x, srcId, warpSize );
+        if ( laneId % ( width * 2 ) >= width )
+            x += dx;
+    }
+    return x;
+}
+
+/**
+ * using that l % 2^k is same as l &~( 2^k-1 ) and that
+ * x & 0b0001111 >= 0b0001000 would be the same as checking
+ * whether bit 4 was set, i.e. x & 0b0001000 != 0
+ */
+template< typename T > __device__ inline
+T warpReduceCumSumMaskedLane( T x )
+{
+    assert( warpSize == 32 );
+    int const laneId = threadIdx.x & 0x1F;
+    T dx;
+    dx = TMP_SHFL( x, ( laneId & 0xFFFF ) - 1, 32 ); if ( laneId %  2 >=  1 ) x += dx;
+    dx = TMP_SHFL( x, ( laneId & 0xFFFE ) - 1, 32 ); if ( laneId %  4 >=  2 ) x += dx;
+    dx = TMP_SHFL( x, ( laneId & 0xFFFC ) - 1, 32 ); if ( laneId %  8 >=  4 ) x += dx;
+    dx = TMP_SHFL( x, ( laneId & 0xFFF8 ) - 1, 32 ); if ( laneId % 16 >=  8 ) x += dx;
+    dx = TMP_SHFL( x, ( laneId & 0xFFF0 ) - 1, 32 ); if ( laneId % 32 >= 16 ) x += dx;
+    return x;
+}
+
+/**
+ * lastly use that __shfl( x, laneId & 0b111100 - 1 ) would be the same
+ * as __shfl( x, id = 0b11, width = 0b1000 )
+ */
+template< typename T > __device__ inline
+T warpReduceCumSumShflWidth( T x )
+{
+    assert( warpSize == 32 );
+    int const laneId = threadIdx.x & 0x1F;
+    T dx;
+    dx = TMP_SHFL( x,  0,  2 ); if ( laneId &  1 ) x += dx;
+    dx = TMP_SHFL( x,  1,  4 ); if ( laneId &  2 ) x += dx;
+    dx = TMP_SHFL( x,  3,  8 ); if ( laneId &  4 ) x += dx;
+    dx = TMP_SHFL( x,  7, 16 ); if ( laneId &  8 ) x += dx;
+    dx = TMP_SHFL( x, 15, 32 ); if ( laneId & 16 ) x += dx;
+    return x;
+}
+
+#undef TMP_SHFL
+#undef TMP_SHFL_DOWN
+
+/* byte-wise additions of 4 packed bytes, like operator+ for uchar4 */
+__device__ inline unsigned int vectorAddScalar( unsigned int const x, unsigned int const y )
+{
+    unsigned int z = 0;
+    #pragma unroll
+    for ( int i = 0; i < 32; i += 8 )
+        z |= ( ( ( x >> i ) + ( y >> i ) ) & 0xFFu ) << i;
+    return z;
+}
+
+__device__ inline unsigned int vectorAddSimdVideo( unsigned int const x, unsigned int const y )
+{
+    return __vadd4( x, y );
+}
+
+#endif // __CUDACC__ && __CUDA_ARCH__ >= 300
+
+
+/************************* emulated on the host *************************/
+
+/* lane i gets x[i+delta] or its own value if that is outside of the warp */
+template< typename T >
+inline void emulateShflDown( T const (&x)[32], int const delta, T (&y)[32] )
+{
+    for ( int lane = 0; lane < 32; ++lane )
+        y[ lane ] = lane + delta < 32 ? x[ lane + delta ] : x[ lane ];
+}
+
+/**
+ * lane i gets x of rSourceLane( i ) inside its subsection of rWidth lanes,
+ * i.e. the source lane is taken modulo the width like for __shfl
+ */
+template< typename T, typename T_SourceLane >
+inline void emulateShfl
+(
+    T            const (&x)[32]     ,
+    T_SourceLane const  &rSourceLane,
+    int          const   rWidth     ,
+    T                  (&y)[32]
+)
+{
+    for ( int lane = 0; lane < 32; ++lane )
+        y[ lane ] = x[ ( lane & ~( rWidth - 1 ) ) + ( rSourceLane( lane ) & ( rWidth - 1 ) ) ];
+}
+
+/* the emulated reductions return lane 0, the scans work in place */
+template< typename T >
+inline T emulatedWarpReduceSumLoop( T (&x)[32] )
+{
+    T dx[32];
+    for ( int delta = 16; delta > 0; delta >>= 1 )
+    {
+        emulateShflDown( x, delta, dx );
+        for ( int lane = 0; lane < 32; ++lane )
+            x[ lane ] += dx[ lane ];
+    }
+    return x[0];
+}
+
+template< typename T >
+inline T emulatedWarpReduceSumUnrolled( T (&x)[32] )
+{
+    T dx[32];
+    #define TMP_STEP( DELTA )                       \
+    emulateShflDown( x, DELTA, dx );                \
+    for ( int lane = 0; lane < 32; ++lane )         \
+        x[ lane ] += dx[ lane ];
+    TMP_STEP( 16 )
+    TMP_STEP(  8 )
+    TMP_STEP(  4 )
+    TMP_STEP(  2 )
+    TMP_STEP(  1 )
+    #undef TMP_STEP
+    return x[0];
+}
+
+template< typename T >
+inline void emulatedWarpReduceCumSumLoop( T (&x)[32] )
+{
+    T dx[32];
+    for ( int width = 1; width < 32; width <<= 1 )
+    {
+        emulateShfl( x, [width]( int const lane ){ return ( lane & ~( width-1 ) ) - 1; }, 32, dx );
+        for ( int lane = 0; lane < 32; ++lane )
+        {
+            if ( lane % ( width * 2 ) >= width )
+                x[ lane ] += dx[ lane ];
+        }
+    }
+}
+
+template< typename T >
+inline void emulatedWarpReduceCumSumMaskedLane( T (&x)[32] )
+{
+    T dx[32];
+    #define TMP_STEP( MASK, MODULO )                                            \
+    emulateShfl( x, []( int const lane ){ return ( lane & MASK ) - 1; }, 32, dx ); \
+    for ( int lane = 0; lane < 32; ++lane )                                     \
+    {                                                                           \
+        if ( lane % MODULO >= MODULO / 2 )                                      \
+            x[ lane ] += dx[ lane ];                                            \
+    }
+    TMP_STEP( 0xFFFF,  2 )
+    TMP_STEP( 0xFFFE,  4 )
+    TMP_STEP( 0xFFFC,  8 )
+    TMP_STEP( 0xFFF8, 16 )
+    TMP_STEP( 0xFFF0, 32 )
+    #undef TMP_STEP
+}
+
+template< typename T >
+inline void emulatedWarpReduceCumSumShflWidth( T (&x)[32] )
+{
+    T dx[32];
+    #define TMP_STEP( SOURCE, WIDTH )                                           \
+    emulateShfl( x, []( int ){ return SOURCE; }, WIDTH, dx );                   \
+    for ( int lane = 0; lane < 32; ++lane )                                     \
+    {                                                                           \
+        if ( lane & ( WIDTH / 2 ) )                                             \
+            x[ lane ] += dx[ lane ];                                            \
+    }
+    TMP_STEP(  0,  2 )
+    TMP_STEP(  1,  4 )
+    TMP_STEP(  3,  8 )
+    TMP_STEP(  7, 16 )
+    TMP_STEP( 15, 32 )
+    #undef TMP_STEP
+}
+
+inline uint32_t emulatedVectorAddScalar( uint32_t const x, uint32_t const y )
+{
+    uint32_t z = 0;
+    for ( int i = 0; i < 32; i += 8 )
+        z |= ( ( ( x >> i ) + ( y >> i ) ) & 0xFFu ) << i;
+    return z;
+}
+
+/* __vadd4 as SIMD within a register: add the lower 7 bits of each byte
+ * and put the sum of the highest bits back in without carrying over */
+inline uint32_t emulatedVectorAddSimdVideo( uint32_t const x, uint32_t const y )
+{
+    return ( ( x & 0x7F7F7F7Fu ) + ( y & 0x7F7F7F7Fu ) ) ^ ( ( x ^ y ) & 0x80808080u );
+}
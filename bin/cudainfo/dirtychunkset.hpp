@@ -0,0 +1,150 @@
+/**
+ * Bitmap of modified fixed-size chunks of a buffer, used by MirroredVector
+ * to only transfer what has changed. Marking is O(1) per chunk and can be
+ * done per element access. Iterating coalesces adjacent dirty chunks into
+ * as few ranges as possible and skips 64 clean chunks at once, so that
+ * even for multi-GB buffers with 4 KiB chunks a push or pop which copies
+ * almost nothing is cheap.
+ */
+
+#pragma once
+
+#include <algorithm>                    // min
+#include <cassert>
+#include <cstddef>                      // size_t
+#include <cstdint>                      // uint64_t
+#include <vector>
+
+
+class DirtyChunkSet
+{
+public:
+    inline DirtyChunkSet
+    (
+        size_t const rnBytes      = 0,
+        size_t const rnChunkBytes = 4096
+    )
+    {
+        reset( rnBytes, rnChunkBytes );
+    }
+
+    /* resizes and marks everything clean */
+    inline void reset
+    (
+        size_t const rnBytes     ,
+        size_t const rnChunkBytes
+    )
+    {
+        assert( rnChunkBytes > 0 );
+        mnBytes      = rnBytes;
+        mnChunkBytes = rnChunkBytes;
+        mnChunks     = ( rnBytes + rnChunkBytes - 1 ) / rnChunkBytes;
+        mWords.assign( ( mnChunks + 63 ) / 64, 0 );
+    }
+
+    /* changes the size keeping the marks, added chunks are clean */
+    inline void resize( size_t const rnBytes )
+    {
+        mnBytes  = rnBytes;
+        mnChunks = ( rnBytes + mnChunkBytes - 1 ) / mnChunkBytes;
+        mWords.resize( ( mnChunks + 63 ) / 64, 0 );
+        /* chunks beyond the end must stay clean for growing again */
+        if ( mnChunks % 64 != 0 )
+            mWords.back() &= ( uint64_t( 1 ) << ( mnChunks % 64 ) ) - 1;
+    }
+
+    /* marks all chunks overlapping with the bytes [rBegin, rEnd) */
+    inline void mark
+    (
+        size_t const rBegin,
+        size_t const rEnd
+    )
+    {
+        assert( rBegin <= rEnd && rEnd <= mnBytes );
+        if ( rBegin >= rEnd )
+            return;
+        size_t const iLast = ( rEnd - 1 ) / mnChunkBytes;
+        for ( size_t iChunk = rBegin / mnChunkBytes; iChunk <= iLast; ++iChunk )
+            mWords[ iChunk / 64 ] |= uint64_t( 1 ) << ( iChunk % 64 );
+    }
+
+    inline void markByte( size_t const rPosition )
+    {
+        assert( rPosition < mnBytes );
+        size_t const iChunk = rPosition / mnChunkBytes;
+        mWords[ iChunk / 64 ] |= uint64_t( 1 ) << ( iChunk % 64 );
+    }
+
+    inline void markAll( void )
+    {
+        mark( 0, mnBytes );
+    }
+
+    inline void clear( void )
+    {
+        mWords.assign( mWords.size(), 0 );
+    }
+
+    inline bool empty( void ) const
+    {
+        for ( auto const word : mWords )
+            if ( word != 0 )
+                return false;
+        return true;
+    }
+
+    inline size_t chunkBytes( void ) const { return mnChunkBytes; }
+    inline size_t size      ( void ) const { return mnBytes     ; }
+
+    inline bool isDirty( size_t const iChunk ) const
+    {
+        return ( mWords[ iChunk / 64 ] >> ( iChunk % 64 ) ) & 1;
+    }
+
+    /**
+     * Calls rFunctor( iByteBegin, nBytes ) for each maximal run of dirty
+     * chunks. The last range is clipped to the buffer size.
+     * @return number of ranges
+     */
+    template< typename T_Functor >
+    inline size_t forEachRange( T_Functor const & rFunctor ) const
+    {
+        size_t nRanges = 0;
+        size_t iChunk  = 0;
+        while ( iChunk < mnChunks )
+        {
+            /* skip whole clean words */
+            if ( iChunk % 64 == 0 && mWords[ iChunk / 64 ] == 0 )
+            {
+                iChunk += 64;
+                continue;
+            }
+            if ( ! isDirty( iChunk ) )
+            {
+                ++iChunk;
+                continue;
+            }
+            size_t const iBegin = iChunk;
+            while ( iChunk < mnChunks && isDirty( iChunk ) )
+                ++iChunk;
+            size_t const iByteBegin = iBegin * mnChunkBytes;
+            size_t const iByteEnd   = std::min( iChunk * mnChunkBytes, mnBytes );
+            rFunctor( iByteBegin, iByteEnd - iByteBegin );
+            ++nRanges;
+        }
+        return nRanges;
+    }
+
+    inline size_t countDirtyBytes( void ) const
+    {
+        size_t nBytes = 0;
+        forEachRange( [&nBytes]( size_t, size_t const n ){ nBytes += n; } );
+        return nBytes;
+    }
+
+private:
+    size_t                  mnBytes     ;
+    size_t                  mnChunkBytes;
+    size_t                  mnChunks    ;
+    std::vector< uint64_t > mWords      ;
+};
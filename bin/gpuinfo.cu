@@ -15,10 +15,20 @@
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
+#include <type_traits>                  // enable_if, is_arithmetic
 #ifdef __CUDACC__
 #   include <cuda_runtime_api.h>
 #   include <cuda.h>                    // cuDeviceGetAttribute
 #endif
+#include "cudainfo/cudaarchitectures.hpp" // getCudaArchitecture
+#include "cudainfo/cudadevicecache.hpp" // getCudaDeviceSnapshots
+#include "cudainfo/cudalaunchplanner.hpp" // getCudaLaunchPlanner
+#include "cudainfo/cudaoccupancy.hpp" // findBestCudaBlockSizes
+#include "cudainfo/cudaroofline.hpp" // makeCudaRoofline, placeOnRoofline
+#include "cudainfo/cudaformat.hpp" // formatInteger, formatFloat
+#include "cudainfo/cudadevicereport.hpp" // makeCudaDeviceReport, writeCudaDeviceReports
+#include "cudainfo/cudawarpvariants.hpp" // GPUINFO_WARP_REDUCE_SUM, warpReduceSumLoop
+#include "cudainfo/cudapeertopology.hpp" // getCudaPeerTopology, printCudaPeerTopology
 
 
 #define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
@@ -132,9 +142,10 @@ TMP_CUDAVECS_UI( int64_t, long  )
  * like this by default at least not in CUDA 7 ...
  * @see http://docs.nvidia.com/cuda/cuda-c-programming-guide/index.html#simd-video
  * preliminary benchmarks indicated using __vadd2 being slower than two normal
- * adds, therefore deactivate wtih false
+ * adds, therefore deactivated by default, @see GPUINFO_VECTOR_ADD in
+ * cudainfo/cudawarpvariants.hpp for measuring and selecting it
  */
-#if defined( __CUDA_ARCH__ ) && __CUDA_ARCH__ >= 300 & false
+#if defined( __CUDA_ARCH__ ) && __CUDA_ARCH__ >= 300 && GPUINFO_VECTOR_ADD == GPUINFO_VECTOR_ADD_SIMD_VIDEO
 #   define TMP_OPERATORP_UI4( UI )                                             \
     __device__ inline UI##char4 operator+                                      \
     (                                                                          \
@@ -271,23 +282,17 @@ __device__ inline ulong4 operator+( ulong4 const & x, ulong4 const & y ) {
  * +-+-+-+-+-+-+-+-+
  * @endverbatim
  * @see https://devblogs.nvidia.com/faster-parallel-reductions-kepler/
+ * @see cudainfo/cudahostwarp.hpp for the host versions working on whole warps
+ * @see cudainfo/cudawarpvariants.hpp for the loop and unrolled versions
  */
 template< typename T > __inline__ __device__
 T warpReduceSum( T x )
 {
-#if 0
-    #pragma unroll
-    for ( int delta = warpSize >> 1; delta > 0; delta >>= 1 )
-        x += __shfl_down( x, delta );
+#if GPUINFO_WARP_REDUCE_SUM == GPUINFO_WARP_REDUCE_SUM_LOOP
+    return warpReduceSumLoop( x );
 #else
-    assert( warpSize == 32 );
-    x += __shfl_down( x, 16 );
-    x += __shfl_down( x,  8 );
-    x += __shfl_down( x,  4 );
-    x += __shfl_down( x,  2 );
-    x += __shfl_down( x,  1 );
+    return warpReduceSumUnrolled( x );
 #endif
-    return x;
 }
 
 template< typename T > __inline__ __device__
@@ -364,49 +369,22 @@ T warpAllReduceSum( T x )
  * @see http://docs.nvidia.com/cuda/cuda-c-programming-guide/#warp-shuffle-functions
  *   -> since CUDA 9 they got renamed to have a suffix '_sync'
  * Actually we could delegate some of the bitmasking to CUDA by using the
- * width parameter!
+ * width parameter! The three formulations, i.e. looping over the widths,
+ * masking the lane IDs and using the width parameter, are in
+ * cudainfo/cudawarpvariants.hpp, which one is used is chosen by
+ * GPUINFO_WARP_REDUCE_CUMSUM.
  */
 template< typename T > __device__ inline
 T warpReduceCumSum( T x )
 {
-    /* todo */
-    assert( warpSize == 32 );
     /* first calculate y_i = \sum_{k=0}^{2^i}  x_i */
-    /* & (32-1) -> laneID, not sure if faster than % warpSize */;
-    int const laneId = threadIdx.x & 0x1F;
-#if 0
-    for ( int width = 1; width < warpSize; width <<= 1 )
-    {
-        int const srcId = ( laneId & ~( width-1 ) ) - 1;
-        int const dx = __shfl( x, srcId );
-        if ( laneId % ( width * 2 ) >= width )
-            x += dx;
-    }
+#if GPUINFO_WARP_REDUCE_CUMSUM == GPUINFO_WARP_REDUCE_CUMSUM_LOOP
+    return warpReduceCumSumLoop( x );
+#elif GPUINFO_WARP_REDUCE_CUMSUM == GPUINFO_WARP_REDUCE_CUMSUM_MASKED_LANE
+    return warpReduceCumSumMaskedLane( x );
 #else
-    T dx;
-    assert( warpSize == 32 );
-    /**
-     * using that l % 2^k is same as l &~( 2^k-1 ) and that
-     * x & 0b0001111 >= 0b0001000 would be the same as checking
-     * whether bit 4 was set, i.e. x & 0b0001000 != 0
-     * lastly use that __shfl( x, laneId & 0b111100 - 1 )
-     * would be the same as as: __shfl( x, id = 0b11, width = 0b1000 )
-     */
-    #if 0
-        dx = __shfl( x, ( laneId & 0xFFFF ) - 1 ); if ( laneId %  2 >=  1 ) x += dx;
-        dx = __shfl( x, ( laneId & 0xFFFE ) - 1 ); if ( laneId %  4 >=  2 ) x += dx;
-        dx = __shfl( x, ( laneId & 0xFFFC ) - 1 ); if ( laneId %  8 >=  4 ) x += dx;
-        dx = __shfl( x, ( laneId & 0xFFF8 ) - 1 ); if ( laneId % 16 >=  8 ) x += dx;
-        dx = __shfl( x, ( laneId & 0xFFF0 ) - 1 ); if ( laneId % 32 >= 16 ) x += dx;
-    #else
-        dx = __shfl( x,  0,  2 ); if ( laneId &  1 ) x += dx;
-        dx = __shfl( x,  1,  4 ); if ( laneId &  2 ) x += dx;
-        dx = __shfl( x,  3,  8 ); if ( laneId &  4 ) x += dx;
-        dx = __shfl( x,  7, 16 ); if ( laneId &  8 ) x += dx;
-        dx = __shfl( x, 15, 32 ); if ( laneId & 16 ) x += dx;
-    #endif
+    return warpReduceCumSumShflWidth( x );
 #endif
-    return x;
 }
 
 /**
@@ -437,6 +415,7 @@ __device__ inline int warpReduceSumPredicate( bool const x )
  *
  * Giving a __shared__ memory pointer like this only works for
  * __CUDA_ARCH__ >= 200
+ * @see cudainfo/cudadevicescan.hpp for scans and compaction over all blocks
  */
 __device__ inline int blockReduceCumSumPredicate( bool const x, int * const smBuffer )
 {
@@ -576,10 +555,9 @@ inline T ceilDiv( T a, S b )
 /**
  * Given the number of bytes, this function prints out an exact human
  * readable format, e.g. 128427:
- *   logical: 125 MiB 427 B
- *   SI     : 128 MB 427 B
- * Wasn't intented, but in both representations the amount of bytes are
- * identical for this number. (This works if xMiB * 1024 ends on 000)
+ *   logical: 125 kiB 427 B
+ *   SI     : 128 kB 427 B
+ * @see formatBytes
  */
 inline std::string prettyPrintBytes
 (
@@ -587,27 +565,8 @@ inline std::string prettyPrintBytes
     bool   const logical = true
 )
 {
-    char const suffixes[] = { ' ', 'k', 'M', 'G', 'T', 'P', 'E', 'Z', 'Y' };
-    std::stringstream out;
-    std::vector< size_t > parts;
-    for ( unsigned i = 0u; i < sizeof( suffixes ); ++i )
-    {
-        parts.push_back( bytes % size_t( 1024 ) );
-        bytes /= size_t( 1024 );
-        if ( bytes == 0 )
-            break;
-    }
-    assert( parts.size() > 0 );
-    for ( int i = (int) parts.size()-1; i >= 0; --i )
-    {
-        if ( i != (int) parts.size()-1 && parts.at(i) == 0 )
-            continue;
-        out << parts[i] << " " << suffixes[i] << ( logical ? "i" : "" )
-            << "B" << ( i > 0 ? " " : "" );
-    }
-    std::string result = out.str();
-    result.erase( result.size()-1, 1 );
-    return result;
+    char buffer[ nMaxFormattedBytesChars ];
+    return std::string( buffer, formatBytes( buffer, bytes, logical ) );
 }
 
 #if defined( __CUDACC__ )
@@ -630,49 +589,21 @@ inline std::string prettyPrintBytes
  */
 inline void calcKernelConfig( int iDevice, uint64_t n, int * nBlocks, int * nThreads )
 {
-    int const nMaxThreads  = 256;
-    int const nMinElements = 32; /* The assumption: one kernel with nMinElements work won't be much slower than nMinElements kernels with each 1 work element. Of course this is workload / kernel dependent, so the fixed value may not be the best idea */
-
-    /* set current device and get device infos */
-    int nDevices;
-    CUDA_ERROR( cudaGetDeviceCount( &nDevices ) );
-    assert( iDevice < nDevices );
+    /* callers rely on iDevice being current for the following launch */
     CUDA_ERROR( cudaSetDevice( iDevice ) );
+    /* The planner is created once per device from the cached properties and
+     * memoizes the block size, so this is O(1) and doesn't need to query the
+     * device. The former nMinElements = 32 and at most 256 threads per block
+     * are the defaults of CudaKernelResources and of the block size
+     * tie-break respectively. */
+    CudaLaunchConfig const config = getCudaLaunchPlanner( iDevice ).plan( n );
+    *nBlocks  = config.nBlocks.x;
+    *nThreads = config.nThreads.x;
 
-    // for GTX 760 this is 12288 threads per device and 384 real cores
-    cudaDeviceProp deviceProperties;
-    CUDA_ERROR( cudaGetDeviceProperties( &deviceProperties, iDevice) );
-
-    int const nMaxThreadsGpu = deviceProperties.maxThreadsPerMultiProcessor
-                             * deviceProperties.multiProcessorCount;
-    if ( n < (uint64_t) nMaxThreadsGpu * nMinElements )
-    {
-        uint64_t const nThreadsNeeded = ceilDiv( n, nMinElements );
-        *nBlocks  = ceilDiv( nThreadsNeeded, nMaxThreads );
-        *nThreads = nMaxThreads;
-        if ( *nBlocks == 1 )
-        {
-            assert( nThreadsNeeded <= nMaxThreads );
-            *nThreads = nThreadsNeeded;
-        }
-    }
-    else
-    {
-        *nBlocks  = nMaxThreadsGpu / nMaxThreads;
-        *nThreads = nMaxThreads;
-    }
     assert( *nBlocks > 0 );
     assert( *nThreads > 0 );
-    uint64_t nIterations = 0;
-    for ( uint64_t linid = 0; linid < (uint64_t) *nBlocks * *nThreads; ++linid )
-    {
-        /* note that this only works if linid < n */
-        assert( linid < n );
-        nIterations += (n-linid-1) / ( *nBlocks * *nThreads ) + 1;
-        //printf( "[thread %i] %i elements\n", linid, (n-linid) / ( *nBlocks * *nThreads ) );
-    }
-    //printf( "Total %i elements out of %i wanted\n", nIterations, n );
-    assert( nIterations == n );
+    /* the derivation above only works if linid < n for all threads */
+    assert( (uint64_t) *nBlocks * *nThreads <= n );
 }
 
 
@@ -796,94 +727,53 @@ static std::map< std::string, std::vector< int > > sCudaInstructionThroughput =
  *      from CUDA Toolkit v9.0.176
  * @see http://docs.nvidia.com/cuda/cuda-c-programming-guide/index.html#arithmetic-instructions
  **/
-inline int getCudaCoresPerMultiprocessor
+__host__ __device__ constexpr int getCudaCoresPerMultiprocessor
 (
     int const majorVersion,
     int const minorVersion
 )
 {
-    if ( majorVersion == 2 && minorVersion == 0 ) /* Fermi   */ return 32 ;
-    if ( majorVersion == 2 && minorVersion == 1 ) /* Fermi   */ return 48 ;
-    if ( majorVersion == 3 )                      /* Kepler  */ return 192;
-    if ( majorVersion == 5 )                      /* Maxwell */ return 128;
-    if ( majorVersion == 6 && minorVersion == 0 ) /* Pascal  */ return 64 ;
-    if ( majorVersion == 6 && minorVersion == 1 ) /* Pascal  */ return 128;
-    if ( majorVersion == 6 && minorVersion == 2 ) /* Pascal  */ return 128;
-    if ( majorVersion == 7 )                      /* Volta   */ return 64 ;
-    return 0; /* unknown, could also throw exception */
+    return getCudaArchitecture( majorVersion, minorVersion ).nCoresPerMultiprocessor;
 }
 
-inline int getSpecialFunctionUnitsPerMultiprocessor
+__host__ __device__ constexpr int getSpecialFunctionUnitsPerMultiprocessor
 (
     int const majorVersion,
     int const minorVersion
 )
 {
-    if ( majorVersion == 3 )                      /* Kepler  */ return 32;
-    if ( majorVersion == 5 )                      /* Maxwell */ return 32;
-    if ( majorVersion == 6 && minorVersion == 0 ) /* Pascal  */ return 16;
-    if ( majorVersion == 6 && minorVersion == 1 ) /* Pascal  */ return 32;
-    if ( majorVersion == 6 && minorVersion == 2 ) /* Pascal  */ return 32;
-    if ( majorVersion == 7 )                      /* Volta   */ return 16;
-    return 0; /* unknown, could also throw exception */
+    return getCudaArchitecture( majorVersion, minorVersion ).nSpecialFunctionUnitsPerMultiprocessor;
 }
 
-inline int getWarpSchedulersPerMultiprocessor
+__host__ __device__ constexpr int getWarpSchedulersPerMultiprocessor
 (
     int const majorVersion,
     int const minorVersion
 )
 {
-    if ( majorVersion == 3 )                      /* Kepler  */ return 4;
-    if ( majorVersion == 5 )                      /* Maxwell */ return 4;
-    if ( majorVersion == 6 && minorVersion == 0 ) /* Pascal  */ return 2;
-    if ( majorVersion == 6 && minorVersion == 1 ) /* Pascal  */ return 4;
-    if ( majorVersion == 6 && minorVersion == 2 ) /* Pascal  */ return 4;
-    if ( majorVersion == 7 )                      /* Volta   */ return 4;
-    return 0; /* unknown, could also throw exception */
+    return getCudaArchitecture( majorVersion, minorVersion ).nWarpSchedulersPerMultiprocessor;
 }
 
-inline int getDoublePrecisionUnitsPerMultiprocessor
+__host__ __device__ constexpr int getDoublePrecisionUnitsPerMultiprocessor
 (
     int const majorVersion,
     int const minorVersion
 )
 {
-    if ( majorVersion == 3 && minorVersion == 0 ) /* Kepler  */ return 8 ;
-    if ( majorVersion == 3 && minorVersion == 2 ) /* Kepler  */ return 8 ;
-    if ( majorVersion == 3 && minorVersion == 5 ) /* Kepler  */ return 64; /* 8 for GeForce GPUs .. how to differentiate? */
-    if ( majorVersion == 3 && minorVersion == 7 ) /* Kepler  */ return 64;
-    if ( majorVersion == 5 )                      /* Maxwell */ return 4 ;
-    if ( majorVersion == 6 && minorVersion == 0 ) /* Pascal  */ return 32;
-    if ( majorVersion == 6 && minorVersion == 1 ) /* Pascal  */ return 4 ;
-    if ( majorVersion == 6 && minorVersion == 2 ) /* Pascal  */ return 4 ;
-    if ( majorVersion == 7 )                      /* Volta   */ return 32;
-    return 0; /* unknown, could also throw exception */
+    return getCudaArchitecture( majorVersion, minorVersion ).nDoublePrecisionUnitsPerMultiprocessor;
 }
 
 /**
  * @see http://docs.nvidia.com/cuda/cuda-c-programming-guide/index.html#compute-capabilities
  *      from CUDA Toolkit v9.0.176
  **/
-inline int getCudaMaxConcurrentKernels
+__host__ __device__ constexpr int getCudaMaxConcurrentKernels
 (
     int const majorVersion,
     int const minorVersion
 )
 {
-    if ( majorVersion == 2 ) /* Fermi */ return 0;
-    if ( majorVersion == 3 && minorVersion == 0 ) /* Kepler  */ return 16 ;
-    if ( majorVersion == 3 && minorVersion == 2 ) /* Kepler  */ return 4  ;
-    if ( majorVersion == 3 && minorVersion == 5 ) /* Kepler  */ return 32 ;
-    if ( majorVersion == 3 && minorVersion == 7 ) /* Kepler  */ return 32 ;
-    if ( majorVersion == 5 && minorVersion == 0 ) /* Maxwell */ return 32 ;
-    if ( majorVersion == 5 && minorVersion == 2 ) /* Maxwell */ return 32 ;
-    if ( majorVersion == 5 && minorVersion == 3 ) /* Maxwell */ return 16 ;
-    if ( majorVersion == 6 && minorVersion == 0 ) /* Pascal  */ return 128;
-    if ( majorVersion == 6 && minorVersion == 1 ) /* Pascal  */ return 32 ;
-    if ( majorVersion == 6 && minorVersion == 2 ) /* Pascal  */ return 16 ;
-    if ( majorVersion == 7 && minorVersion == 0 ) /* Volta   */ return 128;
-    return 0;   /* unknown, could also throw exception */
+    return getCudaArchitecture( majorVersion, minorVersion ).nMaxConcurrentKernels;
 }
 
 /**
@@ -893,15 +783,10 @@ inline int getCudaMaxConcurrentKernels
 inline std::string getCudaCodeName
 (
     int const majorVersion,
-    int const = 0
+    int const minorVersion = 0
 )
 {
-    if ( majorVersion == 2 ) return "Fermi"  ;
-    if ( majorVersion == 3 ) return "Kepler" ;
-    if ( majorVersion == 5 ) return "Maxwell";
-    if ( majorVersion == 6 ) return "Pascal" ;
-    if ( majorVersion == 7 ) return "Volta"  ;
-    return 0; /* unknown, could also throw exception */
+    return getCudaArchitecture( majorVersion, minorVersion ).codeName;
 }
 
 
@@ -918,64 +803,45 @@ inline std::string getCudaCodeName
  */
 inline float getCudaPeakSPFlops( cudaDeviceProp const & props )
 {
-    return (float) props.multiProcessorCount * props.clockRate /* kHz */ * 1e3f *
-        getCudaCoresPerMultiprocessor( props.major, props.minor ) * 2 /* FMA */;
+    return (float) getCudaPeakFmaFlops( props.multiProcessorCount, props.clockRate,
+        getCudaCoresPerMultiprocessor( props.major, props.minor ) );
 }
 
 inline float getCudaPeakDPFlops( cudaDeviceProp const & props )
 {
-    return (float) props.multiProcessorCount * props.clockRate /* kHz */ * 1e3f *
-        getDoublePrecisionUnitsPerMultiprocessor( props.major, props.minor ) * 2 /* FMA */;
+    return (float) getCudaPeakFmaFlops( props.multiProcessorCount, props.clockRate,
+        getDoublePrecisionUnitsPerMultiprocessor( props.major, props.minor ) );
 }
 
 
-#include <sstream>
-
 inline std::string getCudaCacheConfigString( void )
 {
-    std::stringstream out;
-    out << "Prefer ";
     cudaFuncCache funcCache;
     cudaDeviceGetCacheConfig( &funcCache );
-    switch ( funcCache )
-    {
-        case cudaFuncCachePreferNone  : out << "None"  ; break;
-        case cudaFuncCachePreferShared: out << "Shared"; break;
-        case cudaFuncCachePreferL1    : out << "L1"    ; break;
-        case cudaFuncCachePreferEqual : out << "Equal" ; break;
-        default: printf( "?" );
-    }
-    return out.str();
+    return getCudaCacheConfigName( funcCache );
 }
 
 inline std::string getCudaSharedMemBankSizeString( void )
 {
-    std::stringstream out;
     cudaSharedMemConfig config;
     cudaDeviceGetSharedMemConfig( &config );
-    switch ( config )
-    {
-        case cudaSharedMemBankSizeDefault  : out << "Default"; break;
-        case cudaSharedMemBankSizeFourByte : out << "4 Bytes"; break;
-        case cudaSharedMemBankSizeEightByte: out << "8 Bytes"; break;
-        default: printf( "?" );
-    }
-    return out.str();
+    return getCudaSharedMemBankSizeName( config );
 }
 
 
 inline std::string printSharedMemoryConfig( void )
 {
-    std::stringstream out;
-    out << "[Shared Memory] Config: " << getCudaCacheConfigString()
-        << ", Bank Size: " << getCudaSharedMemBankSizeString() << "\n";
-    return out.str();
+    return std::string( "[Shared Memory] Config: " ) + getCudaCacheConfigString()
+           + ", Bank Size: " + getCudaSharedMemBankSizeString() + "\n";
 }
 
 /**
- * @param[out] rpDeviceProperties - Array of cudaDeviceProp of length rnDevices
- *             the user will need to free (C-style) this data on program exit!
- * @param[out] rnDevices - will hold number of cuda devices
+ * @return properties of all cuda devices in device order
+ * @param[in] rPrintInfo - print the properties as table to stdout
+ *
+ * The properties and additional attributes are read from the snapshot
+ * cached on disk, if it is still valid, @see cudadevicecache.hpp. On a
+ * cache miss the devices are queried concurrently, @see queryCudaDeviceSnapshots
  *
  * @see https://www.cs.cmu.edu/afs/cs/academic/class/15668-s11/www/cuda-doc/html/structcudaDeviceProp.html
  * Most of these can also be queried using cuDeviceGetAttribute from the
@@ -983,230 +849,73 @@ inline std::string printSharedMemoryConfig( void )
  * @see http://docs.nvidia.com/cuda/cuda-driver-api/group__CUDA__DEVICE.html
  *      v9.0.176
  */
-inline void getCudaDeviceProperties
+inline std::vector< cudaDeviceProp > getCudaDeviceProperties
 (
-    cudaDeviceProp **       rpDeviceProperties = NULL,
-    int             *       rnDevices          = NULL,
-    bool              const rPrintInfo         = true
+    bool const rPrintInfo = true
 )
 {
-    printf( "Getting Device Informations. As this is the first command, "
-            "it can take ca.30s, because the GPU must be initialized.\n" );
-    fflush( stdout );
-
-    int fallbackNDevices;
-    if ( rnDevices == NULL )
-        rnDevices = &fallbackNDevices;
-    CUDA_ERROR( cudaGetDeviceCount( rnDevices ) );
-
-    cudaDeviceProp * fallbackPropArray;
-    if ( rpDeviceProperties == NULL )
-        rpDeviceProperties = &fallbackPropArray;
-    *rpDeviceProperties = (cudaDeviceProp*) malloc( (*rnDevices) * sizeof(cudaDeviceProp) );
-    assert( *rpDeviceProperties != NULL );
-
-    for ( int iDevice = 0; iDevice < (*rnDevices); ++iDevice )
+    /* only the first query is slow, later runs use the on-disk snapshot */
+    CudaDeviceSnapshotKey const snapshotKey = probeCudaDeviceSnapshotKey();
+    std::vector< CudaDeviceSnapshot > snapshots;
+    if ( ! loadCudaDeviceSnapshots( &snapshots, getCudaDeviceCachePath(), snapshotKey ) )
+    {
+        fprintf( stderr, "Getting Device Informations. As this is the first command, "
+                 "it can take ca.30s, because the GPU must be initialized.\n" );
+        queryCudaDeviceSnapshots( &snapshots );
+        saveCudaDeviceSnapshots( snapshots, getCudaDeviceCachePath(), snapshotKey );
+    }
+
+    std::vector< cudaDeviceProp > properties( snapshots.size() );
+
+    /* one report reused for all devices, all written with one buffer */
+    BufferedWriter out( stdout );
+    CudaDeviceReport report;
+    for ( int iDevice = 0; iDevice < (int) snapshots.size(); ++iDevice )
     {
-        cudaDeviceProp * prop = &( (*rpDeviceProperties)[iDevice] );
-        CUDA_ERROR( cudaGetDeviceProperties( prop, iDevice ) );
+        cudaDeviceProp * prop = &properties[ iDevice ];
+        *prop = snapshots[ iDevice ].properties;
 
         if ( not rPrintInfo )
             continue;
 
         if ( iDevice == 0 && prop->major == 9999 && prop->minor == 9999 )
-            printf("There is no device supporting CUDA.\n");
+            out.write( "There is no device supporting CUDA.\n" );
 
-        const char cms[5][20] =
-            { "Default", "Exclusive", "Prohibited", "ExclusiveProcess", "Unknown" };
-        const char * computeModeString;
-        switch ( prop->computeMode )
+        makeCudaDeviceReport( snapshots[ iDevice ], iDevice, report );
+        writeCudaDeviceReportTable( out, report );
+        out.write( "|-------------------- Occupancy ---------------------\n" )
+           .write( "| Regs | Shared Mem | Block | Blocks/MP | Occupancy | Limited by\n" );
         {
-            case cudaComputeModeDefault          : computeModeString = cms[0];
-            case cudaComputeModeExclusive        : computeModeString = cms[1];
-            case cudaComputeModeProhibited       : computeModeString = cms[2];
-            case cudaComputeModeExclusiveProcess : computeModeString = cms[3];
-            default                              : computeModeString = cms[4];
+            int    const registerBudgets[] = { 16, 32, 64, 128, 255 };
+            size_t const sharedBudgets  [] = { 0, 4*1024, 16*1024, 48*1024 };
+            for ( auto const nRegisters : registerBudgets )
+            for ( auto const nBytesShared : sharedBudgets )
+            {
+                char row[ 128 ];
+                std::vector< CudaOccupancy > const best = findBestCudaBlockSizes(
+                    *prop, CudaKernelResources( nRegisters, nBytesShared ), 1 );
+                if ( best.empty() )
+                {
+                    snprintf( row, sizeof( row ), "| %4i | %7lu kB |     - |         - |         - | %s\n",
+                              nRegisters, (unsigned long) nBytesShared / 1024,
+                              getCudaOccupancyLimiterString( CudaOccupancyInfeasible ) );
+                }
+                else
+                {
+                    snprintf( row, sizeof( row ), "| %4i | %7lu kB | %5i | %9i | %8.1f%% | %s\n",
+                              nRegisters, (unsigned long) nBytesShared / 1024,
+                              best[0].nThreadsPerBlock, best[0].nBlocksPerMultiprocessor,
+                              100 * best[0].occupancy(),
+                              getCudaOccupancyLimiterString( best[0].limiter ) );
+                }
+                out.write( row );
+            }
         }
-        int const coresPerSM = getCudaCoresPerMultiprocessor( prop->major, prop->minor );
-
-        /**
-         * @see http://docs.nvidia.com/cuda/cuda-driver-api/group__CUDA__TYPES.html#group__CUDA__TYPES_1ge12b8a782bebe21b1ac0091bf9f4e2a3
-         * List of attributes not included in device properties:
-         */
-        #define TMP_ATTRIBUTE( VARNAME, NUMBER ) \
-        int VARNAME = -1;                        \
-        if ( NUMBER < CU_DEVICE_ATTRIBUTE_MAX )  \
-            cuDeviceGetAttribute( &VARNAME, (CUdevice_attribute) NUMBER, iDevice );
-        /*
-        CU_DEVICE_ATTRIBUTE_MAX_PITCH (could be normal mem pitch?)
-        CU_DEVICE_ATTRIBUTE_UNIFIED_ADDRESSING = 41
-            Device shares a unified address space with the host
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURE1D_LAYERED_WIDTH = 42
-            Maximum 1D layered texture width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURE1D_LAYERED_LAYERS = 43
-            Maximum layers in a 1D layered texture
-            CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURE3D_WIDTH_ALTERNATE = 47
-            Alternate maximum 3D texture width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURE3D_HEIGHT_ALTERNATE = 48
-            Alternate maximum 3D texture height
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURE3D_DEPTH_ALTERNATE = 49
-            Alternate maximum 3D texture depth
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURECUBEMAP_WIDTH = 52
-            Maximum cubemap texture width/height
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURECUBEMAP_LAYERED_WIDTH = 53
-            Maximum cubemap layered texture width/height
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURECUBEMAP_LAYERED_LAYERS = 54
-            Maximum layers in a cubemap layered texture
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE1D_WIDTH = 55
-            Maximum 1D surface width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE2D_WIDTH = 56
-            Maximum 2D surface width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE2D_HEIGHT = 57
-            Maximum 2D surface height
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE3D_WIDTH = 58
-            Maximum 3D surface width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE3D_HEIGHT = 59
-            Maximum 3D surface height
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE3D_DEPTH = 60
-            Maximum 3D surface depth
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE1D_LAYERED_WIDTH = 61
-            Maximum 1D layered surface width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE1D_LAYERED_LAYERS = 62
-            Maximum layers in a 1D layered surface
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE2D_LAYERED_WIDTH = 63
-            Maximum 2D layered surface width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE2D_LAYERED_HEIGHT = 64
-            Maximum 2D layered surface height
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACE2D_LAYERED_LAYERS = 65
-            Maximum layers in a 2D layered surface
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACECUBEMAP_WIDTH = 66
-            Maximum cubemap surface width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACECUBEMAP_LAYERED_WIDTH = 67
-            Maximum cubemap layered surface width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_SURFACECUBEMAP_LAYERED_LAYERS = 68
-            Maximum layers in a cubemap layered surface
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURE2D_LINEAR_PITCH = 72
-            Maximum 2D linear texture pitch in bytes
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURE2D_MIPMAPPED_WIDTH = 73
-            Maximum mipmapped 2D texture width
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURE2D_MIPMAPPED_HEIGHT = 74
-            Maximum mipmapped 2D texture height
-        CU_DEVICE_ATTRIBUTE_MAXIMUM_TEXTURE1D_MIPMAPPED_WIDTH = 77
-            Maximum mipmapped 1D texture width
-        */
-        TMP_ATTRIBUTE( bStreamPrioritiesSupported, 78 ) // CU_DEVICE_ATTRIBUTE_STREAM_PRIORITIES_SUPPORTED
-        TMP_ATTRIBUTE( bGlobalL1CacheSupported   , 79 ) // CU_DEVICE_ATTRIBUTE_GLOBAL_L1_CACHE_SUPPORTED
-        TMP_ATTRIBUTE( bLocalL1CacheSupported    , 80 ) // CU_DEVICE_ATTRIBUTE_LOCAL_L1_CACHE_SUPPORTED
-        TMP_ATTRIBUTE( nBytesMaxSMPerMP          , 81 ) // CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_MULTIPROCESSOR
-        // CU_DEVICE_ATTRIBUTE_MANAGED_MEMORY = 83 Device can allocate managed memory on this system
-        TMP_ATTRIBUTE( nBytesMaxRegistersPerMP   , 82 ) // CU_DEVICE_ATTRIBUTE_MAX_REGISTERS_PER_MULTIPROCESSOR
-        TMP_ATTRIBUTE( bMultiGpuBoard            , 84 ) // CU_DEVICE_ATTRIBUTE_MULTI_GPU_BOARD
-        TMP_ATTRIBUTE( iMultiGpuBoardId          , 85 ) // CU_DEVICE_ATTRIBUTE_MULTI_GPU_BOARD_GROUP_ID
-        TMP_ATTRIBUTE( ratioSPToDPFlops          , 87 ) // CU_DEVICE_ATTRIBUTE_SINGLE_TO_DOUBLE_PRECISION_PERF_RATIO
-        /*
-        CU_DEVICE_ATTRIBUTE_PAGEABLE_MEMORY_ACCESS = 88
-            Device supports coherently accessing pageable memory without calling cudaHostRegister on it
-        CU_DEVICE_ATTRIBUTE_CONCURRENT_MANAGED_ACCESS = 89
-            Device can coherently access managed memory concurrently with the CPU
-        CU_DEVICE_ATTRIBUTE_COMPUTE_PREEMPTION_SUPPORTED = 90
-            Device supports compute preemption.
-        CU_DEVICE_ATTRIBUTE_CAN_USE_HOST_POINTER_FOR_REGISTERED_MEM = 91
-            Device can access host registered memory at the same virtual address as the CPU
-        CU_DEVICE_ATTRIBUTE_CAN_USE_STREAM_MEM_OPS = 92
-            cuStreamBatchMemOp and related APIs are supported.
-        CU_DEVICE_ATTRIBUTE_CAN_USE_64_BIT_STREAM_MEM_OPS = 93
-            64-bit operations are supported in cuStreamBatchMemOp and related APIs.
-        CU_DEVICE_ATTRIBUTE_CAN_USE_STREAM_WAIT_VALUE_NOR = 94
-            CU_STREAM_WAIT_VALUE_NOR is supported.
-        CU_DEVICE_ATTRIBUTE_COOPERATIVE_LAUNCH = 95
-            Device supports launching cooperative kernels via cuLaunchCooperativeKernel
-        CU_DEVICE_ATTRIBUTE_COOPERATIVE_MULTI_DEVICE_LAUNCH = 96
-            Device can participate in cooperative kernels launched via cuLaunchCooperativeKernelMultiDevice
-        CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK_OPTIN = 97
-            Maximum optin shared memory per block
-        CU_DEVICE_ATTRIBUTE_MAX
-        */
-        #undef TMP_ATTRIBUTE
-
-        printf( "\n================== Device Number %i ==================\n",iDevice );
-        printf( "| Device name              : %s\n"        , prop->name );
-        printf( "| Computability            : %i.%i\n"     , prop->major,
-                                                             prop->minor );
-        printf( "| Code Name                : %s\n"        , getCudaCodeName( prop->major, prop->minor ).c_str() );
-        printf( "| PCI Bus ID               : %i\n"        , prop->pciBusID );
-        printf( "| PCI Device ID            : %i\n"        , prop->pciDeviceID );
-        printf( "| PCI Domain ID            : %i\n"        , prop->pciDomainID );
-        printf( "|------------------- Architecture -------------------\n" );
-        printf( "| Number of SMX            : %i\n"        , prop->multiProcessorCount );
-        printf( "| Max Threads per SMX      : %i\n"        , prop->maxThreadsPerMultiProcessor );
-        printf( "| Max Threads per Block    : %i\n"        , prop->maxThreadsPerBlock );
-        printf( "| Warp Size                : %i\n"        , prop->warpSize );
-        printf( "| Warp Schedulers per MP   : %i\n"        , getWarpSchedulersPerMultiprocessor( prop->major, prop->minor ) );
-        printf( "| Clock Rate               : %f GHz\n"    , prop->clockRate/1.0e6f );
-        printf( "| Max Block Size           : (%i,%i,%i)\n", prop->maxThreadsDim[0],
-                                                             prop->maxThreadsDim[1],
-                                                             prop->maxThreadsDim[2] );
-        printf( "| Max Grid Size            : (%i,%i,%i)\n", prop->maxGridSize[0],
-                                                             prop->maxGridSize[1],
-                                                             prop->maxGridSize[2] );
-        printf( "|  => Max conc. Threads    : %i\n"        , prop->multiProcessorCount *
-                                                             prop->maxThreadsPerMultiProcessor );
-        printf( "|  => Warps per SMX        : %i\n"        , prop->maxThreadsPerMultiProcessor /
-                                                             prop->warpSize );
-        printf( "| CUDA Cores per Multiproc.: %i\n"        , coresPerSM );
-        printf( "| Total CUDA Cores         : %i\n"        , prop->multiProcessorCount * coresPerSM );
-        printf( "| Peak SP-FLOPS            : %f GFLOPS\n" , getCudaPeakSPFlops( *prop ) / 1e9f );
-        printf( "| Peak DP-FLOPS            : %f GFLOPS\n" , getCudaPeakDPFlops( *prop ) / 1e9f );
-        printf( "| Peak SP/DP-FLOPS         : %i (%i)\n"   , ratioSPToDPFlops, getCudaCoresPerMultiprocessor( prop->major, prop->minor ) / getDoublePrecisionUnitsPerMultiprocessor( prop->major, prop->minor ) );
-        printf( "| Special Fun. Units per MP: %i\n"        , getSpecialFunctionUnitsPerMultiprocessor( prop->major, prop->minor ) );
-        printf( "|---------------------- Memory ----------------------\n" );
-        printf( "| Total Global Memory      : %lu Bytes\n" , prop->totalGlobalMem );
-        printf( "| Total Constant Memory    : %lu Bytes\n" , prop->totalConstMem );
-        printf( "| Shared Memory per Block  : %lu Bytes\n" , prop->sharedMemPerBlock );
-        printf( "| Shared Memory per Multip.: %i Bytes\n"  , nBytesMaxSMPerMP );
-        printf( "| Global L1 Cache supported: %s\n"        , bGlobalL1CacheSupported ? "true" : "false" );
-        printf( "| Local  L1 Cache supported: %s\n"        , bLocalL1CacheSupported  ? "true" : "false" );
-        printf( "| L2 Cache Size            : %u Bytes\n"  , prop->l2CacheSize );
-        printf( "| Registers per Block      : %i\n"        , prop->regsPerBlock );
-        printf( "| Registers per Multiproc. : %i\n"        , nBytesMaxRegistersPerMP );
-        printf( "| Memory Bus Width         : %i Bits\n"   , prop->memoryBusWidth );
-        printf( "| Memory Clock Rate        : %f GHz\n"    , prop->memoryClockRate/1.0e6f );
-        printf( "| Memory Pitch             : %lu\n"       , prop->memPitch );
-        printf( "| Unified Addressing       : %i\n"        , prop->unifiedAddressing );
-        printf( "| Texture Alignment        :  %ld\n"      , prop->textureAlignment );
-        printf( "| Max 1D Texture Size      : %i\n"        , prop->maxTexture1D );
-        printf( "| Max 2D Texture Size      : (%i,%i)\n"   , prop->maxTexture2D[0],
-                                                             prop->maxTexture2D[1] );
-        // this really is ONLY in CUDA 3.2. (maybe 3.x) available Oo
-        //printf( "| Max 2D Texture Array Size: (%i,%i)\n"   , prop->maxTexture2DArray[0],
-        //                                                     prop->maxTexture2DArray[1] );
-        printf( "| Max 3D Texture Size      : (%i,%i,%i)\n", prop->maxTexture3D[0],
-                                                             prop->maxTexture3D[1] ,
-                                                             prop->maxTexture3D[2] );
-        printf( "| Cache Configuration      : %s\n"        , getCudaCacheConfigString().c_str() );
-        printf( "| Shared Memory Bank Size  : %s\n"        , getCudaSharedMemBankSizeString().c_str() );
-        printf( "|--------------------- Graphics ---------------------\n" );
-        printf( "| Compute mode             : %s\n"        ,      computeModeString );
-        printf( "|---------------------- Other -----------------------\n" );
-        printf( "| Can map Host Memory      : %s\n"        , prop->canMapHostMemory  ? "true" : "false" );
-        printf( "| Can run Kernels conc.    : %s\n"        , prop->concurrentKernels ? "true" : "false" );
-        printf( "|   => max. conc. kernels  : %i\n"        , getCudaMaxConcurrentKernels( prop->major, prop->minor ) );
-        printf( "| Number of Asyn. Engines  : %i\n"        , prop->asyncEngineCount );
-        printf( "| Can Copy and Kernel conc.: %s\n"        , prop->deviceOverlap     ? "true" : "false" );
-        printf( "| ECC Enabled              : %s\n"        , prop->ECCEnabled        ? "true" : "false" );
-        printf( "| Device is Integrated     : %s\n"        , prop->integrated        ? "true" : "false" );
-        printf( "| Kernel Timeout Enabled   : %s\n"        , prop->kernelExecTimeoutEnabled ? "true" : "false" );
-        printf( "| Uses TESLA Driver        : %s\n"        , prop->tccDriver         ? "true" : "false" );
-        printf( "| Stream Priorities Supp.  : %s\n"        , bStreamPrioritiesSupported ? "true" : "false" );
-        printf( "| Multi-GPU Board          : %s\n"        , bMultiGpuBoard          ? "true" : "false" );
-        if ( bMultiGpuBoard )
-        printf( "| Multi-GPU Board ID       : %i\n"        , iMultiGpuBoardId );
-        printf( "=====================================================\n" );
-        fflush( stdout );
+        out.fill( '=', 53 ).put( '\n' );
     }
+    out.flush();
 
-    if ( rpDeviceProperties == &fallbackPropArray )
-        free( fallbackPropArray );
+    return properties;
 }
 
 #if defined( __CUDA_ARCH__ ) && __CUDA_ARCH__ < 600
@@ -1458,9 +1167,15 @@ public:
 #endif // __CUDACC__
 
 
+/**
+ * Only for arithmetic types, which have no associated namespace, so that
+ * argument-dependent lookup never finds this next to std::swap, e.g. in
+ * std::sort over types declared in the global namespace.
+ */
 template< class T >
 inline __device__ __host__
-void swap( T & a, T & b )
+typename std::enable_if< std::is_arithmetic< T >::value >::type
+swap( T & a, T & b )
 {
     T const c = a;
     a = b;
@@ -1478,47 +1193,61 @@ int snprintInt
     unsigned short int const base = 10u
 )
 {
-    assert( base <= ( '9' - '0' + 1 ) + ( 'Z' - 'A' + 1 ) && "base was chosen too high, not sure how to convert that to characters!" );
+    assert( base >= 2u && base <= ( '9' - '0' + 1 ) + ( 'Z' - 'A' + 1 ) && "base was chosen too high, not sure how to convert that to characters!" );
 
-    unsigned int nCharsWritten = 0u;
-    if ( nCharsWritten+1 >= nChars )
-        return 0;
-    else if ( number < 0 )
+    if ( nChars <= 1u )
     {
-        msg[ nCharsWritten++ ] = '-';
-        number = -number;
+        if ( nChars == 1u )
+            msg[0] = '\0';
+        return 0;
     }
 
-    unsigned int expFloorLogBase = 1;
-    while ( number / expFloorLogBase >= base )
-        expFloorLogBase *= base;
-
-    /* e.g. a possible run for 1230:
-     *   digit 0 = 1 = 1230 / 1000
-     *   digit 1 = 2 = 230  / 100
-     *   digit 2 = 3 = 30   / 10
-     *   digit 3 = 0 = 0    / 1 */
-    while ( expFloorLogBase != 0 )
+    /* format directly into msg if it is large enough, else cut off the last digits */
+    int nCharsWritten = 0;
+    if ( nChars > (unsigned int) nMaxFormattedIntegerChars )
+        nCharsWritten = formatInteger( msg, number, base );
+    else
     {
-        unsigned int const digit = number / expFloorLogBase;
-        number          %= expFloorLogBase;
-        expFloorLogBase /= base;
-        assert( digit <= base );
+        char digits[ nMaxFormattedIntegerChars ];
+        nCharsWritten = formatInteger( digits, number, base );
+        if ( (unsigned int) nCharsWritten > nChars - 1u )
+            nCharsWritten = nChars - 1u;
+        memcpy( msg, digits, nCharsWritten );
+    }
+    msg[ nCharsWritten ] = '\0';
+    return nCharsWritten;
+}
 
-        if ( nCharsWritten+1 < nChars )
-        {
-            if ( digit < '9' - '0' + 1 )
-                msg[ nCharsWritten++ ] = '0' + (unsigned char) digit;
-            else if ( digit - ( '9' - '0' + 1 ) < 'Z' - 'A' + 1u )
-                msg[ nCharsWritten++ ] = 'Z' + (unsigned char)( digit - ( '9' - '0' + 1u ) );
-            else
-                assert( false && "base was chosen too high, not sure how to convert that to characters!" );
-        }
-        else
-            break;
+/**
+ * Writes the shortest number reading back as the same float,
+ * @see formatFloat. Too long numbers are cut off.
+ */
+inline __device__ __host__
+int snprintFloat
+(
+    char        * const msg   ,
+    unsigned int  const nChars,
+    float         const number
+)
+{
+    if ( nChars <= 1u )
+    {
+        if ( nChars == 1u )
+            msg[0] = '\0';
+        return 0;
     }
 
-    assert( nCharsWritten+1 <= nChars ); // includes nChars > 0
+    int nCharsWritten = 0;
+    if ( nChars > (unsigned int) nMaxFormattedFloatChars )
+        nCharsWritten = formatFloat( msg, number );
+    else
+    {
+        char digits[ nMaxFormattedFloatChars ];
+        nCharsWritten = formatFloat( digits, number );
+        if ( (unsigned int) nCharsWritten > nChars - 1u )
+            nCharsWritten = nChars - 1u;
+        memcpy( msg, digits, nCharsWritten );
+    }
     msg[ nCharsWritten ] = '\0';
     return nCharsWritten;
 }
@@ -1538,8 +1267,7 @@ int snprintFloatArray
         if ( nCharsWritten + 1 >= nChars )
             break;
         msg[ nCharsWritten++ ] = ' ';
-        //nCharsWritten += snprintFloat( msg, nChars - nCharsWritten, gpData[j] );
-        nCharsWritten += snprintInt( msg + nCharsWritten, nChars - nCharsWritten, (int)( 10000 * gpData[j] ) );
+        nCharsWritten += snprintFloat( msg + nCharsWritten, nChars - nCharsWritten, gpData[j] );
     }
     assert( nCharsWritten < nChars );
     msg[ nCharsWritten ] = '\0';
@@ -1622,11 +1350,251 @@ inline bool inRange( T_Value const & x )
 #endif
 
 #ifdef CUDACOMMON_GPUINFO_MAIN
-int main( void )
+
+#include <chrono>
+#include <csignal>                      // signal, sig_atomic_t
+#include <fstream>
+#include <thread>                       // sleep_for
+
+#include "cudainfo/cudadevicewatch.hpp" // CudaDeviceWatcher
+#include "cudainfo/cudamemorybenchmark.hpp" // benchmarkHostStream, benchmarkCudaTransfers
+#include "cudainfo/cudacomputebenchmark.hpp" // addHostComputeStrategies, addCudaComputeStrategies
+
+static volatile std::sig_atomic_t gbStopWatching = 0;
+
+inline void stopWatching( int ){ gbStopWatching = 1; }
+
+/**
+ * Samples all devices every rIntervalMs until SIGINT or SIGTERM and
+ * writes them as CSV to rPath or stdout for "-", @see CudaDeviceWatcher
+ */
+inline int watchCudaDevices( double const rIntervalMs, std::string const & rPath )
+{
+    int nDevices = 0;
+    if ( cudaGetDeviceCount( &nDevices ) != cudaSuccess || nDevices <= 0 )
+    {
+        cudaGetLastError();
+        fprintf( stderr, "There is no device supporting CUDA to watch.\n" );
+        return EXIT_FAILURE;
+    }
+    FILE * const file = rPath == "-" ? stdout : fopen( rPath.c_str(), "w" );
+    if ( file == NULL )
+    {
+        fprintf( stderr, "Could not open '%s' for writing\n", rPath.c_str() );
+        return EXIT_FAILURE;
+    }
+
+    signal( SIGINT , stopWatching );
+    signal( SIGTERM, stopWatching );
+    bool bGood;
+    {
+        CudaDeviceWatcher watcher( file, nDevices, (uint64_t)( rIntervalMs * 1000 ) );
+        watcher.start();
+        while ( ! gbStopWatching && watcher.good() )
+            std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+        watcher.stop();
+        bGood = watcher.good();
+        if ( watcher.getDroppedSampleCount() > 0 )
+            fprintf( stderr, "Dropped %llu samples, because writing was too slow\n",
+                     (unsigned long long) watcher.getDroppedSampleCount() );
+    }
+    if ( file != stdout )
+        bGood = fclose( file ) == 0 && bGood;
+    return bGood ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Measures the host memory per NUMA node and, if there are devices, the
+ * transfers to and from each of them and compares them to the theoretical
+ * bandwidths. Works without devices, e.g. on login nodes.
+ */
+inline int benchmarkMemory( void )
+{
+    printHostStreamBenchmarks( benchmarkHostStream() );
+
+    int nDevices = 0;
+    if ( cudaGetDeviceCount( &nDevices ) != cudaSuccess )
+    {
+        cudaGetLastError();
+        nDevices = 0;
+    }
+    for ( int iDevice = 0; iDevice < nDevices; ++iDevice )
+    {
+        cudaDeviceProp prop;
+        CUDA_ERROR( cudaGetDeviceProperties( &prop, iDevice ) );
+        CUDA_ERROR( cudaSetDevice( iDevice ) );
+        /* host buffers near the device like MirroredVector would allocate them */
+        pinThreadToNumaNode( getCudaDeviceNumaNode( iDevice ) );
+        printf( "\n" );
+        printCudaTransferBenchmarks( prop, benchmarkCudaTransfers(), benchmarkCudaDeviceCopy() );
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Measures the FMA throughput of the host and of all devices and prints it
+ * next to the theoretical peaks, @see getCudaPeakSPFlops
+ */
+inline int benchmarkCompute( void )
+{
+    HostThreadPool pool;
+    BenchmarkSuite host( "host" );
+    addHostComputeStrategies( host, pool );
+    std::vector< ComputePeak > peaks = makeHostComputePeaks(
+        host.run( { uint64_t( 1 ) << 34 }, 5, NULL ), pool.size() );
+
+    int nDevices = 0;
+    if ( cudaGetDeviceCount( &nDevices ) != cudaSuccess )
+    {
+        cudaGetLastError();
+        nDevices = 0;
+    }
+    for ( int iDevice = 0; iDevice < nDevices; ++iDevice )
+    {
+        cudaDeviceProp prop;
+        CUDA_ERROR( cudaGetDeviceProperties( &prop, iDevice ) );
+        CUDA_ERROR( cudaSetDevice( iDevice ) );
+        BenchmarkSuite device( "sm_" + std::to_string( prop.major * 10 + prop.minor ) );
+        addCudaComputeStrategies( device );
+        std::vector< ComputePeak > const devicePeaks = makeCudaComputePeaks(
+            device.run( { uint64_t( 1 ) << 38 }, 5, NULL ), prop );
+        peaks.insert( peaks.end(), devicePeaks.begin(), devicePeaks.end() );
+    }
+    printComputePeaks( peaks );
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Prints where the given kernels lie in the roofline model of the device,
+ * i.e. whether they are memory- or compute-bound and which fraction of the
+ * attainable FLOPS they reach.
+ */
+inline void printCudaRoofline
+(
+    cudaDeviceProp                   const & prop    ,
+    std::vector< KernelMeasurement > const & rKernels,
+    FILE                           * const   rFile = stdout
+)
+{
+    CudaRoofline const roofline = makeCudaRoofline( prop,
+        getCudaPeakSPFlops( prop ), getCudaPeakDPFlops( prop ) );
+    fprintf( rFile, "\n================== Roofline for %s ==================\n", prop.name );
+    fprintf( rFile, "| Kernel               | Prec. | FLOP/Byte | GFLOPS    | Roof GFLOPS | Bound   | of Roof\n" );
+    for ( auto const & kernel : rKernels )
+    {
+        RooflinePlacement const placement = placeOnRoofline( roofline, kernel );
+        fprintf( rFile, "| %-20s | %5s | %9.3f | %9.2f | %11.2f | %-7s | %6.1f%%\n",
+                 kernel.name.c_str(), kernel.doublePrecision ? "DP" : "SP",
+                 placement.intensity, placement.achievedFlops / 1e9,
+                 placement.attainableFlops / 1e9,
+                 placement.memoryBound ? "memory" : "compute",
+                 100 * placement.fractionOfRoof );
+    }
+    fprintf( rFile, "=====================================================\n" );
+}
+
+int main( int argc, char ** argv )
 {
-    cudaDeviceProp * pGpus = NULL;
-    int              nGpus = 0   ;
-    getCudaDeviceProperties( &pGpus, &nGpus, true );
+    std::vector< KernelMeasurement > kernels;
+    std::string csvPath;
+    CudaReportFormat format = CudaReportFormatTable;
+    double watchIntervalMs = 0;
+    std::string watchPath = "-";
+    bool bBenchmarkMemory = false;
+    bool bBenchmarkCompute = false;
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string const arg = argv[i];
+        bool bValid = true;
+        if ( arg == "--roofline" && i+1 < argc )
+        {
+            try
+            {
+                kernels.push_back( parseKernelMeasurement( argv[++i] ) );
+            }
+            catch ( std::invalid_argument const & e )
+            {
+                fprintf( stderr, "%s\n", e.what() );
+                bValid = false;
+            }
+        }
+        else if ( arg == "--csv" && i+1 < argc )
+            csvPath = argv[++i];
+        else if ( arg == "--format" && i+1 < argc && parseCudaReportFormat( argv[i+1], &format ) )
+            ++i;
+        else if ( arg == "--watch" && i+1 < argc && ( watchIntervalMs = atof( argv[i+1] ) ) > 0 )
+            ++i;
+        else if ( arg == "--watch-file" && i+1 < argc )
+            watchPath = argv[++i];
+        else if ( arg == "--bench-memory" )
+            bBenchmarkMemory = true;
+        else if ( arg == "--bench-compute" )
+            bBenchmarkCompute = true;
+        else
+            bValid = false;
+
+        if ( ! bValid )
+        {
+            fprintf( stderr, "Usage: %s [--format table|json|csv] [--roofline name:flops:bytes:seconds[:dp]]... [--csv <file>|-]\n"
+                             "       %s --watch <interval ms> [--watch-file <file>|-]\n"
+                             "       %s --bench-memory\n"
+                             "       %s --bench-compute\n", argv[0], argv[0], argv[0], argv[0] );
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* the JSON or CSV report owns stdout */
+    if ( format != CudaReportFormatTable && csvPath == "-" )
+    {
+        fprintf( stderr, "--csv - can't be combined with --format json|csv, because both write to stdout.\n" );
+        return EXIT_FAILURE;
+    }
+
+    if ( watchIntervalMs > 0 )
+        return watchCudaDevices( watchIntervalMs, watchPath );
+    if ( bBenchmarkMemory )
+        return benchmarkMemory();
+    if ( bBenchmarkCompute )
+        return benchmarkCompute();
+
+    std::vector< cudaDeviceProp > const gpus = getCudaDeviceProperties( format == CudaReportFormatTable );
+    /* which of the boards and devices can copy directly to each other */
+    if ( format == CudaReportFormatTable && gpus.size() >= 2 )
+        printCudaPeerTopology( getCudaPeerTopology() );
+    if ( format != CudaReportFormatTable )
+    {
+        BufferedWriter out( stdout );
+        writeCudaDeviceReports( out, getCudaDeviceSnapshots(), format );
+        if ( ! out.flush() )
+            return EXIT_FAILURE;
+    }
+
+    /* to stderr, so that it doesn't mix with the JSON or CSV report */
+    if ( ! kernels.empty() )
+    {
+        for ( auto const & gpu : gpus )
+            printCudaRoofline( gpu, kernels, format == CudaReportFormatTable ? stdout : stderr );
+    }
+
+    if ( ! csvPath.empty() )
+    {
+        std::ofstream file;
+        if ( csvPath != "-" )
+            file.open( csvPath.c_str() );
+        std::ostream & out = csvPath == "-" ? std::cout : file;
+        writeRooflineCsvHeader( out );
+        for ( auto const & gpu : gpus )
+        {
+            writeRooflineCsv( out, gpu.name, makeCudaRoofline( gpu,
+                getCudaPeakSPFlops( gpu ), getCudaPeakDPFlops( gpu ) ), kernels );
+        }
+        if ( ! out )
+        {
+            fprintf( stderr, "Could not write CSV to '%s'\n", csvPath.c_str() );
+            return EXIT_FAILURE;
+        }
+    }
+
     return 0;
 }
 #endif